@@ -1,6 +1,11 @@
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <cstdlib>
 #include <ctime>
 #include <string>
+#include <utility>
+#include <vector>
 
 #define SDL_MAIN_USE_CALLBACKS 1
 
@@ -8,7 +13,16 @@
 #include <SDL3/SDL_main.h>
 #include <SDL3/SDL_thread.h>
 
+#include "boot_cache.h"
 #include "cpu.h"
+#include "debugger.h"
+#include "frame_writer.h"
+#include "input_log.h"
+#include "run_ahead.h"
+#include "save_state.h"
+#include "shared_session.h"
+#include "trace.h"
+#include "upscaler.h"
 
 /// State to be kept between SDL callbacks.
 struct AppState {
@@ -16,17 +30,101 @@ struct AppState {
     SDL_Renderer *renderer;
     SDL_AudioStream *audio;
 
+    /// Texture the display is drawn to, matching the size of the upscaler's output.
+    SDL_Texture *texture = nullptr;
+
+    /// Expands the display to the size of the window.
+    Upscaler upscaler;
+
     /// Thread running the CPU.
     SDL_Thread *cpu_thread;
 
     /// Thread ticking the timers.
     SDL_Thread *timer_thread;
 
+    /// Lock protecting key events against the CPU thread going to sleep.
+    SDL_Mutex *wake_lock;
+
+    /// Signalled whenever a key event or timer tick occurs that may resume a
+    /// halted CPU.
+    SDL_Condition *wake;
+
     CPU cpu;
 
+    /// Runs a copy of the CPU ahead to present, if enabled.
+    RunAhead run_ahead;
+
+    /// Whether the CPU runs a frame at a time and the display of the copy
+    /// run ahead is presented, instead of the CPU's own. Also used, zero
+    /// frames ahead, when recording inputs.
+    bool running_ahead = false;
+
+    /// The display of the copy run ahead.
+    Display ahead_display;
+
+    /// When the key event behind the latest draw in #ahead_display occurred,
+    /// or 0 if there was none since it was last taken.
+    std::atomic<uint64_t> ahead_input = 0;
+
+    /// Key events waiting for the next frame, when running ahead. They are
+    /// passed to the CPU between frames, so the CPU can be copied safely.
+    InputQueue key_events;
+
+    /// Keys held in the current frame, when running ahead.
+    uint16_t frame_keys = 0;
+
+    /// Keys released in the same frame they were pressed in, to be released
+    /// in the next frame.
+    uint16_t deferred_releases = 0;
+
+    /// Path the keys of every frame are saved to as an InputLog on exit, or
+    /// nullptr if not recording inputs.
+    const char *input_log_path = nullptr;
+
+    /// Keys of every frame run so far, when recording inputs.
+    std::vector<uint16_t> inputs;
+
+    /// Writer for recorded frames, if recording.
+    FrameWriter recorder;
+
+    /// Whether frames are being recorded.
+    bool recording = false;
+
+    /// Whether running without a window or audio.
+    bool headless = false;
+
+    /// Shared memory session driving the CPU, if enabled.
+    SharedSession session;
+
+    /// Writer for the execution trace, if tracing.
+    TraceWriter tracer;
+
+    /// Buffer the CPU thread traces into, or nullptr if not tracing.
+    TraceBuffer *trace = nullptr;
+
+    /// Breakpoints and watchpoints. Only accessed by the CPU thread once running.
+    Debugger debugger;
+
+    /// Path the CPU's state is saved to on exit. May be nullptr.
+    const char *state_path = nullptr;
+
+    /// Whether the CPU is paused at a breakpoint or watchpoint, until F5 is pressed.
+    bool paused = false;
+
+    /// Whether the next instruction should execute without checking the
+    /// debugger, after resuming from a pause.
+    bool resuming = false;
+
     /// Whether the CPU should run.
     bool running = false;
 
+    /// When the key event behind the frame being presented occurred, or 0
+    /// if the frame does not react to input.
+    uint64_t presenting_input = 0;
+
+    /// Latency of key events until the frame reacting to them was presented.
+    LatencyHistogram presented_latency;
+
     /// Whether the program is exiting.
     bool exiting = false;
 
@@ -38,6 +136,56 @@ struct AppState {
 struct Arguments {
     /// Path of the ROM to load. May be nullptr.
     const char *rom_path = nullptr;
+
+    /// Run without a window or audio (`--headless`).
+    bool headless = false;
+
+    /// Path to record frames to (`--record <path>`), "-" for stdout. May be nullptr.
+    const char *record_path = nullptr;
+
+    /// Path to record the keys of every frame to as an InputLog
+    /// (`--record-inputs <path>`). May be nullptr.
+    const char *input_log_path = nullptr;
+
+    /// Format of recorded frames (`--format raw|pbm|y4m`).
+    FrameWriter::Format record_format = FrameWriter::Format::Y4M;
+
+    /// Resolution of recorded frames, native with `--native`.
+    FrameWriter::Resolution record_resolution = FrameWriter::Resolution::LOW;
+
+    /// Scaling factor of recorded frames (`--scale <n>`).
+    int record_scale = 1;
+
+    /// Name of a shared memory segment through which an external agent
+    /// drives the CPU (`--shm <name>`). Implies headless. May be nullptr.
+    const char *shm_name = nullptr;
+
+    /// Path to write an execution trace to (`--trace <path>`), "-" for
+    /// stdout. May be nullptr.
+    const char *trace_path = nullptr;
+
+    /// Path of a save state to resume from if it exists, and to save to on
+    /// exit (`--state <path>`). May be nullptr.
+    const char *state_path = nullptr;
+
+    /// Number of frames over which pixels fade out (`--persistence <n>`), 0
+    /// to turn them off at once.
+    unsigned persistence = 0;
+
+    /// Directory of booted ROM states to start from (`--boot-cache <dir>`),
+    /// see BootCache. May be nullptr.
+    const char *boot_cache = nullptr;
+
+    /// Number of frames to run ahead of the CPU when presenting
+    /// (`--run-ahead <n>`), 0 to present the CPU's own display.
+    unsigned run_ahead = 0;
+
+    /// Breakpoints (`--break <addr>`) and watchpoints (`--watch <addr>`),
+    /// with addresses in hexadecimal. Execution pauses on a hit.
+    Debugger debugger;
+
+    /// Whether the arguments were invalid.
+    bool invalid = false;
 };
 
 /// Callback for SDL_ShowOpenFileDialog - loads the selected ROM into the CPU's
@@ -100,6 +248,25 @@ static void test(AppState *state) {
     state->cpu.load_code(code, sizeof(code));
 }
 
+/// Log a breakpoint or watchpoint hit along with the CPU's state.
+static void log_stop(AppState *state, const Debugger::Stop &stop) {
+    const CPU &cpu = state->cpu;
+    auto registers = cpu.get_registers();
+
+    if (stop.reason == Debugger::StopReason::BREAKPOINT) {
+        SDL_Log("Breakpoint at 0x%03X", stop.pc);
+    } else {
+        const char *access = stop.reason == Debugger::StopReason::WATCH_WRITE ? "Write to" : "Read from";
+        SDL_Log("%s 0x%03X at 0x%03X", access, stop.addr, stop.pc);
+    }
+
+    SDL_Log("I=%03X SP=%02X V=%02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X",
+        cpu.get_i(), cpu.get_sp(),
+        registers[0], registers[1], registers[2], registers[3], registers[4], registers[5], registers[6], registers[7],
+        registers[8], registers[9], registers[10], registers[11], registers[12], registers[13], registers[14], registers[15]);
+    SDL_Log("Paused, press F5 to continue");
+}
+
 /// Steps the CPU at roughly 1000 Hz.
 static int cpu_thread(void *appstate) {
     AppState *state = static_cast<AppState *>(appstate);
@@ -109,7 +276,33 @@ static int cpu_thread(void *appstate) {
             break;
         }
         if (state->running) {
-            state->cpu.step();
+            if (state->paused || state->cpu.get_halt() != CPU::Halt::NONE) {
+                // Nothing can change until a key event or timer tick arrives, so sleep until then
+                SDL_LockMutex(state->wake_lock);
+                while ((state->paused || state->cpu.get_halt() != CPU::Halt::NONE) && !state->exiting) {
+                    SDL_WaitCondition(state->wake, state->wake_lock);
+                }
+                SDL_UnlockMutex(state->wake_lock);
+                continue;
+            }
+
+            if (state->debugger.is_active() && !state->resuming) {
+                Debugger::Stop stop = state->debugger.check(state->cpu);
+
+                if (stop.reason != Debugger::StopReason::NONE) {
+                    log_stop(state, stop);
+                    state->paused = true;
+                    state->resuming = true;
+                    continue;
+                }
+            }
+            state->resuming = false;
+
+            if (state->trace != nullptr) {
+                state->trace->step(state->cpu);
+            } else {
+                state->cpu.step();
+            }
 
             // 1ms gives us somewhere between 500 and 1000 Hz clock frequency (depending on the time actually waited)
             SDL_Delay(1);
@@ -129,6 +322,15 @@ static int timer_thread(void *appstate) {
         if (state->running) {
             state->cpu.tick_timers();
 
+            if (state->recording) {
+                // One frame per timer tick gives a fixed 60 fps cadence
+                state->recorder.submit(state->cpu.get_display());
+            }
+
+            SDL_LockMutex(state->wake_lock);
+            SDL_SignalCondition(state->wake);
+            SDL_UnlockMutex(state->wake_lock);
+
             // Timers should run at 60 Hz
             SDL_Delay(1000 / 60);
         }
@@ -136,6 +338,143 @@ static int timer_thread(void *appstate) {
     return 0;
 }
 
+/// Pass the key events of the next frame to the CPU, as the keys held
+/// during the whole frame.
+///
+/// The returned mask is what InputLog::run_frame() runs the frame with. A key
+/// released in the same frame it was pressed in is held for that frame, so
+/// short taps are not lost.
+///
+/// \return The keys held during the frame.
+static uint16_t apply_frame_keys(AppState *state) {
+    uint16_t keys = state->frame_keys & ~state->deferred_releases;
+    uint16_t pressed = 0;
+    std::array<uint64_t, 16> timestamps{};
+
+    state->deferred_releases = 0;
+
+    InputEvent event;
+    while (state->key_events.pop(event)) {
+        uint16_t bit = 1 << (event.key & 0x0F);
+        timestamps[event.key & 0x0F] = event.timestamp;
+
+        if (event.down) {
+            keys |= bit;
+            pressed |= bit;
+        } else if (pressed & bit) {
+            state->deferred_releases |= bit;
+        } else {
+            keys &= ~bit;
+        }
+    }
+
+    // In the same order as CPU::set_keys()
+    uint16_t changed = keys ^ state->frame_keys;
+
+    for (uint8_t key = 0; key < 16; ++key) {
+        if (((changed >> key) & 0x01) && !state->cpu.queue_key_event(key, (keys >> key) & 0x01, timestamps[key])) {
+            SDL_LogWarn(SDL_LOG_CATEGORY_INPUT, "Input queue full, dropping key event");
+        }
+    }
+
+    state->frame_keys = keys;
+
+    return keys;
+}
+
+/// Runs the CPU a frame at a time at 60 Hz, and a copy of it ahead to present.
+///
+/// Used instead of the CPU and timer threads when running ahead. Frames are
+/// paced against absolute deadlines, so the time spent running ahead does
+/// not make the CPU drift.
+static int frame_thread(void *appstate) {
+    AppState *state = static_cast<AppState *>(appstate);
+    constexpr uint64_t FRAME_NS = 1000000000 / 60;
+    uint64_t deadline = SDL_GetTicksNS();
+
+    // A resumed state may have keys held
+    for (uint8_t key = 0; key < 16; ++key) {
+        if (state->cpu.is_key_down(key)) {
+            state->frame_keys |= 1 << key;
+        }
+    }
+
+    while (!state->exiting) {
+        if (!state->running) {
+            SDL_Delay(1);
+            deadline = SDL_GetTicksNS();
+            continue;
+        }
+
+        if (state->input_log_path != nullptr && state->inputs.empty()) {
+            // The log is replayed from the state it started in
+            std::string path = std::string(state->input_log_path) + ".c8s";
+
+            if (!SaveState::save(state->cpu, path.c_str(), SaveState::Compression::NONE)) {
+                SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Failed to save initial state to %s", path.c_str());
+            }
+        }
+
+        uint16_t keys = apply_frame_keys(state);
+
+        if (state->input_log_path != nullptr) {
+            state->inputs.push_back(keys);
+        }
+
+        // The events carry the timestamps for the latency histograms, so they
+        // are applied first and the frame finds the keys already held
+        state->cpu.process_input();
+        InputLog::run_frame(state->cpu, keys);
+
+        if (state->recording) {
+            // Recordings show what actually happened, not the prediction
+            state->recorder.submit(state->cpu.get_display());
+        }
+
+        const CPU &ahead = state->run_ahead.run(state->cpu);
+        state->ahead_display.set_frame(ahead.get_display().get_frame());
+
+        // Stored after the frame, so the frame contains the draw
+        uint64_t input = state->run_ahead.take_drawn_input();
+        if (input != 0) {
+            state->ahead_input.store(input, std::memory_order_release);
+        }
+
+        deadline += FRAME_NS;
+        uint64_t now = SDL_GetTicksNS();
+
+        if (now < deadline) {
+            SDL_DelayNS(deadline - now);
+        } else if (now - deadline > FRAME_NS) {
+            // Fell behind, e.g. while suspended. Carry on from now instead of catching up.
+            deadline = now;
+        }
+    }
+
+    return 0;
+}
+
+/// Runs the CPU as instructed by an agent through the shared memory session.
+///
+/// Used instead of the CPU and timer threads.
+static int session_thread(void *appstate) {
+    AppState *state = static_cast<AppState *>(appstate);
+    int idle = 0;
+
+    state->session.publish(state->cpu);
+
+    while (!state->exiting) {
+        if (state->session.process(state->cpu)) {
+            idle = 0;
+        } else if (++idle > 10000) {
+            // Spin while the agent is active, only sleep once it has gone quiet
+            SDL_Delay(1);
+        }
+    }
+
+    return 0;
+}
+
 /// Parse the given arguments into an Arguments struct
 static Arguments parse_arguments(int argc, char **argv) {
     Arguments ret;
@@ -143,27 +482,78 @@ static Arguments parse_arguments(int argc, char **argv) {
     // Skipping first argument = executable path
     for (int i = 1; i < argc; ++i) {
         std::string arg(argv[i]);
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--headless") {
+            ret.headless = true;
+        } else if (arg == "--record" && has_value) {
+            ret.record_path = argv[++i];
+        } else if (arg == "--record-inputs" && has_value) {
+            ret.input_log_path = argv[++i];
+        } else if (arg == "--format" && has_value) {
+            std::string format(argv[++i]);
+
+            if (format == "raw") {
+                ret.record_format = FrameWriter::Format::RAW;
+            } else if (format == "pbm") {
+                ret.record_format = FrameWriter::Format::PBM;
+            } else if (format == "y4m") {
+                ret.record_format = FrameWriter::Format::Y4M;
+            } else {
+                SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "Unknown frame format: %s", format.c_str());
+                ret.invalid = true;
+            }
+        } else if (arg == "--shm" && has_value) {
+            ret.shm_name = argv[++i];
+            ret.headless = true;
+        } else if (arg == "--trace" && has_value) {
+            ret.trace_path = argv[++i];
+        } else if (arg == "--state" && has_value) {
+            ret.state_path = argv[++i];
+        } else if (arg == "--break" && has_value) {
+            ret.debugger.set_breakpoint(std::strtoul(argv[++i], nullptr, 16), true);
+        } else if (arg == "--watch" && has_value) {
+            ret.debugger.set_watchpoint(std::strtoul(argv[++i], nullptr, 16), 1, Debugger::READ_WRITE);
+        } else if (arg == "--native") {
+            ret.record_resolution = FrameWriter::Resolution::NATIVE;
+        } else if (arg == "--scale" && has_value) {
+            ret.record_scale = std::atoi(argv[++i]);
+        } else if (arg == "--persistence" && has_value) {
+            ret.persistence = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--boot-cache" && has_value) {
+            ret.boot_cache = argv[++i];
+        } else if (arg == "--run-ahead" && has_value) {
+            ret.run_ahead = std::strtoul(argv[++i], nullptr, 10);
+
+            if (ret.run_ahead > RunAhead::MAX_FRAMES) {
+                SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "Can run at most %u frames ahead", RunAhead::MAX_FRAMES);
+                ret.invalid = true;
+            }
+        } else if (arg.starts_with("--")) {
+            SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "Invalid argument: %s", arg.c_str());
+            ret.invalid = true;
+        } else {
+            ret.rom_path = argv[i];
+        }
+    }
 
-        ret.rom_path = argv[i];
+    if (ret.run_ahead > 0 && (ret.trace_path != nullptr || ret.debugger.is_active())) {
+        // Both need the CPU to run an instruction at a time
+        SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "--run-ahead cannot be combined with --trace, --break or --watch");
+        ret.invalid = true;
+    }
+
+    if (ret.input_log_path != nullptr && (ret.shm_name != nullptr || ret.trace_path != nullptr || ret.debugger.is_active())) {
+        // Recording needs the CPU to run a frame at a time, on keys from the window
+        SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "--record-inputs cannot be combined with --shm, --trace, --break or --watch");
+        ret.invalid = true;
     }
 
     return ret;
 }
 
-SDL_AppResult SDL_AppInit(void **appstate, int argc, char **argv) {
-    Arguments args = parse_arguments(argc, argv);
-
-    AppState *state = new AppState();
-    *appstate = static_cast<void *>(state);
-
-    std::srand(std::time(nullptr));
-
-    // Initialise SDL
-    if (!SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO)) {
-        SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "%s", SDL_GetError());
-        return SDL_APP_FAILURE;
-    }
-
+/// Create the window, renderer and audio stream.
+static SDL_AppResult create_window_and_audio(AppState *state) {
     // Create window
     if (!SDL_CreateWindowAndRenderer("Chip8", 1024, 768, 0, &state->window, &state->renderer)) {
         SDL_LogCritical(SDL_LOG_CATEGORY_INPUT, "%s", SDL_GetError());
@@ -187,7 +577,84 @@ SDL_AppResult SDL_AppInit(void **appstate, int argc, char **argv) {
 
     SDL_SetAudioStreamGain(state->audio, 0.1);
 
-    if (args.rom_path != nullptr) {
+    return SDL_APP_CONTINUE;
+}
+
+SDL_AppResult SDL_AppInit(void **appstate, int argc, char **argv) {
+    Arguments args = parse_arguments(argc, argv);
+
+    AppState *state = new AppState();
+    *appstate = static_cast<void *>(state);
+
+    state->cpu.seed(std::time(nullptr));
+
+    if (args.invalid) {
+        return SDL_APP_FAILURE;
+    }
+
+    state->headless = args.headless;
+    state->debugger = args.debugger;
+    state->upscaler.set_persistence(args.persistence);
+    state->run_ahead.set_frames(args.run_ahead);
+    state->running_ahead = (args.run_ahead > 0 || args.input_log_path != nullptr) && args.shm_name == nullptr;
+    state->input_log_path = args.input_log_path;
+
+    if (args.record_path != nullptr) {
+        if (!state->recorder.open(args.record_path, args.record_format, args.record_scale, args.record_resolution)) {
+            SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "Failed to open %s for recording", args.record_path);
+            return SDL_APP_FAILURE;
+        }
+
+        state->recording = true;
+    }
+
+    if (args.trace_path != nullptr) {
+        if (!state->tracer.open(args.trace_path)) {
+            SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "Failed to open %s for tracing", args.trace_path);
+            return SDL_APP_FAILURE;
+        }
+
+        state->trace = state->tracer.create_buffer();
+    }
+
+    state->state_path = args.state_path;
+    bool resumed = args.state_path != nullptr && SaveState::load(state->cpu, args.state_path);
+
+    if (state->headless && args.rom_path == nullptr && !resumed) {
+        SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "A ROM path is required in headless mode");
+        return SDL_APP_FAILURE;
+    }
+
+    // Initialise SDL
+    if (!SDL_Init(state->headless ? 0 : SDL_INIT_VIDEO | SDL_INIT_AUDIO)) {
+        SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "%s", SDL_GetError());
+        return SDL_APP_FAILURE;
+    }
+
+    if (!state->headless) {
+        SDL_AppResult result = create_window_and_audio(state);
+        if (result != SDL_APP_CONTINUE) {
+            return result;
+        }
+    }
+
+    if (resumed) {
+        // Memory is part of the save state, no need to load the ROM
+        SDL_Log("Resumed from %s", args.state_path);
+        state->running = true;
+    } else if (args.rom_path != nullptr && args.boot_cache != nullptr) {
+        // Start where the ROM first reads a key, booting it only if it is not cached yet
+        BootCache cache;
+
+        if (!cache.open(args.boot_cache) || !cache.load_file(state->cpu, args.rom_path)) {
+            SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "Failed to boot ROM from %s", args.rom_path);
+            return SDL_APP_FAILURE;
+        }
+
+        // The boot itself always uses the same seed, so it can be cached
+        state->cpu.seed(std::time(nullptr));
+        state->running = true;
+    } else if (args.rom_path != nullptr) {
         // Load from passed path
         if (!state->cpu.load_code_from_file(args.rom_path)) {
             SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "Failed to load ROM from %s", args.rom_path);
@@ -200,6 +667,30 @@ SDL_AppResult SDL_AppInit(void **appstate, int argc, char **argv) {
         SDL_ShowOpenFileDialog(open_file, appstate, state->window, nullptr, 0, nullptr, false);
     }
 
+    state->wake_lock = SDL_CreateMutex();
+    state->wake = SDL_CreateCondition();
+
+    if (args.shm_name != nullptr) {
+        if (!state->session.create(args.shm_name, CPU::STEPS_PER_FRAME)) {
+            SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "Failed to create shared memory segment %s", args.shm_name);
+            return SDL_APP_FAILURE;
+        }
+
+        // The agent controls time, so there are no separate timer and CPU threads
+        state->cpu_thread = SDL_CreateThread(session_thread, "Session Thread", static_cast<void *>(state));
+        state->timer_thread = nullptr;
+
+        return SDL_APP_CONTINUE;
+    }
+
+    if (state->running_ahead) {
+        // Timers are ticked once per frame, in lockstep with the CPU
+        state->cpu_thread = SDL_CreateThread(frame_thread, "Frame Thread", static_cast<void *>(state));
+        state->timer_thread = nullptr;
+
+        return SDL_APP_CONTINUE;
+    }
+
     // Create threads
     state->cpu_thread = SDL_CreateThread(cpu_thread, "CPU Thread", static_cast<void *>(state));
     state->timer_thread = SDL_CreateThread(timer_thread, "Timer Thread", static_cast<void *>(state));
@@ -221,6 +712,16 @@ SDL_AppResult SDL_AppEvent(void *appstate, SDL_Event *event) {
         }
         SDL_Keycode keycode = event->key.key;
 
+        if (keycode == SDLK_F5 && event->key.down && state->paused) {
+            // Continue from a breakpoint or watchpoint
+            SDL_LockMutex(state->wake_lock);
+            state->paused = false;
+            SDL_SignalCondition(state->wake);
+            SDL_UnlockMutex(state->wake_lock);
+
+            return SDL_APP_CONTINUE;
+        }
+
         uint8_t key;
 
         if (keycode >= '0' && keycode <= '9') {
@@ -232,47 +733,83 @@ SDL_AppResult SDL_AppEvent(void *appstate, SDL_Event *event) {
             return SDL_APP_CONTINUE;
         }
 
-        state->cpu.set_key_down(key, event->key.down);
+        auto now = std::chrono::steady_clock::now().time_since_epoch();
+        uint64_t timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+
+        if (state->running_ahead) {
+            if (!state->key_events.push(InputEvent{timestamp, key, event->key.down})) {
+                SDL_LogWarn(SDL_LOG_CATEGORY_INPUT, "Input queue full, dropping key event");
+            }
+        } else if (!state->cpu.queue_key_event(key, event->key.down, timestamp)) {
+            SDL_LogWarn(SDL_LOG_CATEGORY_INPUT, "Input queue full, dropping key event");
+        }
+
+        SDL_LockMutex(state->wake_lock);
+        SDL_SignalCondition(state->wake);
+        SDL_UnlockMutex(state->wake_lock);
     }
 
     return SDL_APP_CONTINUE;
 }
 
 SDL_AppResult draw_frame(AppState *state) {
-    auto vram = state->cpu.get_display().get_vram();
-
-    int window_w, window_h;
+    int output_w, output_h;
 
-    if (!SDL_GetWindowSize(state->window, &window_w, &window_h)) {
-        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Failed to get window size: %s", SDL_GetError());
+    if (!SDL_GetRenderOutputSize(state->renderer, &output_w, &output_h)) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Failed to get output size: %s", SDL_GetError());
 
         return SDL_APP_FAILURE;
     }
 
-    float pixel_w = static_cast<float>(window_w) / static_cast<float>(Display::WIDTH);
-    float pixel_h = static_cast<float>(window_h) / static_cast<float>(Display::HEIGHT);
+    if (state->texture == nullptr || output_w != state->upscaler.get_width() || output_h != state->upscaler.get_height()) {
+        // Window resized, expand the display to its new size
+        if (state->texture != nullptr) {
+            SDL_DestroyTexture(state->texture);
+        }
 
-    for (int y = 0; y < Display::HEIGHT; ++y) {
-        for (int x = 0; x < Display::WIDTH; ++x) {
-            uint8_t pixel = vram[y * Display::WIDTH + x];
+        state->upscaler.set_size(output_w, output_h);
+        state->texture = SDL_CreateTexture(state->renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING, output_w, output_h);
 
-            SDL_FRect rect = {
-                .x = x * pixel_w,
-                .y = y * pixel_h,
-                .w = pixel_w,
-                .h = pixel_h,
-            };
+        if (state->texture == nullptr) {
+            SDL_LogError(SDL_LOG_CATEGORY_RENDER, "Failed to create texture: %s", SDL_GetError());
 
-            if (pixel != 0) {
-                SDL_SetRenderDrawColor(state->renderer, 255, 255, 255, 255);
-            } else {
-                SDL_SetRenderDrawColor(state->renderer, 0, 0, 0, 255);
-            }
+            return SDL_APP_FAILURE;
+        }
+
+        SDL_SetTextureScaleMode(state->texture, SDL_SCALEMODE_NEAREST);
+    }
 
-            SDL_RenderFillRect(state->renderer, &rect);
+    // Taken before reading the frame, so the frame contains the draw
+    uint64_t input = state->running_ahead ? state->ahead_input.exchange(0, std::memory_order_acquire) : state->cpu.take_drawn_input();
+    if (input != 0 && state->presenting_input == 0) {
+        state->presenting_input = input;
+    }
+
+    const Display &display = state->running_ahead ? state->ahead_display : state->cpu.get_display();
+    state->upscaler.update(display.get_frame());
+
+    // Only upload the rows which changed
+    int begin = state->upscaler.get_dirty_begin();
+    int end = state->upscaler.get_dirty_end();
+
+    if (end > begin) {
+        int pitch = output_w * 4;
+        SDL_Rect rect = {
+            .x = 0,
+            .y = begin,
+            .w = output_w,
+            .h = end - begin,
+        };
+
+        if (!SDL_UpdateTexture(state->texture, &rect, state->upscaler.get_pixels() + begin * pitch, pitch)) {
+            SDL_LogError(SDL_LOG_CATEGORY_RENDER, "Failed to update texture: %s", SDL_GetError());
+
+            return SDL_APP_FAILURE;
         }
     }
 
+    SDL_RenderTexture(state->renderer, state->texture, nullptr, nullptr);
+
     return SDL_APP_CONTINUE;
 }
 
@@ -308,6 +845,12 @@ SDL_AppResult SDL_AppIterate(void *appstate) {
         return SDL_APP_CONTINUE;
     }
 
+    if (state->headless) {
+        // Nothing to present, the CPU and timer threads do all the work
+        SDL_Delay(1000 / 60);
+        return SDL_APP_CONTINUE;
+    }
+
     if (FIRST_RUN) {
         // test(state);
 
@@ -332,16 +875,85 @@ SDL_AppResult SDL_AppIterate(void *appstate) {
     }
 
     SDL_RenderPresent(state->renderer);
+
+    if (state->presenting_input != 0) {
+        auto now = std::chrono::steady_clock::now().time_since_epoch();
+        uint64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+
+        state->presented_latency.add(now_ns > state->presenting_input ? now_ns - state->presenting_input : 0);
+        state->presenting_input = 0;
+    }
+
     return SDL_APP_CONTINUE;
 }
 
+/// Log the latency of key events at every stage, up to being presented.
+/// \param latency Latency statistics, including the presented stage.
+static void log_input_latency(const InputLatency &latency) {
+    const std::pair<const char *, const LatencyHistogram *> stages[] = {
+        {"applied", &latency.applied},
+        {"observed", &latency.observed},
+        {"drawn", &latency.drawn},
+        {"presented", &latency.presented},
+    };
+
+    for (const auto &[name, histogram] : stages) {
+        if (histogram->count == 0) {
+            continue;
+        }
+
+        SDL_Log("Input latency until %s: %llu events, mean %.2f ms, p50 <= %.2f ms, p99 <= %.2f ms, max %.2f ms",
+            name, static_cast<unsigned long long>(histogram->count),
+            histogram->mean_ns() / 1e6, histogram->percentile_ns(0.5) / 1e6,
+            histogram->percentile_ns(0.99) / 1e6, histogram->max_ns / 1e6);
+    }
+}
+
 void SDL_AppQuit(void *appstate, SDL_AppResult result) {
     AppState *state = static_cast<AppState *>(appstate);
+    bool was_running = state->running;
     state->running = false;
     state->exiting = true;
 
+    // Wake up the CPU thread if it is sleeping on a halted CPU
+    SDL_LockMutex(state->wake_lock);
+    SDL_SignalCondition(state->wake);
+    SDL_UnlockMutex(state->wake_lock);
+
     SDL_WaitThread(state->cpu_thread, nullptr);
-    SDL_WaitThread(state->timer_thread, nullptr);
+    if (state->timer_thread != nullptr) {
+        SDL_WaitThread(state->timer_thread, nullptr);
+    }
+
+    SDL_DestroyCondition(state->wake);
+    SDL_DestroyMutex(state->wake_lock);
+
+    InputLatency latency = state->cpu.get_input_latency();
+    latency.presented = state->presented_latency;
+    log_input_latency(latency);
+
+    if (state->state_path != nullptr && was_running) {
+        if (!SaveState::save(state->cpu, state->state_path, SaveState::Compression::NONE)) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Failed to save state to %s", state->state_path);
+        }
+    }
+
+    if (state->input_log_path != nullptr && !state->inputs.empty()) {
+        if (InputLog::save(state->input_log_path, state->inputs)) {
+            SDL_Log("Recorded %zu frames of input, replay with: chip8_replay --state %s.c8s %s <output>",
+                state->inputs.size(), state->input_log_path, state->input_log_path);
+        } else {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Failed to save inputs to %s", state->input_log_path);
+        }
+    }
+
+    state->recorder.close();
+    state->session.close();
+    state->tracer.close();
+
+    if (state->recorder.get_dropped() > 0) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Dropped %llu frames while recording", static_cast<unsigned long long>(state->recorder.get_dropped()));
+    }
 
     delete state;
 }
@@ -0,0 +1,346 @@
+#include "chip8.h"
+
+#include "arena.h"
+#include "boot_cache.h"
+#include "cpu.h"
+#include "input_log.h"
+#include "state_hash.h"
+
+#include <algorithm>
+#include <new>
+#include <exception>
+#include <vector>
+
+/// Per-instance state used to skip cycles.
+struct CycleTracker {
+    StateHash hash;
+    CycleDetector detector;
+
+    /// Keys held while the detector has been running.
+    uint16_t keys = 0;
+};
+
+struct chip8_batch {
+    /// Storage for all instances.
+    CPUArena arena;
+
+    /// All instances, allocated contiguously from #arena.
+    std::vector<CPU *> cpus;
+
+    /// The ROM all instances run.
+    std::vector<uint8_t> rom;
+
+    /// State right after loading the ROM, or after booting it, used for resets.
+    CPU initial;
+
+    chip8_observation observation = CHIP8_OBSERVATION_PACKED;
+    unsigned steps_per_frame = CPU::STEPS_PER_FRAME;
+
+    /// Address of the reward byte, or -1.
+    int reward_address = -1;
+
+    /// One tracker per instance while cycle skipping is enabled, empty otherwise.
+    std::vector<CycleTracker> trackers;
+
+    explicit chip8_batch(size_t n) : arena(n) {}
+};
+
+/// Write the observation of a single instance.
+///
+/// \param cpu The instance.
+/// \param format Observation format.
+/// \param out Destination, large enough for one observation.
+static void write_observation(const CPU &cpu, chip8_observation format, uint8_t *out) {
+    Display::Frame frame = cpu.get_display().get_frame();
+
+    if (format == CHIP8_OBSERVATION_NATIVE) {
+        for (int y = 0; y < Display::HIRES_HEIGHT; ++y) {
+            for (int x = 0; x < Display::HIRES_WIDTH; ++x) {
+                out[y * Display::HIRES_WIDTH + x] = Display::get_pixel(frame, x, y);
+            }
+        }
+
+        return;
+    }
+
+    std::array<uint64_t, Display::HEIGHT> rows = Display::downsample(frame);
+
+    for (int y = 0; y < Display::HEIGHT; ++y) {
+        if (format == CHIP8_OBSERVATION_PACKED) {
+            for (int byte = 0; byte < 8; ++byte) {
+                out[y * 8 + byte] = rows[y] >> (56 - 8 * byte);
+            }
+        } else {
+            for (int x = 0; x < Display::WIDTH; ++x) {
+                out[y * Display::WIDTH + x] = (rows[y] >> (63 - x)) & 0x01;
+            }
+        }
+    }
+}
+
+/// Get the keys currently held by an instance, as a mask for CPU::set_keys().
+static uint16_t held_keys(const CPU &cpu) {
+    uint16_t keys = 0;
+
+    for (uint8_t key = 0; key < 16; ++key) {
+        keys |= cpu.is_key_down(key) << key;
+    }
+
+    return keys;
+}
+
+/// Start tracking the cycles of an instance from its current state.
+static void reset_tracker(CycleTracker &tracker, const CPU &cpu) {
+    tracker.hash.reset(cpu);
+    tracker.detector.reset();
+    tracker.keys = held_keys(cpu);
+}
+
+/// Run a number of frames on an instance, skipping whole cycles of states.
+static void run_skipping(chip8_batch *batch, size_t idx, unsigned frames) {
+    CPU &cpu = *batch->cpus[idx];
+    CycleTracker &tracker = batch->trackers[idx];
+
+    while (frames > 0) {
+        uint64_t period = tracker.detector.get_period();
+
+        if (period != 0) {
+            // Going around the cycle returns to the current state
+            frames %= period;
+
+            if (frames == 0) {
+                break;
+            }
+        }
+
+        InputLog::run_frame(cpu, tracker.keys, tracker.hash, batch->steps_per_frame);
+        tracker.detector.update(cpu, tracker.hash.get(cpu));
+        --frames;
+    }
+}
+
+chip8_batch *chip8_batch_create(size_t n, const uint8_t *rom, size_t rom_size) {
+    if (n == 0 || rom == nullptr || rom_size == 0 || rom_size > CPU::MEMORY_SIZE - CPU::INITIAL_PC) {
+        return nullptr;
+    }
+
+    // Exceptions must not escape into the caller
+    chip8_batch *batch = new (std::nothrow) chip8_batch(n);
+    if (batch == nullptr || batch->arena.get_capacity() != n) {
+        delete batch;
+        return nullptr;
+    }
+
+    try {
+        batch->rom.assign(rom, rom + rom_size);
+        batch->cpus.reserve(n);
+    } catch (const std::exception &) {
+        delete batch;
+        return nullptr;
+    }
+
+    batch->initial.load_code(rom, rom_size);
+
+    for (size_t idx = 0; idx < n; ++idx) {
+        CPU *cpu = batch->arena.allocate();
+        *cpu = batch->initial;
+        batch->cpus.push_back(cpu);
+    }
+
+    return batch;
+}
+
+void chip8_batch_destroy(chip8_batch *batch) {
+    delete batch;
+}
+
+size_t chip8_batch_size(const chip8_batch *batch) {
+    if (batch == nullptr) {
+        return 0;
+    }
+
+    return batch->cpus.size();
+}
+
+int chip8_batch_set_observation(chip8_batch *batch, chip8_observation format) {
+    if (batch == nullptr || (format != CHIP8_OBSERVATION_PACKED && format != CHIP8_OBSERVATION_EXPANDED && format != CHIP8_OBSERVATION_NATIVE)) {
+        return -1;
+    }
+
+    batch->observation = format;
+    return 0;
+}
+
+size_t chip8_batch_observation_size(const chip8_batch *batch) {
+    if (batch == nullptr) {
+        return 0;
+    }
+
+    if (batch->observation == CHIP8_OBSERVATION_PACKED) {
+        return Display::WIDTH * Display::HEIGHT / 8;
+    }
+
+    if (batch->observation == CHIP8_OBSERVATION_NATIVE) {
+        return Display::HIRES_WIDTH * Display::HIRES_HEIGHT;
+    }
+
+    return Display::WIDTH * Display::HEIGHT;
+}
+
+void chip8_batch_set_steps_per_frame(chip8_batch *batch, unsigned steps) {
+    if (batch == nullptr) {
+        return;
+    }
+
+    batch->steps_per_frame = steps;
+
+    // Detected cycles only hold for the number of steps they were found with
+    for (CycleTracker &tracker : batch->trackers) {
+        tracker.detector.reset();
+    }
+}
+
+void chip8_batch_set_reward_address(chip8_batch *batch, int address) {
+    if (batch == nullptr) {
+        return;
+    }
+
+    batch->reward_address = address >= 0 ? (address & CPU::ADDRESS_MASK) : -1;
+}
+
+int chip8_batch_set_cycle_skipping(chip8_batch *batch, int enabled) {
+    if (batch == nullptr) {
+        return -1;
+    }
+
+    if (!enabled) {
+        batch->trackers.clear();
+        return 0;
+    }
+
+    if (!batch->trackers.empty()) {
+        return 0;
+    }
+
+    try {
+        batch->trackers.resize(batch->cpus.size());
+    } catch (const std::exception &) {
+        return -1;
+    }
+
+    for (size_t idx = 0; idx < batch->cpus.size(); ++idx) {
+        reset_tracker(batch->trackers[idx], *batch->cpus[idx]);
+    }
+
+    return 0;
+}
+
+int chip8_batch_find_duplicates(const chip8_batch *batch, size_t *out) {
+    if (batch == nullptr || out == nullptr) {
+        return -1;
+    }
+
+    try {
+        std::vector<const CPU *> cpus(batch->cpus.begin(), batch->cpus.end());
+        std::vector<uint64_t> hashes;
+        hashes.reserve(cpus.size());
+
+        for (size_t idx = 0; idx < cpus.size(); ++idx) {
+            hashes.push_back(batch->trackers.empty() ? StateHash::compute(*cpus[idx]) : batch->trackers[idx].hash.get(*cpus[idx]));
+        }
+
+        std::vector<size_t> duplicates = StateHash::find_duplicates(cpus, hashes);
+        std::copy(duplicates.begin(), duplicates.end(), out);
+    } catch (const std::exception &) {
+        return -1;
+    }
+
+    return 0;
+}
+
+int chip8_batch_step(chip8_batch *batch, const uint16_t *actions, unsigned frames_per_step, uint8_t *obs_out, float *rewards_out) {
+    if (batch == nullptr) {
+        return -1;
+    }
+
+    size_t obs_size = chip8_batch_observation_size(batch);
+
+    try {
+        for (size_t idx = 0; idx < batch->cpus.size(); ++idx) {
+            CPU &cpu = *batch->cpus[idx];
+
+            if (actions != nullptr) {
+                cpu.set_keys(actions[idx]);
+
+                if (!batch->trackers.empty() && batch->trackers[idx].keys != actions[idx]) {
+                    batch->trackers[idx].detector.reset();
+                    batch->trackers[idx].keys = actions[idx];
+                }
+            }
+
+            uint8_t before = batch->reward_address >= 0 ? cpu.read_memory(batch->reward_address) : 0;
+
+            if (!batch->trackers.empty()) {
+                run_skipping(batch, idx, frames_per_step);
+            } else {
+                uint16_t keys = actions != nullptr ? actions[idx] : held_keys(cpu);
+
+                for (unsigned frame = 0; frame < frames_per_step; ++frame) {
+                    InputLog::run_frame(cpu, keys, batch->steps_per_frame);
+                }
+            }
+
+            if (rewards_out != nullptr) {
+                uint8_t after = batch->reward_address >= 0 ? cpu.read_memory(batch->reward_address) : 0;
+                rewards_out[idx] = static_cast<int8_t>(after - before);
+            }
+
+            if (obs_out != nullptr) {
+                write_observation(cpu, batch->observation, obs_out + idx * obs_size);
+            }
+        }
+    } catch (const std::exception &) {
+        return -1;
+    }
+
+    return 0;
+}
+
+int chip8_batch_boot(chip8_batch *batch, const char *cache_dir) {
+    if (batch == nullptr) {
+        return -1;
+    }
+
+    try {
+        BootCache cache;
+        CPU booted = batch->initial;
+
+        if ((cache_dir != nullptr && !cache.open(cache_dir)) || !cache.load(booted, batch->rom.data(), batch->rom.size())) {
+            return -1;
+        }
+
+        batch->initial = booted;
+    } catch (const std::exception &) {
+        return -1;
+    }
+
+    for (size_t idx = 0; idx < batch->cpus.size(); ++idx) {
+        chip8_batch_reset(batch, idx);
+    }
+
+    return 0;
+}
+
+int chip8_batch_reset(chip8_batch *batch, size_t idx) {
+    if (batch == nullptr || idx >= batch->cpus.size()) {
+        return -1;
+    }
+
+    *batch->cpus[idx] = batch->initial;
+
+    if (!batch->trackers.empty()) {
+        reset_tracker(batch->trackers[idx], *batch->cpus[idx]);
+    }
+
+    return 0;
+}
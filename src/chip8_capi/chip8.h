@@ -0,0 +1,176 @@
+#pragma once
+
+/**
+ * Stable C interface for running batches of CHIP-8 instances.
+ *
+ * A batch holds N instances of the same ROM. Each call to chip8_batch_step()
+ * applies one action per instance, runs a number of frames on all of them,
+ * and writes observations and rewards directly into caller-provided buffers.
+ *
+ * Functions on different batches may be called concurrently; functions on
+ * the same batch may not.
+ *
+ * Every function accepts a NULL batch: functions returning int then return
+ * -1, sizes are 0, and functions without a result do nothing. Functions
+ * returning int also return -1 if memory runs out.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#define CHIP8_API __declspec(dllexport)
+#else
+#define CHIP8_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Width of the display in pixels. High resolution ROMs are observed at half
+ * their resolution, a pixel being lit if any of its 2x2 block is lit.
+ */
+#define CHIP8_WIDTH 64
+
+/** Height of the display in pixels. */
+#define CHIP8_HEIGHT 32
+
+/**
+ * Width of native observations in pixels. Low resolution ROMs are observed at
+ * twice their resolution, each pixel covering a 2x2 block.
+ */
+#define CHIP8_NATIVE_WIDTH 128
+
+/** Height of native observations in pixels. */
+#define CHIP8_NATIVE_HEIGHT 64
+
+/** Observation formats. */
+typedef enum chip8_observation {
+    /** 1 bit per pixel, most significant bit first: 256 bytes per instance. */
+    CHIP8_OBSERVATION_PACKED = 0,
+
+    /** 1 byte per pixel, either 0 or 1: 2048 bytes per instance. */
+    CHIP8_OBSERVATION_EXPANDED = 1,
+
+    /**
+     * 1 byte per pixel at CHIP8_NATIVE_WIDTH x CHIP8_NATIVE_HEIGHT, holding
+     * the XO-CHIP planes the pixel is lit in (bit n for plane n, 0 - 3):
+     * 8192 bytes per instance.
+     */
+    CHIP8_OBSERVATION_NATIVE = 2,
+} chip8_observation;
+
+/** Opaque handle to a batch of instances. */
+typedef struct chip8_batch chip8_batch;
+
+/**
+ * Create a batch of instances running the same ROM.
+ *
+ * \param n Number of instances.
+ * \param rom ROM image, loaded at 0x200.
+ * \param rom_size Size of the ROM image in bytes.
+ *
+ * \return The batch, or NULL if the ROM is invalid or allocation failed.
+ */
+CHIP8_API chip8_batch *chip8_batch_create(size_t n, const uint8_t *rom, size_t rom_size);
+
+/** Destroy a batch. Accepts NULL. */
+CHIP8_API void chip8_batch_destroy(chip8_batch *batch);
+
+/** Number of instances in a batch, 0 for NULL. */
+CHIP8_API size_t chip8_batch_size(const chip8_batch *batch);
+
+/**
+ * Set the observation format used by chip8_batch_step(). Defaults to packed.
+ *
+ * \return 0 on success, -1 for an unknown format.
+ */
+CHIP8_API int chip8_batch_set_observation(chip8_batch *batch, chip8_observation format);
+
+/** Size of one instance's observation in bytes, for the current format, 0 for NULL. */
+CHIP8_API size_t chip8_batch_observation_size(const chip8_batch *batch);
+
+/**
+ * Set the number of instructions executed per frame. Defaults to 12.
+ */
+CHIP8_API void chip8_batch_set_steps_per_frame(chip8_batch *batch, unsigned steps);
+
+/**
+ * Derive rewards from a byte of memory, typically a score.
+ *
+ * The reward of a step is the change of the byte's value during that step,
+ * as a signed 8-bit difference. Without a reward address, all rewards are 0.
+ *
+ * \param address Address of the byte, wrapped to the size of memory, or -1 to disable.
+ */
+CHIP8_API void chip8_batch_set_reward_address(chip8_batch *batch, int address);
+
+/**
+ * Skip ahead when instances loop through the same states.
+ *
+ * While enabled, the state of every instance is hashed at the end of each
+ * frame. Once an instance revisits a state without its keys changing, e.g. in
+ * an attract mode or waiting loop, all further frames are reduced modulo the
+ * length of the loop until its keys change again. Observations and rewards
+ * are exactly those of running every frame. Disabled by default, as hashing
+ * slows down instances which never loop.
+ *
+ * \param enabled Non-zero to enable, zero to disable.
+ *
+ * \return 0 on success, -1 on failure.
+ */
+CHIP8_API int chip8_batch_set_cycle_skipping(chip8_batch *batch, int enabled);
+
+/**
+ * Find instances in identical states, so that only one of each needs to be
+ * stepped and its results copied to the others.
+ *
+ * \param out Receives, for every instance, the index of the first instance in
+ * the same state. Unique instances map to their own index.
+ *
+ * \return 0 on success, -1 on failure.
+ */
+CHIP8_API int chip8_batch_find_duplicates(const chip8_batch *batch, size_t *out);
+
+/**
+ * Step all instances.
+ *
+ * \param actions One bitmask of held keys per instance, bit n for key n.
+ * May be NULL to leave the keys unchanged.
+ * \param frames_per_step Number of frames to run.
+ * \param obs_out Receives one observation per instance, back to back. May be NULL.
+ * \param rewards_out Receives one reward per instance. May be NULL.
+ *
+ * \return 0 on success, -1 on invalid arguments.
+ */
+CHIP8_API int chip8_batch_step(chip8_batch *batch, const uint16_t *actions, unsigned frames_per_step, uint8_t *obs_out, float *rewards_out);
+
+/**
+ * Skip the boot of the ROM: reset every instance, and every later reset, to
+ * the state before the frame in which the ROM first reads a key.
+ *
+ * The boot runs with the default number of steps per frame. Booted states are
+ * cached in a directory, keyed by a hash of the ROM, so later batches of the
+ * same ROM start at once.
+ *
+ * \param cache_dir Directory to cache booted states in, created if it does
+ * not exist, or NULL to boot without caching.
+ *
+ * \return 0 on success, -1 if the directory could not be created or on
+ * failure.
+ */
+CHIP8_API int chip8_batch_boot(chip8_batch *batch, const char *cache_dir);
+
+/**
+ * Reset an instance to the state right after loading the ROM, or after
+ * booting it if chip8_batch_boot() was called.
+ *
+ * \return 0 on success, -1 if the index is out of range.
+ */
+CHIP8_API int chip8_batch_reset(chip8_batch *batch, size_t idx);
+
+#ifdef __cplusplus
+}
+#endif
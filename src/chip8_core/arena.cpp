@@ -0,0 +1,55 @@
+#include "arena.h"
+
+#include <new>
+#include <stdint.h>
+#include <type_traits>
+
+CPUArena::CPUArena(size_t capacity) : capacity(capacity) {
+    // Instances are never destroyed individually, which is fine as long as there is nothing to destroy
+    static_assert(std::is_trivially_destructible_v<CPU>);
+
+    if (capacity > SIZE_MAX / sizeof(CPU)) {
+        this->slots = nullptr;
+    } else {
+        this->slots = static_cast<CPU *>(::operator new(sizeof(CPU) * capacity, std::align_val_t(alignof(CPU)), std::nothrow));
+    }
+
+    if (this->slots == nullptr) {
+        this->capacity = 0;
+    }
+}
+
+CPUArena::~CPUArena() {
+    ::operator delete(this->slots, std::align_val_t(alignof(CPU)));
+}
+
+CPU* CPUArena::allocate() {
+    size_t idx;
+
+    if (!this->free_slots.empty()) {
+        idx = this->free_slots.back();
+        this->free_slots.pop_back();
+    } else if (this->high_water < this->capacity) {
+        idx = this->high_water++;
+    } else {
+        return nullptr;
+    }
+
+    return new (this->slots + idx) CPU();
+}
+
+void CPUArena::release(CPU *cpu) {
+    this->free_slots.push_back(this->index_of(cpu));
+}
+
+size_t CPUArena::index_of(const CPU *cpu) const {
+    return cpu - this->slots;
+}
+
+size_t CPUArena::get_capacity() const {
+    return this->capacity;
+}
+
+size_t CPUArena::get_size() const {
+    return this->high_water - this->free_slots.size();
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "cpu.h"
+
+#include <stddef.h>
+#include <vector>
+
+/// Contiguous, fixed-capacity storage for CPU instances.
+///
+/// All instances live in a single allocation, so the memory required for a
+/// given number of sessions is known up front and neighbouring instances are
+/// adjacent in memory. Slots are recycled through a free list, and the address
+/// of an instance stays valid until it is released.
+class CPUArena {
+    private:
+        /// Storage for all slots.
+        CPU *slots;
+
+        /// Maximum number of instances.
+        size_t capacity;
+
+        /// Number of slots which have been handed out at least once.
+        size_t high_water = 0;
+
+        /// Indices of released slots, available for reuse.
+        std::vector<size_t> free_slots;
+
+    public:
+        /// Create an arena.
+        ///
+        /// \param capacity Maximum number of instances the arena can hold. If
+        /// the storage cannot be allocated, the capacity is 0 instead.
+        explicit CPUArena(size_t capacity);
+        ~CPUArena();
+
+        CPUArena(const CPUArena &other) = delete;
+        CPUArena& operator=(const CPUArena &other) = delete;
+
+        /// Allocate a freshly initialised CPU.
+        ///
+        /// \return The new instance, or nullptr if the arena is full.
+        CPU* allocate();
+
+        /// Return an instance to the arena.
+        ///
+        /// \param cpu Instance previously returned by allocate().
+        void release(CPU *cpu);
+
+        /// Get the slot index of an instance.
+        ///
+        /// \param cpu Instance previously returned by allocate().
+        ///
+        /// \return Index of the instance, less than get_capacity().
+        size_t index_of(const CPU *cpu) const;
+
+        /// Maximum number of instances the arena can hold.
+        size_t get_capacity() const;
+
+        /// Number of instances currently allocated.
+        size_t get_size() const;
+};
@@ -0,0 +1,178 @@
+#include "atlas.h"
+
+#include "pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+/// Pack a colour in the byte order of the image.
+static uint32_t make_color(uint32_t rgb) {
+    uint8_t bytes[4] = {
+        static_cast<uint8_t>(rgb >> 16),
+        static_cast<uint8_t>(rgb >> 8),
+        static_cast<uint8_t>(rgb),
+        0xFF,
+    };
+    uint32_t ret;
+    std::memcpy(&ret, bytes, sizeof(ret));
+
+    return ret;
+}
+
+Atlas::Atlas() {
+    this->set_colors(0x000000, 0xFFFFFF, 0xAAAAAA, 0x555555);
+}
+
+void Atlas::set_layout(size_t tiles, int columns) {
+    if (columns <= 0) {
+        // Tiles are twice as wide as they are high
+        columns = std::max(1, static_cast<int>(std::ceil(std::sqrt(tiles / 2.0))));
+    }
+
+    int rows = (tiles + columns - 1) / columns;
+
+    this->tiles = tiles;
+    this->columns = columns;
+    this->width = columns * Atlas::TILE_WIDTH;
+    this->height = rows * Atlas::TILE_HEIGHT;
+
+    // A new display is unmodified and empty, exactly what the cleared tiles show
+    this->pixels.assign(static_cast<size_t>(this->width) * this->height, this->colors[0]);
+    this->versions.assign(tiles, 0);
+    this->frames.assign(tiles, Display::Frame{});
+
+    this->dirty_begin = 0;
+    this->dirty_end = this->height;
+}
+
+void Atlas::set_colors(uint32_t off, uint32_t on) {
+    this->set_colors(off, on, on, on);
+}
+
+void Atlas::set_colors(uint32_t off, uint32_t first, uint32_t second, uint32_t both) {
+    this->colors = {make_color(off), make_color(first), make_color(second), make_color(both)};
+
+    std::fill(this->pixels.begin(), this->pixels.end(), this->colors[0]);
+
+    for (size_t tile = 0; tile < this->tiles; ++tile) {
+        this->draw_tile(tile, this->frames[tile]);
+    }
+
+    this->dirty_begin = 0;
+    this->dirty_end = this->height;
+}
+
+void Atlas::draw_tile(size_t tile, const Display::Frame &frame) {
+    int left = (tile % this->columns) * Atlas::TILE_WIDTH;
+    int top = (tile / this->columns) * Atlas::TILE_HEIGHT;
+    int scale = frame.hires ? 1 : 2;
+
+    for (int y = 0; y < Atlas::TILE_HEIGHT; y += scale) {
+        const auto &row = frame.rows[y / scale];
+        uint32_t *out = this->pixels.data() + static_cast<size_t>(top + y) * this->width + left;
+        uint32_t *next = out;
+
+        // One word per plane in low resolution, two in high resolution
+        for (int word = 0; word < 2 / scale; ++word) {
+            uint64_t first = row[word];
+            uint64_t second = row[2 + word];
+
+            if ((first | second) == 0) {
+                next = std::fill_n(next, 64 * scale, this->colors[0]);
+                continue;
+            }
+
+            for (int bit = 0; bit < 64; ++bit) {
+                next = std::fill_n(next, scale, this->colors[(first >> 63) | (second >> 63) << 1]);
+                first <<= 1;
+                second <<= 1;
+            }
+        }
+
+        if (scale == 2) {
+            // Low resolution rows are doubled
+            std::memcpy(out + this->width, out, Atlas::TILE_WIDTH * sizeof(uint32_t));
+        }
+    }
+
+    if (this->dirty_end == this->dirty_begin) {
+        this->dirty_begin = top;
+        this->dirty_end = top + Atlas::TILE_HEIGHT;
+    } else {
+        this->dirty_begin = std::min(this->dirty_begin, top);
+        this->dirty_end = std::max(this->dirty_end, top + Atlas::TILE_HEIGHT);
+    }
+}
+
+bool Atlas::update(size_t tile, const Display &display) {
+    if (tile >= this->tiles) {
+        return false;
+    }
+
+    uint32_t version = display.get_version();
+    if (version == this->versions[tile]) {
+        return false;
+    }
+
+    // Read after the version, so a write in between only causes another check
+    Display::Frame frame = display.get_frame();
+    this->versions[tile] = version;
+
+    if (frame == this->frames[tile]) {
+        // E.g. a sprite erased and drawn again at the same place
+        return false;
+    }
+
+    this->frames[tile] = frame;
+    this->draw_tile(tile, frame);
+
+    return true;
+}
+
+size_t Atlas::update(Pool &pool) {
+    size_t ret = 0;
+
+    this->reset_dirty();
+
+    for (size_t idx = 0; idx < std::min(this->tiles, pool.size()); ++idx) {
+        ret += this->update(idx, pool.get(idx).get_display());
+    }
+
+    return ret;
+}
+
+void Atlas::reset_dirty() {
+    this->dirty_begin = 0;
+    this->dirty_end = 0;
+}
+
+int Atlas::get_tile(int x, int y) const {
+    if (x < 0 || y < 0 || x >= this->width || y >= this->height) {
+        return -1;
+    }
+
+    size_t tile = (y / Atlas::TILE_HEIGHT) * this->columns + x / Atlas::TILE_WIDTH;
+
+    return tile < this->tiles ? static_cast<int>(tile) : -1;
+}
+
+const uint8_t* Atlas::get_pixels() const {
+    return reinterpret_cast<const uint8_t *>(this->pixels.data());
+}
+
+int Atlas::get_width() const {
+    return this->width;
+}
+
+int Atlas::get_height() const {
+    return this->height;
+}
+
+int Atlas::get_dirty_begin() const {
+    return this->dirty_begin;
+}
+
+int Atlas::get_dirty_end() const {
+    return this->dirty_end;
+}
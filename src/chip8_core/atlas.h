@@ -0,0 +1,136 @@
+#pragma once
+
+#include "display.h"
+
+#include <array>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+class Pool;
+
+/// Renders the displays of many instances side by side into a single RGBA
+/// image, e.g. to monitor every instance of a Pool through one texture.
+///
+/// Every display gets a tile of 128x64 pixels, doubling pixels in low
+/// resolution. A tile is only drawn again when its display was modified (see
+/// Display::get_version()) and its contents actually differ, and the changed
+/// rows of the image are tracked, so a frame needs a single upload of the
+/// rows which changed. Each combination of the two XO-CHIP planes has its
+/// own colour.
+class Atlas {
+    public:
+        /// Width of a tile in pixels.
+        static constexpr int TILE_WIDTH = Display::HIRES_WIDTH;
+
+        /// Height of a tile in pixels.
+        static constexpr int TILE_HEIGHT = Display::HIRES_HEIGHT;
+
+    private:
+        /// Number of tiles.
+        size_t tiles = 0;
+
+        /// Number of tiles per row.
+        int columns = 1;
+
+        /// Width of the image in pixels.
+        int width = 0;
+
+        /// Height of the image in pixels.
+        int height = 0;
+
+        /// The image, `width * height` pixels of 4 bytes: red, green, blue, alpha.
+        std::vector<uint32_t> pixels;
+
+        /// Version of the display every tile was last checked against.
+        std::vector<uint32_t> versions;
+
+        /// Contents every tile was last drawn from.
+        std::vector<Display::Frame> frames;
+
+        /// Colours of pixels lit in no plane, the first plane, the second
+        /// plane and both planes, in the byte order of #pixels.
+        std::array<uint32_t, 4> colors{};
+
+        /// First row of the image changed since the last reset_dirty().
+        int dirty_begin = 0;
+
+        /// One past the last row of the image changed since the last reset_dirty().
+        int dirty_end = 0;
+
+        /// Draw a tile.
+        void draw_tile(size_t tile, const Display::Frame &frame);
+
+    public:
+        Atlas();
+
+        /// Set the number of tiles and how they are arranged, clearing them.
+        ///
+        /// \param tiles Number of tiles.
+        /// \param columns Number of tiles per row, or 0 to pick a number
+        /// which makes the image roughly square.
+        void set_layout(size_t tiles, int columns = 0);
+
+        /// Set the colours of unlit and lit pixels, regardless of plane.
+        ///
+        /// \param off Colour of unlit pixels, as `0xRRGGBB`.
+        /// \param on Colour of lit pixels, as `0xRRGGBB`.
+        void set_colors(uint32_t off, uint32_t on);
+
+        /// Set the colours of every combination of planes, redrawing all tiles.
+        ///
+        /// \param off Colour of unlit pixels, as `0xRRGGBB`.
+        /// \param first Colour of pixels lit in the first plane only.
+        /// \param second Colour of pixels lit in the second plane only.
+        /// \param both Colour of pixels lit in both planes.
+        void set_colors(uint32_t off, uint32_t first, uint32_t second, uint32_t both);
+
+        /// Update a tile from a display, if the display changed.
+        ///
+        /// May be called while another thread draws to the display.
+        ///
+        /// \param tile Index of the tile.
+        /// \param display The display.
+        ///
+        /// \return Whether the tile was drawn.
+        bool update(size_t tile, const Display &display);
+
+        /// Update every tile from the instance of a pool with the same index,
+        /// after resetting the changed rows.
+        ///
+        /// \param pool The pool. Must not be running.
+        ///
+        /// \return Number of tiles drawn.
+        size_t update(Pool &pool);
+
+        /// Forget the rows changed so far, e.g. after uploading them.
+        void reset_dirty();
+
+        /// Get the tile at a position in the image, e.g. to select an instance
+        /// with the mouse.
+        ///
+        /// \param x X position in pixels.
+        /// \param y Y position in pixels.
+        ///
+        /// \return Index of the tile, or -1 if there is none.
+        int get_tile(int x, int y) const;
+
+        /// Get the image.
+        ///
+        /// \return `get_height()` rows of `get_width()` pixels, 4 bytes each:
+        /// red, green, blue and alpha.
+        const uint8_t* get_pixels() const;
+
+        /// Width of the image in pixels.
+        int get_width() const;
+
+        /// Height of the image in pixels.
+        int get_height() const;
+
+        /// First row of the image changed since the last reset_dirty().
+        int get_dirty_begin() const;
+
+        /// One past the last row of the image changed since the last
+        /// reset_dirty(). Equal to get_dirty_begin() if nothing changed.
+        int get_dirty_end() const;
+};
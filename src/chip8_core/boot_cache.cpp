@@ -0,0 +1,143 @@
+#include "boot_cache.h"
+
+#include "byte_order.h"
+#include "fnv.h"
+#include "input_log.h"
+#include "save_state.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+/// Returns whether the next instruction reads a key.
+static bool reads_key(const CPU &cpu) {
+    uint16_t pc = cpu.get_pc();
+    uint16_t opcode = (cpu.read_memory(pc) << 8 | cpu.read_memory(pc + 1)) & 0xF0FF;
+
+    return opcode == 0xE09E || opcode == 0xE0A1 || opcode == 0xF00A;
+}
+
+unsigned BootCache::boot(CPU &cpu, unsigned max_frames) {
+    for (unsigned frame = 0; frame < max_frames; ++frame) {
+        CPU next = cpu;
+
+        bool done = InputLog::run_frame(next, 0, [](CPU &cpu) {
+            if (reads_key(cpu)) {
+                return false;
+            }
+
+            cpu.step();
+            return true;
+        });
+
+        if (!done) {
+            return frame;
+        }
+
+        cpu = next;
+    }
+
+    return max_frames;
+}
+
+uint64_t BootCache::key(const uint8_t *code, size_t length, uint32_t seed) const {
+    // Over the configuration followed by the ROM
+    uint64_t config[] = {seed, CPU::MEMORY_SIZE, CPU::STEPS_PER_FRAME, this->max_frames, length};
+    uint8_t encoded[sizeof(config)];
+    uint8_t *out = encoded;
+
+    for (uint64_t value : config) {
+        out = put_le(out, value, 8);
+    }
+
+    return fnv1a(code, length, fnv1a(encoded, sizeof(encoded)));
+}
+
+bool BootCache::open(const char *directory) {
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+
+    if (!std::filesystem::is_directory(directory, error)) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(this->lock);
+    this->directory = directory;
+
+    return true;
+}
+
+void BootCache::set_max_frames(unsigned frames) {
+    std::lock_guard<std::mutex> lock(this->lock);
+
+    if (frames != this->max_frames) {
+        // Keys depend on the limit
+        this->states.clear();
+        this->max_frames = frames;
+    }
+}
+
+bool BootCache::load(CPU &cpu, const uint8_t *code, size_t length, uint32_t seed) {
+    if (length == 0 || length > CPU::MEMORY_SIZE - CPU::INITIAL_PC) {
+        return false;
+    }
+
+    std::unique_lock<std::mutex> lock(this->lock);
+    uint64_t key = this->key(code, length, seed);
+
+    auto found = this->states.find(key);
+    if (found != this->states.end()) {
+        cpu = found->second;
+        return true;
+    }
+
+    std::string path;
+    if (!this->directory.empty()) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016" PRIx64 ".c8s", key);
+        path = (std::filesystem::path(this->directory) / name).string();
+    }
+
+    unsigned max_frames = this->max_frames;
+
+    // Other sessions need not wait for the boot
+    lock.unlock();
+
+    // Left unchanged if there is no valid cache file
+    CPU booted;
+
+    if (path.empty() || !SaveState::load(booted, path.c_str())) {
+        booted.seed(seed);
+        booted.load_code(code, length);
+        BootCache::boot(booted, max_frames);
+
+        if (!path.empty()) {
+            // Without the cache file, sessions still start from the booted state
+            SaveState::save(booted, path.c_str(), SaveState::Compression::NONE);
+        }
+    }
+
+    cpu = booted;
+
+    lock.lock();
+    if (max_frames == this->max_frames) {
+        this->states.emplace(key, booted);
+    }
+
+    return true;
+}
+
+bool BootCache::load_file(CPU &cpu, const char *path, uint32_t seed) {
+    std::ifstream stream(path, std::ios::in | std::ios::binary);
+
+    if (!stream.is_open()) {
+        return false;
+    }
+
+    std::vector<uint8_t> code((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+
+    return !stream.bad() && this->load(cpu, code.data(), code.size(), seed);
+}
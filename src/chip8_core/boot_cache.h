@@ -0,0 +1,90 @@
+#pragma once
+
+#include "cpu.h"
+
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+
+/// Caches the state of ROMs after booting, so sessions can skip the frames a
+/// ROM spends clearing the screen, drawing title art and waiting on timers
+/// before any input matters.
+///
+/// A ROM is booted by running it without keys, a frame at a time with
+/// InputLog::run_frame(), up to the frame in which it first reads a key
+/// (`Ex9E`, `ExA1` or `Fx0A`). The state before that frame is kept in memory
+/// and saved as a SaveState in the cache directory, named after a hash of
+/// everything the boot depends on: the ROM, the RNG seed, the memory size,
+/// the number of steps per frame and the frame limit. Starting from the cached state is
+/// indistinguishable from booting the ROM and then playing from that frame.
+///
+/// Safe to use from multiple threads. Processes sharing a directory at worst
+/// boot the same ROM more than once, as cache files are replaced atomically
+/// and checksummed.
+class BootCache {
+    public:
+        /// Default maximum number of frames to boot for, 10 seconds at 60 fps.
+        static constexpr unsigned DEFAULT_MAX_FRAMES = 600;
+
+        /// Boot a CPU up to the frame in which it first reads a key.
+        ///
+        /// \param cpu The CPU, with the ROM loaded. Left in the state before
+        /// the frame reading a key.
+        /// \param max_frames Stop after this many frames if no key is read.
+        ///
+        /// \return Number of frames run.
+        static unsigned boot(CPU &cpu, unsigned max_frames = DEFAULT_MAX_FRAMES);
+
+    private:
+        /// Directory the states are saved to, or empty to only cache in memory.
+        std::string directory;
+
+        /// Maximum number of frames to boot for.
+        unsigned max_frames = DEFAULT_MAX_FRAMES;
+
+        /// Lock protecting #states.
+        std::mutex lock;
+
+        /// States booted or loaded so far, by key.
+        std::unordered_map<uint64_t, CPU> states;
+
+        /// Hash of everything booting a ROM depends on.
+        uint64_t key(const uint8_t *code, size_t length, uint32_t seed) const;
+
+    public:
+        /// Save booted states to a directory, and look for them there.
+        ///
+        /// \param directory Path of the directory, created if it does not exist.
+        ///
+        /// \return Whether the directory exists.
+        bool open(const char *directory);
+
+        /// Set the maximum number of frames to boot for.
+        ///
+        /// \param frames Number of frames. ROMs which do not read a key
+        /// within this many frames are cached at that frame.
+        void set_max_frames(unsigned frames);
+
+        /// Start a session of a ROM from its booted state, booting and
+        /// caching it first if necessary.
+        ///
+        /// \param cpu Replaced with the booted state.
+        /// \param code The ROM.
+        /// \param length Size of the ROM in bytes.
+        /// \param seed Seed for the RNG during the boot, see CPU::seed().
+        /// Reseed the CPU afterwards for a session with a different seed.
+        ///
+        /// \return False if the ROM does not fit into memory.
+        bool load(CPU &cpu, const uint8_t *code, size_t length, uint32_t seed = CPU::DEFAULT_SEED);
+
+        /// Start a session of a ROM file from its booted state, see load().
+        ///
+        /// \param cpu Replaced with the booted state.
+        /// \param path Path of the ROM.
+        /// \param seed Seed for the RNG during the boot.
+        ///
+        /// \return False if the ROM could not be read or does not fit into memory.
+        bool load_file(CPU &cpu, const char *path, uint32_t seed = CPU::DEFAULT_SEED);
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+
+// Helpers for the little-endian integers of the binary formats: save states,
+// traces, frame logs and netplay messages.
+
+/// Write a little-endian integer of the given size.
+///
+/// \param out Where to write the integer.
+/// \param value The integer.
+/// \param bytes Size of the integer in bytes, at most 8.
+///
+/// \return Pointer just past the integer written.
+inline uint8_t *put_le(uint8_t *out, uint64_t value, int bytes) {
+    for (int n = 0; n < bytes; ++n) {
+        out[n] = (value >> (8 * n)) & 0xFF;
+    }
+
+    return out + bytes;
+}
+
+/// Read a little-endian integer of the given size.
+///
+/// \param in Where to read the integer from.
+/// \param bytes Size of the integer in bytes, at most 8.
+///
+/// \return The integer.
+inline uint64_t get_le(const uint8_t *in, int bytes) {
+    uint64_t ret = 0;
+
+    for (int n = 0; n < bytes; ++n) {
+        ret |= static_cast<uint64_t>(in[n]) << (8 * n);
+    }
+
+    return ret;
+}
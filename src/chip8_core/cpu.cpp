@@ -1,59 +1,150 @@
 #include "cpu.h"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
 #include <cstdlib>
-#include <cstring>
 #include <fstream>
+#include <type_traits>
 
 CPU::CPU() {
+    static_assert(std::is_trivially_copyable_v<CPU>, "CPU snapshots rely on plain memory copies");
+    static_assert(offsetof(CPU, memory) == 64, "Hot CPU state should fit into a single cache line");
+
     // Copy font data into the CPU's memory
     std::copy(CPU::FONT.begin(), CPU::FONT.end(), this->memory.begin() + CPU::FONT_OFFSET);
+    std::copy(CPU::BIG_FONT.begin(), CPU::BIG_FONT.end(), this->memory.begin() + CPU::BIG_FONT_OFFSET);
 }
 
-CPU::CPU(const CPU &other)
-    : key_wait_register(other.key_wait_register), pc(other.pc), sp(other.sp), i(other.i), dt(other.dt.load()), st(other.st.load()) {
-    this->display = other.display;
-    this->memory = other.memory;
-    std::memcpy(this->keys, other.keys, sizeof(other.keys));
-    std::memcpy(this->registers, other.registers, sizeof(other.registers));
+/// Atomically access a timer register, which may be ticked from a different thread.
+///
+/// \param reg The timer register.
+///
+/// \return An atomic reference to the register.
+static std::atomic_ref<uint8_t> timer(const uint8_t &reg) {
+    return std::atomic_ref<uint8_t>(const_cast<uint8_t &>(reg));
 }
 
-CPU& CPU::operator=(CPU other) {
-    std::swap(this->display, other.display);
-    std::swap(this->memory, other.memory);
-    std::swap(this->keys, other.keys);
-    std::swap(this->key_wait_register, other.key_wait_register);
-    std::swap(this->registers, other.registers);
-    std::swap(this->pc, other.pc);
-    std::swap(this->sp, other.sp);
-    std::swap(this->i, other.i);
-    this->dt = other.dt.load();
-    this->st = other.st.load();
-
-    return *this;
+/// Get the time elapsed since a key event occurred.
+///
+/// \param timestamp When the event occurred, in nanoseconds since the epoch
+/// of `std::chrono::steady_clock`.
+///
+/// \return Elapsed time in nanoseconds, or 0 if the timestamp lies in the future.
+static uint64_t latency_since(uint64_t timestamp) {
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    uint64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+
+    return now_ns > timestamp ? now_ns - timestamp : 0;
 }
 
 void CPU::tick_timers() {
     // Saturating subtraction
     // Essentially: dt = dt.saturating_sub(1)
-    uint8_t current = this->dt.load(std::memory_order_relaxed);
-    while (current > 0 && !this->dt.compare_exchange_weak(current, current - 1, std::memory_order_relaxed));
+    std::atomic_ref<uint8_t> dt = timer(this->dt);
+    uint8_t current = dt.load(std::memory_order_relaxed);
+    while (current > 0 && !dt.compare_exchange_weak(current, current - 1, std::memory_order_relaxed));
 
     // st = st.saturating_sub(1)
-    current = this->st.load(std::memory_order_relaxed);
-    while (current > 0 && !this->st.compare_exchange_weak(current, current - 1, std::memory_order_relaxed));
+    std::atomic_ref<uint8_t> st = timer(this->st);
+    current = st.load(std::memory_order_relaxed);
+    while (current > 0 && !st.compare_exchange_weak(current, current - 1, std::memory_order_relaxed));
+}
+
+void CPU::tick_timers(unsigned ticks) {
+    std::atomic_ref<uint8_t> dt = timer(this->dt);
+    uint8_t current = dt.load(std::memory_order_relaxed);
+    while (current > 0 && !dt.compare_exchange_weak(current, current > ticks ? current - ticks : 0, std::memory_order_relaxed));
+
+    std::atomic_ref<uint8_t> st = timer(this->st);
+    current = st.load(std::memory_order_relaxed);
+    while (current > 0 && !st.compare_exchange_weak(current, current > ticks ? current - ticks : 0, std::memory_order_relaxed));
 }
 
 void CPU::set_key_down(uint8_t key, bool down) {
-    this->keys[key & 0x0F] = down;
+    if (down) {
+        this->keys |= 1 << (key & 0x0F);
+    } else {
+        this->keys &= ~(1 << (key & 0x0F));
+    }
 
     if (!down && this->key_wait_register != 0xFF) {
         // Register the key press on release
         this->registers[this->key_wait_register & 0x0F] = key & 0x0F;
         this->key_wait_register = 0xFF;
+
+        this->observe_input(key & 0x0F);
+    }
+}
+
+void CPU::set_keys(uint16_t keys) {
+    uint16_t changed = this->keys ^ keys;
+
+    for (uint8_t key = 0; key < 16; ++key) {
+        if ((changed >> key) & 0x01) {
+            this->set_key_down(key, (keys >> key) & 0x01);
+        }
+    }
+}
+
+bool CPU::queue_key_event(uint8_t key, bool down, uint64_t timestamp) {
+    return this->input.push(InputEvent {
+        .timestamp = timestamp,
+        .key = key,
+        .down = down,
+    });
+}
+
+void CPU::process_input() {
+    InputEvent event;
+
+    while (this->input.pop(event)) {
+        uint8_t key = event.key & 0x0F;
+
+        this->input_latency.applied.add(latency_since(event.timestamp));
+
+        this->unobserved_inputs[key] = event.timestamp;
+        this->unobserved_keys |= 1 << key;
+
+        this->set_key_down(key, event.down);
+    }
+}
+
+InputLatency CPU::get_input_latency() const {
+    return this->input_latency;
+}
+
+uint64_t CPU::take_drawn_input() {
+    return std::atomic_ref<uint64_t>(this->drawn_input).exchange(0, std::memory_order_acquire);
+}
+
+bool CPU::read_key(uint8_t key) {
+    if (this->unobserved_keys != 0) {
+        this->observe_input(key);
+    }
+
+    return this->is_key_down(key);
+}
+
+void CPU::observe_input(uint8_t key) {
+    if (!((this->unobserved_keys >> key) & 0x01)) {
+        return;
+    }
+
+    uint64_t timestamp = this->unobserved_inputs[key];
+    this->unobserved_keys &= ~(1 << key);
+    this->input_latency.observed.add(latency_since(timestamp));
+
+    if (!this->input_observed) {
+        // Keep the oldest event, until a draw reacts to it
+        this->input_observed = true;
+        this->observed_input = timestamp;
     }
 }
 
 bool CPU::is_key_down(uint8_t key) const {
-    return this->keys[key & 0x0F];
+    return (this->keys >> (key & 0x0F)) & 0x01;
 }
 
 void CPU::push(uint8_t val) {
@@ -104,7 +195,7 @@ const Display& CPU::get_display() const {
 }
 
 uint8_t CPU::read_memory(uint16_t addr) const {
-    return this->memory[addr & 0x0FFF];
+    return this->memory[addr & CPU::ADDRESS_MASK];
 }
 
 std::array<uint8_t, 16> CPU::get_registers() const {
@@ -131,21 +222,234 @@ uint16_t CPU::get_i() const {
 }
 
 bool CPU::is_sound_playing() const {
-    return this->st > 0;
+    return timer(this->st).load(std::memory_order_relaxed) > 0;
+}
+
+std::array<uint8_t, 16> CPU::get_audio_pattern() const {
+    return this->audio_pattern;
+}
+
+uint8_t CPU::get_pitch() const {
+    return this->pitch;
+}
+
+int CPU::timer_loop_start() const {
+    uint8_t dt = timer(this->dt).load(std::memory_order_relaxed);
+
+    if (dt == 0) {
+        return -1;
+    }
+
+    // The CPU may be at any of the loop's three instructions
+    for (int offset = 0; offset <= 4; offset += 2) {
+        int start = this->pc - offset;
+
+        if (start < 0 || start + 5 >= static_cast<int>(this->memory.size())) {
+            continue;
+        }
+
+        uint8_t reg = this->memory[start] & 0x0F;
+
+        if ((this->memory[start] & 0xF0) != 0xF0 || this->memory[start + 1] != 0x07) {
+            // Fx07 - LD Vx, DT
+            continue;
+        }
+        if (this->memory[start + 2] != (0x30 | reg) || this->memory[start + 3] != 0x00) {
+            // 3x00 - SE Vx, 0
+            continue;
+        }
+        if (this->memory[start + 4] != (0x10 | (start >> 8)) || this->memory[start + 5] != (start & 0xFF)) {
+            // 1nnn - JP back to the start of the loop
+            continue;
+        }
+
+        if (this->registers[reg] != dt) {
+            // DT changed since the Fx07 was last executed, so the next
+            // iteration is not a no-op
+            continue;
+        }
+
+        return start;
+    }
+
+    return -1;
+}
+
+void CPU::draw_sprite(uint8_t x, uint8_t y, uint8_t n) {
+    // Up to 32 bytes for each plane, wrapping around the end of memory
+    uint8_t data[32 * Display::PLANES];
+    int length = std::popcount(this->display.get_selected_planes()) * (n == 0 ? 32 : n);
+
+    for (int i = 0; i < length; ++i) {
+        data[i] = this->memory[(this->i + i) & CPU::ADDRESS_MASK];
+    }
+
+    this->registers[0xF] = this->display.draw_sprite(x, y, data, n) ? 1 : 0;
+
+    if (this->input_observed && std::any_of(data, data + length, [](uint8_t byte) { return byte != 0; })) {
+        // The sprite toggled pixels, so this is the reaction to the input
+        this->input_latency.drawn.add(latency_since(this->observed_input));
+        this->input_observed = false;
+
+        // Keep an older draw the frontend has not taken yet
+        uint64_t expected = 0;
+        std::atomic_ref<uint64_t>(this->drawn_input).compare_exchange_strong(expected, this->observed_input, std::memory_order_release);
+    }
+}
+
+void CPU::skip() {
+    uint16_t next = this->pc + 2;
+
+    if (this->memory[next & CPU::ADDRESS_MASK] == 0xF0 && this->memory[(next + 1) & CPU::ADDRESS_MASK] == 0x00) {
+        this->pc += 4;
+    } else {
+        this->pc += 2;
+    }
+}
+
+uint8_t CPU::random_byte() {
+    // xorshift32
+    this->rng ^= this->rng << 13;
+    this->rng ^= this->rng >> 17;
+    this->rng ^= this->rng << 5;
+
+    return this->rng >> 24;
+}
+
+void CPU::seed(uint32_t seed) {
+    this->rng = seed != 0 ? seed : CPU::DEFAULT_SEED;
+}
+
+/// Check whether a halt other than Halt::KEY_WAIT may start at an instruction.
+///
+/// Only `00FD`, jumps and the `Fx07` and `3x00` of a delay timer polling loop
+/// can be, see CPU::get_halt().
+///
+/// \param instruction The instruction.
+///
+/// \return Whether the instruction needs a closer look.
+static bool may_halt(uint16_t instruction) {
+    return instruction == 0x00FD || (instruction & 0xF000) == 0x1000
+        || (instruction & 0xF0FF) == 0xF007 || (instruction & 0xF0FF) == 0x3000;
+}
+
+CPU::Halt CPU::get_halt() const {
+    return this->get_halt(this->fetch());
+}
+
+CPU::Halt CPU::get_halt(uint16_t instruction) const {
+    if (this->key_wait_register != 0xFF && this->input.empty()) {
+        return Halt::KEY_WAIT;
+    }
+
+    if (!may_halt(instruction)) {
+        return Halt::NONE;
+    }
+
+    if (instruction == 0x00FD || (this->pc <= 0x0FFF && instruction == (0x1000 | this->pc))) {
+        return Halt::JUMP_SELF;
+    }
+
+    if (this->timer_loop_start() >= 0) {
+        return Halt::TIMER_WAIT;
+    }
+
+    return Halt::NONE;
+}
+
+unsigned CPU::run(unsigned max_steps) {
+    unsigned steps = 0;
+
+    this->process_input();
+
+    while (steps < max_steps) {
+        if (this->key_wait_register != 0xFF) {
+            if (this->input.empty()) {
+                // Halt::KEY_WAIT
+                break;
+            }
+
+            // Pending key events may resume the CPU, which step() takes care of
+            this->step();
+            ++steps;
+            continue;
+        }
+
+        if (!this->input.empty()) {
+            this->process_input();
+        }
+
+        uint16_t instruction = this->fetch();
+        Halt halt = may_halt(instruction) ? this->get_halt(instruction) : Halt::NONE;
+
+        if (halt == Halt::JUMP_SELF) {
+            break;
+        }
+
+        if (halt == Halt::TIMER_WAIT) {
+            // Every iteration leaves the state unchanged, apart from the
+            // position within the loop. Skip straight to where the remaining
+            // steps would have ended up.
+            int start = this->timer_loop_start();
+            unsigned position = (this->pc - start) / 2 + (max_steps - steps);
+
+            this->pc = start + 2 * (position % 3);
+
+            return max_steps;
+        }
+
+        this->execute(instruction);
+        ++steps;
+    }
+
+    return steps;
+}
+
+uint16_t CPU::fetch() const {
+    uint16_t instruction = this->memory[this->pc & CPU::ADDRESS_MASK] << 8;
+    instruction |= this->memory[(this->pc + 1) & CPU::ADDRESS_MASK];
+
+    return instruction;
 }
 
 void CPU::step() {
+    if (!this->input.empty()) {
+        this->process_input();
+    }
+
     if (this->key_wait_register != 0xFF) {
         // Currently waiting for a key press
         return;
     }
 
-    uint16_t instruction = this->memory[this->pc] << 8;
-    instruction |= this->memory[this->pc + 1];
+    this->execute(this->fetch());
+}
 
+void CPU::execute(uint16_t instruction) {
     if (instruction == 0x00E0) {
         // CLS - clear screen
         this->display.clear();
+    } else if ((instruction & 0xFFF0) == 0x00C0) {
+        // SCD n - Scroll down by n rows (SUPER-CHIP)
+        this->display.scroll_down(instruction & 0x000F);
+    } else if ((instruction & 0xFFF0) == 0x00D0) {
+        // SCU n - Scroll up by n rows (XO-CHIP)
+        this->display.scroll_up(instruction & 0x000F);
+    } else if (instruction == 0x00FB) {
+        // SCR - Scroll right by 4 pixels (SUPER-CHIP)
+        this->display.scroll_right();
+    } else if (instruction == 0x00FC) {
+        // SCL - Scroll left by 4 pixels (SUPER-CHIP)
+        this->display.scroll_left();
+    } else if (instruction == 0x00FD) {
+        // EXIT - Stop the interpreter (SUPER-CHIP)
+        return; // Prevent PC increment, see Halt::JUMP_SELF
+    } else if (instruction == 0x00FE) {
+        // LOW - Switch to low resolution (SUPER-CHIP)
+        this->display.set_hires(false);
+    } else if (instruction == 0x00FF) {
+        // HIGH - Switch to high resolution (SUPER-CHIP)
+        this->display.set_hires(true);
     } else if (instruction == 0x00EE) {
         // RET - return from subroutine
         uint16_t addr = this->pop();
@@ -178,7 +482,7 @@ void CPU::step() {
         uint8_t value = instruction & 0x00FF;
 
         if (this->registers[reg] == value) {
-            this->pc += 2;
+            this->skip();
         }
     } else if ((instruction & 0xF000) == 0x4000) {
         // SNE Vx, yy - Skip next instruction if Vx != yy
@@ -186,7 +490,7 @@ void CPU::step() {
         uint8_t value = instruction & 0x00FF;
 
         if (this->registers[reg] != value) {
-            this->pc += 2;
+            this->skip();
         }
     } else if ((instruction & 0xF00F) == 0x5000) {
         // SNE Vx, Vy - Skip next instruction if Vx == yy
@@ -194,7 +498,27 @@ void CPU::step() {
         uint8_t reg2 = (instruction & 0x00F0) >> 4;
 
         if (this->registers[reg1] == this->registers[reg2]) {
-            this->pc += 2;
+            this->skip();
+        }
+    } else if ((instruction & 0xF00F) == 0x5002) {
+        // LD [I], Vx - Vy - Store registers Vx through Vy to memory starting at address I (XO-CHIP)
+        //
+        // I is left unchanged, and the registers are stored in reverse if x > y
+        uint8_t reg1 = (instruction & 0x0F00) >> 8;
+        uint8_t reg2 = (instruction & 0x00F0) >> 4;
+        int direction = reg1 <= reg2 ? 1 : -1;
+
+        for (int n = 0; n <= std::abs(reg2 - reg1); ++n) {
+            this->memory[(this->i + n) & CPU::ADDRESS_MASK] = this->registers[reg1 + direction * n];
+        }
+    } else if ((instruction & 0xF00F) == 0x5003) {
+        // LD Vx - Vy, [I] - Load registers Vx through Vy from memory starting at address I (XO-CHIP)
+        uint8_t reg1 = (instruction & 0x0F00) >> 8;
+        uint8_t reg2 = (instruction & 0x00F0) >> 4;
+        int direction = reg1 <= reg2 ? 1 : -1;
+
+        for (int n = 0; n <= std::abs(reg2 - reg1); ++n) {
+            this->registers[reg1 + direction * n] = this->memory[(this->i + n) & CPU::ADDRESS_MASK];
         }
     } else if ((instruction & 0xF000) == 0x6000) {
         // LD Vx, yy - Load immediate to register
@@ -304,7 +628,7 @@ void CPU::step() {
         uint8_t reg2 = (instruction & 0x00F0) >> 4;
 
         if (this->registers[reg1] != this->registers[reg2]) {
-            this->pc += 2;
+            this->skip();
         }
     } else if ((instruction & 0xF000) == 0xA000) {
         // LD I, nnn - Load immediate to I
@@ -321,48 +645,48 @@ void CPU::step() {
         uint8_t reg = (instruction & 0x0F00) >> 8;
         uint16_t mask = instruction & 0x00FF;
 
-        // Randomness slightly biased towards lower numbers due to the modulo
-        // This is acceptable
-        this->registers[reg] = (std::rand() % 256) & mask;
+        this->registers[reg] = this->random_byte() & mask;
     } else if ((instruction & 0xF000) == 0xD000) {
-        // DRW Vx, Vy, n - Draw n bytes of sprite at I to x, y
+        // DRW Vx, Vy, n - Draw n bytes of sprite at I to x, y, or a 16x16 sprite if n is 0
         uint8_t x_reg = (instruction & 0x0F00) >> 8;
         uint8_t y_reg = (instruction & 0x00F0) >> 4;
         uint8_t n = instruction & 0x000F;
 
-        uint8_t x = this->registers[x_reg];
-        uint8_t y = this->registers[y_reg];
-
-        bool flag = false;
-
-        for (int i = 0; i < n; ++i) {
-            uint8_t data = this->memory[this->i + i];
-            if (this->display.draw_byte(x, (y + i) % Display::HEIGHT, data)) {
-                flag = true;
-            }
-        }
-
-        this->registers[0xF] = flag ? 1 : 0;
+        this->draw_sprite(this->registers[x_reg], this->registers[y_reg], n);
     } else if ((instruction & 0xF0FF) == 0xE09E) {
         // SKP Vx - Skip next instruction if the key in Vx is pressed
         uint8_t reg = (instruction & 0x0F00) >> 8;
 
         uint8_t key = this->registers[reg] & 0x0F;
-        if (this->is_key_down(key)) {
-            this->pc += 2;
+        if (this->read_key(key)) {
+            this->skip();
         }
     } else if ((instruction & 0xF0FF) == 0xE0A1) {
         // SKNP Vx - Skip next instruction if the key in Vx is NOT pressed
         uint8_t reg = (instruction & 0x0F00) >> 8;
 
-        if (!this->is_key_down(this->registers[reg] & 0x0F)) {
-            this->pc += 2;
+        if (!this->read_key(this->registers[reg] & 0x0F)) {
+            this->skip();
+        }
+    } else if (instruction == 0xF000) {
+        // LD I, nnnn - Load the following 16 bits to I (XO-CHIP)
+        this->i = this->memory[(this->pc + 2) & CPU::ADDRESS_MASK] << 8;
+        this->i |= this->memory[(this->pc + 3) & CPU::ADDRESS_MASK];
+
+        this->pc += 2;
+    } else if ((instruction & 0xF0FF) == 0xF001) {
+        // PLANE n - Select the planes to draw to (XO-CHIP)
+        this->display.select_planes((instruction & 0x0F00) >> 8);
+    } else if (instruction == 0xF002) {
+        // AUDIO - Load the audio pattern from memory at I (XO-CHIP)
+        for (size_t n = 0; n < this->audio_pattern.size(); ++n) {
+            this->audio_pattern[n] = this->memory[(this->i + n) & CPU::ADDRESS_MASK];
         }
     } else if ((instruction & 0xF0FF) == 0xF007) {
         // LD Vx, DT - Store the value of DT in Vx
         uint8_t reg = (instruction & 0x0F00) >> 8;
 
-        this->registers[reg] = this->dt;
+        this->registers[reg] = timer(this->dt).load(std::memory_order_relaxed);
     } else if ((instruction & 0xF0FF) == 0xF00A) {
         // LD Vx, K - Wait for a key press and store the pressed key in Vx
         uint8_t reg = (instruction & 0x0F00) >> 8;
@@ -372,12 +696,12 @@ void CPU::step() {
         // LD DT, Vx - Store the value of Vx in DT
         uint8_t reg = (instruction & 0x0F00) >> 8;
 
-        this->dt = this->registers[reg];
+        timer(this->dt).store(this->registers[reg], std::memory_order_relaxed);
     } else if ((instruction & 0xF0FF) == 0xF018) {
         // LD ST, Vx - Store the value of Vx in ST
         uint8_t reg = (instruction & 0x0F00) >> 8;
 
-        this->st = this->registers[reg];
+        timer(this->st).store(this->registers[reg], std::memory_order_relaxed);
     } else if ((instruction & 0xF0FF) == 0xF01E) {
         // ADD I, Vx - Add Vx to I
         uint8_t reg = (instruction & 0x0F00) >> 8;
@@ -392,21 +716,32 @@ void CPU::step() {
         uint8_t character = this->registers[reg] & 0x0F;
 
         this->i = CPU::FONT_OFFSET + 5 * character;
+    } else if ((instruction & 0xF0FF) == 0xF030) {
+        // LD HF, Vx - Set I to the address of big font character Vx (SUPER-CHIP)
+        uint8_t reg = (instruction & 0x0F00) >> 8;
+        uint8_t character = this->registers[reg] & 0x0F;
+
+        this->i = CPU::BIG_FONT_OFFSET + 10 * character;
     } else if ((instruction & 0xF0FF) == 0xF033) {
         // LD B, Vx - Set memory locations at I, I+1, and I+2 to the BCD representation of Vx
 
         uint8_t reg = (instruction & 0x0F00) >> 8;
 
-        this->memory[this->i] = (this->registers[reg] / 100) % 10;
-        this->memory[this->i + 1] = (this->registers[reg] / 10) % 10;
-        this->memory[this->i + 2] = this->registers[reg] % 10;
+        this->memory[this->i & CPU::ADDRESS_MASK] = (this->registers[reg] / 100) % 10;
+        this->memory[(this->i + 1) & CPU::ADDRESS_MASK] = (this->registers[reg] / 10) % 10;
+        this->memory[(this->i + 2) & CPU::ADDRESS_MASK] = this->registers[reg] % 10;
+    } else if ((instruction & 0xF0FF) == 0xF03A) {
+        // PITCH Vx - Set the pitch of the audio pattern (XO-CHIP)
+        uint8_t reg = (instruction & 0x0F00) >> 8;
+
+        this->pitch = this->registers[reg];
     } else if ((instruction & 0xF0FF) == 0xF055) {
         // LD [I], Vx - Store registers V0 through Vx to memory starting at address I
 
         uint8_t max_reg = (instruction & 0x0F00) >> 8;
 
         for (int i = 0; i <= max_reg; ++i) {
-            this->memory[this->i++] = this->registers[i];
+            this->memory[this->i++ & CPU::ADDRESS_MASK] = this->registers[i];
         }
     } else if ((instruction & 0xF0FF) == 0xF065) {
         // LD Vx, [I] - Load registers V0 through Vx from memory starting at address I
@@ -414,8 +749,18 @@ void CPU::step() {
         uint8_t max_reg = (instruction & 0x0F00) >> 8;
 
         for (int i = 0; i <= max_reg; ++i) {
-            this->registers[i] = this->memory[this->i++];
+            this->registers[i] = this->memory[this->i++ & CPU::ADDRESS_MASK];
         }
+    } else if ((instruction & 0xF0FF) == 0xF075) {
+        // LD R, Vx - Store registers V0 through Vx in the flag registers (SUPER-CHIP)
+        uint8_t max_reg = (instruction & 0x0F00) >> 8;
+
+        std::copy(this->registers, this->registers + max_reg + 1, this->flags);
+    } else if ((instruction & 0xF0FF) == 0xF085) {
+        // LD Vx, R - Load registers V0 through Vx from the flag registers (SUPER-CHIP)
+        uint8_t max_reg = (instruction & 0x0F00) >> 8;
+
+        std::copy(this->flags, this->flags + max_reg + 1, this->registers);
     }
 
     this->pc += 2;
@@ -1,46 +1,157 @@
 #pragma once
 
 #include "display.h"
+#include "input.h"
 
-#include<array>
-#include <atomic>
+#include <array>
+#include <stddef.h>
 #include <stdint.h>
 
+#ifndef CHIP8_MEMORY_SIZE
+/// Size of the CPU's memory in bytes. XO-CHIP ROMs may need up to 65536, at
+/// the cost of larger snapshots and instances.
+#define CHIP8_MEMORY_SIZE 4096
+#endif
+
 /// Main CHIP-8 implementation.
 ///
-/// Responsible for fetching and executing instructions.
-class CPU {
+/// Responsible for fetching and executing instructions. Besides the original
+/// instruction set, the SUPER-CHIP and XO-CHIP extensions are supported.
+///
+/// The state is laid out so that everything touched by most instructions
+/// shares the first cache line, followed by memory and the display. The CPU is
+/// trivially copyable, so snapshots are plain memory copies.
+class alignas(64) CPU {
     private:
-        /// Display containing the video memory.
-        Display display;
+        // --- Hot state, in the first cache line ---
 
-        /// Internal memory, visible to the running ROM.
-        std::array<uint8_t, 4096> memory;
+        /// Program counter.
+        uint16_t pc = CPU::INITIAL_PC;
+
+        /// Index register.
+        uint16_t i = 0;
 
-        /// Array of keys, indicating whether the corresponding key is pressed.
-        bool keys[16];
+        /// Stack pointer.
+        uint8_t sp = 0;
 
         /// When waiting for a key, this attribute indicates which register the pressed key should be written to.
         /// \note Using 0xFF as a special "not waiting" value
         uint8_t key_wait_register = 0xFF;
 
+        /// Delay timer register.
+        ///
+        /// \important Ticked from a different thread, only access through `std::atomic_ref`.
+        uint8_t dt = 0;
+
+        /// Sound timer register.
+        ///
+        /// \important Ticked from a different thread, only access through `std::atomic_ref`.
+        uint8_t st = 0;
+
         /// State of the CPU registers.
-        uint8_t registers[16];
+        uint8_t registers[16]{};
 
-        /// Program counter.
-        uint16_t pc = CPU::INITIAL_PC;
+        /// Bitmask of keys, bit n indicating whether key n is pressed.
+        uint16_t keys = 0;
 
-        /// Stack pointer.
-        uint8_t sp = 0;
+        /// State of the random number generator used by `Cxnn` (xorshift32).
+        ///
+        /// Kept per CPU, so that execution is fully determined by the CPU's
+        /// state and its inputs. Never zero.
+        uint32_t rng = CPU::DEFAULT_SEED;
 
-        /// Index register.
-        uint16_t i = 0;
+        // --- Cold state ---
 
-        /// Delay timer register.
-        std::atomic<uint8_t> dt = 0;
+        /// Internal memory, visible to the running ROM.
+        alignas(64) std::array<uint8_t, CHIP8_MEMORY_SIZE> memory{};
 
-        /// Sound timer register.
-        std::atomic<uint8_t> st = 0;
+        /// Display containing the video memory.
+        alignas(64) Display display;
+
+        /// Persistent flag registers of SUPER-CHIP (`Fx75` and `Fx85`).
+        uint8_t flags[16]{};
+
+        /// Audio pattern of XO-CHIP (`F002`), one bit per sample.
+        std::array<uint8_t, 16> audio_pattern{};
+
+        /// Playback rate of the audio pattern (`Fx3A`), see get_pitch().
+        uint8_t pitch = CPU::DEFAULT_PITCH;
+
+        /// Key events queued from other threads, applied before the next instruction.
+        alignas(64) InputQueue input;
+
+        /// Latency of key events at every stage up to being drawn.
+        InputLatency input_latency;
+
+        /// When each key's latest event not yet read by the ROM occurred.
+        uint64_t unobserved_inputs[16]{};
+
+        /// Bitmask of keys with an event in #unobserved_inputs.
+        uint16_t unobserved_keys = 0;
+
+        /// Whether an event was read by the ROM, but not yet reacted to with
+        /// a draw.
+        bool input_observed = false;
+
+        /// When the event in #input_observed occurred.
+        uint64_t observed_input = 0;
+
+        /// When the event behind the latest draw not yet taken by
+        /// take_drawn_input() occurred, or 0 if there is none.
+        ///
+        /// \important Read from a different thread, only access through `std::atomic_ref`.
+        uint64_t drawn_input = 0;
+
+        /// Find the delay timer polling loop the CPU is currently spinning in.
+        ///
+        /// Such a loop consists of `Fx07`, `3x00` and a `1nnn` jumping back to
+        /// the `Fx07`. Once Vx holds the current (non-zero) value of DT, every
+        /// further iteration leaves the state unchanged until DT changes.
+        ///
+        /// \return Address of the loop's `Fx07`, or -1 if the CPU is not
+        /// currently spinning in such a loop.
+        int timer_loop_start() const;
+
+        /// Draw a sprite from memory at I to the display, setting VF on collision.
+        ///
+        /// The sprite data of all selected planes follows each other in memory.
+        ///
+        /// \param x X position of the sprite.
+        /// \param y Y position of the sprite.
+        /// \param n Height of the sprite in bytes, or 0 for a 16x16 sprite.
+        void draw_sprite(uint8_t x, uint8_t y, uint8_t n);
+
+        /// Read the state of a key for `Ex9E` or `ExA1`, recording the latency
+        /// of its latest event if it was not read before.
+        ///
+        /// \param key Which key to read. (0x0 - 0xF)
+        ///
+        /// \return True if the key is being pressed.
+        bool read_key(uint8_t key);
+
+        /// Record the latency of a key's latest event being read by the ROM.
+        ///
+        /// \param key Which key was read. (0x0 - 0xF)
+        void observe_input(uint8_t key);
+
+        /// Skip the next instruction, which may be the 4 byte `F000 nnnn`.
+        void skip();
+
+        /// Load the instruction at PC.
+        uint16_t fetch() const;
+
+        /// Execute an instruction, fetched from PC.
+        ///
+        /// \param instruction The instruction.
+        void execute(uint16_t instruction);
+
+        /// Generate a random byte for `Cxnn`, advancing #rng.
+        uint8_t random_byte();
+
+        friend class Decoder;
+        friend class Engine;
+        friend class SaveState;
+        friend class StateHash;
 
     public:
         /// Static font data.
@@ -65,9 +176,29 @@ class CPU {
             0xF0, 0x80, 0xF0, 0x80, 0x80, // F
         };
 
+        /// Static font data of SUPER-CHIP and XO-CHIP, 8x10 pixels per digit (`Fx30`).
+        ///
+        /// Copied into the CPU's memory when the CPU is created.
+        static constexpr std::array<uint8_t, 160> BIG_FONT = {
+            0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+            0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+            0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+            0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+            0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+            0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+            0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+            0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+            0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+            0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+            0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+            0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+            0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+            0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+            0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+            0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0, // F
+        };
+
         CPU();
-        CPU(const CPU &other);
-        CPU& operator=(CPU other);
 
         /// Load code into the CPU's memory.
         ///
@@ -82,9 +213,59 @@ class CPU {
         /// \return Whether the load was successful.
         bool load_code_from_file(const char *path);
 
+        /// Reasons for which the CPU cannot make progress on its own.
+        enum class Halt : uint8_t {
+            /// Not halted, execution continues normally.
+            NONE,
+
+            /// Waiting for a key press (`Fx0A`). Only a key event can resume
+            /// execution. Not reported while queued key events are pending.
+            KEY_WAIT,
+
+            /// Stuck in a jump to its own address (`1nnn`), or exited (`00FD`).
+            /// Execution can never resume, although the timers keep running.
+            JUMP_SELF,
+
+            /// Spinning in a loop polling the delay timer. Nothing changes
+            /// until the next timer tick.
+            TIMER_WAIT,
+        };
+
         /// Execute the next instruction
         void step();
 
+        /// Execute up to the given number of instructions, stopping early if
+        /// the CPU halts.
+        ///
+        /// When spinning in a delay timer polling loop (Halt::TIMER_WAIT), the
+        /// remaining instructions are skipped without being executed, leaving
+        /// the CPU in the same state as actually executing them would.
+        ///
+        /// \param max_steps Maximum number of instructions to execute.
+        ///
+        /// \return Number of instructions executed or skipped.
+        unsigned run(unsigned max_steps);
+
+        /// Returns whether, and why, the CPU is currently halted.
+        ///
+        /// A halted CPU does not need to be stepped until the reason for the
+        /// halt is resolved. See Halt for details.
+        ///
+        /// \return The reason for the halt, or Halt::NONE.
+        Halt get_halt() const;
+
+        /// Like get_halt(), for an instruction already fetched from PC.
+        ///
+        /// Only `00FD`, jumps and the instructions of a delay timer polling
+        /// loop can be where a halt starts, so other instructions are rejected
+        /// without looking any further, and without fetching again. Cheap
+        /// enough to call before every instruction.
+        ///
+        /// \param instruction The instruction at PC.
+        ///
+        /// \return The reason for the halt, or Halt::NONE.
+        Halt get_halt(uint16_t instruction) const;
+
         /// Push a value onto the stack.
         ///
         /// \param val Value to be pushed.
@@ -95,11 +276,26 @@ class CPU {
         /// \return The popped value.
         uint8_t pop();
 
+        /// Seed the random number generator used by `Cxnn`.
+        ///
+        /// CPUs with the same state, seed and inputs behave identically.
+        ///
+        /// \param seed The seed. Zero is replaced with DEFAULT_SEED.
+        void seed(uint32_t seed);
+
         /// Tick the timers.
         ///
         /// Should be called at a frequency of 60 Hz.
         void tick_timers();
 
+        /// Tick the timers several times at once.
+        ///
+        /// Equivalent to calling tick_timers() `ticks` times. Used to catch up
+        /// on timers of a CPU that has not been scheduled for a while.
+        ///
+        /// \param ticks Number of ticks to apply.
+        void tick_timers(unsigned ticks);
+
         /// Set the key state of a given key.
         ///
         /// Should be called whenever a key is pressed or released.
@@ -108,6 +304,51 @@ class CPU {
         /// \param down Whether the key was pressed (true) or released (false).
         void set_key_down(uint8_t key, bool down);
 
+        /// Set the state of all keys at once.
+        ///
+        /// Equivalent to calling set_key_down() for every key whose state
+        /// changed, in ascending order.
+        ///
+        /// \param keys Bitmask of pressed keys, bit n indicating key n.
+        void set_keys(uint16_t keys);
+
+        /// Queue a key event from a different thread.
+        ///
+        /// The event is applied at the next instruction boundary by the thread
+        /// running the CPU. Only one thread may queue events at a time.
+        ///
+        /// \param key Which key's state has changed. (0x0 - 0xF)
+        /// \param down Whether the key was pressed (true) or released (false).
+        /// \param timestamp When the event occurred, in nanoseconds since the
+        /// epoch of `std::chrono::steady_clock`. Used for latency statistics.
+        ///
+        /// \return False if too many events are pending and the event was dropped.
+        bool queue_key_event(uint8_t key, bool down, uint64_t timestamp);
+
+        /// Apply all queued key events.
+        ///
+        /// Called automatically by step() and run().
+        void process_input();
+
+        /// Get statistics about the latency of queued key events.
+        ///
+        /// Should be called from the thread running the CPU.
+        ///
+        /// \return Latency statistics of all events applied so far. The
+        /// presented stage is left empty, as only the frontend knows when
+        /// frames are shown.
+        InputLatency get_input_latency() const;
+
+        /// Take the key event behind the latest draw reacting to input.
+        ///
+        /// May be called from a different thread, before reading the frame
+        /// to be presented. The frame then contains the draw, so the time from
+        /// the returned timestamp to presenting the frame is its latency.
+        ///
+        /// \return When the event occurred, or 0 if no draw reacted to input
+        /// since the last call.
+        uint64_t take_drawn_input();
+
         /// Returns whether the given key is currently being pressed.
         ///
         /// \return True if the key is being pressed.
@@ -120,7 +361,7 @@ class CPU {
 
         /// Read a value from the CPUs memory;
         ///
-        /// \param addr Address to read. (0x0000 - 0x0FFF)
+        /// \param addr Address to read, wrapped to the size of memory.
         /// 
         /// \return Value at the given address.
         uint8_t read_memory(uint16_t addr) const;
@@ -157,9 +398,41 @@ class CPU {
         /// \return True if ST > 0
         bool is_sound_playing() const;
 
+        /// Get the XO-CHIP audio pattern played while sound is playing.
+        ///
+        /// \return 128 one-bit samples, the most significant bit of each byte first.
+        std::array<uint8_t, 16> get_audio_pattern() const;
+
+        /// Get the XO-CHIP pitch of the audio pattern.
+        ///
+        /// \return The pitch. Samples are played at `4000 * 2^((pitch - 64) / 48)` Hz.
+        uint8_t get_pitch() const;
+
+        /// Number of instructions executed per 60 Hz frame when running in
+        /// lockstep with the timers, giving the roughly 700 Hz most ROMs expect.
+        static constexpr unsigned STEPS_PER_FRAME = 12;
+
+        /// Pitch of the audio pattern of a newly created CPU, playing at 4000 Hz.
+        static constexpr uint8_t DEFAULT_PITCH = 64;
+
+        /// Seed of the random number generator of a newly created CPU.
+        static constexpr uint32_t DEFAULT_SEED = 0x2545F491;
+
         /// Initial value of the program counter.
         static constexpr uint16_t INITIAL_PC = 0x200;
 
         /// Offset at which the font is loaded.
         static constexpr uint16_t FONT_OFFSET = 0;
+
+        /// Offset at which the big font is loaded, right after the font.
+        static constexpr uint16_t BIG_FONT_OFFSET = 0x50;
+
+        /// Size of the CPU's memory in bytes, see CHIP8_MEMORY_SIZE.
+        static constexpr size_t MEMORY_SIZE = CHIP8_MEMORY_SIZE;
+
+        /// Mask applied to addresses accessed through I.
+        static constexpr uint16_t ADDRESS_MASK = CPU::MEMORY_SIZE - 1;
+
+        static_assert(CPU::MEMORY_SIZE >= 4096 && CPU::MEMORY_SIZE <= 65536 && (CPU::MEMORY_SIZE & (CPU::MEMORY_SIZE - 1)) == 0,
+            "Memory size should be a power of two between 4096 and 65536");
 };
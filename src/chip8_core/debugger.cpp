@@ -0,0 +1,155 @@
+#include "debugger.h"
+
+#include <bit>
+#include <cstdlib>
+
+void Debugger::set_breakpoint(uint16_t addr, bool enabled) {
+    addr &= CPU::ADDRESS_MASK;
+
+    if (this->breakpoints[addr] != enabled) {
+        this->breakpoints[addr] = enabled;
+        this->breakpoint_count += enabled ? 1 : -1;
+    }
+}
+
+void Debugger::set_watchpoint(uint16_t addr, uint16_t length, uint8_t access) {
+    access &= Access::READ_WRITE;
+
+    for (uint16_t n = 0; n < length && addr + n < CPU::MEMORY_SIZE; ++n) {
+        uint8_t &watched = this->watchpoints[addr + n];
+
+        if (watched == 0 && access != 0) {
+            this->watchpoint_count += 1;
+        } else if (watched != 0 && access == 0) {
+            this->watchpoint_count -= 1;
+        }
+
+        watched = access;
+    }
+}
+
+void Debugger::clear() {
+    this->breakpoints.reset();
+    this->watchpoints.fill(0);
+    this->breakpoint_count = 0;
+    this->watchpoint_count = 0;
+}
+
+bool Debugger::is_active() const {
+    return this->breakpoint_count > 0 || this->watchpoint_count > 0;
+}
+
+Debugger::Stop Debugger::check(const CPU &cpu) const {
+    uint16_t pc = cpu.get_pc();
+
+    if (this->breakpoints[pc & CPU::ADDRESS_MASK]) {
+        return Stop {
+            .reason = StopReason::BREAKPOINT,
+            .pc = pc,
+        };
+    }
+
+    if (this->watchpoint_count == 0) {
+        return Stop { .pc = pc };
+    }
+
+    uint16_t instruction = cpu.read_memory(pc) << 8 | cpu.read_memory(pc + 1);
+
+    // Range of memory accessed by the instruction
+    uint16_t start = cpu.get_i();
+    uint16_t length = 0;
+    Access access = Access::READ;
+
+    if (instruction == 0x00EE) {
+        // RET pops the return address
+        start = 0x1FF - cpu.get_sp() + 1;
+        length = 2;
+    } else if ((instruction & 0xF000) == 0x2000) {
+        // CALL pushes the return address
+        start = 0x1FF - cpu.get_sp() - 1;
+        length = 2;
+        access = Access::WRITE;
+    } else if ((instruction & 0xF000) == 0xD000) {
+        // Sprite data of every selected plane, 32 bytes each for 16x16 sprites
+        uint16_t n = instruction & 0x000F;
+        length = std::popcount(cpu.get_display().get_selected_planes()) * (n == 0 ? 32 : n);
+    } else if ((instruction & 0xF00E) == 0x5002) {
+        // 5xy2 writes and 5xy3 reads Vx through Vy
+        length = std::abs(((instruction & 0x0F00) >> 8) - ((instruction & 0x00F0) >> 4)) + 1;
+        access = (instruction & 0x000F) == 0x2 ? Access::WRITE : Access::READ;
+    } else if (instruction == 0xF002) {
+        length = 16;
+    } else if ((instruction & 0xF0FF) == 0xF033) {
+        length = 3;
+        access = Access::WRITE;
+    } else if ((instruction & 0xF0FF) == 0xF055) {
+        length = ((instruction & 0x0F00) >> 8) + 1;
+        access = Access::WRITE;
+    } else if ((instruction & 0xF0FF) == 0xF065) {
+        length = ((instruction & 0x0F00) >> 8) + 1;
+    }
+
+    for (uint16_t n = 0; n < length; ++n) {
+        uint16_t addr = (start + n) & CPU::ADDRESS_MASK;
+
+        if (this->watchpoints[addr] & access) {
+            return Stop {
+                .reason = access == Access::WRITE ? StopReason::WATCH_WRITE : StopReason::WATCH_READ,
+                .pc = pc,
+                .addr = addr,
+            };
+        }
+    }
+
+    return Stop { .pc = pc };
+}
+
+Debugger::Stop Debugger::run(CPU &cpu, unsigned max_steps) const {
+    if (!this->is_active()) {
+        // Hot path, nothing to check
+        unsigned steps = cpu.run(max_steps);
+
+        return Stop {
+            .reason = steps < max_steps ? StopReason::HALT : StopReason::NONE,
+            .steps = steps,
+            .pc = cpu.get_pc(),
+        };
+    }
+
+    return this->run_checked(cpu, max_steps);
+}
+
+Debugger::Stop Debugger::run_checked(CPU &cpu, unsigned max_steps) const {
+    unsigned steps = 0;
+
+    cpu.process_input();
+
+    while (steps < max_steps) {
+        if (steps > 0) {
+            Stop stop = this->check(cpu);
+
+            if (stop.reason != StopReason::NONE) {
+                stop.steps = steps;
+                return stop;
+            }
+        }
+
+        CPU::Halt halt = cpu.get_halt();
+
+        if (halt == CPU::Halt::KEY_WAIT || halt == CPU::Halt::JUMP_SELF) {
+            return Stop {
+                .reason = StopReason::HALT,
+                .steps = steps,
+                .pc = cpu.get_pc(),
+            };
+        }
+
+        cpu.step();
+        ++steps;
+    }
+
+    return Stop {
+        .steps = steps,
+        .pc = cpu.get_pc(),
+    };
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "cpu.h"
+
+#include <array>
+#include <bitset>
+#include <stddef.h>
+#include <stdint.h>
+
+/// PC breakpoints and memory watchpoints for a CPU.
+///
+/// Watchpoints cover every memory access made by an instruction: the sprite
+/// read by `Dxyn`, the bytes written by `Fx33`, `Fx55` and `5xy2`, the bytes
+/// read by `Fx65`, `5xy3` and `F002`, and the return address pushed by `2nnn`
+/// or popped by `00EE`.
+/// Instruction fetches are only covered by breakpoints.
+///
+/// Hits are reported before the instruction causing them is executed. While
+/// no breakpoints or watchpoints are set, run() is exactly CPU::run(), so a
+/// debugger can stay attached to a live session at no cost.
+class Debugger {
+    public:
+        /// Kinds of access a watchpoint triggers on.
+        enum Access : uint8_t {
+            READ = 0x01,
+            WRITE = 0x02,
+            READ_WRITE = READ | WRITE,
+        };
+
+        /// Reasons for run() to return.
+        enum class StopReason : uint8_t {
+            /// The requested number of instructions was executed.
+            NONE,
+
+            /// The CPU halted, see CPU::Halt::KEY_WAIT and CPU::Halt::JUMP_SELF.
+            HALT,
+
+            /// The next instruction is at a breakpoint.
+            BREAKPOINT,
+
+            /// The next instruction reads a watched byte.
+            WATCH_READ,
+
+            /// The next instruction writes a watched byte.
+            WATCH_WRITE,
+        };
+
+        /// Result of check() or run().
+        struct Stop {
+            StopReason reason = StopReason::NONE;
+
+            /// Number of instructions executed before stopping.
+            unsigned steps = 0;
+
+            /// Address of the next instruction.
+            uint16_t pc = 0;
+
+            /// Address of the watched byte accessed, for watchpoint hits.
+            uint16_t addr = 0;
+        };
+
+    private:
+        /// Breakpoint addresses.
+        std::bitset<CPU::MEMORY_SIZE> breakpoints;
+
+        /// Watched accesses per address, as a combination of Access flags.
+        std::array<uint8_t, CPU::MEMORY_SIZE> watchpoints{};
+
+        /// Number of set bits in #breakpoints.
+        size_t breakpoint_count = 0;
+
+        /// Number of non-zero entries in #watchpoints.
+        size_t watchpoint_count = 0;
+
+        /// Implementation of run() while any breakpoints or watchpoints are set.
+        Stop run_checked(CPU &cpu, unsigned max_steps) const;
+
+    public:
+        /// Set or remove a breakpoint.
+        ///
+        /// \param addr Address of the instruction, wrapped to the size of memory.
+        /// \param enabled Whether to set (true) or remove (false) the breakpoint.
+        void set_breakpoint(uint16_t addr, bool enabled);
+
+        /// Set which accesses to a range of memory should stop execution.
+        ///
+        /// \param addr First address of the range.
+        /// \param length Number of bytes in the range.
+        /// \param access Accesses to watch, replacing any previously watched
+        /// accesses in the range. Zero removes the watchpoints.
+        void set_watchpoint(uint16_t addr, uint16_t length, uint8_t access);
+
+        /// Remove all breakpoints and watchpoints.
+        void clear();
+
+        /// Returns whether any breakpoints or watchpoints are set.
+        bool is_active() const;
+
+        /// Check whether the next instruction would hit a breakpoint or watchpoint.
+        ///
+        /// \param cpu The CPU about to execute the instruction.
+        ///
+        /// \return The hit, or a Stop with StopReason::NONE.
+        Stop check(const CPU &cpu) const;
+
+        /// Execute up to the given number of instructions, stopping early at
+        /// breakpoints, watchpoints or if the CPU halts.
+        ///
+        /// The instruction at the current PC is never checked, so calling run()
+        /// again after a hit resumes past it. Use check() to test it first.
+        /// While any breakpoints or watchpoints are set, delay timer polling
+        /// loops are executed rather than skipped.
+        ///
+        /// \param cpu The CPU to run.
+        /// \param max_steps Maximum number of instructions to execute.
+        ///
+        /// \return Why and where execution stopped.
+        Stop run(CPU &cpu, unsigned max_steps) const;
+};
@@ -0,0 +1,296 @@
+#include "decoder.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+/// Load the eight bytes of code at an address, the first at the most significant end.
+static uint64_t fetch(const std::array<uint8_t, CPU::MEMORY_SIZE> &memory, uint16_t pc) {
+    uint64_t code;
+    std::memcpy(&code, memory.data() + pc, sizeof(code));
+
+    if constexpr (std::endian::native == std::endian::little) {
+        code = __builtin_bswap64(code);
+    }
+
+    return code;
+}
+
+/// Get the nth instruction of some code, as returned by fetch().
+static uint16_t instruction(uint64_t code, int n) {
+    return (code >> (48 - 16 * n)) & 0xFFFF;
+}
+
+void Decoder::decode(Entry &entry, uint64_t code, uint16_t pc) {
+    uint16_t first = instruction(code, 0);
+    uint16_t second = instruction(code, 1);
+    uint16_t third = instruction(code, 2);
+
+    entry.code = code;
+    entry.kind = Kind::STEP;
+    entry.count = 1;
+    entry.length = 1;
+
+    // Instructions which CPU::timer_loop_start() may find the CPU at
+    entry.timer_loop = (first & 0xF0FF) == 0xF007 || (first & 0xF0FF) == 0x3000 || (first & 0xF000) == 0x1000;
+
+    switch (first >> 12) {
+        case 0x0:
+            if (first == 0x00FD) {
+                entry.kind = Kind::EXIT;
+            }
+            break;
+        case 0x1:
+            entry.kind = Kind::JP;
+            break;
+        case 0x3:
+        case 0x4:
+            // Skipping the 4 byte F000 nnnn is left to the CPU
+            entry.length = 2;
+            if (second != 0xF000) {
+                entry.kind = (first >> 12) == 0x3 ? Kind::SE : Kind::SNE;
+            }
+            break;
+        case 0x6:
+            while (entry.count < 4 && (instruction(code, entry.count) & 0xF000) == 0x6000) {
+                entry.count += 1;
+            }
+            entry.kind = entry.count > 1 ? Kind::LD_RUN : Kind::LD;
+            break;
+        case 0x7:
+            entry.kind = Kind::ADD;
+
+            // The jump must not be to itself, which would halt the CPU instead
+            if ((third & 0xF000) == 0x1000 && (third & 0x0FFF) != pc + 4) {
+                if ((second & 0xF000) == 0x3000) {
+                    entry.kind = Kind::ADD_SE_JP;
+                    entry.count = 3;
+                } else if ((second & 0xF000) == 0x4000) {
+                    entry.kind = Kind::ADD_SNE_JP;
+                    entry.count = 3;
+                }
+            }
+            break;
+        case 0xA:
+            if ((second & 0xF000) == 0xD000) {
+                entry.kind = Kind::LD_I_DRAW;
+                entry.count = 2;
+            } else {
+                entry.kind = Kind::LD_I;
+            }
+            break;
+        case 0xF:
+            if ((first & 0x00FF) == 0x1E && (second & 0xF0FF) == 0xF065) {
+                entry.kind = Kind::ADD_I_LOAD;
+                entry.count = 2;
+            }
+            break;
+    }
+
+    entry.length = std::max(entry.length, entry.count);
+}
+
+bool Decoder::matches(const Entry &entry, uint64_t code) {
+    return entry.kind != Kind::NONE && (entry.code ^ code) >> (64 - 16 * entry.length) == 0;
+}
+
+const Decoder::Entry& Decoder::private_entry(Overlay &overlay, uint64_t code, uint16_t pc) {
+    std::unique_ptr<Page> &page = overlay.pages[pc / Decoder::PAGE_SIZE];
+
+    if (page == nullptr) {
+        page = std::make_unique<Page>();
+    }
+
+    Entry &entry = (*page)[pc % Decoder::PAGE_SIZE];
+
+    if (!Decoder::matches(entry, code)) {
+        Decoder::decode(entry, code, pc);
+    }
+
+    return entry;
+}
+
+size_t Decoder::Overlay::get_pages() const {
+    return std::count_if(this->pages.begin(), this->pages.end(), [](const std::unique_ptr<Page> &page) {
+        return page != nullptr;
+    });
+}
+
+Decoder::Decoder(const CPU &cpu) {
+    for (size_t pc = CPU::INITIAL_PC; pc <= CPU::MEMORY_SIZE - 8; ++pc) {
+        Decoder::decode(this->entries[pc], fetch(cpu.memory, pc), pc);
+    }
+}
+
+unsigned Decoder::run(CPU &cpu, unsigned max_steps) {
+    return this->run(cpu, max_steps, this->overlay);
+}
+
+unsigned Decoder::run(CPU &cpu, unsigned max_steps, Overlay &overlay) const {
+    unsigned steps = 0;
+    uint8_t *v = cpu.registers;
+
+    cpu.process_input();
+
+    while (steps < max_steps) {
+        if (cpu.key_wait_register != 0xFF) {
+            if (cpu.input.empty()) {
+                // Halt::KEY_WAIT
+                break;
+            }
+
+            // Pending key events may resume the CPU, which CPU::step() takes care of
+            cpu.step();
+            ++steps;
+            continue;
+        }
+
+        if (!cpu.input.empty()) {
+            cpu.process_input();
+        }
+
+        uint16_t pc = cpu.pc;
+
+        if (pc > CPU::MEMORY_SIZE - 8) {
+            // Too close to the end of memory to decode, interpret exactly like CPU::run()
+            CPU::Halt halt = cpu.get_halt();
+
+            if (halt == CPU::Halt::TIMER_WAIT) {
+                cpu.run(max_steps - steps);
+                return max_steps;
+            } else if (halt != CPU::Halt::NONE) {
+                break;
+            }
+
+            cpu.step();
+            ++steps;
+            continue;
+        }
+
+        uint64_t code = fetch(cpu.memory, pc);
+
+        // Only use the shared entry while memory still holds the code it was decoded from
+        const Entry &entry = Decoder::matches(this->entries[pc], code) ? this->entries[pc] : Decoder::private_entry(overlay, code, pc);
+
+        if (entry.timer_loop && cpu.timer_loop_start() >= 0) {
+            // Halt::TIMER_WAIT, let the CPU skip the remaining steps
+            cpu.run(max_steps - steps);
+            return max_steps;
+        }
+
+        uint16_t op = code >> 48;
+        uint8_t x = (op & 0x0F00) >> 8;
+        uint8_t nn = op & 0x00FF;
+        uint16_t nnn = op & 0x0FFF;
+
+        if (entry.count > max_steps - steps) {
+            // Not enough steps left for the whole superinstruction. None of
+            // them start with an instruction that could halt.
+            cpu.step();
+            ++steps;
+            continue;
+        }
+
+        switch (entry.kind) {
+            case Kind::LD:
+                v[x] = nn;
+                cpu.pc += 2;
+                steps += 1;
+                break;
+            case Kind::ADD:
+                v[x] += nn;
+                cpu.pc += 2;
+                steps += 1;
+                break;
+            case Kind::LD_I:
+                cpu.i = nnn;
+                cpu.pc += 2;
+                steps += 1;
+                break;
+            case Kind::JP:
+                if (nnn == pc) {
+                    // Halt::JUMP_SELF
+                    return steps;
+                }
+
+                cpu.pc = nnn;
+                steps += 1;
+                break;
+            case Kind::EXIT:
+                // Halt::JUMP_SELF
+                return steps;
+            case Kind::SE:
+                cpu.pc += v[x] == nn ? 4 : 2;
+                steps += 1;
+                break;
+            case Kind::SNE:
+                cpu.pc += v[x] != nn ? 4 : 2;
+                steps += 1;
+                break;
+            case Kind::LD_RUN:
+                for (uint8_t n = 0; n < entry.count; ++n) {
+                    uint16_t ld = instruction(code, n);
+                    v[(ld & 0x0F00) >> 8] = ld & 0x00FF;
+                }
+
+                cpu.pc += 2 * entry.count;
+                steps += entry.count;
+                break;
+            case Kind::LD_I_DRAW: {
+                uint16_t draw = instruction(code, 1);
+
+                cpu.i = nnn;
+                cpu.draw_sprite(v[(draw & 0x0F00) >> 8], v[(draw & 0x00F0) >> 4], draw & 0x000F);
+                cpu.pc += 4;
+                steps += 2;
+                break;
+            }
+            case Kind::ADD_SE_JP:
+            case Kind::ADD_SNE_JP: {
+                uint16_t skip = instruction(code, 1);
+
+                v[x] += nn;
+
+                bool equal = v[(skip & 0x0F00) >> 8] == (skip & 0x00FF);
+                if (equal == (entry.kind == Kind::ADD_SE_JP)) {
+                    // Skips the jump
+                    cpu.pc += 6;
+                    steps += 2;
+                } else {
+                    cpu.pc = instruction(code, 2) & 0x0FFF;
+                    steps += 3;
+                }
+                break;
+            }
+            case Kind::ADD_I_LOAD: {
+                uint8_t max_reg = (instruction(code, 1) & 0x0F00) >> 8;
+
+                cpu.i += v[x];
+                for (int reg = 0; reg <= max_reg; ++reg) {
+                    v[reg] = cpu.memory[cpu.i++ & CPU::ADDRESS_MASK];
+                }
+
+                cpu.pc += 4;
+                steps += 2;
+                break;
+            }
+            default:
+                cpu.step();
+                steps += 1;
+                break;
+        }
+    }
+
+    return steps;
+}
+
+Decoder::Kind Decoder::get_kind(uint16_t addr) const {
+    addr &= CPU::ADDRESS_MASK;
+    const std::unique_ptr<Page> &page = this->overlay.pages[addr / Decoder::PAGE_SIZE];
+
+    if (page != nullptr && (*page)[addr % Decoder::PAGE_SIZE].kind != Kind::NONE) {
+        return (*page)[addr % Decoder::PAGE_SIZE].kind;
+    }
+
+    return this->entries[addr].kind;
+}
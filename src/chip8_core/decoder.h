@@ -0,0 +1,196 @@
+#pragma once
+
+#include "cpu.h"
+
+#include <array>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+
+/// Interpreter running from a cache of decoded instructions.
+///
+/// Each address is decoded once into an entry, fusing common sequences into
+/// superinstructions that execute in a single dispatch:
+///
+/// - runs of two to four `6xnn`
+/// - `Annn` followed by `Dxyn`
+/// - `7xnn`, `3xnn` or `4xnn`, `1nnn` (loop counters)
+/// - `Fx1E` followed by `Fy65` (table lookups)
+///
+/// Entries remember the code they were decoded from and are only used while
+/// memory still holds exactly that code, so self-modifying code is always
+/// correct without having to invalidate the cache.
+///
+/// A decoder can be built from a ROM image up front and then shared,
+/// read-only, by any number of instances and threads running that ROM. Code
+/// an instance finds different from the image, e.g. after modifying itself,
+/// is decoded into the instance's own Overlay, which only holds entries for
+/// the pages of memory where that happens. A decoder built empty decodes all
+/// code into overlays on demand.
+class Decoder {
+    public:
+        /// Number of addresses covered by a page of an Overlay.
+        static constexpr size_t PAGE_SIZE = 256;
+
+        /// Kinds of decoded entries.
+        enum class Kind : uint8_t {
+            /// Not decoded yet.
+            NONE,
+
+            /// Any instruction without a faster implementation, executed by CPU::step().
+            STEP,
+
+            /// `6xnn`
+            LD,
+
+            /// `7xnn`
+            ADD,
+
+            /// `Annn`
+            LD_I,
+
+            /// `1nnn`
+            JP,
+
+            /// `3xnn`
+            SE,
+
+            /// `4xnn`
+            SNE,
+
+            /// Two to four `6xnn`.
+            LD_RUN,
+
+            /// `Annn`, `Dxyn`
+            LD_I_DRAW,
+
+            /// `7xnn`, `3xnn`, `1nnn`
+            ADD_SE_JP,
+
+            /// `7xnn`, `4xnn`, `1nnn`
+            ADD_SNE_JP,
+
+            /// `Fx1E`, `Fy65`
+            ADD_I_LOAD,
+
+            /// `00FD`, halting the CPU like a jump to itself.
+            EXIT,
+        };
+
+    private:
+        /// A decoded instruction or superinstruction.
+        struct Entry {
+            /// The eight bytes of code at the entry's address when decoded,
+            /// the first at the most significant end.
+            uint64_t code = 0;
+
+            Kind kind = Kind::NONE;
+
+            /// Number of instructions covered by the entry.
+            uint8_t count = 0;
+
+            /// Number of instructions the entry depends on, at least #count.
+            /// Only these are compared against memory before use.
+            uint8_t length = 0;
+
+            /// Whether the first instruction may be part of a delay timer
+            /// polling loop, see CPU::Halt::TIMER_WAIT.
+            bool timer_loop = false;
+        };
+
+        /// Entries of a page of memory.
+        using Page = std::array<Entry, PAGE_SIZE>;
+
+    public:
+        /// Entries private to a single instance, for code which differs from
+        /// what its decoder was built from.
+        ///
+        /// Pages are allocated on first use, so an instance running the code
+        /// it shares with others needs none.
+        class Overlay {
+            friend class Decoder;
+
+            private:
+                /// Pages by number, nullptr where none is allocated.
+                std::array<std::unique_ptr<Page>, CPU::MEMORY_SIZE / PAGE_SIZE> pages;
+
+            public:
+                /// Number of pages allocated.
+                size_t get_pages() const;
+        };
+
+    private:
+        /// Entries by address, decoded from the ROM image the decoder was
+        /// built from. Never modified afterwards. Addresses too close to the
+        /// end of memory to hold eight bytes are never decoded.
+        std::array<Entry, CPU::MEMORY_SIZE> entries{};
+
+        /// Private entries used when running without an overlay.
+        Overlay overlay;
+
+        /// Decode the code at an address into its entry.
+        ///
+        /// \param entry The entry to fill.
+        /// \param code The eight bytes of code at the address.
+        /// \param pc The address.
+        static void decode(Entry &entry, uint64_t code, uint16_t pc);
+
+        /// Returns whether an entry was decoded from the given code.
+        static bool matches(const Entry &entry, uint64_t code);
+
+        /// Get the private entry for some code, decoding it if necessary.
+        ///
+        /// \param overlay The instance's private entries.
+        /// \param code The eight bytes of code at the address.
+        /// \param pc The address.
+        static const Entry& private_entry(Overlay &overlay, uint64_t code, uint16_t pc);
+
+    public:
+        /// Create an empty decoder, decoding all code on demand.
+        Decoder() = default;
+
+        /// Decode a ROM image up front, to share the decoder between all
+        /// instances running it.
+        ///
+        /// \param cpu A CPU with the ROM loaded. Code from CPU::INITIAL_PC to
+        /// the end of memory is decoded.
+        explicit Decoder(const CPU &cpu);
+
+        Decoder(const Decoder &other) = delete;
+        Decoder& operator=(const Decoder &other) = delete;
+
+        /// Execute up to the given number of instructions.
+        ///
+        /// Behaves exactly like CPU::run(), including stopping early on halts
+        /// and skipping delay timer polling loops. Queued key events are only
+        /// applied between (super)instructions.
+        ///
+        /// Does not modify the decoder, so instances may be run concurrently
+        /// as long as each has its own overlay.
+        ///
+        /// \param cpu The CPU to run.
+        /// \param max_steps Maximum number of instructions to execute.
+        /// \param overlay Private entries of the instance.
+        ///
+        /// \return Number of instructions executed or skipped.
+        unsigned run(CPU &cpu, unsigned max_steps, Overlay &overlay) const;
+
+        /// Execute up to the given number of instructions, with private
+        /// entries kept by the decoder itself. Must only be used by one thread
+        /// at a time, but several instances may take turns.
+        ///
+        /// \param cpu The CPU to run.
+        /// \param max_steps Maximum number of instructions to execute.
+        ///
+        /// \return Number of instructions executed or skipped.
+        unsigned run(CPU &cpu, unsigned max_steps);
+
+        /// Get the kind of entry decoded at an address, for tests and profiling.
+        ///
+        /// \param addr The address.
+        ///
+        /// \return The kind of the entry last used by run() without an
+        /// overlay, or else decoded from the ROM image, or Kind::NONE if
+        /// nothing was decoded at the address.
+        Kind get_kind(uint16_t addr) const;
+};
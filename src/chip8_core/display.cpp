@@ -1,47 +1,369 @@
 #include "display.h"
-#include <mutex>
 
-Display::Display(const Display &other) {
-    std::lock_guard<std::mutex> lock(other.lock);
+#include <atomic>
+#include <bit>
+#include <cstring>
 
-    std::copy(other.vram.begin(), other.vram.end(), this->vram.begin());
+/// A row of every plane, see Display::Frame::rows.
+typedef std::array<uint64_t, 2 * Display::PLANES> Row;
+
+/// A row of every plane, in a vector register.
+typedef uint64_t u64x4 __attribute__((vector_size(32)));
+
+static_assert(sizeof(Row) == sizeof(u64x4), "A row should fit into a single vector");
+
+// Vectors are passed by reference, as passing them by value depends on
+// whether AVX is enabled
+
+/// Load a row into a vector.
+static void load(const Row &row, u64x4 &out) {
+    std::memcpy(&out, row.data(), sizeof(out));
+}
+
+/// Store a vector into a row, following the sequence protocol.
+static void store(Row &row, const u64x4 &value) {
+    for (int lane = 0; lane < 2 * Display::PLANES; ++lane) {
+        std::atomic_ref<uint64_t>(row[lane]).store(value[lane], std::memory_order_relaxed);
+    }
+}
+
+/// Get a mask of the words belonging to the given planes.
+///
+/// In low resolution, the right halves of rows are always excluded.
+static void plane_mask(uint8_t planes, bool hires, u64x4 &out) {
+    uint64_t first = (planes & 0x1) ? UINT64_MAX : 0;
+    uint64_t second = (planes & 0x2) ? UINT64_MAX : 0;
+
+    out = u64x4{first, hires ? first : 0, second, hires ? second : 0};
+}
+
+/// Halve the horizontal resolution of a word, setting each bit of the result
+/// if either of the corresponding two bits is set.
+static uint32_t halve(uint64_t word) {
+    // Combine each pair into its lower bit, then gather those bits
+    word = (word | word >> 1) & 0x5555555555555555;
+    word = (word | word >> 1) & 0x3333333333333333;
+    word = (word | word >> 2) & 0x0F0F0F0F0F0F0F0F;
+    word = (word | word >> 4) & 0x00FF00FF00FF00FF;
+    word = (word | word >> 8) & 0x0000FFFF0000FFFF;
+    word = (word | word >> 16) & 0x00000000FFFFFFFF;
+
+    return word;
+}
+
+void Display::begin_write() {
+    std::atomic_ref<uint32_t> sequence(this->sequence);
+
+    sequence.store(this->sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
 }
 
-Display& Display::operator=(Display other) {
-    std::lock_guard<std::mutex> lock(this->lock);
+void Display::end_write() {
+    std::atomic_ref<uint32_t> sequence(this->sequence);
 
-    std::swap(this->vram, other.vram);
-    return *this;
+    sequence.store(this->sequence + 1, std::memory_order_release);
 }
 
 void Display::clear() {
-    this->vram.fill(0);
+    u64x4 mask;
+    plane_mask(this->planes, true, mask);
+
+    this->begin_write();
+
+    for (Row &row : this->frame.rows) {
+        u64x4 old;
+        load(row, old);
+        store(row, old & ~mask);
+    }
+
+    this->end_write();
+}
+
+bool Display::draw_sprite(int x, int y, const uint8_t *data, int n) {
+    bool hires = this->frame.hires;
+    int width = hires ? Display::HIRES_WIDTH : Display::WIDTH;
+    int height = hires ? Display::HIRES_HEIGHT : Display::HEIGHT;
+
+    bool wide = n == 0;
+    int rows = wide ? 16 : n;
+    int bits = wide ? 16 : 8;
+
+    x %= width;
+    y %= height;
+
+    u64x4 collision = {};
+
+    this->begin_write();
+
+    for (int row = 0; row < rows; ++row) {
+        u64x4 sprite = {};
+        const uint8_t *plane_data = data;
+
+        for (int plane = 0; plane < Display::PLANES; ++plane) {
+            if (!(this->planes & (1 << plane))) {
+                continue;
+            }
+
+            uint64_t line = wide ? (plane_data[2 * row] << 8 | plane_data[2 * row + 1]) : plane_data[row];
+            plane_data += wide ? 32 : n;
+
+            // Place the sprite at the left of the row, then rotate it into
+            // position, which also takes care of wrapping around the right edge
+            if (hires) {
+                unsigned __int128 placed = static_cast<unsigned __int128>(line) << (128 - bits);
+                if (x != 0) {
+                    placed = placed >> x | placed << (128 - x);
+                }
+
+                sprite[2 * plane] = static_cast<uint64_t>(placed >> 64);
+                sprite[2 * plane + 1] = static_cast<uint64_t>(placed);
+            } else {
+                sprite[2 * plane] = std::rotr(line << (64 - bits), x);
+            }
+        }
+
+        Row &target = this->frame.rows[(y + row) % height];
+        u64x4 old;
+        load(target, old);
+
+        collision |= old & sprite;
+        store(target, old ^ sprite);
+    }
+
+    this->end_write();
+
+    return (collision[0] | collision[1] | collision[2] | collision[3]) != 0;
 }
 
 bool Display::draw_byte(int x, int y, uint8_t data) {
-    std::lock_guard<std::mutex> lock(this->lock);
+    uint8_t planes[Display::PLANES] = {data, data};
 
-    bool ret = false;
+    return this->draw_sprite(x, y, planes, 1);
+}
 
-    for (int bit = 0; bit < 8; ++bit) {
-        int vram_x = (x + bit) % Display::WIDTH;
+void Display::scroll_down(int n) {
+    int height = this->frame.hires ? Display::HIRES_HEIGHT : Display::HEIGHT;
+    u64x4 mask;
+    plane_mask(this->planes, this->frame.hires, mask);
 
-        int idx = y * Display::WIDTH + vram_x;
-        int old_val = this->vram[idx];
-        int xor_val = (data >> (7 - bit)) & 0x01;
+    this->begin_write();
 
-        if ((old_val & xor_val) == 1) {
-            ret = true;
+    // Bottom up, so every source row is read before it is overwritten
+    for (int y = height - 1; y >= 0; --y) {
+        u64x4 source = {};
+        if (y >= n) {
+            load(this->frame.rows[y - n], source);
         }
 
-        this->vram[idx] = old_val ^ xor_val;
+        u64x4 old;
+        load(this->frame.rows[y], old);
+
+        store(this->frame.rows[y], (source & mask) | (old & ~mask));
+    }
+
+    this->end_write();
+}
+
+void Display::scroll_up(int n) {
+    int height = this->frame.hires ? Display::HIRES_HEIGHT : Display::HEIGHT;
+    u64x4 mask;
+    plane_mask(this->planes, this->frame.hires, mask);
+
+    this->begin_write();
+
+    for (int y = 0; y < height; ++y) {
+        u64x4 source = {};
+        if (y + n < height) {
+            load(this->frame.rows[y + n], source);
+        }
+
+        u64x4 old;
+        load(this->frame.rows[y], old);
+
+        store(this->frame.rows[y], (source & mask) | (old & ~mask));
+    }
+
+    this->end_write();
+}
+
+void Display::scroll_right() {
+    int height = this->frame.hires ? Display::HIRES_HEIGHT : Display::HEIGHT;
+    u64x4 mask;
+    plane_mask(this->planes, this->frame.hires, mask);
+    u64x4 zero = {};
+
+    this->begin_write();
+
+    for (int y = 0; y < height; ++y) {
+        u64x4 old;
+        load(this->frame.rows[y], old);
+
+        // The right half of every plane receives the bits shifted out of its left half
+        u64x4 carry = __builtin_shufflevector(old, zero, 4, 0, 4, 2) << 60;
+        u64x4 shifted = old >> 4 | carry;
+
+        store(this->frame.rows[y], (shifted & mask) | (old & ~mask));
+    }
+
+    this->end_write();
+}
+
+void Display::scroll_left() {
+    int height = this->frame.hires ? Display::HIRES_HEIGHT : Display::HEIGHT;
+    u64x4 mask;
+    plane_mask(this->planes, this->frame.hires, mask);
+    u64x4 zero = {};
+
+    this->begin_write();
+
+    for (int y = 0; y < height; ++y) {
+        u64x4 old;
+        load(this->frame.rows[y], old);
+
+        // The left half of every plane receives the bits shifted out of its right half
+        u64x4 carry = __builtin_shufflevector(old, zero, 1, 4, 3, 4) >> 60;
+        u64x4 shifted = old << 4 | carry;
+
+        store(this->frame.rows[y], (shifted & mask) | (old & ~mask));
+    }
+
+    this->end_write();
+}
+
+void Display::set_hires(bool hires) {
+    this->begin_write();
+
+    std::atomic_ref<bool>(this->frame.hires).store(hires, std::memory_order_relaxed);
+
+    u64x4 zero = {};
+
+    for (Row &row : this->frame.rows) {
+        store(row, zero);
+    }
+
+    this->end_write();
+}
+
+bool Display::is_hires() const {
+    return std::atomic_ref<bool>(const_cast<bool &>(this->frame.hires)).load(std::memory_order_relaxed);
+}
+
+void Display::select_planes(uint8_t planes) {
+    this->planes = planes & ((1 << Display::PLANES) - 1);
+}
+
+uint8_t Display::get_selected_planes() const {
+    return this->planes;
+}
+
+void Display::set_rows(const std::array<uint64_t, Display::HEIGHT> &rows) {
+    Frame frame;
+
+    for (int y = 0; y < Display::HEIGHT; ++y) {
+        frame.rows[y][0] = rows[y];
+    }
+
+    this->set_frame(frame);
+}
+
+std::array<uint64_t, Display::HEIGHT> Display::get_rows() const {
+    return Display::downsample(this->get_frame());
+}
+
+uint8_t Display::get_pixel(const Frame &frame, int x, int y) {
+    if (!frame.hires) {
+        x /= 2;
+        y /= 2;
+    }
+
+    const Row &row = frame.rows[y];
+    int shift = 63 - x % 64;
+    int half = x / 64;
+
+    return ((row[half] >> shift) & 0x01) | ((row[2 + half] >> shift) & 0x01) << 1;
+}
+
+std::array<uint64_t, Display::HEIGHT> Display::downsample(const Frame &frame) {
+    std::array<uint64_t, Display::HEIGHT> ret;
+
+    for (int y = 0; y < Display::HEIGHT; ++y) {
+        if (!frame.hires) {
+            ret[y] = frame.rows[y][0] | frame.rows[y][2];
+            continue;
+        }
+
+        const Row &top = frame.rows[2 * y];
+        const Row &bottom = frame.rows[2 * y + 1];
+        uint64_t left = top[0] | top[2] | bottom[0] | bottom[2];
+        uint64_t right = top[1] | top[3] | bottom[1] | bottom[3];
+
+        ret[y] = static_cast<uint64_t>(halve(left)) << 32 | halve(right);
     }
 
     return ret;
 }
 
+void Display::set_frame(const Frame &frame) {
+    this->begin_write();
+
+    std::atomic_ref<bool>(this->frame.hires).store(frame.hires, std::memory_order_relaxed);
+
+    for (int y = 0; y < Display::HIRES_HEIGHT; ++y) {
+        u64x4 row;
+        load(frame.rows[y], row);
+        store(this->frame.rows[y], row);
+    }
+
+    this->end_write();
+}
+
+uint32_t Display::get_version() const {
+    // atomic_ref requires a non-const reference, but nothing is written
+    Display *self = const_cast<Display *>(this);
+
+    return std::atomic_ref<uint32_t>(self->sequence).load(std::memory_order_acquire);
+}
+
+Display::Frame Display::get_frame() const {
+    Frame ret;
+
+    // atomic_ref requires a non-const reference, but nothing is written
+    Display *self = const_cast<Display *>(this);
+    std::atomic_ref<uint32_t> sequence(self->sequence);
+
+    while (true) {
+        uint32_t before = sequence.load(std::memory_order_acquire);
+
+        if (before % 2 != 0) {
+            // Write in progress
+            continue;
+        }
+
+        ret.hires = std::atomic_ref<bool>(self->frame.hires).load(std::memory_order_relaxed);
+
+        for (int y = 0; y < Display::HIRES_HEIGHT; ++y) {
+            for (int lane = 0; lane < 2 * Display::PLANES; ++lane) {
+                ret.rows[y][lane] = std::atomic_ref<uint64_t>(self->frame.rows[y][lane]).load(std::memory_order_relaxed);
+            }
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if (sequence.load(std::memory_order_relaxed) == before) {
+            return ret;
+        }
+    }
+}
+
 std::array<uint8_t, Display::WIDTH * Display::HEIGHT> Display::get_vram() const {
-    std::lock_guard<std::mutex> lock(this->lock);
+    std::array<uint64_t, Display::HEIGHT> rows = this->get_rows();
+    std::array<uint8_t, Display::WIDTH * Display::HEIGHT> ret;
 
-    return this->vram;
+    for (int y = 0; y < Display::HEIGHT; ++y) {
+        for (int x = 0; x < Display::WIDTH; ++x) {
+            ret[y * Display::WIDTH + x] = (rows[y] >> (63 - x)) & 0x01;
+        }
+    }
+
+    return ret;
 }
@@ -1,39 +1,93 @@
 #pragma once
 
 #include <array>
-#include <mutex>
 #include <stdint.h>
 
 /// Video memory for the CHIP-8 emulator.
+///
+/// Supports the SUPER-CHIP high resolution mode and the two bitplanes of
+/// XO-CHIP. Pixels are kept at the native resolution of the current mode, in
+/// rows of packed words, so scrolling is done with whole-word shifts, and a
+/// sprite row is drawn to all planes with a single vector operation.
+///
+/// The display is written by the thread running the CPU, but may be read
+/// from any other thread. Readers are synchronised through a sequence lock,
+/// so drawing never blocks. The display is trivially copyable; copying it
+/// while it is being drawn to is not safe.
 class Display {
+    public:
+        /// Width of the display in pixels, in low resolution.
+        static constexpr int WIDTH = 64;
+
+        /// Height of the display in pixels, in low resolution.
+        static constexpr int HEIGHT = 32;
+
+        /// Width of the display in pixels, in high resolution.
+        static constexpr int HIRES_WIDTH = 128;
+
+        /// Height of the display in pixels, in high resolution.
+        static constexpr int HIRES_HEIGHT = 64;
+
+        /// Number of bitplanes.
+        static constexpr int PLANES = 2;
+
+        /// The complete contents of the display.
+        struct Frame {
+            /// Whether the display is in high resolution.
+            bool hires = false;
+
+            /// Video memory, packed as two words per row and plane.
+            ///
+            /// Row y holds the left and right half of the row in every plane:
+            /// `{plane 0 left, plane 0 right, plane 1 left, plane 1 right}`.
+            /// The most significant bit of each word is its leftmost pixel.
+            /// In low resolution, only the left words of the first #HEIGHT
+            /// rows are used, and the rest is zero.
+            std::array<std::array<uint64_t, 2 * PLANES>, HIRES_HEIGHT> rows{};
+
+            bool operator==(const Frame &other) const = default;
+        };
+
     private:
-        /// Video memory as an array of bytes.
+        /// Current contents.
         ///
-        /// Each entry should either be 1 for a lit pixel, or 0 for an unlit one.
-        /// Calculate the index for a pixel at (x, y) as `y * Display::WIDTH + x`
-        ///
-        /// \important Acquire the [lock](#lock) before accessing this field!
-        std::array<uint8_t, 64 * 32> vram;
-
-        /// A mutex lock for [vram](#vram).
-        mutable std::mutex lock;
+        /// \important Only access this through `std::atomic_ref` while
+        /// following the [sequence](#sequence) protocol.
+        Frame frame;
 
+        /// Sequence counter for [frame](#frame).
+        ///
+        /// Odd while a write is in progress. Increased by 2 for every
+        /// completed modification of the display.
+        uint32_t sequence = 0;
 
-    public:
-        /// Width of the display in pixels.
-        static constexpr int WIDTH = 64;
+        /// Bitmask of the planes drawn to, cleared and scrolled.
+        uint8_t planes = 0x1;
 
-        /// Height of the display in pixels.
-        static constexpr int HEIGHT = 32;
+        /// Start modifying the display.
+        void begin_write();
 
-        Display() = default;
-        Display(const Display &other);
-        Display& operator=(Display other);
+        /// Finish modifying the display.
+        void end_write();
 
-        /// Clear the screen.
+    public:
+        /// Clear the selected planes.
         void clear();
 
-        /// Draw a single byte of sprite data.
+        /// Draw a sprite to the selected planes, wrapping around the edges.
+        ///
+        /// \param x Leftmost x position of the sprite.
+        /// \param y Topmost y position of the sprite.
+        /// \param data Sprite data for every selected plane in ascending
+        /// order, one byte per row, or two if the sprite is 16 pixels wide.
+        /// Set bits toggle their pixel.
+        /// \param n Height of the sprite, or 0 for a 16x16 sprite.
+        ///
+        /// \return A boolean indicating whether any pixels were unset by this
+        /// operation. Commonly used for collision detection.
+        bool draw_sprite(int x, int y, const uint8_t *data, int n);
+
+        /// Draw a single byte of sprite data to the selected planes.
         ///
         /// \param x Leftmost x position of where to draw the sprite.
         /// \param y Y position of where to draw the sprite.
@@ -45,8 +99,97 @@ class Display {
         /// operation. Commonly used for collision detection.
         bool draw_byte(int x, int y, uint8_t data);
 
-        /// Get a copy of the current vram.
+        /// Scroll the selected planes down, filling in blank rows (`00Cn`).
+        ///
+        /// \param n Number of rows, in pixels of the current resolution.
+        void scroll_down(int n);
+
+        /// Scroll the selected planes up, filling in blank rows (`00Dn`).
+        ///
+        /// \param n Number of rows, in pixels of the current resolution.
+        void scroll_up(int n);
+
+        /// Scroll the selected planes right by 4 pixels (`00FB`).
+        void scroll_right();
+
+        /// Scroll the selected planes left by 4 pixels (`00FC`).
+        void scroll_left();
+
+        /// Switch between low and high resolution (`00FE` and `00FF`),
+        /// clearing all planes.
+        ///
+        /// \param hires Whether to switch to high resolution.
+        void set_hires(bool hires);
+
+        /// Returns whether the display is in high resolution.
+        bool is_hires() const;
+
+        /// Select the planes affected by drawing, clearing and scrolling (`Fn01`).
+        ///
+        /// \param planes Bitmask of planes, bit n indicating plane n.
+        void select_planes(uint8_t planes);
+
+        /// Get the planes affected by drawing, clearing and scrolling.
+        ///
+        /// \return Bitmask of planes, bit n indicating plane n.
+        uint8_t get_selected_planes() const;
+
+        /// Replace the whole video memory with a low resolution image in the
+        /// first plane, e.g. when restoring an old snapshot.
+        ///
+        /// \param rows The new video memory, one word per row, as returned by get_rows().
+        void set_rows(const std::array<uint64_t, Display::HEIGHT> &rows);
+
+        /// Get a consistent copy of the packed rows at low resolution.
+        ///
+        /// A pixel is lit if it is lit in any plane. In high resolution, each
+        /// pixel covers a 2x2 block, lit if any of its pixels are.
+        ///
+        /// \return A copy of the current video memory, one word per row.
+        std::array<uint64_t, Display::HEIGHT> get_rows() const;
+
+        /// Reduce a frame to packed rows at low resolution, like get_rows().
+        ///
+        /// \param frame The frame, as returned by get_frame().
+        ///
+        /// \return The frame, one word per row.
+        static std::array<uint64_t, Display::HEIGHT> downsample(const Frame &frame);
+
+        /// Get a pixel of a frame at high resolution, in every plane.
+        ///
+        /// In low resolution, each pixel covers a 2x2 block, so frames of
+        /// both resolutions can be shown at the same size.
+        ///
+        /// \param frame The frame, as returned by get_frame().
+        /// \param x X position. (0 - #HIRES_WIDTH - 1)
+        /// \param y Y position. (0 - #HIRES_HEIGHT - 1)
+        ///
+        /// \return Bitmask of the planes the pixel is lit in, bit n
+        /// indicating plane n.
+        static uint8_t get_pixel(const Frame &frame, int x, int y);
+
+        /// Replace the whole video memory, e.g. when restoring a snapshot.
+        ///
+        /// \param frame The new contents, as returned by get_frame().
+        void set_frame(const Frame &frame);
+
+        /// Get a consistent copy of the complete contents.
+        ///
+        /// \return A copy of the current contents at the native resolution.
+        Frame get_frame() const;
+
+        /// Get a number which changes whenever the display is modified, to
+        /// cheaply check whether it needs to be read again.
+        ///
+        /// \return The sequence counter. Equal values mean the contents are
+        /// unchanged, unless a write was in progress.
+        uint32_t get_version() const;
+
+        /// Get a copy of the current vram at low resolution.
+        ///
+        /// Each entry is either 1 for a lit pixel, or 0 for an unlit one.
+        /// Calculate the index for a pixel at (x, y) as `y * Display::WIDTH + x`
         ///
-        /// \return A copt of the current vram.
+        /// \return A copy of the current vram, see get_rows().
         std::array<uint8_t, Display::WIDTH * Display::HEIGHT> get_vram() const;
 };
@@ -0,0 +1,46 @@
+#include "engine.h"
+
+#include <algorithm>
+
+unsigned Engine::run(CPU &cpu, unsigned max_steps) const {
+    const uint8_t *image = this->get_image();
+    unsigned steps = 0;
+
+    cpu.process_input();
+
+    while (steps < max_steps) {
+        if (!cpu.input.empty()) {
+            // Key events are applied between instructions, like CPU::run()
+            cpu.process_input();
+        }
+
+        const Block *block = this->find_block(cpu.pc);
+
+        bool usable = block != nullptr
+            && block->steps <= max_steps - steps
+            && cpu.key_wait_register == 0xFF
+            && std::equal(
+                image + (block->start - CPU::INITIAL_PC),
+                image + (block->start - CPU::INITIAL_PC + block->length),
+                cpu.memory.begin() + block->start
+            );
+
+        if (!usable) {
+            // No block, not enough steps left, or the code has been modified
+            unsigned executed = cpu.run(1);
+
+            if (executed == 0) {
+                // Halted
+                break;
+            }
+
+            steps += executed;
+            continue;
+        }
+
+        block->execute(cpu);
+        steps += block->steps;
+    }
+
+    return steps;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "cpu.h"
+
+#include <array>
+#include <atomic>
+#include <stdint.h>
+
+/// Base class for ahead-of-time compiled execution engines.
+///
+/// An engine executes basic blocks of a specific ROM as native functions,
+/// falling back to the interpreter (CPU::run()) wherever no block is
+/// available. Before a block is executed, the memory it covers is compared
+/// against the ROM image the block was generated from, so code modified at
+/// runtime is always interpreted.
+///
+/// Engines are generated by the `chip8_recompile` tool, and get direct access
+/// to the CPU's internals through the protected accessors of this class.
+class Engine {
+    public:
+        /// A basic block compiled to a native function.
+        struct Block {
+            /// Executes the block, including the final update of the PC.
+            void (*execute)(CPU &cpu);
+
+            /// Address of the first instruction in the block.
+            uint16_t start;
+
+            /// Length of the block's code in bytes.
+            uint16_t length;
+
+            /// Number of instructions executed by the block.
+            uint16_t steps;
+        };
+
+        virtual ~Engine() = default;
+
+        /// Execute up to the given number of instructions.
+        ///
+        /// Behaves exactly like CPU::run(), including stopping early on halts.
+        ///
+        /// \param cpu CPU to run, which should have this engine's ROM loaded.
+        /// \param max_steps Maximum number of instructions to execute.
+        ///
+        /// \return Number of instructions executed or skipped.
+        unsigned run(CPU &cpu, unsigned max_steps) const;
+
+    protected:
+        /// Find the block starting at the given address.
+        ///
+        /// \param pc Address of the first instruction.
+        ///
+        /// \return The block, or nullptr if there is none.
+        virtual const Block* find_block(uint16_t pc) const = 0;
+
+        /// ROM image the blocks were generated from.
+        ///
+        /// \return Pointer to the image, which is loaded at CPU::INITIAL_PC.
+        virtual const uint8_t* get_image() const = 0;
+
+        static uint8_t* registers(CPU &cpu) {
+            return cpu.registers;
+        }
+
+        static std::array<uint8_t, CPU::MEMORY_SIZE>& memory(CPU &cpu) {
+            return cpu.memory;
+        }
+
+        static uint16_t& pc(CPU &cpu) {
+            return cpu.pc;
+        }
+
+        static uint16_t& i(CPU &cpu) {
+            return cpu.i;
+        }
+
+        static uint8_t& key_wait_register(CPU &cpu) {
+            return cpu.key_wait_register;
+        }
+
+        static std::atomic_ref<uint8_t> dt(CPU &cpu) {
+            return std::atomic_ref<uint8_t>(cpu.dt);
+        }
+
+        static std::atomic_ref<uint8_t> st(CPU &cpu) {
+            return std::atomic_ref<uint8_t>(cpu.st);
+        }
+
+        static bool read_key(CPU &cpu, uint8_t key) {
+            return cpu.read_key(key);
+        }
+
+        static void clear(CPU &cpu) {
+            cpu.display.clear();
+        }
+
+        static void draw_sprite(CPU &cpu, uint8_t x, uint8_t y, uint8_t n) {
+            cpu.draw_sprite(x, y, n);
+        }
+
+        static uint8_t random_byte(CPU &cpu) {
+            return cpu.random_byte();
+        }
+};
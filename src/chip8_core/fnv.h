@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Offset basis of the 64-bit FNV-1a hash, the hash of no data.
+inline constexpr uint64_t FNV_OFFSET_BASIS = 0xCBF29CE484222325;
+
+/// Compute the 64-bit FNV-1a hash of some data.
+///
+/// \param data The data to hash.
+/// \param size Size of the data in bytes.
+/// \param hash Hash of any data preceding it, to hash data in parts.
+///
+/// \return The hash.
+inline uint64_t fnv1a(const uint8_t *data, size_t size, uint64_t hash = FNV_OFFSET_BASIS) {
+    for (size_t n = 0; n < size; ++n) {
+        hash ^= data[n];
+        hash *= 0x100000001B3;
+    }
+
+    return hash;
+}
@@ -0,0 +1,401 @@
+#include "frame_log.h"
+
+#include "byte_order.h"
+
+#include <cstring>
+
+/// Number of bytes covered by the encoding of a frame.
+static constexpr size_t FRAME_BYTES = sizeof(Display::Frame::rows);
+
+/// Size of the fixed part at the end of the index in bytes.
+static constexpr size_t INDEX_TRAILER_SIZE = 24;
+
+/// Append a varint.
+static void put_varint(std::vector<uint8_t> &out, size_t value) {
+    while (value >= 0x80) {
+        out.push_back((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+
+    out.push_back(value);
+}
+
+/// Read a varint of at most 3 bytes, enough for any offset within a frame.
+///
+/// \return Whether a varint was read.
+static bool get_varint(const uint8_t *data, size_t size, size_t &pos, size_t &value) {
+    value = 0;
+
+    for (int shift = 0; shift < 21 && pos < size; shift += 7) {
+        uint8_t byte = data[pos++];
+        value |= static_cast<size_t>(byte & 0x7F) << shift;
+
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void FrameLogWriter::encode(const Display::Frame &frame, const Display::Frame &previous, std::vector<uint8_t> &out) {
+    // Difference to the previous frame, as little-endian bytes
+    uint64_t words[FRAME_BYTES / 8];
+    uint8_t delta[FRAME_BYTES];
+    size_t count = 0;
+
+    for (size_t y = 0; y < frame.rows.size(); ++y) {
+        for (size_t lane = 0; lane < frame.rows[y].size(); ++lane) {
+            words[count] = frame.rows[y][lane] ^ previous.rows[y][lane];
+            put_le(delta + 8 * count, words[count], 8);
+            ++count;
+        }
+    }
+
+    out.push_back(frame.hires ? 0x01 : 0x00);
+
+    size_t pos = 0;
+
+    while (true) {
+        size_t start = pos;
+
+        // Skip zero bytes, whole words at a time where possible
+        while (pos < FRAME_BYTES && delta[pos] == 0) {
+            pos += (pos % 8 == 0 && words[pos / 8] == 0) ? 8 : 1;
+        }
+
+        if (pos == FRAME_BYTES) {
+            break;
+        }
+
+        // Literals end at two zero bytes in a row, which are cheaper to skip
+        size_t literals = pos;
+        while (literals < FRAME_BYTES && !(delta[literals] == 0 && (literals + 1 == FRAME_BYTES || delta[literals + 1] == 0))) {
+            ++literals;
+        }
+
+        put_varint(out, pos - start);
+        put_varint(out, literals - pos);
+        out.insert(out.end(), delta + pos, delta + literals);
+        pos = literals;
+    }
+
+    put_varint(out, 0);
+    put_varint(out, 0);
+}
+
+size_t FrameLogWriter::decode(const uint8_t *data, size_t size, Display::Frame &frame) {
+    if (size == 0 || data[0] > 0x01) {
+        return 0;
+    }
+
+    uint8_t delta[FRAME_BYTES]{};
+    size_t in = 1;
+    size_t pos = 0;
+
+    while (true) {
+        size_t skip;
+        size_t literals;
+
+        if (!get_varint(data, size, in, skip) || !get_varint(data, size, in, literals)) {
+            return 0;
+        }
+
+        if (literals == 0) {
+            break;
+        }
+
+        if (skip > FRAME_BYTES - pos || literals > FRAME_BYTES - pos - skip || literals > size - in) {
+            return 0;
+        }
+
+        pos += skip;
+        std::memcpy(delta + pos, data + in, literals);
+        pos += literals;
+        in += literals;
+    }
+
+    frame.hires = data[0] & 0x01;
+
+    const uint8_t *word = delta;
+    for (auto &row : frame.rows) {
+        for (uint64_t &value : row) {
+            value ^= get_le(word, 8);
+            word += 8;
+        }
+    }
+
+    return in;
+}
+
+FrameLogWriter::~FrameLogWriter() {
+    this->close();
+}
+
+bool FrameLogWriter::open(const char *path, uint32_t chunk_frames) {
+    if (this->file != nullptr || chunk_frames == 0) {
+        return false;
+    }
+
+    this->file = std::fopen(path, "wb");
+    if (this->file == nullptr) {
+        return false;
+    }
+
+    uint8_t header[FrameLogWriter::HEADER_SIZE];
+    std::memcpy(header, FrameLogWriter::MAGIC.data(), FrameLogWriter::MAGIC.size());
+    put_le(put_le(header + 8, FrameLogWriter::VERSION, 4), chunk_frames, 4);
+
+    this->failed = std::fwrite(header, 1, sizeof(header), this->file) != sizeof(header);
+    this->chunk_frames = chunk_frames;
+    this->chunk.clear();
+    this->chunk_count = 0;
+    this->index.clear();
+    this->offset = sizeof(header);
+    this->frames = 0;
+
+    return !this->failed;
+}
+
+void FrameLogWriter::append(const Display::Frame &frame) {
+    if (this->file == nullptr) {
+        return;
+    }
+
+    // The first frame of a chunk must decode on its own
+    FrameLogWriter::encode(frame, this->chunk_count == 0 ? Display::Frame{} : this->previous, this->chunk);
+
+    this->previous = frame;
+    this->chunk_count += 1;
+    this->frames += 1;
+
+    if (this->chunk_count == this->chunk_frames) {
+        this->flush();
+    }
+}
+
+void FrameLogWriter::flush() {
+    if (this->chunk_count == 0) {
+        return;
+    }
+
+    uint8_t header[FrameLogWriter::CHUNK_HEADER_SIZE];
+    put_le(put_le(header, this->chunk_count, 4), this->chunk.size(), 4);
+
+    this->failed |= std::fwrite(header, 1, sizeof(header), this->file) != sizeof(header);
+    this->failed |= std::fwrite(this->chunk.data(), 1, this->chunk.size(), this->file) != this->chunk.size();
+
+    this->index.push_back(this->offset);
+    this->offset += sizeof(header) + this->chunk.size();
+
+    this->chunk.clear();
+    this->chunk_count = 0;
+}
+
+bool FrameLogWriter::close() {
+    if (this->file == nullptr) {
+        return false;
+    }
+
+    this->flush();
+
+    std::vector<uint8_t> index(8 * this->index.size() + INDEX_TRAILER_SIZE);
+    uint8_t *out = index.data();
+
+    for (uint64_t chunk_offset : this->index) {
+        out = put_le(out, chunk_offset, 8);
+    }
+
+    out = put_le(put_le(out, this->index.size(), 8), this->frames, 8);
+    std::memcpy(out, FrameLogWriter::INDEX_MAGIC.data(), FrameLogWriter::INDEX_MAGIC.size());
+
+    this->failed |= std::fwrite(index.data(), 1, index.size(), this->file) != index.size();
+    this->failed |= std::fclose(this->file) != 0;
+    this->file = nullptr;
+
+    return !this->failed;
+}
+
+uint64_t FrameLogWriter::get_frames() const {
+    return this->frames;
+}
+
+FrameLogReader::~FrameLogReader() {
+    this->close();
+}
+
+bool FrameLogReader::open(const char *path) {
+    if (this->file != nullptr) {
+        return false;
+    }
+
+    this->file = std::fopen(path, "rb");
+    if (this->file == nullptr) {
+        return false;
+    }
+
+    uint8_t header[FrameLogWriter::HEADER_SIZE];
+    if (std::fread(header, 1, sizeof(header), this->file) != sizeof(header)
+            || std::memcmp(header, FrameLogWriter::MAGIC.data(), FrameLogWriter::MAGIC.size()) != 0
+            || get_le(header + 8, 4) != FrameLogWriter::VERSION
+            || get_le(header + 12, 4) == 0
+            || std::fseek(this->file, 0, SEEK_END) != 0) {
+        this->close();
+        return false;
+    }
+
+    long file_size = std::ftell(this->file);
+    if (file_size < 0) {
+        this->close();
+        return false;
+    }
+
+    this->chunk_frames = get_le(header + 12, 4);
+    this->chunk_number = -1;
+    this->current_number = -1;
+
+    if (!this->read_index(file_size)) {
+        this->scan_chunks(file_size);
+    }
+
+    return true;
+}
+
+bool FrameLogReader::read_index(uint64_t file_size) {
+    if (file_size < FrameLogWriter::HEADER_SIZE + INDEX_TRAILER_SIZE) {
+        return false;
+    }
+
+    uint8_t trailer[INDEX_TRAILER_SIZE];
+    if (std::fseek(this->file, file_size - INDEX_TRAILER_SIZE, SEEK_SET) != 0
+            || std::fread(trailer, 1, sizeof(trailer), this->file) != sizeof(trailer)
+            || std::memcmp(trailer + 16, FrameLogWriter::INDEX_MAGIC.data(), FrameLogWriter::INDEX_MAGIC.size()) != 0) {
+        return false;
+    }
+
+    uint64_t chunks = get_le(trailer, 8);
+    uint64_t frames = get_le(trailer + 8, 8);
+
+    if (chunks > (file_size - FrameLogWriter::HEADER_SIZE - INDEX_TRAILER_SIZE) / 8
+            || chunks != (frames + this->chunk_frames - 1) / this->chunk_frames) {
+        return false;
+    }
+
+    std::vector<uint8_t> offsets(8 * chunks);
+    if (std::fseek(this->file, file_size - INDEX_TRAILER_SIZE - offsets.size(), SEEK_SET) != 0
+            || std::fread(offsets.data(), 1, offsets.size(), this->file) != offsets.size()) {
+        return false;
+    }
+
+    this->index.resize(chunks);
+    for (uint64_t n = 0; n < chunks; ++n) {
+        this->index[n] = get_le(offsets.data() + 8 * n, 8);
+    }
+
+    this->frames = frames;
+
+    return true;
+}
+
+void FrameLogReader::scan_chunks(uint64_t file_size) {
+    uint64_t offset = FrameLogWriter::HEADER_SIZE;
+
+    this->index.clear();
+    this->frames = 0;
+
+    while (offset + FrameLogWriter::CHUNK_HEADER_SIZE <= file_size) {
+        uint8_t header[FrameLogWriter::CHUNK_HEADER_SIZE];
+
+        if (std::fseek(this->file, offset, SEEK_SET) != 0
+                || std::fread(header, 1, sizeof(header), this->file) != sizeof(header)) {
+            break;
+        }
+
+        uint64_t count = get_le(header, 4);
+        uint64_t length = get_le(header + 4, 4);
+
+        if (count == 0 || count > this->chunk_frames || offset + sizeof(header) + length > file_size) {
+            break;
+        }
+
+        this->index.push_back(offset);
+        this->frames += count;
+        offset += sizeof(header) + length;
+
+        if (count < this->chunk_frames) {
+            // Only the last chunk can be partial
+            break;
+        }
+    }
+}
+
+bool FrameLogReader::read_chunk(int64_t number) {
+    uint8_t header[FrameLogWriter::CHUNK_HEADER_SIZE];
+
+    this->chunk_number = -1;
+
+    if (std::fseek(this->file, this->index[number], SEEK_SET) != 0
+            || std::fread(header, 1, sizeof(header), this->file) != sizeof(header)) {
+        return false;
+    }
+
+    this->chunk.resize(get_le(header + 4, 4));
+
+    if (std::fread(this->chunk.data(), 1, this->chunk.size(), this->file) != this->chunk.size()) {
+        return false;
+    }
+
+    this->chunk_number = number;
+    this->chunk_offset = 0;
+    this->current_number = number * this->chunk_frames - 1;
+    this->current = Display::Frame{};
+
+    return true;
+}
+
+uint64_t FrameLogReader::get_frames() const {
+    return this->frames;
+}
+
+bool FrameLogReader::read(uint64_t number, Display::Frame &frame) {
+    if (this->file == nullptr || number >= this->frames) {
+        return false;
+    }
+
+    int64_t chunk_number = number / this->chunk_frames;
+
+    // Continue decoding the current chunk if possible, otherwise start over
+    if (chunk_number != this->chunk_number || this->current_number > static_cast<int64_t>(number)) {
+        if (!this->read_chunk(chunk_number)) {
+            return false;
+        }
+    }
+
+    while (this->current_number < static_cast<int64_t>(number)) {
+        size_t length = FrameLogWriter::decode(this->chunk.data() + this->chunk_offset, this->chunk.size() - this->chunk_offset, this->current);
+
+        if (length == 0) {
+            this->chunk_number = -1;
+            return false;
+        }
+
+        this->chunk_offset += length;
+        this->current_number += 1;
+    }
+
+    frame = this->current;
+
+    return true;
+}
+
+void FrameLogReader::close() {
+    if (this->file != nullptr) {
+        std::fclose(this->file);
+        this->file = nullptr;
+    }
+
+    this->index.clear();
+    this->frames = 0;
+    this->chunk_number = -1;
+    this->current_number = -1;
+}
@@ -0,0 +1,229 @@
+#pragma once
+
+#include "display.h"
+
+#include <array>
+#include <cstdio>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/// Appends every frame of a session to a compact, seekable file.
+///
+/// Frames are stored as the XOR of their Display::Frame with the previous
+/// frame, which is mostly zero, with runs of zero bytes skipped. Frames are
+/// grouped into chunks of a fixed number of frames, and the first frame of
+/// every chunk is stored against an empty frame, so any frame can be decoded
+/// from the start of its chunk. An unchanged frame takes three bytes.
+///
+/// The file starts with a 16 byte header:
+///
+/// - 8 bytes #MAGIC
+/// - `uint32_t` #VERSION
+/// - `uint32_t` number of frames per chunk
+///
+/// followed by chunks:
+///
+/// - `uint32_t` number of frames in the chunk
+/// - `uint32_t` length of the encoded frames in bytes
+/// - the encoded frames
+///
+/// Each frame is encoded as a flags byte, bit 0 set in high resolution,
+/// followed by pairs of varints: a number of zero bytes to skip and a number
+/// of literal bytes, followed by the literal bytes. The pairs run over the
+/// `uint64_t` words of Display::Frame::rows in order, 2048 bytes in total.
+/// A pair without literals ends the frame, leaving the remaining bytes as is.
+/// Varints store 7 bits per byte, least significant first, with the top bit
+/// set on all but the last byte.
+///
+/// Closing the writer appends an index of the offsets of all chunks:
+///
+/// - `uint64_t` file offset of every chunk
+/// - `uint64_t` number of chunks
+/// - `uint64_t` number of frames
+/// - 8 bytes #INDEX_MAGIC
+///
+/// All integers are little-endian. Files whose writer did not close them,
+/// e.g. after a crash, can still be read: the chunk headers are scanned
+/// instead.
+class FrameLogWriter {
+    public:
+        /// Magic bytes at the start of every frame log.
+        static constexpr std::array<uint8_t, 8> MAGIC = {'C', '8', 'F', 'R', 'A', 'M', 'E', 'S'};
+
+        /// Magic bytes at the end of the index.
+        static constexpr std::array<uint8_t, 8> INDEX_MAGIC = {'C', '8', 'F', 'I', 'N', 'D', 'E', 'X'};
+
+        /// Version of the frame log format.
+        static constexpr uint32_t VERSION = 1;
+
+        /// Size of the header in bytes.
+        static constexpr size_t HEADER_SIZE = 16;
+
+        /// Size of a chunk header in bytes.
+        static constexpr size_t CHUNK_HEADER_SIZE = 8;
+
+        /// Default number of frames per chunk, about 4 seconds at 60 fps.
+        static constexpr uint32_t DEFAULT_CHUNK_FRAMES = 256;
+
+        /// Encode a frame as the difference to a previous frame.
+        ///
+        /// \param frame The frame to encode.
+        /// \param previous The frame before it, or an empty frame at the start
+        /// of a chunk.
+        /// \param out The encoded frame is appended to this.
+        static void encode(const Display::Frame &frame, const Display::Frame &previous, std::vector<uint8_t> &out);
+
+        /// Decode a frame encoded by encode().
+        ///
+        /// \param data The encoded frame.
+        /// \param size Number of bytes available.
+        /// \param frame The previous frame, replaced with the decoded frame.
+        ///
+        /// \return Number of bytes consumed, or 0 if the data is malformed.
+        static size_t decode(const uint8_t *data, size_t size, Display::Frame &frame);
+
+    private:
+        /// Output file.
+        std::FILE *file = nullptr;
+
+        /// Number of frames per chunk.
+        uint32_t chunk_frames = DEFAULT_CHUNK_FRAMES;
+
+        /// Encoded frames of the current chunk.
+        std::vector<uint8_t> chunk;
+
+        /// Number of frames in #chunk.
+        uint32_t chunk_count = 0;
+
+        /// The previously appended frame.
+        Display::Frame previous;
+
+        /// File offset of every chunk written so far.
+        std::vector<uint64_t> index;
+
+        /// Offset at which the next chunk is written.
+        uint64_t offset = 0;
+
+        /// Number of frames appended so far.
+        uint64_t frames = 0;
+
+        /// Whether writing failed at some point.
+        bool failed = false;
+
+        /// Write the current chunk, if it holds any frames.
+        void flush();
+
+    public:
+        FrameLogWriter() = default;
+        ~FrameLogWriter();
+
+        FrameLogWriter(const FrameLogWriter &other) = delete;
+        FrameLogWriter& operator=(const FrameLogWriter &other) = delete;
+
+        /// Create a frame log, replacing any existing file.
+        ///
+        /// \param path Path of the file to write.
+        /// \param chunk_frames Number of frames per chunk. Larger chunks
+        /// compress slightly better, smaller ones seek faster.
+        ///
+        /// \return Whether the file was created successfully.
+        bool open(const char *path, uint32_t chunk_frames = DEFAULT_CHUNK_FRAMES);
+
+        /// Append a frame.
+        ///
+        /// Encoding takes a single pass over the frame, and chunks are written
+        /// through a buffered stream, so this keeps up with emulation.
+        ///
+        /// \param frame The frame, as returned by Display::get_frame().
+        void append(const Display::Frame &frame);
+
+        /// Write the remaining frames and the index, and close the file.
+        ///
+        /// \return Whether all frames were written successfully.
+        bool close();
+
+        /// Number of frames appended so far.
+        uint64_t get_frames() const;
+};
+
+/// Reads frames from a file written by FrameLogWriter, in any order.
+///
+/// Reading the frames in order decodes each one once. Any other frame is
+/// decoded from the start of its chunk.
+class FrameLogReader {
+    private:
+        /// Input file.
+        std::FILE *file = nullptr;
+
+        /// Number of frames per chunk.
+        uint32_t chunk_frames = 0;
+
+        /// File offset of every chunk.
+        std::vector<uint64_t> index;
+
+        /// Number of frames in the file.
+        uint64_t frames = 0;
+
+        /// Encoded frames of the chunk last read.
+        std::vector<uint8_t> chunk;
+
+        /// Number of the chunk in #chunk, or -1 if none.
+        int64_t chunk_number = -1;
+
+        /// Offset of the next frame to decode within #chunk.
+        size_t chunk_offset = 0;
+
+        /// Number of the frame in #current, or -1 if none.
+        int64_t current_number = -1;
+
+        /// The frame decoded last.
+        Display::Frame current;
+
+        /// Read the index at the end of the file.
+        ///
+        /// \param file_size Size of the file in bytes.
+        ///
+        /// \return Whether the file has a valid index.
+        bool read_index(uint64_t file_size);
+
+        /// Build the index by walking the chunk headers, for files that were
+        /// not closed properly. A chunk cut off at the end is ignored.
+        ///
+        /// \param file_size Size of the file in bytes.
+        void scan_chunks(uint64_t file_size);
+
+        /// Read a chunk into #chunk.
+        ///
+        /// \param number Number of the chunk, starting at 0.
+        ///
+        /// \return Whether the chunk was read successfully.
+        bool read_chunk(int64_t number);
+
+    public:
+        FrameLogReader() = default;
+        ~FrameLogReader();
+
+        FrameLogReader(const FrameLogReader &other) = delete;
+        FrameLogReader& operator=(const FrameLogReader &other) = delete;
+
+        /// Open a frame log and load its index.
+        ///
+        /// \param path Path of the file to read.
+        ///
+        /// \return Whether the frame log was opened successfully.
+        bool open(const char *path);
+
+        /// Number of frames in the file.
+        uint64_t get_frames() const;
+
+        /// Read a frame.
+        ///
+        /// \param number Number of the frame, starting at 0.
+        /// \param frame Set to the frame.
+        ///
+        /// \return False if there is no such frame or the file is malformed.
+        bool read(uint64_t number, Display::Frame &frame);
+
+        void close();
+};
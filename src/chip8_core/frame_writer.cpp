@@ -0,0 +1,208 @@
+#include "frame_writer.h"
+
+#include <cstring>
+
+FrameWriter::~FrameWriter() {
+    this->close();
+}
+
+bool FrameWriter::open(const char *path, Format format, int scale, Resolution resolution) {
+    if (this->file != nullptr || scale < 1 || scale > 64) {
+        return false;
+    }
+
+    if (std::strcmp(path, "-") == 0) {
+        this->file = stdout;
+        this->owns_file = false;
+    } else {
+        this->file = std::fopen(path, "wb");
+        this->owns_file = true;
+    }
+
+    if (this->file == nullptr) {
+        return false;
+    }
+
+    this->format = format;
+    this->resolution = resolution;
+    this->scale = scale;
+    this->closing = false;
+    this->has_last = false;
+
+    std::string header = FrameWriter::get_header(format, scale, resolution);
+    std::fwrite(header.data(), 1, header.size(), this->file);
+
+    this->thread = std::thread(&FrameWriter::write_frames, this);
+
+    return true;
+}
+
+void FrameWriter::submit(const Display &display) {
+    Display::Frame frame = display.get_frame();
+
+    if (this->resolution == Resolution::LOW) {
+        // Frames that only differ below the written resolution are repeats
+        std::array<uint64_t, Display::HEIGHT> rows = Display::downsample(frame);
+        frame = Display::Frame { .hires = false, .rows = {} };
+
+        for (int y = 0; y < Display::HEIGHT; ++y) {
+            frame.rows[y][0] = rows[y];
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(this->lock);
+
+    if (this->has_last && frame == this->last_frame) {
+        if (!this->queue.empty()) {
+            // Still waiting to be written, write it once more
+            this->queue.back().count += 1;
+            return;
+        }
+
+        // Already written, queue a cheap repeat of the encoded frame
+        this->queue.push_back(Frame { .frame = frame, .count = 1 });
+    } else if (this->queue.size() >= FrameWriter::CAPACITY) {
+        // Repeat the previous frame instead, so the stream keeps one frame per submission
+        this->queue.back().count += 1;
+        this->dropped += 1;
+        return;
+    } else {
+        this->queue.push_back(Frame { .frame = frame, .count = 1 });
+    }
+
+    this->last_frame = frame;
+    this->has_last = true;
+    this->available.notify_one();
+}
+
+std::string FrameWriter::get_header(Format format, int scale, Resolution resolution) {
+    if (format != Format::Y4M) {
+        return "";
+    }
+
+    bool native = resolution == Resolution::NATIVE;
+    int width = (native ? Display::HIRES_WIDTH : Display::WIDTH) * scale;
+    int height = (native ? Display::HIRES_HEIGHT : Display::HEIGHT) * scale;
+
+    char header[64];
+    std::snprintf(header, sizeof(header), "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 Cmono\n", width, height);
+
+    return header;
+}
+
+void FrameWriter::encode(const Display::Frame &frame, Format format, int scale, Resolution resolution, std::vector<uint8_t> &out) {
+    // Gray level of each combination of planes, plane 0 being the brightest
+    static constexpr uint8_t LEVELS[4] = { 0, 255, 85, 170 };
+
+    bool native = resolution == Resolution::NATIVE;
+    int columns = native ? Display::HIRES_WIDTH : Display::WIDTH;
+    int lines = native ? Display::HIRES_HEIGHT : Display::HEIGHT;
+    int width = columns * scale;
+
+    std::array<uint64_t, Display::HEIGHT> rows{};
+    if (!native) {
+        rows = Display::downsample(frame);
+    }
+
+    out.clear();
+
+    if (format == Format::PBM) {
+        char header[32];
+        int length = std::snprintf(header, sizeof(header), "P4\n%d %d\n", width, lines * scale);
+        out.insert(out.end(), header, header + length);
+    } else if (format == Format::Y4M) {
+        const char header[] = "FRAME\n";
+        out.insert(out.end(), header, header + sizeof(header) - 1);
+    }
+
+    // Bytes per output row; widths are always a multiple of 64 pixels
+    size_t row_size = format == Format::Y4M ? width : width / 8;
+    std::vector<uint8_t> row(row_size);
+
+    for (int y = 0; y < lines; ++y) {
+        for (int x = 0; x < width; ++x) {
+            uint8_t planes = native ? Display::get_pixel(frame, x / scale, y) : (rows[y] >> (63 - x / scale)) & 0x01;
+            bool lit = planes != 0;
+
+            if (format == Format::Y4M) {
+                row[x] = LEVELS[planes];
+            } else {
+                // PBM uses 1 for black
+                bool bit = format == Format::PBM ? !lit : lit;
+                uint8_t mask = 0x80 >> (x % 8);
+                row[x / 8] = bit ? (row[x / 8] | mask) : (row[x / 8] & ~mask);
+            }
+        }
+
+        for (int n = 0; n < scale; ++n) {
+            out.insert(out.end(), row.begin(), row.end());
+        }
+    }
+}
+
+void FrameWriter::write_frames() {
+    bool has_encoded = false;
+    Display::Frame encoded_frame;
+
+    while (true) {
+        Frame frame;
+
+        {
+            std::unique_lock<std::mutex> lock(this->lock);
+            this->available.wait(lock, [this] { return !this->queue.empty() || this->closing; });
+
+            if (this->queue.empty()) {
+                break;
+            }
+
+            frame = this->queue.front();
+            this->queue.pop_front();
+        }
+
+        if (!has_encoded || frame.frame != encoded_frame) {
+            FrameWriter::encode(frame.frame, this->format, this->scale, this->resolution, this->encoded);
+            encoded_frame = frame.frame;
+            has_encoded = true;
+        }
+
+        for (uint32_t n = 0; n < frame.count; ++n) {
+            std::fwrite(this->encoded.data(), 1, this->encoded.size(), this->file);
+        }
+    }
+
+    std::fflush(this->file);
+}
+
+void FrameWriter::close() {
+    if (this->file == nullptr) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->lock);
+        this->closing = true;
+    }
+    this->available.notify_one();
+
+    this->thread.join();
+
+    if (this->owns_file) {
+        std::fclose(this->file);
+    }
+    this->file = nullptr;
+}
+
+uint64_t FrameWriter::get_dropped() const {
+    std::lock_guard<std::mutex> lock(this->lock);
+    return this->dropped;
+}
+
+int FrameWriter::get_width() const {
+    int width = this->resolution == Resolution::NATIVE ? Display::HIRES_WIDTH : Display::WIDTH;
+    return width * this->scale;
+}
+
+int FrameWriter::get_height() const {
+    int height = this->resolution == Resolution::NATIVE ? Display::HIRES_HEIGHT : Display::HEIGHT;
+    return height * this->scale;
+}
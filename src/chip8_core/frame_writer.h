@@ -0,0 +1,164 @@
+#pragma once
+
+#include "display.h"
+
+#include <array>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// Streams frames of a Display to a file or pipe from a background thread.
+///
+/// Frames are submitted at a fixed cadence (usually once per timer tick) and
+/// queued in a bounded buffer, so a slow output never stalls emulation. If the
+/// buffer is full, changed frames are dropped and counted, and the previous
+/// frame is written in their place to keep the cadence. Unchanged frames
+/// never take up space in the buffer; they are written as repeats of the
+/// previously encoded frame.
+class FrameWriter {
+    public:
+        /// Output formats.
+        enum class Format {
+            /// Raw 1 bit per pixel, most significant bit first, lit pixels set.
+            RAW,
+
+            /// Concatenated binary PBM (`P4`) images.
+            PBM,
+
+            /// YUV4MPEG2 stream with a monochrome luma plane at 60 fps.
+            ///
+            /// At native resolution, each combination of planes has its own
+            /// gray level.
+            Y4M,
+        };
+
+        /// Resolutions frames are written at.
+        enum class Resolution {
+            /// Display::WIDTH x Display::HEIGHT, as returned by Display::get_rows().
+            LOW,
+
+            /// Display::HIRES_WIDTH x Display::HIRES_HEIGHT, low resolution
+            /// frames are doubled in both dimensions.
+            NATIVE,
+        };
+
+        /// Maximum number of distinct frames waiting to be written.
+        static constexpr size_t CAPACITY = 64;
+
+    private:
+        /// A queued frame.
+        struct Frame {
+            /// Contents of the display, as returned by Display::get_frame().
+            Display::Frame frame;
+
+            /// Number of times the frame should be written.
+            uint32_t count;
+        };
+
+        /// Output file.
+        std::FILE *file = nullptr;
+
+        /// Whether #file was opened by this writer and should be closed.
+        bool owns_file = false;
+
+        Format format = Format::RAW;
+
+        Resolution resolution = Resolution::LOW;
+
+        /// Scaling factor in both dimensions.
+        int scale = 1;
+
+        /// Frames waiting to be written. Protected by #lock.
+        std::deque<Frame> queue;
+
+        /// Number of frames dropped because the queue was full. Protected by #lock.
+        uint64_t dropped = 0;
+
+        /// Whether the writer thread should exit once the queue is empty. Protected by #lock.
+        bool closing = false;
+
+        mutable std::mutex lock;
+
+        /// Signalled when frames are queued or the writer is closed.
+        std::condition_variable available;
+
+        /// Thread writing frames to #file.
+        std::thread thread;
+
+        /// Last submitted frame, to detect repeats.
+        Display::Frame last_frame{};
+
+        /// Whether any frame has been submitted yet.
+        bool has_last = false;
+
+        /// Encoded form of the last written frame. Only used by the writer thread.
+        std::vector<uint8_t> encoded;
+
+        /// Main function of the writer thread.
+        void write_frames();
+
+    public:
+        FrameWriter() = default;
+        ~FrameWriter();
+
+        FrameWriter(const FrameWriter &other) = delete;
+        FrameWriter& operator=(const FrameWriter &other) = delete;
+
+        /// Open the output and start the writer thread.
+        ///
+        /// \param path Path of the file or named pipe to write to, or "-" for
+        /// standard output.
+        /// \param format Format to write frames in.
+        /// \param scale Scaling factor in both dimensions. (1 - 64)
+        /// \param resolution Resolution to write frames at.
+        ///
+        /// \return Whether the output was opened successfully.
+        bool open(const char *path, Format format, int scale, Resolution resolution = Resolution::LOW);
+
+        /// Queue the current contents of a display for writing.
+        ///
+        /// Never blocks on I/O. Should be called once per emulated frame.
+        ///
+        /// \param display The display to capture.
+        void submit(const Display &display);
+
+        /// Encode a single frame, as written by a FrameWriter.
+        ///
+        /// Concatenating encoded frames after get_header() gives a complete
+        /// stream, which allows frames to be encoded on multiple threads.
+        ///
+        /// \param frame Contents of the display, as returned by Display::get_frame().
+        /// \param format Format to encode the frame in.
+        /// \param scale Scaling factor in both dimensions. (1 - 64)
+        /// \param resolution Resolution to encode the frame at.
+        /// \param out Replaced with the encoded frame.
+        static void encode(const Display::Frame &frame, Format format, int scale, Resolution resolution, std::vector<uint8_t> &out);
+
+        /// Get the header written once at the start of a stream.
+        ///
+        /// \param format Format of the stream.
+        /// \param scale Scaling factor in both dimensions. (1 - 64)
+        /// \param resolution Resolution of the stream.
+        ///
+        /// \return The header, empty for formats without one.
+        static std::string get_header(Format format, int scale, Resolution resolution = Resolution::LOW);
+
+        /// Write all queued frames and close the output.
+        void close();
+
+        /// Get the number of frames dropped because the output could not keep up.
+        ///
+        /// \return Number of dropped frames.
+        uint64_t get_dropped() const;
+
+        /// Width of the written frames in pixels.
+        int get_width() const;
+
+        /// Height of the written frames in pixels.
+        int get_height() const;
+};
@@ -0,0 +1,75 @@
+#include "input.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+
+bool InputQueue::push(const InputEvent &event) {
+    std::atomic_ref<uint32_t> head(this->head);
+
+    if (this->tail - head.load(std::memory_order_acquire) >= InputQueue::CAPACITY) {
+        return false;
+    }
+
+    this->events[this->tail % InputQueue::CAPACITY] = event;
+    std::atomic_ref<uint32_t>(this->tail).store(this->tail + 1, std::memory_order_release);
+
+    return true;
+}
+
+bool InputQueue::pop(InputEvent &event) {
+    std::atomic_ref<uint32_t> tail(this->tail);
+
+    if (tail.load(std::memory_order_acquire) == this->head) {
+        return false;
+    }
+
+    event = this->events[this->head % InputQueue::CAPACITY];
+    std::atomic_ref<uint32_t>(this->head).store(this->head + 1, std::memory_order_release);
+
+    return true;
+}
+
+bool InputQueue::empty() const {
+    // atomic_ref requires a non-const reference, but nothing is written
+    InputQueue *self = const_cast<InputQueue *>(this);
+
+    uint32_t tail = std::atomic_ref<uint32_t>(self->tail).load(std::memory_order_acquire);
+    uint32_t head = std::atomic_ref<uint32_t>(self->head).load(std::memory_order_acquire);
+
+    return head == tail;
+}
+
+void LatencyHistogram::add(uint64_t ns) {
+    uint64_t us = ns / 1000;
+    int bucket = std::min<int>(std::bit_width(us), LatencyHistogram::BUCKETS - 1);
+
+    this->count += 1;
+    this->total_ns += ns;
+    this->max_ns = std::max(this->max_ns, ns);
+    this->buckets[bucket] += 1;
+}
+
+uint64_t LatencyHistogram::mean_ns() const {
+    return this->count != 0 ? this->total_ns / this->count : 0;
+}
+
+uint64_t LatencyHistogram::percentile_ns(double fraction) const {
+    if (this->count == 0) {
+        return 0;
+    }
+
+    // Rank of the latency to find, counting from 1
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(fraction * this->count + 0.5));
+    uint64_t seen = 0;
+
+    for (int bucket = 0; bucket < LatencyHistogram::BUCKETS - 1; ++bucket) {
+        seen += this->buckets[bucket];
+
+        if (seen >= rank) {
+            return std::min(this->max_ns, (uint64_t{1} << bucket) * 1000);
+        }
+    }
+
+    return this->max_ns;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <array>
+#include <stddef.h>
+#include <stdint.h>
+
+/// A key event.
+struct InputEvent {
+    /// Time at which the event occurred, in nanoseconds since the epoch of
+    /// `std::chrono::steady_clock`.
+    uint64_t timestamp;
+
+    /// Which key's state has changed. (0x0 - 0xF)
+    uint8_t key;
+
+    /// Whether the key was pressed (true) or released (false).
+    bool down;
+};
+
+/// Histogram of latencies, in power-of-two buckets of microseconds.
+struct LatencyHistogram {
+    /// Number of buckets.
+    static constexpr int BUCKETS = 24;
+
+    /// Number of latencies recorded.
+    uint64_t count = 0;
+
+    /// Sum of all latencies, in nanoseconds.
+    uint64_t total_ns = 0;
+
+    /// Highest latency, in nanoseconds.
+    uint64_t max_ns = 0;
+
+    /// Bucket 0 counts latencies below 1 µs, and bucket n those of at least
+    /// 2^(n-1) µs but below 2^n µs. The last bucket also counts everything
+    /// longer.
+    std::array<uint64_t, BUCKETS> buckets{};
+
+    /// Record a latency.
+    ///
+    /// \param ns Latency in nanoseconds.
+    void add(uint64_t ns);
+
+    /// Get the mean latency.
+    ///
+    /// \return Mean latency in nanoseconds, or 0 if nothing was recorded.
+    uint64_t mean_ns() const;
+
+    /// Estimate a percentile of the latencies.
+    ///
+    /// \param fraction Fraction of latencies which should be at most the
+    /// result, from 0 to 1.
+    ///
+    /// \return Upper bound of the bucket containing the percentile in
+    /// nanoseconds, capped at #max_ns, or 0 if nothing was recorded.
+    uint64_t percentile_ns(double fraction) const;
+};
+
+/// Latencies of key events reaching the screen.
+///
+/// Every stage is measured from the time the event occurred, so the
+/// difference between two stages is the time spent in between:
+///
+/// - applied: event handling and scheduling of the CPU thread.
+/// - observed: the ROM polling its input.
+/// - drawn: the ROM reacting to its input.
+/// - presented: waiting for the next frame and vsync.
+struct InputLatency {
+    /// Until the event was applied to the keys, between instructions.
+    LatencyHistogram applied;
+
+    /// Until the ROM first read the key with `Ex9E`, `ExA1` or `Fx0A`.
+    LatencyHistogram observed;
+
+    /// Until the first `Dxyn` after the observation changed video memory.
+    LatencyHistogram drawn;
+
+    /// Until the frame containing the draw was presented. Recorded by the
+    /// frontend, see CPU::take_drawn_input().
+    LatencyHistogram presented;
+};
+
+/// Lock-free queue of key events, with a single producer and a single consumer.
+///
+/// The queue is trivially copyable, so copying a CPU also copies its pending
+/// events. Copying is not safe while events are being pushed.
+class InputQueue {
+    public:
+        /// Maximum number of pending events.
+        static constexpr size_t CAPACITY = 16;
+
+    private:
+        /// Ring buffer of events.
+        std::array<InputEvent, InputQueue::CAPACITY> events{};
+
+        /// Number of events popped so far. Only written by the consumer.
+        ///
+        /// \important Only access this through `std::atomic_ref`.
+        uint32_t head = 0;
+
+        /// Number of events pushed so far. Only written by the producer.
+        ///
+        /// \important Only access this through `std::atomic_ref`.
+        uint32_t tail = 0;
+
+    public:
+        /// Add an event to the queue. Must only be called from the producer thread.
+        ///
+        /// \param event The event to add.
+        ///
+        /// \return False if the queue is full and the event was dropped.
+        bool push(const InputEvent &event);
+
+        /// Take the oldest event from the queue. Must only be called from the consumer thread.
+        ///
+        /// \param event Set to the event, if there is one.
+        ///
+        /// \return False if the queue was empty.
+        bool pop(InputEvent &event);
+
+        /// Returns whether there are no pending events.
+        bool empty() const;
+};
@@ -0,0 +1,52 @@
+#include "input_log.h"
+
+#include <fstream>
+#include <iterator>
+
+bool InputLog::load(const char *path, std::vector<uint16_t> &frames) {
+    std::ifstream stream(path, std::ios::in | std::ios::binary);
+
+    if (!stream.is_open()) {
+        return false;
+    }
+
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+
+    if (stream.bad() || data.size() % 2 != 0) {
+        return false;
+    }
+
+    frames.resize(data.size() / 2);
+    for (size_t frame = 0; frame < frames.size(); ++frame) {
+        frames[frame] = data[2 * frame] | data[2 * frame + 1] << 8;
+    }
+
+    return true;
+}
+
+bool InputLog::save(const char *path, const std::vector<uint16_t> &frames) {
+    std::ofstream stream(path, std::ios::out | std::ios::binary | std::ios::trunc);
+
+    if (!stream.is_open()) {
+        return false;
+    }
+
+    for (uint16_t keys : frames) {
+        char bytes[2] = {static_cast<char>(keys & 0xFF), static_cast<char>(keys >> 8)};
+        stream.write(bytes, 2);
+    }
+
+    return static_cast<bool>(stream);
+}
+
+void InputLog::run_frame(CPU &cpu, uint16_t keys, unsigned steps) {
+    cpu.set_keys(keys);
+    cpu.run(steps);
+    cpu.tick_timers();
+}
+
+void InputLog::run_frame(CPU &cpu, uint16_t keys, StateHash &hash, unsigned steps) {
+    cpu.set_keys(keys);
+    hash.run(cpu, steps);
+    cpu.tick_timers();
+}
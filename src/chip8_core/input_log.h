@@ -0,0 +1,94 @@
+#pragma once
+
+#include "cpu.h"
+#include "state_hash.h"
+
+#include <stdint.h>
+#include <vector>
+
+/// Key input of a session running in lockstep with the timers.
+///
+/// Holds one bitmask of pressed keys per frame, bit n indicating key n. A
+/// frame consists of applying the mask with CPU::set_keys(), running
+/// CPU::STEPS_PER_FRAME instructions and ticking the timers once, so a log
+/// together with the initial state fully determines a session.
+///
+/// Logs are stored without a header as little-endian 16-bit masks, so they
+/// can be appended to while recording and concatenated.
+class InputLog {
+    public:
+        /// Read a log from a file.
+        ///
+        /// \param path Path of the file to read.
+        /// \param frames Replaced with the key mask of every frame.
+        ///
+        /// \return Whether the file was read successfully.
+        static bool load(const char *path, std::vector<uint16_t> &frames);
+
+        /// Write a log to a file.
+        ///
+        /// \param path Path of the file to write.
+        /// \param frames Key mask of every frame.
+        ///
+        /// \return Whether the file was written successfully.
+        static bool save(const char *path, const std::vector<uint16_t> &frames);
+
+        /// Run a single frame.
+        ///
+        /// \param cpu The CPU to run.
+        /// \param keys Key mask to hold during the frame.
+        /// \param steps Instructions per frame. Only sessions which are not
+        /// logs, like those of the C API, may run a different number.
+        static void run_frame(CPU &cpu, uint16_t keys, unsigned steps = CPU::STEPS_PER_FRAME);
+
+        /// Run a single frame, keeping a hash of the CPU's state up to date.
+        ///
+        /// \param cpu The CPU to run.
+        /// \param keys Key mask to hold during the frame.
+        /// \param hash Hash of the CPU's state.
+        /// \param steps Instructions per frame, see run_frame().
+        static void run_frame(CPU &cpu, uint16_t keys, StateHash &hash, unsigned steps = CPU::STEPS_PER_FRAME);
+
+        /// Run a single frame one instruction at a time, for callers looking
+        /// at every instruction.
+        ///
+        /// Halts are handled like CPU::run(), so the CPU ends up in the same
+        /// state as with run_frame(): delay timer polling loops are skipped,
+        /// and nothing is executed while the CPU waits for a key or jumps to
+        /// itself.
+        ///
+        /// \param cpu The CPU to run.
+        /// \param keys Key mask to hold during the frame.
+        /// \param step Called as `bool step(CPU &cpu)` to execute each other
+        /// instruction, usually through CPU::step(). Returning false ends the
+        /// frame early, without ticking the timers.
+        ///
+        /// \return Whether the frame was run to its end.
+        template<typename Step>
+        static bool run_frame(CPU &cpu, uint16_t keys, Step step);
+};
+
+template<typename Step>
+bool InputLog::run_frame(CPU &cpu, uint16_t keys, Step step) {
+    cpu.set_keys(keys);
+
+    for (unsigned n = 0; n < CPU::STEPS_PER_FRAME; ++n) {
+        uint16_t pc = cpu.get_pc();
+        CPU::Halt halt = cpu.get_halt(cpu.read_memory(pc) << 8 | cpu.read_memory(pc + 1));
+
+        if (halt == CPU::Halt::TIMER_WAIT) {
+            cpu.run(CPU::STEPS_PER_FRAME - n);
+            break;
+        } else if (halt != CPU::Halt::NONE) {
+            break;
+        }
+
+        if (!step(cpu)) {
+            return false;
+        }
+    }
+
+    cpu.tick_timers();
+
+    return true;
+}
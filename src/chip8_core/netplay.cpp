@@ -0,0 +1,291 @@
+#include "netplay.h"
+
+#include "byte_order.h"
+#include "input_log.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/// Size of the fixed part of a message in bytes.
+static constexpr size_t MESSAGE_HEADER_SIZE = 9;
+
+void LoopbackTransport::connect(LoopbackTransport &a, LoopbackTransport &b) {
+    a.inbox = std::make_shared<Queue>();
+    b.inbox = std::make_shared<Queue>();
+    a.outbox = b.inbox;
+    b.outbox = a.inbox;
+}
+
+void LoopbackTransport::set_delay(unsigned polls) {
+    this->delay = polls;
+}
+
+void LoopbackTransport::set_loss(unsigned every_nth) {
+    this->loss = every_nth;
+}
+
+bool LoopbackTransport::send(const uint8_t *data, size_t size) {
+    if (this->outbox == nullptr) {
+        return false;
+    }
+
+    this->sent += 1;
+
+    if (this->loss != 0 && this->sent % this->loss == 0) {
+        // Lost in transit
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(this->outbox->lock);
+    this->outbox->messages.push_back(Message{std::vector<uint8_t>(data, data + size), this->delay});
+
+    return true;
+}
+
+bool LoopbackTransport::receive(std::vector<uint8_t> &message) {
+    if (this->inbox == nullptr) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(this->inbox->lock);
+    std::deque<Message> &messages = this->inbox->messages;
+
+    // Every poll brings all messages in flight one step closer
+    auto arrived = std::find_if(messages.begin(), messages.end(), [](const Message &message) {
+        return message.delay == 0;
+    });
+
+    if (arrived == messages.end()) {
+        for (Message &pending : messages) {
+            pending.delay -= 1;
+        }
+
+        return false;
+    }
+
+    message = std::move(arrived->data);
+    messages.erase(arrived);
+
+    return true;
+}
+
+UdpTransport::~UdpTransport() {
+    this->close();
+}
+
+bool UdpTransport::open(uint16_t local_port, const char *remote_host, uint16_t remote_port) {
+    if (this->fd >= 0) {
+        return false;
+    }
+
+    sockaddr_in remote{};
+    remote.sin_family = AF_INET;
+    remote.sin_port = htons(remote_port);
+
+    if (::inet_pton(AF_INET, remote_host, &remote.sin_addr) != 1) {
+        return false;
+    }
+
+    this->fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (this->fd < 0) {
+        return false;
+    }
+
+    sockaddr_in local{};
+    local.sin_family = AF_INET;
+    local.sin_port = htons(local_port);
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+
+    // Connecting filters out datagrams from anyone but the peer
+    if (::bind(this->fd, reinterpret_cast<const sockaddr *>(&local), sizeof(local)) != 0
+            || ::connect(this->fd, reinterpret_cast<const sockaddr *>(&remote), sizeof(remote)) != 0) {
+        this->close();
+        return false;
+    }
+
+    return true;
+}
+
+void UdpTransport::close() {
+    if (this->fd >= 0) {
+        ::close(this->fd);
+        this->fd = -1;
+    }
+}
+
+bool UdpTransport::send(const uint8_t *data, size_t size) {
+    if (this->fd < 0) {
+        return false;
+    }
+
+    // A peer which is not listening yet is no error, the message is just lost
+    ssize_t sent = ::send(this->fd, data, size, MSG_DONTWAIT);
+
+    return sent == static_cast<ssize_t>(size) || (sent < 0 && errno == ECONNREFUSED);
+}
+
+bool UdpTransport::receive(std::vector<uint8_t> &message) {
+    if (this->fd < 0) {
+        return false;
+    }
+
+    uint8_t buffer[512];
+
+    while (true) {
+        ssize_t size = ::recv(this->fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+
+        if (size >= 0) {
+            message.assign(buffer, buffer + size);
+            return true;
+        }
+
+        // Refusals are reported for earlier sends while the peer was not listening
+        if (errno != EINTR && errno != ECONNREFUSED) {
+            return false;
+        }
+    }
+}
+
+Rollback::Rollback(const CPU &start, Transport &transport) : cpu(start), transport(transport) {}
+
+void Rollback::receive() {
+    std::vector<uint8_t> message;
+
+    while (this->transport.receive(message)) {
+        if (message.size() < MESSAGE_HEADER_SIZE || message.size() != MESSAGE_HEADER_SIZE + 2 * message[8]) {
+            continue;
+        }
+
+        uint32_t acknowledged = get_le(message.data(), 4);
+        uint32_t first = get_le(message.data() + 4, 4);
+        uint32_t count = message[8];
+
+        this->acknowledged = std::max(this->acknowledged, std::min<uint32_t>(acknowledged, this->local_inputs.size()));
+
+        for (uint32_t n = 0; n < count; ++n) {
+            uint32_t number = first + n;
+
+            if (number < this->remote_inputs.size()) {
+                // Already received
+                continue;
+            } else if (number > this->remote_inputs.size()) {
+                // An earlier message was lost, a later one will fill the gap
+                break;
+            }
+
+            uint16_t keys = get_le(message.data() + MESSAGE_HEADER_SIZE + 2 * n, 2);
+
+            if (number < this->frame && this->predictions[number % this->predictions.size()] != keys) {
+                this->mispredicted = std::min(this->mispredicted, number);
+            }
+
+            this->remote_inputs.push_back(keys);
+        }
+    }
+}
+
+void Rollback::send() {
+    uint32_t first = this->acknowledged;
+    uint32_t count = std::min<uint32_t>(this->local_inputs.size() - first, Rollback::MAX_MESSAGE_FRAMES);
+
+    uint8_t message[MESSAGE_HEADER_SIZE + 2 * Rollback::MAX_MESSAGE_FRAMES];
+    uint8_t *out = put_le(put_le(message, this->remote_inputs.size(), 4), first, 4);
+    out = put_le(out, count, 1);
+
+    for (uint32_t n = 0; n < count; ++n) {
+        out = put_le(out, this->local_inputs[first + n], 2);
+    }
+
+    // Sent even without new keys, to acknowledge the peer's
+    this->transport.send(message, out - message);
+}
+
+void Rollback::run_frame(uint32_t number) {
+    size_t slot = number % this->snapshots.size();
+    uint16_t remote;
+
+    if (number < this->remote_inputs.size()) {
+        remote = this->remote_inputs[number];
+    } else {
+        remote = this->remote_inputs.empty() ? 0 : this->remote_inputs.back();
+    }
+
+    this->snapshots[slot] = this->cpu;
+    this->predictions[slot] = remote;
+
+    InputLog::run_frame(this->cpu, this->local_inputs[number] | remote);
+}
+
+void Rollback::receive_and_rollback() {
+    this->receive();
+
+    if (this->mispredicted != UINT32_MAX) {
+        // Restore the state before the first mispredicted frame, and run up to the present again
+        this->cpu = this->snapshots[this->mispredicted % this->snapshots.size()];
+        this->rollbacks += 1;
+        this->resimulated += this->frame - this->mispredicted;
+
+        for (uint32_t number = this->mispredicted; number < this->frame; ++number) {
+            this->run_frame(number);
+        }
+
+        this->mispredicted = UINT32_MAX;
+    }
+}
+
+void Rollback::poll() {
+    this->receive_and_rollback();
+    this->send();
+}
+
+bool Rollback::advance(uint16_t local_keys) {
+    this->receive_and_rollback();
+
+    if (this->frame >= this->remote_inputs.size() + Rollback::MAX_PREDICTION) {
+        // Too far ahead, wait for the peer to catch up
+        this->send();
+        return false;
+    }
+
+    this->local_inputs.push_back(local_keys);
+    this->run_frame(this->frame);
+    this->frame += 1;
+
+    this->send();
+
+    return true;
+}
+
+const CPU& Rollback::get_cpu() const {
+    return this->cpu;
+}
+
+uint32_t Rollback::get_frame() const {
+    return this->frame;
+}
+
+uint32_t Rollback::get_confirmed_frames() const {
+    return std::min<uint32_t>(this->frame, this->remote_inputs.size());
+}
+
+std::vector<uint16_t> Rollback::get_inputs() const {
+    std::vector<uint16_t> ret(this->get_confirmed_frames());
+
+    for (size_t number = 0; number < ret.size(); ++number) {
+        ret[number] = this->local_inputs[number] | this->remote_inputs[number];
+    }
+
+    return ret;
+}
+
+uint64_t Rollback::get_rollbacks() const {
+    return this->rollbacks;
+}
+
+uint64_t Rollback::get_resimulated_frames() const {
+    return this->resimulated;
+}
@@ -0,0 +1,243 @@
+#pragma once
+
+#include "cpu.h"
+
+#include <array>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/// Unreliable, unordered delivery of small messages to a single peer.
+class Transport {
+    public:
+        virtual ~Transport() = default;
+
+        /// Send a message to the peer. Messages may be lost or reordered.
+        ///
+        /// \param data The message.
+        /// \param size Size of the message in bytes.
+        ///
+        /// \return False if the message could not be sent.
+        virtual bool send(const uint8_t *data, size_t size) = 0;
+
+        /// Take a message sent by the peer, without blocking.
+        ///
+        /// \param message Replaced with the message, if there is one.
+        ///
+        /// \return False if no message is waiting.
+        virtual bool receive(std::vector<uint8_t> &message) = 0;
+};
+
+/// Transport between two objects in the same process, for testing.
+///
+/// Messages can be delayed and dropped deterministically, to simulate a
+/// network.
+class LoopbackTransport : public Transport {
+    private:
+        /// A message in flight.
+        struct Message {
+            std::vector<uint8_t> data;
+
+            /// Number of further receive() calls before the message arrives.
+            unsigned delay;
+        };
+
+        /// Messages sent to one side of the connection.
+        struct Queue {
+            std::mutex lock;
+            std::deque<Message> messages;
+        };
+
+        /// Messages sent to this side.
+        std::shared_ptr<Queue> inbox;
+
+        /// Messages sent to the peer.
+        std::shared_ptr<Queue> outbox;
+
+        /// Number of receive() calls a message sent by this side takes to arrive.
+        unsigned delay = 0;
+
+        /// Drop every n-th message sent by this side, or 0 to drop none.
+        unsigned loss = 0;
+
+        /// Number of messages sent so far.
+        uint64_t sent = 0;
+
+    public:
+        /// Connect two transports to each other.
+        ///
+        /// \param a One side of the connection.
+        /// \param b The other side.
+        static void connect(LoopbackTransport &a, LoopbackTransport &b);
+
+        /// Delay messages sent by this side.
+        ///
+        /// \param polls Number of receive() calls on the other side before a
+        /// message arrives, usually one per frame.
+        void set_delay(unsigned polls);
+
+        /// Drop messages sent by this side.
+        ///
+        /// \param every_nth Drop every n-th message, or 0 to drop none.
+        void set_loss(unsigned every_nth);
+
+        bool send(const uint8_t *data, size_t size) override;
+        bool receive(std::vector<uint8_t> &message) override;
+};
+
+/// Transport over UDP, e.g. to another process on the same host.
+class UdpTransport : public Transport {
+    private:
+        /// Socket, or -1 if not open.
+        int fd = -1;
+
+    public:
+        UdpTransport() = default;
+        ~UdpTransport();
+
+        UdpTransport(const UdpTransport &other) = delete;
+        UdpTransport& operator=(const UdpTransport &other) = delete;
+
+        /// Bind to a local port and set the peer's address.
+        ///
+        /// \param local_port Port to receive on.
+        /// \param remote_host IPv4 address of the peer, e.g. "127.0.0.1".
+        /// \param remote_port Port the peer receives on.
+        ///
+        /// \return Whether the socket was set up successfully.
+        bool open(uint16_t local_port, const char *remote_host, uint16_t remote_port);
+
+        void close();
+
+        bool send(const uint8_t *data, size_t size) override;
+        bool receive(std::vector<uint8_t> &message) override;
+};
+
+/// Rollback netplay of a two-player ROM sharing one keypad.
+///
+/// Both peers run the same ROM from the same state, a frame at a time with
+/// InputLog::run_frame(), holding the keys of both players. Each frame,
+/// the local player's keys are sent to the peer and the frame is run at once,
+/// predicting that the remote player still holds the keys they held last.
+/// When the remote player's actual keys arrive and differ from the
+/// prediction, the CPU is restored to its state before the mispredicted frame
+/// and the frames since are run again.
+///
+/// States are saved every frame for the last #MAX_PREDICTION frames. Saving
+/// and restoring is a plain copy of the CPU, and frames run independently of
+/// wall-clock time, so both peers stay in lockstep.
+///
+/// Each message carries all local keys the peer has not acknowledged yet,
+/// so lost messages are recovered by the next one. A message is encoded as:
+///
+/// - `uint32_t` number of the peer's frames received so far, in a row
+/// - `uint32_t` number of the first frame
+/// - `uint8_t` number of frames
+/// - `uint16_t` key mask of each frame
+///
+/// All integers are little-endian.
+class Rollback {
+    public:
+        /// Maximum number of frames run ahead of the remote player's keys.
+        static constexpr uint32_t MAX_PREDICTION = 8;
+
+        /// Maximum number of frames sent in a single message.
+        static constexpr uint32_t MAX_MESSAGE_FRAMES = 4 * MAX_PREDICTION;
+
+    private:
+        /// The CPU at the current frame, possibly running on predicted keys.
+        CPU cpu;
+
+        /// Transport to the peer.
+        Transport &transport;
+
+        /// Number of frames run so far.
+        uint32_t frame = 0;
+
+        /// Local keys of every frame so far.
+        std::vector<uint16_t> local_inputs;
+
+        /// Remote keys of every frame received so far, in a row.
+        std::vector<uint16_t> remote_inputs;
+
+        /// Number of local frames the peer has received, in a row.
+        uint32_t acknowledged = 0;
+
+        /// State before each of the frames not yet confirmed by remote keys,
+        /// indexed by frame modulo the size.
+        std::array<CPU, MAX_PREDICTION + 1> snapshots;
+
+        /// Remote keys each unconfirmed frame was run with, indexed like #snapshots.
+        std::array<uint16_t, MAX_PREDICTION + 1> predictions{};
+
+        /// Earliest frame run with mispredicted keys, or UINT32_MAX if none.
+        uint32_t mispredicted = UINT32_MAX;
+
+        /// Number of rollbacks so far.
+        uint64_t rollbacks = 0;
+
+        /// Number of frames run again after rollbacks.
+        uint64_t resimulated = 0;
+
+        /// Read all messages received from the peer, noting the earliest
+        /// mispredicted frame.
+        void receive();
+
+        /// Apply all messages received from the peer, and roll back if any
+        /// frame was mispredicted.
+        void receive_and_rollback();
+
+        /// Send all local keys the peer has not acknowledged.
+        void send();
+
+        /// Run a single frame, saving the state before it.
+        ///
+        /// \param number Number of the frame, equal to the current frame.
+        void run_frame(uint32_t number);
+
+    public:
+        /// Start a session.
+        ///
+        /// \param start State of the CPU at frame 0, identical on both peers.
+        /// \param transport Transport to the peer, which must outlive the session.
+        Rollback(const CPU &start, Transport &transport);
+
+        /// Run the next frame with the local player's keys.
+        ///
+        /// Call once per frame. First applies the keys received from the
+        /// peer, rolling back if any frame was mispredicted.
+        ///
+        /// \param local_keys Bitmask of keys held by the local player.
+        ///
+        /// \return False if the frame was not run, because the peer is
+        /// #MAX_PREDICTION frames behind. Call again with the same keys on
+        /// the next frame.
+        bool advance(uint16_t local_keys);
+
+        /// Exchange keys with the peer without running a frame, e.g. while
+        /// paused or to confirm the last frames at the end of a session.
+        void poll();
+
+        /// Get the CPU at the current frame, e.g. to present its display.
+        const CPU& get_cpu() const;
+
+        /// Number of frames run so far.
+        uint32_t get_frame() const;
+
+        /// Number of frames run with the remote player's actual keys, which
+        /// can no longer be rolled back.
+        uint32_t get_confirmed_frames() const;
+
+        /// Get the combined keys of every confirmed frame, e.g. to save the
+        /// session as an InputLog.
+        std::vector<uint16_t> get_inputs() const;
+
+        /// Number of rollbacks so far.
+        uint64_t get_rollbacks() const;
+
+        /// Number of frames run again after rollbacks.
+        uint64_t get_resimulated_frames() const;
+};
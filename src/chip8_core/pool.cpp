@@ -0,0 +1,137 @@
+#include "pool.h"
+
+#include "state_hash.h"
+
+#include <utility>
+
+/// Whether an instance halted for the given reason can be parked.
+///
+/// Instances waiting for the delay timer are woken every frame anyway, and
+/// CPU::run() already skips their remaining steps cheaply.
+static bool should_park(CPU::Halt halt) {
+    return halt == CPU::Halt::KEY_WAIT || halt == CPU::Halt::JUMP_SELF;
+}
+
+size_t Pool::add(const CPU &cpu) {
+    size_t idx = this->cpus.size();
+
+    this->cpus.push_back(cpu);
+    this->parked_at.push_back(Pool::NOT_PARKED);
+    this->runnable.push_back(idx);
+
+    return idx;
+}
+
+void Pool::reserve(size_t capacity) {
+    this->cpus.reserve(capacity);
+    this->parked_at.reserve(capacity);
+    this->runnable.reserve(capacity);
+}
+
+void Pool::wake(size_t idx) {
+    if (this->parked_at[idx] == Pool::NOT_PARKED) {
+        return;
+    }
+
+    CPU &cpu = this->cpus[idx];
+    cpu.tick_timers(this->frame - this->parked_at[idx]);
+
+    if (!should_park(cpu.get_halt())) {
+        this->parked_at[idx] = Pool::NOT_PARKED;
+        this->runnable.push_back(idx);
+    } else {
+        // Still halted, but timers are now up-to-date
+        this->parked_at[idx] = this->frame;
+    }
+}
+
+CPU& Pool::get(size_t idx) {
+    this->wake(idx);
+    return this->cpus[idx];
+}
+
+void Pool::set_key_down(size_t idx, uint8_t key, bool down) {
+    this->cpus[idx].set_key_down(key, down);
+    this->wake(idx);
+}
+
+void Pool::set_engine(const Engine *engine) {
+    this->engine = engine;
+}
+
+void Pool::set_decoding(bool enabled) {
+    this->decoding = enabled;
+
+    if (!enabled) {
+        this->decoder.reset();
+        this->overlays.clear();
+    }
+}
+
+void Pool::set_decoder(std::shared_ptr<const Decoder> decoder) {
+    this->decoding = true;
+    this->decoder = std::move(decoder);
+}
+
+void Pool::run_frame(unsigned steps) {
+    if (this->decoding && this->engine == nullptr && !this->cpus.empty()) {
+        if (this->decoder == nullptr) {
+            this->decoder = std::make_shared<const Decoder>(this->cpus[0]);
+        }
+
+        this->overlays.resize(this->cpus.size());
+    }
+
+    for (size_t n = 0; n < this->runnable.size();) {
+        size_t idx = this->runnable[n];
+        CPU &cpu = this->cpus[idx];
+
+        if (this->engine != nullptr) {
+            this->engine->run(cpu, steps);
+        } else if (this->decoding) {
+            this->decoder->run(cpu, steps, this->overlays[idx]);
+        } else {
+            cpu.run(steps);
+        }
+        cpu.tick_timers();
+
+        if (should_park(cpu.get_halt())) {
+            // Park the instance; this frame's tick has already been applied
+            this->parked_at[idx] = this->frame + 1;
+            this->runnable[n] = this->runnable.back();
+            this->runnable.pop_back();
+        } else {
+            ++n;
+        }
+    }
+
+    ++this->frame;
+}
+
+std::vector<size_t> Pool::find_duplicates() {
+    std::vector<const CPU *> cpus;
+    std::vector<uint64_t> hashes;
+    cpus.reserve(this->cpus.size());
+    hashes.reserve(this->cpus.size());
+
+    for (size_t idx = 0; idx < this->cpus.size(); ++idx) {
+        const CPU &cpu = this->get(idx);
+
+        cpus.push_back(&cpu);
+        hashes.push_back(StateHash::compute(cpu));
+    }
+
+    return StateHash::find_duplicates(cpus, hashes);
+}
+
+bool Pool::is_parked(size_t idx) const {
+    return this->parked_at[idx] != Pool::NOT_PARKED;
+}
+
+size_t Pool::size() const {
+    return this->cpus.size();
+}
+
+size_t Pool::runnable_count() const {
+    return this->runnable.size();
+}
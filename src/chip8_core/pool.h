@@ -0,0 +1,133 @@
+#pragma once
+
+#include "cpu.h"
+#include "decoder.h"
+#include "engine.h"
+
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/// A collection of CPUs which are scheduled together, one frame at a time.
+///
+/// Instances which halt waiting for a key or in a jump to themselves (see
+/// CPU::Halt) are parked and no longer stepped until an event arrives that
+/// could resume them. Timers of parked instances are
+/// not ticked either; the missed ticks are applied in one go when the
+/// instance is woken up or accessed.
+class Pool {
+    private:
+        /// All instances in this pool.
+        std::vector<CPU> cpus;
+
+        /// Frame at which each instance was parked, or NOT_PARKED.
+        std::vector<uint64_t> parked_at;
+
+        /// Indices of instances which are not parked.
+        std::vector<size_t> runnable;
+
+        /// Number of frames run so far.
+        uint64_t frame = 0;
+
+        /// Engine used to run the instances, or nullptr to use the interpreter.
+        const Engine *engine = nullptr;
+
+        /// Whether to run instances from a decode cache.
+        bool decoding = false;
+
+        /// Decode cache shared by all instances, or nullptr until the first
+        /// frame is run with decoding enabled.
+        std::shared_ptr<const Decoder> decoder;
+
+        /// Decoded code private to each instance, see Decoder::Overlay.
+        std::vector<Decoder::Overlay> overlays;
+
+        /// Special value for #parked_at, indicating a runnable instance.
+        static constexpr uint64_t NOT_PARKED = UINT64_MAX;
+
+        /// Apply timer ticks missed while parked, and return the instance to
+        /// the run queue if it is no longer halted.
+        void wake(size_t idx);
+
+    public:
+        /// Add a new instance to the pool.
+        ///
+        /// \note Adding instances invalidates references returned by get().
+        ///
+        /// \param cpu Initial state of the new instance.
+        ///
+        /// \return Index of the new instance.
+        size_t add(const CPU &cpu);
+
+        /// Reserve space for the given number of instances.
+        ///
+        /// Instances are stored contiguously; reserving up front avoids
+        /// reallocating and copying them as the pool grows.
+        ///
+        /// \param capacity Number of instances to reserve space for.
+        void reserve(size_t capacity);
+
+        /// Get an instance by index.
+        ///
+        /// Missed timer ticks of a parked instance are applied first, so the
+        /// returned state is always up-to-date.
+        ///
+        /// \param idx Index as returned by add().
+        ///
+        /// \return The instance.
+        CPU& get(size_t idx);
+
+        /// Set the key state of a given instance, waking it if necessary.
+        ///
+        /// \param idx Index of the instance.
+        /// \param key Which key's state has changed. (0x0 - 0xF)
+        /// \param down Whether the key was pressed (true) or released (false).
+        void set_key_down(size_t idx, uint8_t key, bool down);
+
+        /// Run all instances on a recompiled engine instead of the interpreter.
+        ///
+        /// \param engine Engine generated for the ROM the instances are
+        /// running, or nullptr to use the interpreter.
+        void set_engine(const Engine *engine);
+
+        /// Run all instances from a cache of decoded superinstructions (see
+        /// Decoder) instead of the plain interpreter. Has no effect while an
+        /// engine is set.
+        ///
+        /// The cache is decoded from the memory of the first instance when
+        /// the next frame is run, and shared read-only by all instances.
+        ///
+        /// \param enabled Whether to use the decode cache.
+        void set_decoding(bool enabled);
+
+        /// Run all instances from a given decode cache, e.g. one shared with
+        /// other pools running the same ROM. Enables decoding.
+        ///
+        /// \param decoder Decoder built from the ROM the instances are
+        /// running, or nullptr to decode it from the first instance.
+        void set_decoder(std::shared_ptr<const Decoder> decoder);
+
+        /// Run a single frame: step every runnable instance, then tick its timers.
+        ///
+        /// \param steps Number of instructions to execute per instance.
+        void run_frame(unsigned steps);
+
+        /// Find instances in identical states, e.g. sessions sitting in the
+        /// same attract-mode loop, so that only one of each needs to be run.
+        ///
+        /// Brings the timers of parked instances up to date first.
+        ///
+        /// \return For every instance, the index of the first instance in the
+        /// same state (see StateHash::find_duplicates()).
+        std::vector<size_t> find_duplicates();
+
+        /// Returns whether the given instance is currently parked.
+        bool is_parked(size_t idx) const;
+
+        /// Number of instances in the pool.
+        size_t size() const;
+
+        /// Number of instances which are currently being scheduled.
+        size_t runnable_count() const;
+};
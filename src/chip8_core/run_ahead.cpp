@@ -0,0 +1,42 @@
+#include "run_ahead.h"
+
+bool RunAhead::set_frames(unsigned frames) {
+    if (frames > RunAhead::MAX_FRAMES) {
+        return false;
+    }
+
+    this->frames = frames;
+
+    return true;
+}
+
+unsigned RunAhead::get_frames() const {
+    return this->frames;
+}
+
+const CPU& RunAhead::run(const CPU &cpu) {
+    this->ahead = cpu;
+
+    // Drop a draw the real CPU has not handed out, so the copy can report its own
+    this->ahead.take_drawn_input();
+
+    for (unsigned frame = 0; frame < this->frames; ++frame) {
+        this->ahead.run(CPU::STEPS_PER_FRAME);
+        this->ahead.tick_timers();
+    }
+
+    uint64_t input = this->ahead.take_drawn_input();
+    if (input > this->latest_input) {
+        this->drawn_input = input;
+        this->latest_input = input;
+    }
+
+    return this->ahead;
+}
+
+uint64_t RunAhead::take_drawn_input() {
+    uint64_t ret = this->drawn_input;
+    this->drawn_input = 0;
+
+    return ret;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "cpu.h"
+
+#include <stdint.h>
+
+/// Presents the display as it will be a few frames from now, hiding the
+/// frames a ROM takes to react to input.
+///
+/// Every frame, the CPU is copied and the copy is run ahead with the keys
+/// currently held, see InputLog::run_frame(). The real
+/// CPU is left untouched, so a key pressed in between is still applied at the
+/// right frame. Copying is a single memcpy of the CPU, and running ahead
+/// costs a few dozen instructions per frame, far below the frame budget.
+class RunAhead {
+    public:
+        /// Maximum number of frames to run ahead.
+        static constexpr unsigned MAX_FRAMES = 8;
+
+    private:
+        /// The copy run ahead.
+        CPU ahead;
+
+        /// Number of frames to run ahead.
+        unsigned frames = 1;
+
+        /// Key event behind the latest draw found by run(), not yet taken.
+        uint64_t drawn_input = 0;
+
+        /// Key event behind the latest draw found by run() so far.
+        uint64_t latest_input = 0;
+
+    public:
+        /// Set the number of frames to run ahead.
+        ///
+        /// \param frames Number of frames, up to #MAX_FRAMES. Should not
+        /// exceed the number of frames the ROM takes to react to input, or
+        /// the game appears to react to keys before they are pressed.
+        ///
+        /// \return False if the number is out of range.
+        bool set_frames(unsigned frames);
+
+        /// Get the number of frames to run ahead.
+        unsigned get_frames() const;
+
+        /// Run a copy of the CPU ahead.
+        ///
+        /// \param cpu The CPU at the current frame. Must not be running.
+        ///
+        /// \return The copy, valid until the next call.
+        const CPU& run(const CPU &cpu);
+
+        /// Take the key event behind the latest draw reacting to input in
+        /// the copy, like CPU::take_drawn_input(). Events are reported once,
+        /// even though every copy repeats the draws of the previous one.
+        ///
+        /// \return When the event occurred, or 0 if there is no new one.
+        uint64_t take_drawn_input();
+};
@@ -0,0 +1,286 @@
+#include "save_state.h"
+
+#include "byte_order.h"
+#include "fnv.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/// Run-length encode data (PackBits).
+///
+/// A control byte n below 128 is followed by n + 1 literal bytes. Otherwise,
+/// the following byte is repeated n - 126 times.
+static void compress(const uint8_t *data, size_t size, std::vector<uint8_t> &out) {
+    size_t pos = 0;
+
+    while (pos < size) {
+        size_t run = 1;
+        while (pos + run < size && run < 129 && data[pos + run] == data[pos]) {
+            ++run;
+        }
+
+        if (run >= 2) {
+            out.push_back(run + 126);
+            out.push_back(data[pos]);
+            pos += run;
+            continue;
+        }
+
+        // Collect literals until the next run of at least two bytes
+        size_t literals = 1;
+        while (pos + literals < size && literals < 128
+                && !(pos + literals + 1 < size && data[pos + literals] == data[pos + literals + 1])) {
+            ++literals;
+        }
+
+        out.push_back(literals - 1);
+        out.insert(out.end(), data + pos, data + pos + literals);
+        pos += literals;
+    }
+}
+
+/// Decode run-length encoded data.
+///
+/// \return Whether the data decoded to exactly `size` bytes.
+static bool decompress(const uint8_t *data, size_t size, uint8_t *out, size_t out_size) {
+    size_t in_pos = 0;
+    size_t out_pos = 0;
+
+    while (in_pos < size) {
+        uint8_t control = data[in_pos++];
+
+        if (control < 128) {
+            size_t literals = control + 1;
+
+            if (in_pos + literals > size || out_pos + literals > out_size) {
+                return false;
+            }
+
+            std::memcpy(out + out_pos, data + in_pos, literals);
+            in_pos += literals;
+            out_pos += literals;
+        } else {
+            size_t run = control - 126;
+
+            if (in_pos >= size || out_pos + run > out_size) {
+                return false;
+            }
+
+            std::memset(out + out_pos, data[in_pos++], run);
+            out_pos += run;
+        }
+    }
+
+    return out_pos == out_size;
+}
+
+std::vector<uint8_t> SaveState::serialize(const CPU &cpu, Compression compression) {
+    std::array<uint8_t, SaveState::PAYLOAD_SIZE> payload{};
+
+    // Timers may be ticked from a different thread
+    uint8_t dt = std::atomic_ref<uint8_t>(const_cast<uint8_t &>(cpu.dt)).load(std::memory_order_relaxed);
+    uint8_t st = std::atomic_ref<uint8_t>(const_cast<uint8_t &>(cpu.st)).load(std::memory_order_relaxed);
+
+    uint8_t *out = payload.data();
+    out = put_le(out, cpu.pc, 2);
+    out = put_le(out, cpu.i, 2);
+    out = put_le(out, cpu.sp, 1);
+    out = put_le(out, cpu.key_wait_register, 1);
+    out = put_le(out, dt, 1);
+    out = put_le(out, st, 1);
+    out = std::copy(std::begin(cpu.registers), std::end(cpu.registers), out);
+    out = put_le(out, cpu.keys, 2);
+    out = put_le(out, 0, 2);
+    out = put_le(out, cpu.rng, 4);
+    out = std::copy(std::begin(cpu.flags), std::end(cpu.flags), out);
+    out = std::copy(cpu.audio_pattern.begin(), cpu.audio_pattern.end(), out);
+    out = put_le(out, cpu.pitch, 1);
+    out = put_le(out, cpu.display.get_selected_planes(), 1);
+
+    Display::Frame frame = cpu.display.get_frame();
+    out = put_le(out, frame.hires ? 1 : 0, 1);
+    out = put_le(out, 0, 5);
+    out = std::copy(cpu.memory.begin(), cpu.memory.end(), out);
+
+    for (const auto &row : frame.rows) {
+        for (uint64_t word : row) {
+            out = put_le(out, word, 8);
+        }
+    }
+
+    std::vector<uint8_t> ret;
+    ret.reserve(SaveState::HEADER_SIZE + payload.size());
+    ret.resize(SaveState::HEADER_SIZE);
+
+    if (compression == Compression::RLE) {
+        compress(payload.data(), payload.size(), ret);
+    } else {
+        ret.insert(ret.end(), payload.begin(), payload.end());
+    }
+
+    uint8_t *header = std::copy(SaveState::MAGIC.begin(), SaveState::MAGIC.end(), ret.data());
+    header = put_le(header, SaveState::VERSION, 4);
+    header = put_le(header, static_cast<uint32_t>(compression), 4);
+    header = put_le(header, payload.size(), 4);
+    header = put_le(header, ret.size() - SaveState::HEADER_SIZE, 4);
+    put_le(header, fnv1a(payload.data(), payload.size()), 8);
+
+    return ret;
+}
+
+bool SaveState::deserialize(const uint8_t *data, size_t size, CPU &cpu) {
+    if (size < SaveState::HEADER_SIZE || !std::equal(SaveState::MAGIC.begin(), SaveState::MAGIC.end(), data)) {
+        return false;
+    }
+
+    uint32_t version = get_le(data + 8, 4);
+    uint32_t compression = get_le(data + 12, 4);
+    uint32_t payload_size = get_le(data + 16, 4);
+    uint32_t stored_size = get_le(data + 20, 4);
+    uint64_t expected = get_le(data + 24, 8);
+
+    // Size of the memory stored in the payload
+    size_t memory_size = 0;
+
+    if (version == 1 && payload_size == SaveState::V1_PAYLOAD_SIZE) {
+        memory_size = 4096;
+    } else if (version == SaveState::VERSION && payload_size <= SaveState::PAYLOAD_SIZE
+            && payload_size >= SaveState::PAYLOAD_SIZE - CPU::MEMORY_SIZE + 4096) {
+        memory_size = payload_size - (SaveState::PAYLOAD_SIZE - CPU::MEMORY_SIZE);
+    }
+
+    if (memory_size == 0 || stored_size != size - SaveState::HEADER_SIZE) {
+        return false;
+    }
+
+    std::array<uint8_t, SaveState::PAYLOAD_SIZE> buffer;
+    const uint8_t *payload = data + SaveState::HEADER_SIZE;
+
+    if (compression == static_cast<uint32_t>(Compression::RLE)) {
+        if (!decompress(payload, stored_size, buffer.data(), payload_size)) {
+            return false;
+        }
+
+        payload = buffer.data();
+    } else if (compression != static_cast<uint32_t>(Compression::NONE) || stored_size != payload_size) {
+        return false;
+    }
+
+    if (fnv1a(payload, payload_size) != expected) {
+        return false;
+    }
+
+    const uint8_t *in = payload;
+    cpu.pc = get_le(in, 2);
+    cpu.i = get_le(in + 2, 2);
+    cpu.sp = in[4];
+    cpu.key_wait_register = in[5];
+    std::atomic_ref<uint8_t>(cpu.dt).store(in[6], std::memory_order_relaxed);
+    std::atomic_ref<uint8_t>(cpu.st).store(in[7], std::memory_order_relaxed);
+    std::copy(in + 8, in + 24, std::begin(cpu.registers));
+    cpu.keys = get_le(in + 24, 2);
+    cpu.rng = get_le(in + 28, 4);
+    in += 32;
+
+    if (version == 1) {
+        std::fill(std::begin(cpu.flags), std::end(cpu.flags), 0);
+        cpu.audio_pattern.fill(0);
+        cpu.pitch = CPU::DEFAULT_PITCH;
+        cpu.display.select_planes(0x1);
+    } else {
+        std::copy(in, in + 16, std::begin(cpu.flags));
+        std::copy(in + 16, in + 32, cpu.audio_pattern.begin());
+        cpu.pitch = in[32];
+        cpu.display.select_planes(in[33]);
+    }
+
+    Display::Frame frame;
+    frame.hires = version != 1 && in[34] != 0;
+
+    if (version != 1) {
+        in += 40;
+    }
+
+    std::copy(in, in + memory_size, cpu.memory.begin());
+    std::fill(cpu.memory.begin() + memory_size, cpu.memory.end(), 0);
+    in += memory_size;
+
+    for (int y = 0; y < (version == 1 ? Display::HEIGHT : Display::HIRES_HEIGHT); ++y) {
+        for (int word = 0; word < (version == 1 ? 1 : 2 * Display::PLANES); ++word) {
+            frame.rows[y][word] = get_le(in, 8);
+            in += 8;
+        }
+    }
+    cpu.display.set_frame(frame);
+
+    if (cpu.rng == 0) {
+        cpu.rng = CPU::DEFAULT_SEED;
+    }
+
+    return true;
+}
+
+bool SaveState::save(const CPU &cpu, const char *path, Compression compression) {
+    std::vector<uint8_t> data = SaveState::serialize(cpu, compression);
+    std::string temp_path = std::string(path) + ".tmp";
+
+    int fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t result = ::write(fd, data.data() + written, data.size() - written);
+
+        if (result <= 0) {
+            ::close(fd);
+            ::unlink(temp_path.c_str());
+            return false;
+        }
+
+        written += result;
+    }
+
+    // Make sure the data is on disk before it replaces the previous state
+    bool success = ::fsync(fd) == 0;
+    success = ::close(fd) == 0 && success;
+    success = success && ::rename(temp_path.c_str(), path) == 0;
+
+    if (!success) {
+        ::unlink(temp_path.c_str());
+    }
+
+    return success;
+}
+
+bool SaveState::load(CPU &cpu, const char *path) {
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(SaveState::HEADER_SIZE)) {
+        ::close(fd);
+        return false;
+    }
+
+    void *data = ::mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+
+    if (data == MAP_FAILED) {
+        return false;
+    }
+
+    bool ret = SaveState::deserialize(static_cast<const uint8_t *>(data), info.st_size, cpu);
+    ::munmap(data, info.st_size);
+
+    return ret;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "cpu.h"
+
+#include <array>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/// Versioned binary snapshots of a CPU, including its display.
+///
+/// A save state consists of a 32 byte header followed by the payload:
+///
+/// - 8 bytes #MAGIC
+/// - `uint32_t` #VERSION
+/// - `uint32_t` compression, see Compression
+/// - `uint32_t` size of the payload, #PAYLOAD_SIZE for the CPU's memory size
+/// - `uint32_t` size of the payload as stored, after compression
+/// - `uint64_t` FNV-1a hash of the uncompressed payload
+///
+/// The uncompressed payload has a fixed layout:
+///
+/// - `uint16_t` PC, `uint16_t` I, `uint8_t` SP
+/// - `uint8_t` register written by a pending `Fx0A`, 0xFF if none
+/// - `uint8_t` DT, `uint8_t` ST, 16 bytes V0 - VF
+/// - `uint16_t` bitmask of pressed keys, 2 bytes reserved, `uint32_t` RNG state
+/// - 16 bytes of SUPER-CHIP flag registers, 16 bytes of XO-CHIP audio pattern
+/// - `uint8_t` pitch, `uint8_t` selected planes, `uint8_t` 1 in high
+///   resolution, 5 bytes reserved
+/// - the CPU's memory, including the stack, usually 4096 bytes
+/// - 64 rows of 4 `uint64_t` of video memory, see Display::Frame::rows
+///
+/// All integers are little-endian, so states can be moved between hosts.
+/// Pending key events and latency statistics are not saved. States with less
+/// memory than the CPU, and states of version 1, which lack the SUPER-CHIP and
+/// XO-CHIP state and only have 32 rows of a single word, can still be loaded.
+class SaveState {
+    public:
+        /// Magic bytes at the start of every save state.
+        static constexpr std::array<uint8_t, 8> MAGIC = {'C', '8', 'S', 'T', 'A', 'T', 'E', 0};
+
+        /// Version of the save state format.
+        static constexpr uint32_t VERSION = 2;
+
+        /// Size of the header in bytes.
+        static constexpr size_t HEADER_SIZE = 32;
+
+        /// Size of the uncompressed payload in bytes.
+        static constexpr size_t PAYLOAD_SIZE = 72 + CPU::MEMORY_SIZE + 8 * 2 * Display::PLANES * Display::HIRES_HEIGHT;
+
+        /// Size of the uncompressed payload of version 1 in bytes.
+        static constexpr size_t V1_PAYLOAD_SIZE = 32 + 4096 + 8 * Display::HEIGHT;
+
+        /// Ways the payload can be stored.
+        enum class Compression : uint32_t {
+            /// Stored as is, for the fastest possible resume.
+            NONE,
+
+            /// Run-length encoded, for archiving. Mostly empty memory and
+            /// video memory compress well.
+            RLE,
+        };
+
+        /// Serialize a CPU into a save state.
+        ///
+        /// Should be called from the thread running the CPU.
+        ///
+        /// \param cpu The CPU to save.
+        /// \param compression How to store the payload.
+        ///
+        /// \return The save state.
+        static std::vector<uint8_t> serialize(const CPU &cpu, Compression compression);
+
+        /// Restore a CPU from a save state.
+        ///
+        /// The CPU is left unchanged if the save state is invalid, of an
+        /// unknown version, has more memory than the CPU, or its checksum
+        /// does not match.
+        ///
+        /// \param data The save state.
+        /// \param size Size of the save state in bytes.
+        /// \param cpu The CPU to restore into.
+        ///
+        /// \return Whether the CPU was restored.
+        static bool deserialize(const uint8_t *data, size_t size, CPU &cpu);
+
+        /// Save a CPU to a file.
+        ///
+        /// The state is written to a temporary file which then replaces the
+        /// file at path, so an existing save state is never left half-written.
+        ///
+        /// \param cpu The CPU to save.
+        /// \param path Path of the file to write.
+        /// \param compression How to store the payload.
+        ///
+        /// \return Whether the file was written successfully.
+        static bool save(const CPU &cpu, const char *path, Compression compression);
+
+        /// Restore a CPU from a file, mapping it into memory.
+        ///
+        /// \param cpu The CPU to restore into.
+        /// \param path Path of the file to read.
+        ///
+        /// \return Whether the CPU was restored.
+        static bool load(CPU &cpu, const char *path);
+};
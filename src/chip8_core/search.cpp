@@ -0,0 +1,316 @@
+#include "search.h"
+#include "input_log.h"
+#include "state_hash.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
+/// A state waiting to be expanded.
+struct Node {
+    CPU cpu;
+
+    /// Hash of #cpu, kept up to date while running frames.
+    StateHash hash;
+
+    /// Index of the node's Edge in the search tree.
+    uint32_t id;
+
+    /// Number of frames leading to the node.
+    size_t frames;
+
+    /// Rating of the node by the heuristic, if any.
+    double score;
+};
+
+/// How a visited state was reached from its parent.
+struct Edge {
+    /// Index of the parent's Edge, or NO_PARENT for the start.
+    uint32_t parent;
+
+    /// Key mask held.
+    uint16_t keys;
+
+    /// Number of frames the key mask was held for.
+    uint16_t frames;
+};
+
+/// Special value for Edge::parent, indicating the start of the search.
+static constexpr uint32_t NO_PARENT = UINT32_MAX;
+
+/// A child produced by expanding a node, to be merged into the search.
+struct Child {
+    std::unique_ptr<Node> node;
+    Edge edge;
+
+    /// Whether the goal was reached.
+    bool goal;
+};
+
+/// State shared between all workers.
+struct Shared {
+    std::mutex lock;
+
+    /// Signalled whenever nodes are added, or the search is done.
+    std::condition_variable changed;
+
+    /// Nodes waiting to be expanded. A queue for breadth-first searches, a
+    /// heap ordered by score for best-first searches.
+    std::deque<std::unique_ptr<Node>> open;
+
+    /// Hashes of all visited states.
+    std::unordered_set<uint64_t> visited;
+
+    /// How every visited state was reached.
+    std::vector<Edge> tree;
+
+    /// Number of workers currently expanding a node.
+    unsigned busy = 0;
+
+    /// Whether the search is over.
+    bool done = false;
+
+    Search::Result result;
+};
+
+/// Orders nodes by score for a max-heap, preferring shorter sequences on ties.
+static bool worse(const std::unique_ptr<Node> &a, const std::unique_ptr<Node> &b) {
+    return a->score < b->score || (a->score == b->score && a->frames > b->frames);
+}
+
+/// Run a single frame of an InputLog, updating the hash.
+///
+/// \param cpu The CPU to run.
+/// \param hash Hash of the CPU's state.
+/// \param keys Key mask to hold during the frame.
+/// \param target_pc Address to look out for, or -1.
+///
+/// \return Whether the PC reached the target address.
+static bool run_frame(CPU &cpu, StateHash &hash, uint16_t keys, int target_pc) {
+    if (target_pc < 0) {
+        InputLog::run_frame(cpu, keys, hash);
+        return false;
+    }
+
+    // Step one instruction at a time, so no address is missed
+    bool reached = cpu.get_pc() == target_pc;
+
+    InputLog::run_frame(cpu, keys, [&hash, &reached, target_pc](CPU &cpu) {
+        hash.run(cpu, 1);
+        reached |= cpu.get_pc() == target_pc;
+        return true;
+    });
+
+    // Skipped polling loops end up elsewhere
+    reached |= cpu.get_pc() == target_pc;
+
+    return reached;
+}
+
+/// Collect the key mask of every frame leading to a state.
+///
+/// \param tree How every visited state was reached.
+/// \param id Index of the state's Edge.
+///
+/// \return The key masks, one per frame.
+static std::vector<uint16_t> trace_inputs(const std::vector<Edge> &tree, uint32_t id) {
+    std::vector<uint16_t> ret;
+
+    for (; id != NO_PARENT; id = tree[id].parent) {
+        // Collected backwards, reversed at the end
+        ret.insert(ret.end(), tree[id].frames, tree[id].keys);
+    }
+
+    std::reverse(ret.begin(), ret.end());
+
+    return ret;
+}
+
+Search::Search() {
+    this->choices.push_back(0);
+
+    for (int key = 0; key < 16; ++key) {
+        this->choices.push_back(1 << key);
+    }
+
+    this->jobs = std::max(1u, std::thread::hardware_concurrency());
+}
+
+void Search::set_choices(const std::vector<uint16_t> &choices) {
+    this->choices = choices;
+}
+
+void Search::set_hold_frames(unsigned frames) {
+    this->hold_frames = std::clamp(frames, 1u, static_cast<unsigned>(UINT16_MAX));
+}
+
+void Search::set_target_pc(int pc) {
+    this->target_pc = pc;
+}
+
+void Search::set_predicate(Predicate predicate) {
+    this->predicate = std::move(predicate);
+}
+
+void Search::set_score(Score score) {
+    this->score = std::move(score);
+}
+
+void Search::set_max_frames(size_t frames) {
+    this->max_frames = frames;
+}
+
+void Search::set_max_states(size_t states) {
+    this->max_states = std::max<size_t>(1, std::min<size_t>(states, NO_PARENT));
+}
+
+void Search::set_jobs(unsigned jobs) {
+    this->jobs = std::max(1u, jobs);
+}
+
+Search::Result Search::run(const CPU &start) const {
+    Shared shared;
+
+    auto root = std::make_unique<Node>();
+    root->cpu = start;
+    root->hash.reset(root->cpu);
+    root->id = 0;
+    root->frames = 0;
+    root->score = this->score ? this->score(root->cpu) : 0.0;
+
+    if (root->cpu.get_pc() == this->target_pc || (this->predicate && this->predicate(root->cpu))) {
+        shared.result.found = true;
+        shared.result.state = start;
+        shared.result.states = 1;
+
+        return shared.result;
+    }
+
+    shared.visited.insert(root->hash.get(root->cpu));
+    shared.tree.push_back(Edge{NO_PARENT, 0, 0});
+    shared.open.push_back(std::move(root));
+
+    auto expand = [this](const Node &parent) {
+        std::vector<Child> ret;
+        ret.reserve(this->choices.size());
+
+        for (uint16_t keys : this->choices) {
+            Child child{std::make_unique<Node>(parent), Edge{parent.id, keys, 0}, false};
+            Node &node = *child.node;
+
+            while (child.edge.frames < this->hold_frames && node.frames < this->max_frames) {
+                bool reached = run_frame(node.cpu, node.hash, keys, this->target_pc);
+                child.edge.frames += 1;
+                node.frames += 1;
+
+                if (reached || (this->predicate && this->predicate(node.cpu))) {
+                    child.goal = true;
+                    break;
+                }
+            }
+
+            if (!child.goal && node.cpu.get_halt() != CPU::Halt::KEY_WAIT) {
+                // The next frame replaces the keys, unless releasing one would end a key wait
+                node.cpu.set_keys(0);
+            }
+
+            if (!child.goal && this->score) {
+                node.score = this->score(node.cpu);
+            }
+
+            ret.push_back(std::move(child));
+        }
+
+        return ret;
+    };
+
+    auto worker = [this, &shared, &expand]() {
+        std::unique_lock<std::mutex> lock(shared.lock);
+
+        while (!shared.done) {
+            if (shared.open.empty()) {
+                if (shared.busy == 0) {
+                    // Nothing left to explore
+                    shared.done = true;
+                    shared.changed.notify_all();
+                } else {
+                    shared.changed.wait(lock);
+                }
+
+                continue;
+            }
+
+            if (this->score) {
+                std::pop_heap(shared.open.begin(), shared.open.end(), worse);
+            }
+
+            std::unique_ptr<Node> node = std::move(this->score ? shared.open.back() : shared.open.front());
+            if (this->score) {
+                shared.open.pop_back();
+            } else {
+                shared.open.pop_front();
+            }
+
+            shared.busy += 1;
+            lock.unlock();
+
+            std::vector<Child> children = expand(*node);
+
+            lock.lock();
+            shared.busy -= 1;
+
+            for (Child &child : children) {
+                if (shared.done) {
+                    break;
+                }
+
+                if (child.goal) {
+                    shared.result.found = true;
+                    shared.result.inputs = trace_inputs(shared.tree, node->id);
+                    shared.result.inputs.insert(shared.result.inputs.end(), child.edge.frames, child.edge.keys);
+                    shared.result.state = child.node->cpu;
+                    shared.done = true;
+                    break;
+                }
+
+                if (child.node->frames >= this->max_frames || !shared.visited.insert(child.node->hash.get(child.node->cpu)).second) {
+                    continue;
+                }
+
+                child.node->id = shared.tree.size();
+                shared.tree.push_back(child.edge);
+                shared.open.push_back(std::move(child.node));
+
+                if (this->score) {
+                    std::push_heap(shared.open.begin(), shared.open.end(), worse);
+                }
+
+                if (shared.visited.size() >= this->max_states) {
+                    shared.done = true;
+                }
+            }
+
+            shared.changed.notify_all();
+        }
+    };
+
+    std::vector<std::thread> workers;
+
+    for (unsigned job = 1; job < this->jobs; ++job) {
+        workers.emplace_back(worker);
+    }
+
+    worker();
+
+    for (std::thread &thread : workers) {
+        thread.join();
+    }
+
+    shared.result.states = shared.visited.size();
+
+    return shared.result;
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "cpu.h"
+
+#include <functional>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/// Explores the key inputs a ROM can receive, looking for a sequence which
+/// reaches a goal, e.g. to prove that a game can be completed or that a
+/// softlock is reachable.
+///
+/// Starting from a given state, every node of the search branches into one
+/// child per input choice, each holding a key mask for a number of frames.
+/// Frames are run with InputLog::run_frame(), so the resulting sequence can
+/// be saved and replayed.
+///
+/// States are deduplicated by their StateHash, so paths merging into the same
+/// state are only explored once. Keys held at the end of a frame are ignored
+/// unless the CPU waits for a key, as the next frame replaces them. Only the
+/// 64-bit hashes of visited states are kept, trading a negligible chance of
+/// wrongly pruning a state on a collision for not having to store them.
+///
+/// Nodes are expanded by a pool of threads. Each child starts as a plain copy
+/// of its parent, as the CPU is trivially copyable.
+class Search {
+    public:
+        /// Outcome of a search.
+        struct Result {
+            /// Whether the goal was reached.
+            bool found = false;
+
+            /// Key mask of every frame leading to the goal, see InputLog.
+            std::vector<uint16_t> inputs;
+
+            /// State in which the goal was reached, if found.
+            CPU state;
+
+            /// Number of distinct states visited.
+            size_t states = 0;
+        };
+
+        /// Returns whether a state reaches the goal, checked after every frame.
+        typedef std::function<bool(const CPU &)> Predicate;
+
+        /// Rates how promising a state is, higher being better.
+        typedef std::function<double(const CPU &)> Score;
+
+    private:
+        /// Key masks to branch into at every node.
+        std::vector<uint16_t> choices;
+
+        /// Number of frames each choice is held for.
+        unsigned hold_frames = 1;
+
+        /// Address the PC should reach, or -1 for none.
+        int target_pc = -1;
+
+        /// Goal checked on the screen or any other state, may be empty.
+        Predicate predicate;
+
+        /// Heuristic of a best-first search, or empty for breadth-first.
+        Score score;
+
+        /// Maximum number of frames in a sequence.
+        size_t max_frames = 3600;
+
+        /// Maximum number of distinct states to visit.
+        size_t max_states = 100000;
+
+        /// Number of worker threads.
+        unsigned jobs = 1;
+
+    public:
+        /// Create a search branching into no keys or any single key being
+        /// held, with one thread per core.
+        Search();
+
+        /// Set the key masks to branch into at every node.
+        ///
+        /// \param choices Key masks, bit n indicating key n.
+        void set_choices(const std::vector<uint16_t> &choices);
+
+        /// Set the number of frames each choice is held for.
+        ///
+        /// Longer holds reduce the branching factor, as games rarely react
+        /// to input in every frame.
+        ///
+        /// \param frames Number of frames, at least 1.
+        void set_hold_frames(unsigned frames);
+
+        /// Search for an instruction at the given address being executed.
+        ///
+        /// \param pc Address to reach, or -1 to only check the predicate.
+        void set_target_pc(int pc);
+
+        /// Search for a state satisfying a predicate, e.g. on its display.
+        ///
+        /// \param predicate Checked after every frame, or empty to only
+        /// check the target PC.
+        void set_predicate(Predicate predicate);
+
+        /// Expand the most promising states first, rather than breadth-first.
+        ///
+        /// \param score Heuristic rating each state, or empty for breadth-first.
+        /// Ties are broken in favour of shorter sequences.
+        void set_score(Score score);
+
+        /// Limit the length of sequences.
+        ///
+        /// \param frames Maximum number of frames.
+        void set_max_frames(size_t frames);
+
+        /// Limit the number of distinct states visited, which bounds the
+        /// memory used by the search.
+        ///
+        /// \param states Maximum number of states.
+        void set_max_states(size_t states);
+
+        /// Set the number of worker threads.
+        ///
+        /// With more than one thread, breadth-first order is only kept
+        /// approximately, so sequences may be slightly longer than the
+        /// shortest one.
+        ///
+        /// \param jobs Number of threads, at least 1.
+        void set_jobs(unsigned jobs);
+
+        /// Search for the goal.
+        ///
+        /// \param start State to start from.
+        ///
+        /// \return The sequence reaching the goal, if any was found before
+        /// running out of states or frames.
+        Result run(const CPU &start) const;
+};
@@ -0,0 +1,257 @@
+#include "shared_session.h"
+
+#include <atomic>
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/// Layout of the shared memory segment.
+///
+/// All fields written by one side while the other may read them are only
+/// accessed through `std::atomic_ref`.
+struct SharedSession::Segment {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t steps_per_frame;
+
+    /// Sequence lock for the published state below. Odd while writing.
+    alignas(64) uint32_t sequence;
+
+    /// Published state, packed as pc | i << 16 | halt << 32 | sound << 40.
+    uint64_t registers;
+    uint64_t commands_done;
+    uint64_t frames;
+    uint64_t rows[Display::HEIGHT];
+    uint64_t hires;
+    uint64_t frame[Display::HIRES_HEIGHT][2 * Display::PLANES];
+
+    /// Number of commands pushed. Written by the agent.
+    alignas(64) uint64_t command_tail;
+
+    /// Number of commands popped. Written by the emulator.
+    alignas(64) uint64_t command_head;
+
+    Command commands[SharedSession::RING_SIZE];
+};
+
+/// Atomically access a field of the segment.
+///
+/// \param value The field.
+///
+/// \return An atomic reference to the field.
+template<typename T>
+static std::atomic_ref<T> shared(const T &value) {
+    return std::atomic_ref<T>(const_cast<T &>(value));
+}
+
+SharedSession::~SharedSession() {
+    this->close();
+}
+
+/// Open and map a segment.
+///
+/// \param name Name of the segment.
+/// \param flags Flags for `shm_open`.
+/// \param size Size of the segment.
+///
+/// \return The mapped segment, or nullptr.
+static void* map_segment(const char *name, int flags, size_t size) {
+    int fd = shm_open(name, flags, 0600);
+
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    if ((flags & O_CREAT) && ftruncate(fd, size) != 0) {
+        ::close(fd);
+        return nullptr;
+    }
+
+    void *ret = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    return ret == MAP_FAILED ? nullptr : ret;
+}
+
+bool SharedSession::create(const char *name, unsigned steps_per_frame) {
+    this->close();
+
+    void *mapping = map_segment(name, O_CREAT | O_EXCL | O_RDWR, sizeof(Segment));
+    if (mapping == nullptr) {
+        return false;
+    }
+
+    this->segment = new (mapping) Segment {};
+    this->segment->steps_per_frame = steps_per_frame;
+    this->segment->version = SharedSession::VERSION;
+    this->name = name;
+    this->owner = true;
+    this->commands_done = 0;
+    this->frames = 0;
+
+    // Written last, so agents never see a half-initialised segment
+    shared(this->segment->magic).store(SharedSession::MAGIC, std::memory_order_release);
+
+    return true;
+}
+
+bool SharedSession::attach(const char *name) {
+    this->close();
+
+    void *mapping = map_segment(name, O_RDWR, sizeof(Segment));
+    if (mapping == nullptr) {
+        return false;
+    }
+
+    this->segment = static_cast<Segment *>(mapping);
+    this->name = name;
+    this->owner = false;
+
+    if (shared(this->segment->magic).load(std::memory_order_acquire) != SharedSession::MAGIC
+            || this->segment->version != SharedSession::VERSION) {
+        this->close();
+        return false;
+    }
+
+    return true;
+}
+
+void SharedSession::close() {
+    if (this->segment == nullptr) {
+        return;
+    }
+
+    munmap(this->segment, sizeof(Segment));
+    this->segment = nullptr;
+
+    if (this->owner) {
+        shm_unlink(this->name.c_str());
+    }
+}
+
+bool SharedSession::process(CPU &cpu) {
+    Segment *segment = this->segment;
+
+    uint64_t head = segment->command_head;
+    uint64_t tail = shared(segment->command_tail).load(std::memory_order_acquire);
+
+    if (head == tail) {
+        return false;
+    }
+
+    for (; head != tail; ++head, ++this->commands_done) {
+        const Command &command = segment->commands[head % SharedSession::RING_SIZE];
+
+        switch (command.type) {
+            case CommandType::KEY_DOWN:
+            case CommandType::KEY_UP:
+                cpu.set_key_down(command.key, command.type == CommandType::KEY_DOWN);
+                break;
+            case CommandType::STEP:
+                cpu.run(command.count);
+                break;
+            case CommandType::FRAME:
+                for (uint32_t n = 0; n < command.count; ++n) {
+                    cpu.run(segment->steps_per_frame);
+                    cpu.tick_timers();
+                }
+                this->frames += command.count;
+                break;
+        }
+    }
+
+    // Publish before freeing the slots, so the state of all finished commands is visible
+    this->publish(cpu);
+    shared(segment->command_head).store(head, std::memory_order_release);
+
+    return true;
+}
+
+void SharedSession::publish(const CPU &cpu) {
+    Segment *segment = this->segment;
+    Display::Frame frame = cpu.get_display().get_frame();
+    std::array<uint64_t, Display::HEIGHT> rows = Display::downsample(frame);
+
+    uint64_t registers = cpu.get_pc()
+        | static_cast<uint64_t>(cpu.get_i()) << 16
+        | static_cast<uint64_t>(cpu.get_halt()) << 32
+        | static_cast<uint64_t>(cpu.is_sound_playing()) << 40;
+
+    auto sequence = shared(segment->sequence);
+    sequence.store(segment->sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    shared(segment->registers).store(registers, std::memory_order_relaxed);
+    shared(segment->frames).store(this->frames, std::memory_order_relaxed);
+    for (int y = 0; y < Display::HEIGHT; ++y) {
+        shared(segment->rows[y]).store(rows[y], std::memory_order_relaxed);
+    }
+    shared(segment->hires).store(frame.hires, std::memory_order_relaxed);
+    for (int y = 0; y < Display::HIRES_HEIGHT; ++y) {
+        for (int word = 0; word < 2 * Display::PLANES; ++word) {
+            shared(segment->frame[y][word]).store(frame.rows[y][word], std::memory_order_relaxed);
+        }
+    }
+    shared(segment->commands_done).store(this->commands_done, std::memory_order_relaxed);
+
+    sequence.store(segment->sequence + 1, std::memory_order_release);
+}
+
+bool SharedSession::push_command(const Command &command) {
+    Segment *segment = this->segment;
+
+    uint64_t tail = segment->command_tail;
+    if (tail - shared(segment->command_head).load(std::memory_order_acquire) >= SharedSession::RING_SIZE) {
+        return false;
+    }
+
+    segment->commands[tail % SharedSession::RING_SIZE] = command;
+    shared(segment->command_tail).store(tail + 1, std::memory_order_release);
+
+    return true;
+}
+
+uint64_t SharedSession::get_commands_sent() const {
+    return this->segment->command_tail;
+}
+
+SharedSession::Status SharedSession::get_status() const {
+    const Segment *segment = this->segment;
+    Status ret;
+    uint64_t registers;
+
+    while (true) {
+        uint32_t before = shared(segment->sequence).load(std::memory_order_acquire);
+
+        if (before % 2 != 0) {
+            continue;
+        }
+
+        registers = shared(segment->registers).load(std::memory_order_relaxed);
+        ret.frames = shared(segment->frames).load(std::memory_order_relaxed);
+        ret.commands_done = shared(segment->commands_done).load(std::memory_order_relaxed);
+        for (int y = 0; y < Display::HEIGHT; ++y) {
+            ret.rows[y] = shared(segment->rows[y]).load(std::memory_order_relaxed);
+        }
+        ret.frame.hires = shared(segment->hires).load(std::memory_order_relaxed) != 0;
+        for (int y = 0; y < Display::HIRES_HEIGHT; ++y) {
+            for (int word = 0; word < 2 * Display::PLANES; ++word) {
+                ret.frame.rows[y][word] = shared(segment->frame[y][word]).load(std::memory_order_relaxed);
+            }
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if (shared(segment->sequence).load(std::memory_order_relaxed) == before) {
+            break;
+        }
+    }
+
+    ret.pc = registers & 0xFFFF;
+    ret.i = (registers >> 16) & 0xFFFF;
+    ret.halt = static_cast<CPU::Halt>((registers >> 32) & 0xFF);
+    ret.sound_playing = (registers >> 40) & 0x01;
+
+    return ret;
+}
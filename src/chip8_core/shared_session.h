@@ -0,0 +1,163 @@
+#pragma once
+
+#include "cpu.h"
+#include "display.h"
+
+#include <array>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+/// Interface between an emulator and an external agent process through a
+/// POSIX shared-memory segment.
+///
+/// The emulator publishes the display and a small status block into the
+/// segment, and takes commands (key events, steps and frames) from a
+/// lock-free ring in the same segment. Neither side needs a system call or a
+/// copy through the kernel per command.
+///
+/// The emulator side calls create(), then process() in a loop. The agent
+/// side calls attach(), pushes commands and reads back the status.
+class SharedSession {
+    public:
+        /// Types of commands sent by the agent.
+        enum class CommandType : uint8_t {
+            /// Press a key.
+            KEY_DOWN,
+
+            /// Release a key.
+            KEY_UP,
+
+            /// Execute a number of instructions.
+            STEP,
+
+            /// Run a number of frames, each executing the session's steps per
+            /// frame followed by a timer tick.
+            FRAME,
+        };
+
+        /// A command sent by the agent.
+        struct Command {
+            CommandType type;
+
+            /// Key for KEY_DOWN and KEY_UP. (0x0 - 0xF)
+            uint8_t key;
+
+            /// Number of instructions or frames for STEP and FRAME.
+            uint32_t count;
+        };
+
+        /// State published by the emulator.
+        struct Status {
+            /// Number of commands fully processed. The state below reflects
+            /// all of them.
+            uint64_t commands_done;
+
+            /// Number of frames run so far.
+            uint64_t frames;
+
+            uint16_t pc;
+            uint16_t i;
+            CPU::Halt halt;
+            bool sound_playing;
+
+            /// Packed rows of the display, as returned by Display::get_rows().
+            std::array<uint64_t, Display::HEIGHT> rows;
+
+            /// Contents of the display at native resolution, in every plane,
+            /// as returned by Display::get_frame().
+            Display::Frame frame;
+        };
+
+        /// Number of commands that can be pending at once.
+        static constexpr size_t RING_SIZE = 64;
+
+        /// Identifies a session segment. ("C8SM")
+        static constexpr uint32_t MAGIC = 0x4338534D;
+
+        /// Version of the segment layout.
+        static constexpr uint32_t VERSION = 2;
+
+    private:
+        /// Layout of the shared memory segment, defined in the source file.
+        struct Segment;
+
+        /// The mapped segment, or nullptr.
+        Segment *segment = nullptr;
+
+        /// Name of the segment.
+        std::string name;
+
+        /// Whether this side created the segment, and should unlink it.
+        bool owner = false;
+
+        /// Number of commands processed. Emulator side only.
+        uint64_t commands_done = 0;
+
+        /// Number of frames run. Emulator side only.
+        uint64_t frames = 0;
+
+    public:
+        SharedSession() = default;
+        ~SharedSession();
+
+        SharedSession(const SharedSession &other) = delete;
+        SharedSession& operator=(const SharedSession &other) = delete;
+
+        /// Create a new segment, as the emulator side.
+        ///
+        /// \param name Name of the segment, starting with a slash, e.g. "/chip8-0".
+        /// \param steps_per_frame Instructions executed per FRAME command.
+        ///
+        /// \return Whether the segment was created successfully.
+        bool create(const char *name, unsigned steps_per_frame);
+
+        /// Attach to an existing segment, as the agent side.
+        ///
+        /// \param name Name the segment was created with.
+        ///
+        /// \return Whether the segment exists and is compatible.
+        bool attach(const char *name);
+
+        /// Unmap the segment, and remove it if it was created by this side.
+        void close();
+
+        /// Process all pending commands and publish the resulting state.
+        ///
+        /// Emulator side only.
+        ///
+        /// \param cpu CPU to run the commands on.
+        ///
+        /// \return Whether any commands were processed.
+        bool process(CPU &cpu);
+
+        /// Publish the current state of a CPU.
+        ///
+        /// Emulator side only. Called by process(), but also useful to publish
+        /// the initial state.
+        ///
+        /// \param cpu The CPU to publish.
+        void publish(const CPU &cpu);
+
+        /// Send a command to the emulator.
+        ///
+        /// Agent side only.
+        ///
+        /// \param command The command to send.
+        ///
+        /// \return False if the ring is full and the command was not sent.
+        bool push_command(const Command &command);
+
+        /// Get the number of commands sent so far.
+        ///
+        /// Agent side only. Once Status::commands_done reaches this value,
+        /// all commands have been processed.
+        ///
+        /// \return Number of commands sent.
+        uint64_t get_commands_sent() const;
+
+        /// Read the state most recently published by the emulator.
+        ///
+        /// \return A consistent copy of the published state.
+        Status get_status() const;
+};
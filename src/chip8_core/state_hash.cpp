@@ -0,0 +1,253 @@
+#include "state_hash.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_map>
+
+/// 64-bit finaliser of SplitMix64, spreading every input bit across the output.
+static uint64_t mix(uint64_t value) {
+    value ^= value >> 30;
+    value *= 0xBF58476D1CE4E5B9;
+    value ^= value >> 27;
+    value *= 0x94D049BB133111EB;
+    value ^= value >> 31;
+
+    return value;
+}
+
+/// Read a timer, which may be ticked from a different thread.
+static uint8_t load_timer(const uint8_t &timer) {
+    return std::atomic_ref<uint8_t>(const_cast<uint8_t &>(timer)).load(std::memory_order_relaxed);
+}
+
+uint64_t StateHash::hash_byte(uint16_t addr, uint8_t value) {
+    return mix(static_cast<uint64_t>(addr) << 8 | value);
+}
+
+uint64_t StateHash::hash_row(int y, const std::array<uint64_t, 2 * Display::PLANES> &row) {
+    // Rows and bytes must not cancel each other out
+    uint64_t hash = mix(0x10000 + y);
+
+    for (uint64_t word : row) {
+        hash = mix(hash ^ word);
+    }
+
+    return hash;
+}
+
+uint64_t StateHash::combine(const CPU &cpu, uint64_t memory_hash, uint64_t display_hash) {
+    uint64_t registers[2];
+    std::memcpy(registers, cpu.registers, sizeof(registers));
+
+    uint64_t hash = memory_hash ^ mix(display_hash);
+    hash = mix(hash ^ registers[0]);
+    hash = mix(hash ^ registers[1]);
+    hash = mix(hash ^ (static_cast<uint64_t>(cpu.pc) | static_cast<uint64_t>(cpu.i) << 16
+        | static_cast<uint64_t>(cpu.sp) << 32 | static_cast<uint64_t>(cpu.key_wait_register) << 40
+        | static_cast<uint64_t>(load_timer(cpu.dt)) << 48 | static_cast<uint64_t>(load_timer(cpu.st)) << 56));
+    hash = mix(hash ^ (static_cast<uint64_t>(cpu.keys) | static_cast<uint64_t>(cpu.rng) << 16
+        | static_cast<uint64_t>(cpu.pitch) << 48 | static_cast<uint64_t>(cpu.display.get_selected_planes()) << 56
+        | static_cast<uint64_t>(cpu.display.is_hires()) << 60));
+
+    uint64_t extended[4];
+    std::memcpy(extended, cpu.flags, sizeof(cpu.flags));
+    std::memcpy(extended + 2, cpu.audio_pattern.data(), cpu.audio_pattern.size());
+
+    for (uint64_t word : extended) {
+        hash = mix(hash ^ word);
+    }
+
+    return hash;
+}
+
+void StateHash::step(CPU &cpu) {
+    if (cpu.key_wait_register != 0xFF) {
+        // Either stays halted or applies a key event, neither touching memory
+        cpu.step();
+        return;
+    }
+
+    uint16_t instruction = cpu.memory[cpu.pc & CPU::ADDRESS_MASK] << 8 | cpu.memory[(cpu.pc + 1) & CPU::ADDRESS_MASK];
+
+    // Range of memory written by the instruction
+    uint16_t start = cpu.i;
+    uint16_t length = 0;
+
+    if (((instruction & 0xFF00) == 0x0000 && instruction != 0x00EE) || (instruction & 0xF000) == 0xD000) {
+        // Clears, scrolls, resolution changes and draws
+        Display::Frame before = cpu.display.get_frame();
+        cpu.step();
+        Display::Frame after = cpu.display.get_frame();
+
+        for (int y = 0; y < Display::HIRES_HEIGHT; ++y) {
+            if (before.rows[y] != after.rows[y]) {
+                this->display_hash ^= StateHash::hash_row(y, before.rows[y]) ^ StateHash::hash_row(y, after.rows[y]);
+            }
+        }
+
+        return;
+    } else if ((instruction & 0xF000) == 0x2000) {
+        // CALL pushes the return address
+        start = 0x1FF - cpu.sp - 1;
+        length = 2;
+    } else if ((instruction & 0xF0FF) == 0xF033) {
+        length = 3;
+    } else if ((instruction & 0xF0FF) == 0xF055) {
+        length = ((instruction & 0x0F00) >> 8) + 1;
+    } else if ((instruction & 0xF00F) == 0x5002) {
+        length = std::abs(((instruction & 0x0F00) >> 8) - ((instruction & 0x00F0) >> 4)) + 1;
+    }
+
+    if (length == 0) {
+        cpu.step();
+        return;
+    }
+
+    uint8_t before[16];
+    for (uint16_t n = 0; n < length; ++n) {
+        before[n] = cpu.memory[(start + n) & CPU::ADDRESS_MASK];
+    }
+
+    cpu.step();
+
+    for (uint16_t n = 0; n < length; ++n) {
+        uint16_t addr = (start + n) & CPU::ADDRESS_MASK;
+
+        if (cpu.memory[addr] != before[n]) {
+            this->memory_hash ^= StateHash::hash_byte(addr, before[n]) ^ StateHash::hash_byte(addr, cpu.memory[addr]);
+        }
+    }
+}
+
+void StateHash::reset(const CPU &cpu) {
+    this->memory_hash = 0;
+    this->display_hash = 0;
+
+    for (size_t addr = 0; addr < cpu.memory.size(); ++addr) {
+        this->memory_hash ^= StateHash::hash_byte(addr, cpu.memory[addr]);
+    }
+
+    Display::Frame frame = cpu.display.get_frame();
+    for (int y = 0; y < Display::HIRES_HEIGHT; ++y) {
+        this->display_hash ^= StateHash::hash_row(y, frame.rows[y]);
+    }
+}
+
+unsigned StateHash::run(CPU &cpu, unsigned max_steps) {
+    unsigned steps = 0;
+
+    cpu.process_input();
+
+    while (steps < max_steps) {
+        CPU::Halt halt = cpu.get_halt(cpu.fetch());
+
+        if (halt == CPU::Halt::TIMER_WAIT) {
+            // The polling loop writes neither memory nor the display
+            cpu.run(max_steps - steps);
+            return max_steps;
+        } else if (halt != CPU::Halt::NONE) {
+            break;
+        }
+
+        this->step(cpu);
+        ++steps;
+    }
+
+    return steps;
+}
+
+uint64_t StateHash::get(const CPU &cpu) const {
+    return StateHash::combine(cpu, this->memory_hash, this->display_hash);
+}
+
+uint64_t StateHash::compute(const CPU &cpu) {
+    StateHash hash;
+    hash.reset(cpu);
+
+    return hash.get(cpu);
+}
+
+bool StateHash::equal(const CPU &a, const CPU &b) {
+    return a.pc == b.pc
+        && a.i == b.i
+        && a.sp == b.sp
+        && a.key_wait_register == b.key_wait_register
+        && load_timer(a.dt) == load_timer(b.dt)
+        && load_timer(a.st) == load_timer(b.st)
+        && std::equal(std::begin(a.registers), std::end(a.registers), std::begin(b.registers))
+        && a.keys == b.keys
+        && a.rng == b.rng
+        && std::equal(std::begin(a.flags), std::end(a.flags), std::begin(b.flags))
+        && a.audio_pattern == b.audio_pattern
+        && a.pitch == b.pitch
+        && a.display.get_selected_planes() == b.display.get_selected_planes()
+        && a.memory == b.memory
+        && a.display.get_frame() == b.display.get_frame();
+}
+
+std::vector<size_t> StateHash::find_duplicates(const std::vector<const CPU *> &cpus, const std::vector<uint64_t> &hashes) {
+    std::vector<size_t> ret(cpus.size());
+
+    // Distinct states seen so far by hash, usually just one per hash
+    std::unordered_map<uint64_t, std::vector<size_t>> seen;
+    seen.reserve(cpus.size());
+
+    for (size_t idx = 0; idx < cpus.size(); ++idx) {
+        std::vector<size_t> &candidates = seen[hashes[idx]];
+        auto match = std::find_if(candidates.begin(), candidates.end(), [&cpus, idx](size_t other) {
+            return StateHash::equal(*cpus[other], *cpus[idx]);
+        });
+
+        if (match != candidates.end()) {
+            ret[idx] = *match;
+        } else {
+            candidates.push_back(idx);
+            ret[idx] = idx;
+        }
+    }
+
+    return ret;
+}
+
+void CycleDetector::reset() {
+    this->has_reference = false;
+    this->power = 1;
+    this->length = 0;
+    this->period = 0;
+}
+
+uint64_t CycleDetector::update(const CPU &cpu, uint64_t hash) {
+    if (this->period != 0) {
+        return this->period;
+    }
+
+    if (!this->has_reference) {
+        this->reference = cpu;
+        this->reference_hash = hash;
+        this->has_reference = true;
+        return 0;
+    }
+
+    ++this->length;
+
+    if (hash == this->reference_hash && StateHash::equal(cpu, this->reference)) {
+        this->period = this->length;
+        return this->period;
+    }
+
+    if (this->length == this->power) {
+        // Move the reference forward, so it eventually lies within the cycle
+        this->reference = cpu;
+        this->reference_hash = hash;
+        this->power *= 2;
+        this->length = 0;
+    }
+
+    return 0;
+}
+
+uint64_t CycleDetector::get_period() const {
+    return this->period;
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "cpu.h"
+
+#include <array>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/// Incrementally maintained hash of a CPU's complete state.
+///
+/// Covers everything that determines the CPU's future behaviour: registers,
+/// PC, I, the stack pointer, timers, held keys, the random number generator,
+/// the SUPER-CHIP and XO-CHIP state, memory and the display. Queued key events
+/// are not included.
+///
+/// The memory and display parts are kept up to date by running the CPU
+/// through run(), which looks at the few instructions able to write memory or
+/// draw, so reading the hash is cheap. The result is always equal to
+/// compute() on the same state.
+class StateHash {
+    private:
+        /// XOR of the hashes of every (address, byte) pair of memory.
+        uint64_t memory_hash = 0;
+
+        /// XOR of the hashes of every (row, pixels) pair of the display.
+        uint64_t display_hash = 0;
+
+        /// Hash of a single byte of memory.
+        static uint64_t hash_byte(uint16_t addr, uint8_t value);
+
+        /// Hash of a single row of the display, in all planes.
+        static uint64_t hash_row(int y, const std::array<uint64_t, 2 * Display::PLANES> &row);
+
+        /// Combine the memory and display hashes with the rest of the state.
+        static uint64_t combine(const CPU &cpu, uint64_t memory_hash, uint64_t display_hash);
+
+        /// Execute a single instruction, updating the hash.
+        void step(CPU &cpu);
+
+    public:
+        /// Recompute the hash from scratch.
+        ///
+        /// Must be called before first use, and whenever memory or the display
+        /// were modified other than through run(), e.g. after loading code or
+        /// a save state.
+        ///
+        /// \param cpu The CPU to hash.
+        void reset(const CPU &cpu);
+
+        /// Execute up to the given number of instructions, updating the hash.
+        ///
+        /// Behaves exactly like CPU::run().
+        ///
+        /// \param cpu The CPU to run.
+        /// \param max_steps Maximum number of instructions to execute.
+        ///
+        /// \return Number of instructions executed or skipped.
+        unsigned run(CPU &cpu, unsigned max_steps);
+
+        /// Get the hash of the CPU's current state.
+        ///
+        /// \param cpu The CPU last passed to reset() or run().
+        ///
+        /// \return The hash, equal to compute(cpu).
+        uint64_t get(const CPU &cpu) const;
+
+        /// Hash a CPU's state from scratch.
+        ///
+        /// \param cpu The CPU to hash.
+        ///
+        /// \return The hash.
+        static uint64_t compute(const CPU &cpu);
+
+        /// Returns whether two CPUs are in exactly the same state, i.e. all
+        /// state covered by the hash is equal.
+        static bool equal(const CPU &a, const CPU &b);
+
+        /// Find instances in identical states.
+        ///
+        /// \param cpus The instances.
+        /// \param hashes Hash of each instance's state.
+        ///
+        /// \return For every instance, the index of the first instance in the
+        /// same state. Unique instances map to their own index.
+        static std::vector<size_t> find_duplicates(const std::vector<const CPU *> &cpus, const std::vector<uint64_t> &hashes);
+};
+
+/// Detects when a CPU revisits a state it has been in before, using Brent's
+/// algorithm on the state hashes of consecutive frames.
+///
+/// Without input, every frame is a pure function of the state at its start
+/// (see CPU::seed() for `Cxnn`). Once a state repeats after `p` frames, the
+/// CPU keeps going around the same cycle of `p` states, so any number of
+/// further frames can be reduced modulo `p`.
+///
+/// Only a single reference state is kept, updated at exponentially growing
+/// intervals. Hash matches are confirmed against it, so detection is exact.
+class CycleDetector {
+    private:
+        /// State to compare against.
+        CPU reference;
+
+        /// Hash of #reference.
+        uint64_t reference_hash = 0;
+
+        /// Whether #reference has been set.
+        bool has_reference = false;
+
+        /// Number of frames after which #reference is replaced.
+        uint64_t power = 1;
+
+        /// Number of frames since #reference.
+        uint64_t length = 0;
+
+        /// Length of the detected cycle, or 0.
+        uint64_t period = 0;
+
+    public:
+        /// Forget all recorded states, e.g. after input changed.
+        void reset();
+
+        /// Record the state at the end of a frame.
+        ///
+        /// All frames must be run with the same number of instructions and
+        /// the same held keys, and without queued key events.
+        ///
+        /// \param cpu The CPU.
+        /// \param hash Hash of the CPU's state.
+        ///
+        /// \return Length of the cycle in frames once one was detected, 0 otherwise.
+        uint64_t update(const CPU &cpu, uint64_t hash);
+
+        /// Get the length of the detected cycle.
+        ///
+        /// \return The length in frames, or 0 if no cycle was detected yet.
+        uint64_t get_period() const;
+};
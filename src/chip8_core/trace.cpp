@@ -0,0 +1,389 @@
+#include "trace.h"
+
+#include "byte_order.h"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+TraceBuffer::TraceBuffer(uint16_t stream) : data(new uint8_t[TraceBuffer::CAPACITY]), stream(stream) {
+    static_assert((TraceBuffer::CAPACITY & (TraceBuffer::CAPACITY - 1)) == 0, "Capacity must be a power of two");
+}
+
+void TraceBuffer::write(const uint8_t *record, size_t length) {
+    uint64_t tail = this->tail.load(std::memory_order_relaxed);
+
+    if (tail + length - this->head.load(std::memory_order_acquire) > TraceBuffer::CAPACITY) {
+        this->stalls.fetch_add(1, std::memory_order_relaxed);
+
+        while (tail + length - this->head.load(std::memory_order_acquire) > TraceBuffer::CAPACITY) {
+            std::this_thread::yield();
+        }
+    }
+
+    size_t offset = tail & (TraceBuffer::CAPACITY - 1);
+    size_t first = std::min(length, TraceBuffer::CAPACITY - offset);
+
+    std::memcpy(this->data.get() + offset, record, first);
+    std::memcpy(this->data.get(), record + first, length - first);
+
+    this->tail.store(tail + length, std::memory_order_release);
+}
+
+void TraceBuffer::drain(std::vector<uint8_t> &out) {
+    uint64_t head = this->head.load(std::memory_order_relaxed);
+    uint64_t tail = this->tail.load(std::memory_order_acquire);
+
+    size_t length = tail - head;
+    size_t offset = head & (TraceBuffer::CAPACITY - 1);
+    size_t first = std::min(length, TraceBuffer::CAPACITY - offset);
+
+    out.resize(length);
+    std::memcpy(out.data(), this->data.get() + offset, first);
+    std::memcpy(out.data() + first, this->data.get(), length - first);
+
+    this->head.store(tail, std::memory_order_release);
+}
+
+void TraceBuffer::step(CPU &cpu) {
+    uint16_t pc = cpu.get_pc();
+    this->step(cpu, cpu.read_memory(pc) << 8 | cpu.read_memory(pc + 1));
+}
+
+void TraceBuffer::step(CPU &cpu, uint16_t opcode) {
+    std::array<uint8_t, 16> registers = cpu.get_registers();
+
+    // Key events never move PC, so the instruction stays the same
+    cpu.process_input();
+
+    if (cpu.get_halt(opcode) == CPU::Halt::KEY_WAIT) {
+        // CPU::step() would not execute anything
+        return;
+    }
+
+    uint16_t pc = cpu.get_pc();
+    uint16_t i = cpu.get_i();
+    uint8_t sp = cpu.get_sp();
+
+    cpu.step();
+
+    // Addresses of the bytes the instruction may have written
+    uint16_t write_addr = 0;
+    uint8_t write_count = 0;
+
+    if ((opcode & 0xF000) == 0x2000) {
+        // CALL pushes the return address below 0x200
+        write_addr = 0x1FF - sp - 1;
+        write_count = 2;
+    } else if ((opcode & 0xF0FF) == 0xF033) {
+        write_addr = i;
+        write_count = 3;
+    } else if ((opcode & 0xF0FF) == 0xF055) {
+        write_addr = i;
+        write_count = ((opcode & 0x0F00) >> 8) + 1;
+    } else if ((opcode & 0xF00F) == 0x5002) {
+        write_addr = i;
+        write_count = std::abs(((opcode & 0x0F00) >> 8) - ((opcode & 0x00F0) >> 4)) + 1;
+    }
+
+    uint8_t record[TraceBuffer::MAX_RECORD_SIZE];
+    uint8_t *out = put_le(record, pc, 2);
+    out = put_le(out, opcode, 2);
+
+    uint8_t *header = out;
+    out += 4;
+
+    uint16_t changed_registers = 0;
+    for (uint8_t reg = 0; reg < 16; ++reg) {
+        uint8_t value = cpu.get_register(reg);
+
+        if (value != registers[reg]) {
+            changed_registers |= 1 << reg;
+            *out++ = value;
+        }
+    }
+
+    uint8_t flags = 0;
+    if (cpu.get_i() != i) {
+        flags |= 0x01;
+        out = put_le(out, cpu.get_i(), 2);
+    }
+    if (cpu.get_sp() != sp) {
+        flags |= 0x02;
+        *out++ = cpu.get_sp();
+    }
+
+    for (uint8_t n = 0; n < write_count; ++n) {
+        uint16_t addr = (write_addr + n) & CPU::ADDRESS_MASK;
+
+        out = put_le(out, addr, 2);
+        *out++ = cpu.read_memory(addr);
+    }
+
+    put_le(header, changed_registers, 2);
+    header[2] = flags;
+    header[3] = write_count;
+
+    this->write(record, out - record);
+}
+
+unsigned TraceBuffer::run(CPU &cpu, unsigned max_steps) {
+    unsigned steps = 0;
+
+    cpu.process_input();
+
+    while (steps < max_steps) {
+        uint16_t pc = cpu.get_pc();
+        uint16_t opcode = cpu.read_memory(pc) << 8 | cpu.read_memory(pc + 1);
+        CPU::Halt halt = cpu.get_halt(opcode);
+
+        if (halt == CPU::Halt::KEY_WAIT || halt == CPU::Halt::JUMP_SELF) {
+            break;
+        }
+
+        this->step(cpu, opcode);
+        ++steps;
+    }
+
+    return steps;
+}
+
+uint16_t TraceBuffer::get_stream() const {
+    return this->stream;
+}
+
+uint64_t TraceBuffer::get_stalls() const {
+    return this->stalls.load(std::memory_order_relaxed);
+}
+
+TraceWriter::~TraceWriter() {
+    this->close();
+}
+
+bool TraceWriter::open(const char *path) {
+    if (this->file != nullptr) {
+        return false;
+    }
+
+    if (std::strcmp(path, "-") == 0) {
+        this->file = stdout;
+        this->owns_file = false;
+    } else {
+        this->file = std::fopen(path, "wb");
+        this->owns_file = true;
+    }
+
+    if (this->file == nullptr) {
+        return false;
+    }
+
+    uint8_t version[4];
+    put_le(version, TraceWriter::VERSION, 4);
+
+    std::fwrite(TraceWriter::MAGIC.data(), 1, TraceWriter::MAGIC.size(), this->file);
+    std::fwrite(version, 1, sizeof(version), this->file);
+
+    this->closing = false;
+    this->thread = std::thread(&TraceWriter::write_traces, this);
+
+    return true;
+}
+
+TraceBuffer *TraceWriter::create_buffer() {
+    std::lock_guard<std::mutex> lock(this->lock);
+
+    this->buffers.push_back(std::make_unique<TraceBuffer>(this->buffers.size()));
+
+    return this->buffers.back().get();
+}
+
+bool TraceWriter::flush(TraceBuffer &buffer, std::vector<uint8_t> &chunk) {
+    buffer.drain(chunk);
+
+    if (chunk.empty()) {
+        return false;
+    }
+
+    uint8_t header[8];
+    put_le(put_le(put_le(header, buffer.get_stream(), 2), 0, 2), chunk.size(), 4);
+
+    std::fwrite(header, 1, sizeof(header), this->file);
+    std::fwrite(chunk.data(), 1, chunk.size(), this->file);
+
+    return true;
+}
+
+void TraceWriter::write_traces() {
+    std::vector<uint8_t> chunk;
+    chunk.reserve(TraceBuffer::CAPACITY);
+
+    std::unique_lock<std::mutex> lock(this->lock);
+
+    while (true) {
+        bool closing = this->closing;
+        bool written = false;
+
+        for (std::unique_ptr<TraceBuffer> &buffer : this->buffers) {
+            written |= this->flush(*buffer, chunk);
+        }
+
+        if (closing) {
+            break;
+        }
+
+        if (written) {
+            std::fflush(this->file);
+        } else {
+            // Emulation threads never signal, to keep tracing cheap; poll instead
+            this->closed.wait_for(lock, std::chrono::milliseconds(1));
+        }
+    }
+}
+
+void TraceWriter::close() {
+    if (this->file == nullptr) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->lock);
+        this->closing = true;
+    }
+    this->closed.notify_one();
+
+    if (this->thread.joinable()) {
+        this->thread.join();
+    }
+
+    if (this->owns_file) {
+        std::fclose(this->file);
+    } else {
+        std::fflush(this->file);
+    }
+
+    this->file = nullptr;
+}
+
+TraceReader::~TraceReader() {
+    this->close();
+}
+
+bool TraceReader::open(const char *path) {
+    if (this->file != nullptr) {
+        return false;
+    }
+
+    if (std::strcmp(path, "-") == 0) {
+        this->file = stdin;
+        this->owns_file = false;
+    } else {
+        this->file = std::fopen(path, "rb");
+        this->owns_file = true;
+    }
+
+    if (this->file == nullptr) {
+        return false;
+    }
+
+    uint8_t header[12];
+    if (std::fread(header, 1, sizeof(header), this->file) != sizeof(header)
+            || std::memcmp(header, TraceWriter::MAGIC.data(), TraceWriter::MAGIC.size()) != 0
+            || get_le(header + 8, 4) != TraceWriter::VERSION) {
+        this->close();
+        return false;
+    }
+
+    this->chunk.clear();
+    this->offset = 0;
+
+    return true;
+}
+
+bool TraceReader::read_chunk() {
+    uint8_t header[8];
+
+    if (std::fread(header, 1, sizeof(header), this->file) != sizeof(header)) {
+        return false;
+    }
+
+    this->stream = get_le(header, 2);
+    this->chunk.resize(get_le(header + 4, 4));
+    this->offset = 0;
+
+    return std::fread(this->chunk.data(), 1, this->chunk.size(), this->file) == this->chunk.size();
+}
+
+bool TraceReader::next(TraceRecord &record) {
+    if (this->file == nullptr) {
+        return false;
+    }
+
+    while (this->offset >= this->chunk.size()) {
+        if (!this->read_chunk()) {
+            return false;
+        }
+    }
+
+    const uint8_t *in = this->chunk.data() + this->offset;
+    size_t available = this->chunk.size() - this->offset;
+
+    if (available < 8) {
+        return false;
+    }
+
+    record = TraceRecord {};
+    record.stream = this->stream;
+    record.pc = get_le(in, 2);
+    record.opcode = get_le(in + 2, 2);
+    record.changed_registers = get_le(in + 4, 2);
+    record.i_changed = in[6] & 0x01;
+    record.sp_changed = in[6] & 0x02;
+    record.write_count = in[7];
+
+    size_t length = 8 + std::popcount(record.changed_registers)
+        + (record.i_changed ? 2 : 0)
+        + (record.sp_changed ? 1 : 0)
+        + 3 * record.write_count;
+
+    if (record.write_count > record.writes.size() || length > available) {
+        return false;
+    }
+
+    in += 8;
+
+    for (uint8_t reg = 0; reg < 16; ++reg) {
+        if ((record.changed_registers >> reg) & 0x01) {
+            record.registers[reg] = *in++;
+        }
+    }
+
+    if (record.i_changed) {
+        record.i = get_le(in, 2);
+        in += 2;
+    }
+    if (record.sp_changed) {
+        record.sp = *in++;
+    }
+
+    for (uint8_t n = 0; n < record.write_count; ++n) {
+        record.writes[n] = TraceWrite {
+            .addr = static_cast<uint16_t>(get_le(in, 2)),
+            .value = in[2],
+        };
+        in += 3;
+    }
+
+    this->offset += length;
+
+    return true;
+}
+
+void TraceReader::close() {
+    if (this->file != nullptr && this->owns_file) {
+        std::fclose(this->file);
+    }
+
+    this->file = nullptr;
+}
@@ -0,0 +1,278 @@
+#pragma once
+
+#include "cpu.h"
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+/// A memory write recorded in a trace.
+struct TraceWrite {
+    uint16_t addr;
+    uint8_t value;
+};
+
+/// A single decoded instruction from a trace.
+///
+/// Only the state changed by the instruction is recorded. Register changes
+/// caused by a key release resolving an `Fx0A` are attributed to the
+/// instruction following it.
+struct TraceRecord {
+    /// Stream the record belongs to, one per traced thread.
+    uint16_t stream;
+
+    /// Address of the instruction.
+    uint16_t pc;
+
+    /// The instruction itself.
+    uint16_t opcode;
+
+    /// Bitmask of general purpose registers changed, bit n indicating Vn.
+    uint16_t changed_registers;
+
+    /// New values of the registers in #changed_registers. Other entries are zero.
+    std::array<uint8_t, 16> registers;
+
+    /// Whether the index register was changed.
+    bool i_changed;
+
+    /// New value of the index register, if changed.
+    uint16_t i;
+
+    /// Whether the stack pointer was changed.
+    bool sp_changed;
+
+    /// New value of the stack pointer, if changed.
+    uint8_t sp;
+
+    /// Number of entries in #writes.
+    uint8_t write_count;
+
+    /// Memory bytes written by the instruction.
+    std::array<TraceWrite, 16> writes;
+};
+
+/// Ring buffer of encoded trace records, written by a single emulation thread.
+///
+/// Records are encoded straight into a preallocated buffer, so tracing never
+/// allocates. A TraceWriter drains the buffer from its background thread. If
+/// the buffer is full, tracing waits for the writer rather than losing records.
+///
+/// Tracing is done by stepping the CPU through step() or run() instead of
+/// CPU::step() and CPU::run(), so the CPU itself has no overhead when tracing
+/// is disabled.
+class TraceBuffer {
+    public:
+        /// Size of the ring buffer in bytes. Must be a power of two.
+        static constexpr size_t CAPACITY = 1 << 20;
+
+        /// Maximum size of a single encoded record in bytes.
+        static constexpr size_t MAX_RECORD_SIZE = 8 + 16 + 3 + 16 * 3;
+
+    private:
+        /// The ring buffer.
+        std::unique_ptr<uint8_t[]> data;
+
+        /// Number of bytes drained so far. Only written by the writer thread.
+        alignas(64) std::atomic<uint64_t> head = 0;
+
+        /// Number of bytes written so far. Only written by the emulation thread.
+        alignas(64) std::atomic<uint64_t> tail = 0;
+
+        /// Number of times tracing had to wait for the writer.
+        std::atomic<uint64_t> stalls = 0;
+
+        uint16_t stream;
+
+        /// Copy an encoded record into the ring buffer, waiting for space if necessary.
+        void write(const uint8_t *record, size_t length);
+
+        /// Execute the next instruction and record it, like step().
+        ///
+        /// \param cpu The CPU to step.
+        /// \param opcode The instruction at PC, already fetched.
+        void step(CPU &cpu, uint16_t opcode);
+
+        /// Take all available bytes out of the ring buffer.
+        ///
+        /// \param out Replaced with the drained bytes, which always consist of whole records.
+        void drain(std::vector<uint8_t> &out);
+
+        friend class TraceWriter;
+
+    public:
+        /// \param stream Identifier of the stream written to the trace.
+        explicit TraceBuffer(uint16_t stream);
+
+        TraceBuffer(const TraceBuffer &other) = delete;
+        TraceBuffer& operator=(const TraceBuffer &other) = delete;
+
+        /// Execute the next instruction and record it.
+        ///
+        /// Equivalent to CPU::step(). Nothing is recorded while the CPU waits for a key.
+        ///
+        /// \param cpu The CPU to step.
+        void step(CPU &cpu);
+
+        /// Execute and record up to the given number of instructions,
+        /// stopping early if the CPU halts.
+        ///
+        /// Equivalent to CPU::run(), except that delay timer polling loops are
+        /// actually executed, so every iteration shows up in the trace.
+        ///
+        /// \param cpu The CPU to run.
+        /// \param max_steps Maximum number of instructions to execute.
+        ///
+        /// \return Number of instructions executed.
+        unsigned run(CPU &cpu, unsigned max_steps);
+
+        /// Get the identifier of the stream written to the trace.
+        uint16_t get_stream() const;
+
+        /// Get the number of times tracing had to wait for the writer to catch up.
+        uint64_t get_stalls() const;
+};
+
+/// Writes the contents of TraceBuffer%s to a file or pipe from a background thread.
+///
+/// The file starts with #MAGIC and #VERSION, followed by chunks, each holding
+/// whole records of a single stream:
+///
+/// - `uint16_t` stream
+/// - `uint16_t` reserved, zero
+/// - `uint32_t` length of the records in bytes
+/// - the records
+///
+/// Each record is encoded as:
+///
+/// - `uint16_t` pc
+/// - `uint16_t` opcode
+/// - `uint16_t` bitmask of changed registers
+/// - `uint8_t` flags: bit 0 if I changed, bit 1 if SP changed
+/// - `uint8_t` number of memory writes
+/// - one byte per changed register, in ascending order
+/// - `uint16_t` I, if changed
+/// - `uint8_t` SP, if changed
+/// - per memory write: `uint16_t` address, `uint8_t` value
+///
+/// All integers are little-endian. The format can be decoded while it is
+/// still being written.
+class TraceWriter {
+    public:
+        /// Magic bytes at the start of every trace.
+        static constexpr std::array<uint8_t, 8> MAGIC = {'C', '8', 'T', 'R', 'A', 'C', 'E', 0};
+
+        /// Version of the trace format.
+        static constexpr uint32_t VERSION = 1;
+
+    private:
+        /// Output file.
+        std::FILE *file = nullptr;
+
+        /// Whether #file was opened by this writer and should be closed.
+        bool owns_file = false;
+
+        /// Buffers being drained. Protected by #lock.
+        std::vector<std::unique_ptr<TraceBuffer>> buffers;
+
+        /// Whether the writer thread should drain all buffers one final time and exit. Protected by #lock.
+        bool closing = false;
+
+        std::mutex lock;
+
+        /// Signalled when the writer is closed.
+        std::condition_variable closed;
+
+        /// Thread writing chunks to #file.
+        std::thread thread;
+
+        /// Drain a buffer and write its contents as a chunk.
+        ///
+        /// \return Whether anything was written.
+        bool flush(TraceBuffer &buffer, std::vector<uint8_t> &chunk);
+
+        /// Main function of the writer thread.
+        void write_traces();
+
+    public:
+        TraceWriter() = default;
+        ~TraceWriter();
+
+        TraceWriter(const TraceWriter &other) = delete;
+        TraceWriter& operator=(const TraceWriter &other) = delete;
+
+        /// Open the output and start the writer thread.
+        ///
+        /// \param path Path of the file or named pipe to write to, or "-" for
+        /// standard output.
+        ///
+        /// \return Whether the output was opened successfully.
+        bool open(const char *path);
+
+        /// Create a buffer for a thread to trace into.
+        ///
+        /// Each emulation thread should use its own buffer. The buffer remains
+        /// owned by the writer and is valid until the writer is destroyed.
+        ///
+        /// \return The buffer, with the next free stream identifier.
+        TraceBuffer *create_buffer();
+
+        /// Write all buffered records and close the output.
+        ///
+        /// No thread may be tracing into any of the buffers while closing.
+        void close();
+};
+
+/// Decodes a trace written by TraceWriter.
+class TraceReader {
+    private:
+        /// Input file.
+        std::FILE *file = nullptr;
+
+        /// Whether #file was opened by this reader and should be closed.
+        bool owns_file = false;
+
+        /// Records of the current chunk.
+        std::vector<uint8_t> chunk;
+
+        /// Offset of the next record within #chunk.
+        size_t offset = 0;
+
+        /// Stream of the current chunk.
+        uint16_t stream = 0;
+
+        /// Read the next chunk into #chunk.
+        ///
+        /// \return False at the end of the trace or on error.
+        bool read_chunk();
+
+    public:
+        TraceReader() = default;
+        ~TraceReader();
+
+        TraceReader(const TraceReader &other) = delete;
+        TraceReader& operator=(const TraceReader &other) = delete;
+
+        /// Open a trace and check its header.
+        ///
+        /// \param path Path of the file or named pipe to read from, or "-" for
+        /// standard input.
+        ///
+        /// \return Whether the trace was opened successfully.
+        bool open(const char *path);
+
+        /// Decode the next record.
+        ///
+        /// \param record Set to the record, if there is one.
+        ///
+        /// \return False at the end of the trace or if the trace is malformed.
+        bool next(TraceRecord &record);
+
+        void close();
+};
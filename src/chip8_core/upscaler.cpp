@@ -0,0 +1,239 @@
+#include "upscaler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+typedef uint8_t u8x16 __attribute__((vector_size(16)));
+typedef uint16_t u16x16 __attribute__((vector_size(32)));
+typedef uint32_t u32x4 __attribute__((vector_size(16)));
+
+/// Bytes of 0x00 or 0xFF for each bit of a byte, the most significant bit first.
+static constexpr std::array<std::array<uint8_t, 8>, 256> EXPAND = [] {
+    std::array<std::array<uint8_t, 8>, 256> ret{};
+
+    for (int bits = 0; bits < 256; ++bits) {
+        for (int bit = 0; bit < 8; ++bit) {
+            ret[bits][bit] = (bits & (0x80 >> bit)) ? 0xFF : 0x00;
+        }
+    }
+
+    return ret;
+}();
+
+/// Build a colour from its channels, in the byte order of the output.
+static uint32_t make_color(uint8_t red, uint8_t green, uint8_t blue) {
+    uint8_t bytes[4] = {red, green, blue, 0xFF};
+    uint32_t ret;
+    std::memcpy(&ret, bytes, sizeof(ret));
+
+    return ret;
+}
+
+/// Double every bit of a low resolution half row, the most significant bit first.
+static uint64_t widen(uint32_t bits) {
+    uint64_t word = bits;
+    word = (word | word << 16) & 0x0000FFFF0000FFFF;
+    word = (word | word << 8) & 0x00FF00FF00FF00FF;
+    word = (word | word << 4) & 0x0F0F0F0F0F0F0F0F;
+    word = (word | word << 2) & 0x3333333333333333;
+    word = (word | word << 1) & 0x5555555555555555;
+
+    return word | word << 1;
+}
+
+/// Fill a run of pixels with a single colour.
+static void fill(uint32_t *out, int count, uint32_t color) {
+    u32x4 vector = {color, color, color, color};
+    int n = 0;
+
+    for (; n + 4 <= count; n += 4) {
+        std::memcpy(out + n, &vector, sizeof(vector));
+    }
+
+    for (; n < count; ++n) {
+        out[n] = color;
+    }
+}
+
+Upscaler::Upscaler() {
+    this->set_colors(0x000000, 0xFFFFFF, 0xAAAAAA, 0x555555);
+}
+
+void Upscaler::set_size(int width, int height) {
+    this->width = std::max(0, width);
+    this->height = std::max(0, height);
+    this->pixels.assign(static_cast<size_t>(this->width) * this->height, 0);
+
+    for (int x = 0; x <= Display::HIRES_WIDTH; ++x) {
+        this->column_starts[x] = x * this->width / Display::HIRES_WIDTH;
+    }
+
+    for (int y = 0; y <= Display::HIRES_HEIGHT; ++y) {
+        this->row_starts[y] = y * this->height / Display::HIRES_HEIGHT;
+    }
+
+    this->all_dirty = true;
+}
+
+void Upscaler::set_colors(uint32_t off, uint32_t on) {
+    this->set_colors(off, on, on, on);
+}
+
+void Upscaler::set_colors(uint32_t off, uint32_t first, uint32_t second, uint32_t both) {
+    uint32_t colors[4] = {off, first, second, both};
+
+    for (int n = 0; n < 4; ++n) {
+        for (int channel = 0; channel < 3; ++channel) {
+            this->colors[n][channel] = (colors[n] >> (16 - 8 * channel)) & 0xFF;
+        }
+    }
+
+    this->all_dirty = true;
+}
+
+void Upscaler::set_persistence(unsigned frames) {
+    if (frames <= 1) {
+        this->decay = 0;
+    } else {
+        // Full brightness drops below 1 after about the given number of frames
+        double factor = std::pow(1.0 / 255.0, 1.0 / frames);
+        this->decay = std::min(255L, std::lround(256.0 * factor));
+    }
+}
+
+uint32_t Upscaler::blend(int first, int second) const {
+    // Bilinear between the colours of the four combinations of planes
+    int weights[4] = {
+        (255 - first) * (255 - second),
+        first * (255 - second),
+        (255 - first) * second,
+        first * second,
+    };
+    uint8_t channels[3];
+
+    for (int channel = 0; channel < 3; ++channel) {
+        int sum = 0;
+
+        for (int n = 0; n < 4; ++n) {
+            sum += this->colors[n][channel] * weights[n];
+        }
+
+        channels[channel] = (sum + 255 * 255 / 2) / (255 * 255);
+    }
+
+    return make_color(channels[0], channels[1], channels[2]);
+}
+
+void Upscaler::update(const Display::Frame &frame) {
+    // Blend the new frame into the brightness, 16 pixels at a time
+    for (int plane = 0; plane < Display::PLANES; ++plane) {
+        for (int y = 0; y < Display::HIRES_HEIGHT; ++y) {
+            uint64_t words[2];
+
+            if (frame.hires) {
+                words[0] = frame.rows[y][2 * plane];
+                words[1] = frame.rows[y][2 * plane + 1];
+            } else {
+                uint64_t row = frame.rows[y / 2][2 * plane];
+                words[0] = widen(row >> 32);
+                words[1] = widen(row & 0xFFFFFFFF);
+            }
+
+            for (int chunk = 0; chunk < Display::HIRES_WIDTH / 16; ++chunk) {
+                uint8_t *out = this->brightness[plane].data() + y * Display::HIRES_WIDTH + 16 * chunk;
+                uint64_t word = words[chunk / 4];
+                int quarter = chunk % 4;
+
+                u8x16 vector;
+                std::memcpy(&vector, EXPAND[(word >> (56 - 16 * quarter)) & 0xFF].data(), 8);
+                std::memcpy(reinterpret_cast<uint8_t *>(&vector) + 8, EXPAND[(word >> (48 - 16 * quarter)) & 0xFF].data(), 8);
+
+                if (this->decay != 0) {
+                    u8x16 previous;
+                    std::memcpy(&previous, out, sizeof(previous));
+
+                    u16x16 faded = __builtin_convertvector(previous, u16x16) * this->decay >> 8;
+                    vector |= __builtin_convertvector(faded, u8x16);
+                }
+
+                std::memcpy(out, &vector, sizeof(vector));
+            }
+        }
+    }
+
+    this->dirty_begin = this->height;
+    this->dirty_end = 0;
+
+    for (int y = 0; y < Display::HIRES_HEIGHT; ++y) {
+        bool changed = this->all_dirty;
+
+        for (int plane = 0; plane < Display::PLANES; ++plane) {
+            const uint8_t *row = this->brightness[plane].data() + y * Display::HIRES_WIDTH;
+            uint8_t *shown_row = this->shown[plane].data() + y * Display::HIRES_WIDTH;
+
+            if (changed || std::memcmp(row, shown_row, Display::HIRES_WIDTH) != 0) {
+                std::memcpy(shown_row, row, Display::HIRES_WIDTH);
+                changed = true;
+            }
+        }
+
+        if (!changed) {
+            continue;
+        }
+
+        this->expand_row(y);
+
+        this->dirty_begin = std::min(this->dirty_begin, this->row_starts[y]);
+        this->dirty_end = std::max(this->dirty_end, this->row_starts[y + 1]);
+    }
+
+    if (this->dirty_end <= this->dirty_begin) {
+        this->dirty_begin = this->dirty_end = 0;
+    }
+
+    this->all_dirty = false;
+}
+
+void Upscaler::expand_row(int y) {
+    int first = this->row_starts[y];
+    int last = this->row_starts[y + 1];
+
+    if (first == last || this->width == 0) {
+        return;
+    }
+
+    // Expand the first output row, then copy it to the rest
+    uint32_t *out = this->pixels.data() + static_cast<size_t>(first) * this->width;
+    const uint8_t *first_plane = this->shown[0].data() + y * Display::HIRES_WIDTH;
+    const uint8_t *second_plane = this->shown[1].data() + y * Display::HIRES_WIDTH;
+
+    for (int x = 0; x < Display::HIRES_WIDTH; ++x) {
+        int start = this->column_starts[x];
+        fill(out + start, this->column_starts[x + 1] - start, this->blend(first_plane[x], second_plane[x]));
+    }
+
+    for (int n = first + 1; n < last; ++n) {
+        std::memcpy(this->pixels.data() + static_cast<size_t>(n) * this->width, out, this->width * sizeof(uint32_t));
+    }
+}
+
+const uint8_t* Upscaler::get_pixels() const {
+    return reinterpret_cast<const uint8_t *>(this->pixels.data());
+}
+
+int Upscaler::get_width() const {
+    return this->width;
+}
+
+int Upscaler::get_height() const {
+    return this->height;
+}
+
+int Upscaler::get_dirty_begin() const {
+    return this->dirty_begin;
+}
+
+int Upscaler::get_dirty_end() const {
+    return this->dirty_end;
+}
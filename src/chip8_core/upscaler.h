@@ -0,0 +1,124 @@
+#pragma once
+
+#include "display.h"
+
+#include <array>
+#include <stdint.h>
+#include <vector>
+
+/// Expands the display into a scaled RGBA image, for renderers without a GPU.
+///
+/// Works at the high resolution of 128x64, doubling pixels in low resolution.
+/// Each combination of the two XO-CHIP planes has its own colour.
+///
+/// Optionally simulates phosphor persistence: instead of going dark at once,
+/// pixels which are turned off fade out over the following frames. This hides
+/// most of the flicker caused by games erasing and redrawing sprites with XOR.
+///
+/// Brightness is blended at 128x64 per plane, and only rows whose
+/// brightness changed are expanded again, so the cost of a frame is mostly
+/// proportional to how much of the screen changed. Both steps use vector
+/// instructions.
+class Upscaler {
+    private:
+        /// Width of the output in pixels.
+        int width = 0;
+
+        /// Height of the output in pixels.
+        int height = 0;
+
+        /// The output, `width * height` pixels of 4 bytes: red, green, blue, alpha.
+        std::vector<uint32_t> pixels;
+
+        /// First output column of every display column, followed by #width.
+        std::array<int, Display::HIRES_WIDTH + 1> column_starts{};
+
+        /// First output row of every display row, followed by #height.
+        std::array<int, Display::HIRES_HEIGHT + 1> row_starts{};
+
+        /// Brightness of every display pixel in every plane, row by row.
+        alignas(16) std::array<std::array<uint8_t, Display::HIRES_WIDTH * Display::HIRES_HEIGHT>, Display::PLANES> brightness{};
+
+        /// Brightness the output was last expanded from.
+        alignas(16) std::array<std::array<uint8_t, Display::HIRES_WIDTH * Display::HIRES_HEIGHT>, Display::PLANES> shown{};
+
+        /// Factor applied to the brightness of unlit pixels every frame, in
+        /// 1/256ths. 0 disables persistence.
+        uint16_t decay = 0;
+
+        /// Red, green and blue channels of the colours of pixels lit in no
+        /// plane, the first plane, the second plane and both planes.
+        std::array<std::array<int, 3>, 4> colors{};
+
+        /// Get the colour of a pixel from its brightness in each plane, in
+        /// the byte order of #pixels.
+        uint32_t blend(int first, int second) const;
+
+        /// Whether the whole output must be expanded on the next update().
+        bool all_dirty = true;
+
+        /// First output row changed by the last update().
+        int dirty_begin = 0;
+
+        /// One past the last output row changed by the last update().
+        int dirty_end = 0;
+
+        /// Expand a display row into its rows of the output.
+        void expand_row(int y);
+
+    public:
+        Upscaler();
+
+        /// Set the size of the output.
+        ///
+        /// Display pixels are mapped to blocks of output pixels as evenly as
+        /// possible, so any size is supported.
+        ///
+        /// \param width Width in pixels.
+        /// \param height Height in pixels.
+        void set_size(int width, int height);
+
+        /// Set the colours of unlit and lit pixels, regardless of plane.
+        ///
+        /// \param off Colour of unlit pixels, as `0xRRGGBB`.
+        /// \param on Colour of lit pixels, as `0xRRGGBB`.
+        void set_colors(uint32_t off, uint32_t on);
+
+        /// Set the colours of every combination of planes.
+        ///
+        /// \param off Colour of unlit pixels, as `0xRRGGBB`.
+        /// \param first Colour of pixels lit in the first plane only.
+        /// \param second Colour of pixels lit in the second plane only.
+        /// \param both Colour of pixels lit in both planes.
+        void set_colors(uint32_t off, uint32_t first, uint32_t second, uint32_t both);
+
+        /// Enable or disable phosphor persistence.
+        ///
+        /// \param frames Number of frames over which pixels that are turned
+        /// off fade out. 0 or 1 disables persistence.
+        void set_persistence(unsigned frames);
+
+        /// Advance by one frame, updating the output.
+        ///
+        /// \param frame The display contents, as returned by Display::get_frame().
+        void update(const Display::Frame &frame);
+
+        /// Get the output.
+        ///
+        /// \return `get_height()` rows of `get_width()` pixels, 4 bytes each:
+        /// red, green, blue and alpha.
+        const uint8_t* get_pixels() const;
+
+        /// Width of the output in pixels.
+        int get_width() const;
+
+        /// Height of the output in pixels.
+        int get_height() const;
+
+        /// First output row changed by the last update().
+        int get_dirty_begin() const;
+
+        /// One past the last output row changed by the last update(). Equal
+        /// to get_dirty_begin() if nothing changed.
+        int get_dirty_end() const;
+};
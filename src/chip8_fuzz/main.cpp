@@ -0,0 +1,379 @@
+#include <atomic>
+#include <bit>
+#include <bitset>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "boot_cache.h"
+#include "cpu.h"
+#include "input_log.h"
+#include "save_state.h"
+
+/// Number of bits in the edge coverage bitmap.
+static constexpr size_t MAP_SIZE = 1 << 16;
+
+/// Edge coverage, one bit per (hashed) pair of consecutive PCs.
+using Coverage = std::bitset<MAP_SIZE>;
+
+/// A sequence of inputs, one bitmask of held keys per frame.
+using Inputs = std::vector<uint16_t>;
+
+/// Ways in which a ROM can crash.
+enum class Fault {
+    NONE,
+
+    /// PC outside of memory.
+    PC_OUT_OF_BOUNDS,
+
+    /// Memory access through I outside of memory.
+    I_OUT_OF_BOUNDS,
+
+    /// More than 16 nested subroutine calls.
+    STACK_OVERFLOW,
+
+    /// Return without a matching call.
+    STACK_UNDERFLOW,
+};
+
+static const char *fault_name(Fault fault) {
+    switch (fault) {
+        case Fault::PC_OUT_OF_BOUNDS: return "pc-out-of-bounds";
+        case Fault::I_OUT_OF_BOUNDS: return "i-out-of-bounds";
+        case Fault::STACK_OVERFLOW: return "stack-overflow";
+        case Fault::STACK_UNDERFLOW: return "stack-underflow";
+        default: return "none";
+    }
+}
+
+/// %Options passed on launch.
+struct Options {
+    const char *rom_path = nullptr;
+    const char *out_dir = "fuzz_out";
+
+    /// Maximum number of frames per input sequence.
+    size_t max_frames = 300;
+
+    /// Maximum number of frames to run while booting, before the first input poll.
+    unsigned boot_frames = 600;
+
+    /// Number of worker threads.
+    unsigned jobs = std::thread::hardware_concurrency();
+
+    /// Time to fuzz for, in seconds.
+    unsigned seconds = 60;
+
+    uint32_t seed = 1;
+};
+
+/// State shared between all workers.
+struct Shared {
+    std::mutex lock;
+
+    /// Coverage reached by the whole corpus.
+    Coverage coverage;
+
+    /// Inputs which reached new coverage.
+    std::vector<Inputs> corpus;
+
+    /// Crashes found so far, keyed by fault and PC.
+    std::map<std::pair<Fault, uint16_t>, Inputs> crashes;
+
+    std::atomic<uint64_t> executions = 0;
+    std::atomic<bool> stop = false;
+};
+
+/// Check whether executing the next instruction would crash.
+///
+/// \param cpu The CPU, before executing the instruction.
+///
+/// \return The fault the instruction would cause, or Fault::NONE.
+static Fault check_fault(const CPU &cpu) {
+    uint16_t pc = cpu.get_pc();
+
+    if (pc > CPU::MEMORY_SIZE - 2) {
+        return Fault::PC_OUT_OF_BOUNDS;
+    }
+
+    uint16_t instruction = cpu.read_memory(pc) << 8 | cpu.read_memory(pc + 1);
+    unsigned i = cpu.get_i();
+    unsigned x = (instruction & 0x0F00) >> 8;
+
+    if (instruction == 0x00EE && cpu.get_sp() < 2) {
+        return Fault::STACK_UNDERFLOW;
+    } else if ((instruction & 0xF000) == 0x2000 && cpu.get_sp() >= 32) {
+        return Fault::STACK_OVERFLOW;
+    } else if ((instruction & 0xF000) == 0xD000) {
+        unsigned n = instruction & 0x000F;
+        unsigned length = std::popcount(cpu.get_display().get_selected_planes()) * (n == 0 ? 32 : n);
+
+        if (i + length > CPU::MEMORY_SIZE) {
+            return Fault::I_OUT_OF_BOUNDS;
+        }
+    } else if ((instruction & 0xF0FF) == 0xF033 && i + 3 > CPU::MEMORY_SIZE) {
+        return Fault::I_OUT_OF_BOUNDS;
+    } else if (((instruction & 0xF0FF) == 0xF055 || (instruction & 0xF0FF) == 0xF065) && i + x + 1 > CPU::MEMORY_SIZE) {
+        return Fault::I_OUT_OF_BOUNDS;
+    }
+
+    return Fault::NONE;
+}
+
+/// Execute a sequence of inputs, collecting edge coverage.
+///
+/// \param cpu The CPU, restored to the snapshot.
+/// \param inputs Inputs to apply, one per frame.
+/// \param coverage Edges are added to this bitmap.
+///
+/// \return The fault encountered, if any.
+static Fault execute(CPU &cpu, const Inputs &inputs, Coverage &coverage) {
+    uint16_t prev = cpu.get_pc();
+    Fault fault = Fault::NONE;
+
+    for (uint16_t keys : inputs) {
+        bool done = InputLog::run_frame(cpu, keys, [&prev, &fault, &coverage](CPU &cpu) {
+            fault = check_fault(cpu);
+            if (fault != Fault::NONE) {
+                return false;
+            }
+
+            cpu.step();
+
+            uint16_t pc = cpu.get_pc();
+            coverage.set(((prev << 4) ^ pc) % MAP_SIZE);
+            prev = pc;
+
+            return true;
+        });
+
+        if (!done) {
+            return fault;
+        }
+    }
+
+    return Fault::NONE;
+}
+
+/// Create a new input sequence by mutating one from the corpus.
+///
+/// \param base The corpus entry to mutate. May be empty.
+/// \param other Another corpus entry to splice with. May be empty.
+/// \param rng Random number generator of the calling worker.
+/// \param max_frames Maximum length of the returned sequence.
+static Inputs mutate(const Inputs &base, const Inputs &other, std::mt19937 &rng, size_t max_frames) {
+    Inputs ret = base;
+
+    if (ret.empty()) {
+        ret.resize(1 + rng() % max_frames, 0);
+    }
+
+    int mutations = 1 + rng() % 4;
+    for (int n = 0; n < mutations; ++n) {
+        size_t pos = rng() % ret.size();
+
+        switch (rng() % 5) {
+            case 0:
+                // Toggle a single key
+                ret[pos] ^= 1 << (rng() % 16);
+                break;
+            case 1:
+                // Hold a key over a range of frames
+                {
+                    uint16_t mask = 1 << (rng() % 16);
+                    size_t end = std::min(ret.size(), pos + 1 + rng() % 30);
+                    for (size_t frame = pos; frame < end; ++frame) {
+                        ret[frame] |= mask;
+                    }
+                }
+                break;
+            case 2:
+                // Release everything over a range of frames
+                {
+                    size_t end = std::min(ret.size(), pos + 1 + rng() % 30);
+                    for (size_t frame = pos; frame < end; ++frame) {
+                        ret[frame] = 0;
+                    }
+                }
+                break;
+            case 3:
+                // Splice with another corpus entry
+                if (!other.empty()) {
+                    size_t other_pos = rng() % other.size();
+                    ret.resize(pos);
+                    ret.insert(ret.end(), other.begin() + other_pos, other.end());
+                }
+                break;
+            case 4:
+                // Extend with random frames
+                ret.resize(ret.size() + 1 + rng() % 60, static_cast<uint16_t>(rng()));
+                break;
+        }
+
+        if (ret.empty()) {
+            ret.push_back(0);
+        }
+        if (ret.size() > max_frames) {
+            ret.resize(max_frames);
+        }
+    }
+
+    return ret;
+}
+
+/// Main function of a worker thread.
+static void worker(Shared &shared, const CPU &snapshot, const Options &options, uint32_t seed) {
+    std::mt19937 rng(seed);
+    Coverage known;
+    Coverage local;
+    CPU cpu = snapshot;
+
+    while (!shared.stop) {
+        Inputs base;
+        Inputs other;
+
+        {
+            std::lock_guard<std::mutex> lock(shared.lock);
+            known = shared.coverage;
+
+            if (!shared.corpus.empty()) {
+                base = shared.corpus[rng() % shared.corpus.size()];
+                other = shared.corpus[rng() % shared.corpus.size()];
+            }
+        }
+
+        // Run a batch of mutations before synchronising again
+        for (int n = 0; n < 64 && !shared.stop; ++n) {
+            Inputs inputs = mutate(base, other, rng, options.max_frames);
+
+            // Restoring the snapshot is a plain copy
+            cpu = snapshot;
+            local.reset();
+
+            Fault fault = execute(cpu, inputs, local);
+            shared.executions += 1;
+
+            bool new_coverage = (local & ~known).any();
+
+            if (fault == Fault::NONE && !new_coverage) {
+                continue;
+            }
+
+            std::lock_guard<std::mutex> lock(shared.lock);
+
+            if (new_coverage && (local & ~shared.coverage).any()) {
+                shared.coverage |= local;
+                shared.corpus.push_back(inputs);
+            }
+            known = shared.coverage;
+
+            auto key = std::make_pair(fault, cpu.get_pc());
+            if (fault != Fault::NONE && shared.crashes.count(key) == 0) {
+                shared.crashes.emplace(key, inputs);
+
+                char name[64];
+                std::snprintf(name, sizeof(name), "crash-%s-%03X.bin", fault_name(fault), cpu.get_pc());
+                InputLog::save((std::filesystem::path(options.out_dir) / name).c_str(), inputs);
+
+                std::fprintf(stderr, "Found %s at 0x%03X after %zu frames\n", fault_name(fault), cpu.get_pc(), inputs.size());
+            }
+        }
+    }
+}
+
+/// Parse the given arguments into an Options struct.
+///
+/// \return Whether the arguments were valid.
+static bool parse_arguments(int argc, char **argv, Options &options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--out" && has_value) {
+            options.out_dir = argv[++i];
+        } else if (arg == "--frames" && has_value) {
+            options.max_frames = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--boot-frames" && has_value) {
+            options.boot_frames = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--jobs" && has_value) {
+            options.jobs = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--time" && has_value) {
+            options.seconds = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--seed" && has_value) {
+            options.seed = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg.starts_with("--")) {
+            return false;
+        } else {
+            options.rom_path = argv[i];
+        }
+    }
+
+    return options.rom_path != nullptr && options.max_frames > 0;
+}
+
+/// Snapshot-fork fuzzer searching for input sequences that crash a ROM.
+///
+/// Usage: `chip8_fuzz [--out dir] [--frames n] [--boot-frames n] [--jobs n] [--time s] [--seed n] <rom>`
+///
+/// The ROM is booted once up to its first input poll. Every execution then
+/// starts from a copy of that snapshot and applies a mutated sequence of key
+/// masks, one per frame. Sequences reaching new PC edges are kept in the
+/// corpus; sequences causing a fault are saved to the output directory as
+/// InputLog%s, next to the snapshot saved as `boot.c8s`.
+int main(int argc, char **argv) {
+    Options options;
+
+    if (!parse_arguments(argc, argv, options)) {
+        std::fprintf(stderr, "Usage: %s [--out dir] [--frames n] [--boot-frames n] [--jobs n] [--time s] [--seed n] <rom>\n", argv[0]);
+        return 1;
+    }
+
+    CPU snapshot;
+    snapshot.seed(options.seed);
+
+    if (!snapshot.load_code_from_file(options.rom_path)) {
+        std::fprintf(stderr, "Failed to load ROM from %s\n", options.rom_path);
+        return 1;
+    }
+
+    BootCache::boot(snapshot, options.boot_frames);
+    std::fprintf(stderr, "Booted to 0x%03X\n", snapshot.get_pc());
+
+    std::filesystem::create_directories(options.out_dir);
+
+    // Crash inputs start from this state, keep it around for replaying them
+    std::filesystem::path boot_path = std::filesystem::path(options.out_dir) / "boot.c8s";
+    if (!SaveState::save(snapshot, boot_path.c_str(), SaveState::Compression::RLE)) {
+        std::fprintf(stderr, "Failed to save boot state to %s\n", boot_path.c_str());
+    }
+
+    Shared shared;
+    std::vector<std::thread> workers;
+
+    for (unsigned job = 0; job < std::max(1u, options.jobs); ++job) {
+        workers.emplace_back(worker, std::ref(shared), std::cref(snapshot), std::cref(options), options.seed + job);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - start < std::chrono::seconds(options.seconds)) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+
+        std::lock_guard<std::mutex> lock(shared.lock);
+        std::fprintf(stderr, "execs: %llu, corpus: %zu, edges: %zu, crashes: %zu\n",
+            static_cast<unsigned long long>(shared.executions.load()), shared.corpus.size(), shared.coverage.count(), shared.crashes.size());
+    }
+
+    shared.stop = true;
+    for (std::thread &thread : workers) {
+        thread.join();
+    }
+
+    return shared.crashes.empty() ? 0 : 2;
+}
@@ -0,0 +1,260 @@
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+
+#define SDL_MAIN_USE_CALLBACKS 1
+
+#include <SDL3/SDL.h>
+#include <SDL3/SDL_main.h>
+
+#include "atlas.h"
+#include "cpu.h"
+#include "pool.h"
+
+/// Length of a frame in nanoseconds, at 60 Hz.
+static constexpr uint64_t FRAME_NS = 1000000000 / 60;
+
+/// Maximum number of frames run in one iteration to catch up, e.g. after the
+/// window was moved. Any further frames are dropped.
+static constexpr uint64_t MAX_CATCH_UP = 4;
+
+/// State to be kept between SDL callbacks.
+struct AppState {
+    SDL_Window *window = nullptr;
+    SDL_Renderer *renderer = nullptr;
+
+    /// Texture the atlas is uploaded to, matching its size.
+    SDL_Texture *texture = nullptr;
+
+    /// All sessions, run together one frame at a time.
+    Pool pool;
+
+    /// The displays of all sessions.
+    Atlas atlas;
+
+    /// Index of the session receiving key events.
+    size_t selected = 0;
+
+    /// When the first frame was run, in nanoseconds since SDL was initialised.
+    uint64_t start = 0;
+
+    /// Number of frames run or dropped so far.
+    uint64_t frames = 0;
+};
+
+/// %Arguments passed on launch.
+struct Arguments {
+    /// Path of the ROM every session runs.
+    const char *rom_path = nullptr;
+
+    /// Number of sessions (`--count <n>`).
+    size_t count = 64;
+
+    /// Number of sessions per row (`--columns <n>`), 0 for a roughly square grid.
+    int columns = 0;
+
+    /// Whether the arguments were invalid.
+    bool invalid = false;
+};
+
+/// Parse the given arguments into an Arguments struct
+static Arguments parse_arguments(int argc, char **argv) {
+    Arguments ret;
+
+    // Skipping first argument = executable path
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--count" && has_value) {
+            ret.count = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--columns" && has_value) {
+            ret.columns = std::atoi(argv[++i]);
+        } else if (arg.starts_with("--")) {
+            SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "Invalid argument: %s", arg.c_str());
+            ret.invalid = true;
+        } else {
+            ret.rom_path = argv[i];
+        }
+    }
+
+    if (ret.rom_path == nullptr || ret.count == 0) {
+        SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "Usage: chip8_grid [--count <n>] [--columns <n>] <rom>");
+        ret.invalid = true;
+    }
+
+    return ret;
+}
+
+/// Show the selected session in the window title.
+static void update_title(AppState *state) {
+    std::string title = "Chip8 Grid - session " + std::to_string(state->selected) + " of " + std::to_string(state->pool.size());
+    SDL_SetWindowTitle(state->window, title.c_str());
+}
+
+SDL_AppResult SDL_AppInit(void **appstate, int argc, char **argv) {
+    Arguments args = parse_arguments(argc, argv);
+
+    AppState *state = new AppState();
+    *appstate = static_cast<void *>(state);
+
+    if (args.invalid) {
+        return SDL_APP_FAILURE;
+    }
+
+    CPU cpu;
+    if (!cpu.load_code_from_file(args.rom_path)) {
+        SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "Failed to load ROM from %s", args.rom_path);
+        return SDL_APP_FAILURE;
+    }
+
+    state->pool.reserve(args.count);
+    state->pool.set_decoding(true);
+
+    for (size_t idx = 0; idx < args.count; ++idx) {
+        // Different seeds, so sessions of games with randomness diverge
+        cpu.seed(idx + 1);
+        state->pool.add(cpu);
+    }
+
+    state->atlas.set_layout(args.count, args.columns);
+
+    if (!SDL_Init(SDL_INIT_VIDEO)) {
+        SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "%s", SDL_GetError());
+        return SDL_APP_FAILURE;
+    }
+
+    // At most 1024 pixels wide, keeping the aspect ratio of the atlas
+    int width = state->atlas.get_width();
+    int height = state->atlas.get_height();
+    int window_width = std::min(width, 1024);
+    int window_height = static_cast<int>(static_cast<int64_t>(height) * window_width / width);
+
+    if (!SDL_CreateWindowAndRenderer("Chip8 Grid", window_width, window_height, SDL_WINDOW_RESIZABLE, &state->window, &state->renderer)) {
+        SDL_LogCritical(SDL_LOG_CATEGORY_VIDEO, "%s", SDL_GetError());
+        return SDL_APP_FAILURE;
+    }
+
+    SDL_SetRenderVSync(state->renderer, 1);
+
+    // Scales the atlas to the window, and mouse positions back to the atlas
+    SDL_SetRenderLogicalPresentation(state->renderer, width, height, SDL_LOGICAL_PRESENTATION_LETTERBOX);
+
+    state->texture = SDL_CreateTexture(state->renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING, width, height);
+    if (state->texture == nullptr) {
+        SDL_LogCritical(SDL_LOG_CATEGORY_RENDER, "Failed to create texture: %s", SDL_GetError());
+        return SDL_APP_FAILURE;
+    }
+
+    SDL_SetTextureScaleMode(state->texture, SDL_SCALEMODE_NEAREST);
+    update_title(state);
+
+    state->start = SDL_GetTicksNS();
+
+    return SDL_APP_CONTINUE;
+}
+
+SDL_AppResult SDL_AppEvent(void *appstate, SDL_Event *event) {
+    AppState *state = static_cast<AppState *>(appstate);
+
+    if (event->type == SDL_EVENT_QUIT) {
+        return SDL_APP_SUCCESS;
+    }
+
+    if (event->type == SDL_EVENT_MOUSE_BUTTON_DOWN && event->button.button == SDL_BUTTON_LEFT) {
+        // Send keys to the session clicked on
+        SDL_ConvertEventToRenderCoordinates(state->renderer, event);
+        int tile = state->atlas.get_tile(event->button.x, event->button.y);
+
+        if (tile >= 0) {
+            state->selected = tile;
+            update_title(state);
+        }
+
+        return SDL_APP_CONTINUE;
+    }
+
+    if (event->type == SDL_EVENT_KEY_DOWN || event->type == SDL_EVENT_KEY_UP) {
+        if (event->key.repeat) {
+            // Ignore key repeats on held keys
+            return SDL_APP_CONTINUE;
+        }
+        SDL_Keycode keycode = event->key.key;
+        uint8_t key;
+
+        if (keycode >= '0' && keycode <= '9') {
+            key = keycode - '0';
+        } else if (keycode >= 'a' && keycode <= 'f') {
+            key = keycode - 'a' + 0xA;
+        } else {
+            // Unused key
+            return SDL_APP_CONTINUE;
+        }
+
+        state->pool.set_key_down(state->selected, key, event->key.down);
+    }
+
+    return SDL_APP_CONTINUE;
+}
+
+SDL_AppResult SDL_AppIterate(void *appstate) {
+    AppState *state = static_cast<AppState *>(appstate);
+
+    // Run as many frames as are due at 60 Hz, whatever the refresh rate
+    uint64_t now = SDL_GetTicksNS();
+    uint64_t due = (now - state->start) / FRAME_NS;
+
+    if (due > state->frames + MAX_CATCH_UP) {
+        state->frames = due - MAX_CATCH_UP;
+    }
+
+    if (due == state->frames) {
+        // Nothing changed, wait for the next frame instead of presenting again
+        SDL_DelayNS(state->start + (due + 1) * FRAME_NS - now);
+        return SDL_APP_CONTINUE;
+    }
+
+    for (; state->frames < due; ++state->frames) {
+        state->pool.run_frame(CPU::STEPS_PER_FRAME);
+    }
+
+    state->atlas.update(state->pool);
+
+    // A single upload of the rows of all tiles which changed
+    int begin = state->atlas.get_dirty_begin();
+    int end = state->atlas.get_dirty_end();
+
+    if (end > begin) {
+        int pitch = state->atlas.get_width() * 4;
+        SDL_Rect rect = {
+            .x = 0,
+            .y = begin,
+            .w = state->atlas.get_width(),
+            .h = end - begin,
+        };
+
+        if (!SDL_UpdateTexture(state->texture, &rect, state->atlas.get_pixels() + begin * pitch, pitch)) {
+            SDL_LogError(SDL_LOG_CATEGORY_RENDER, "Failed to update texture: %s", SDL_GetError());
+
+            return SDL_APP_FAILURE;
+        }
+    }
+
+    // And a single draw call for all of them
+    SDL_SetRenderDrawColor(state->renderer, 0, 0, 0, 255);
+    SDL_RenderClear(state->renderer);
+    SDL_RenderTexture(state->renderer, state->texture, nullptr, nullptr);
+    SDL_RenderPresent(state->renderer);
+
+    return SDL_APP_CONTINUE;
+}
+
+void SDL_AppQuit(void *appstate, SDL_AppResult result) {
+    AppState *state = static_cast<AppState *>(appstate);
+
+    if (state->texture != nullptr) {
+        SDL_DestroyTexture(state->texture);
+    }
+
+    delete state;
+}
@@ -0,0 +1,455 @@
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "cpu.h"
+
+/// A basic block discovered in the ROM.
+struct BasicBlock {
+    /// Addresses of the instructions in this block, in order.
+    std::vector<uint16_t> addresses;
+
+    /// Whether the last instruction sets the PC itself.
+    bool terminated = false;
+};
+
+/// The ROM being recompiled.
+struct Rom {
+    std::vector<uint8_t> data;
+
+    /// Returns whether a full instruction can be fetched from the given address.
+    bool contains(uint16_t addr) const {
+        return addr >= CPU::INITIAL_PC && static_cast<size_t>(addr) + 2 <= CPU::INITIAL_PC + this->data.size();
+    }
+
+    /// Fetch the instruction at the given address.
+    uint16_t fetch(uint16_t addr) const {
+        return this->data[addr - CPU::INITIAL_PC] << 8 | this->data[addr - CPU::INITIAL_PC + 1];
+    }
+};
+
+/// Returns whether the given instruction is a conditional skip.
+static bool is_skip(uint16_t instruction) {
+    switch (instruction & 0xF000) {
+        case 0x3000:
+        case 0x4000:
+            return true;
+        case 0x5000:
+        case 0x9000:
+            return (instruction & 0x000F) == 0;
+        case 0xE000:
+            return (instruction & 0x00FF) == 0x9E || (instruction & 0x00FF) == 0xA1;
+        default:
+            return false;
+    }
+}
+
+/// Returns whether the instruction at the given address is left to the
+/// interpreter, ending any block before it.
+///
+/// Covers the SUPER-CHIP and XO-CHIP extensions, as well as skips over the 4
+/// byte `F000 nnnn`, whose target depends on the following instruction.
+static bool is_interpreted(const Rom &rom, uint16_t addr) {
+    uint16_t instruction = rom.fetch(addr);
+
+    if (is_skip(instruction) && rom.contains(addr + 2) && rom.fetch(addr + 2) == 0xF000) {
+        return true;
+    }
+
+    switch (instruction & 0xF000) {
+        case 0x0000:
+            return (instruction & 0xFFE0) == 0x00C0 || (instruction >= 0x00FB && instruction <= 0x00FF);
+        case 0x5000:
+            return (instruction & 0x000F) == 0x2 || (instruction & 0x000F) == 0x3;
+        case 0xF000:
+            switch (instruction & 0x00FF) {
+                case 0x00:
+                case 0x01:
+                case 0x02:
+                case 0x30:
+                case 0x3A:
+                case 0x75:
+                case 0x85:
+                    return true;
+            }
+            return false;
+        default:
+            return false;
+    }
+}
+
+/// Returns whether the given instruction writes to memory, which may modify
+/// code following it in the same block.
+static bool writes_memory(uint16_t instruction) {
+    return (instruction & 0xF0FF) == 0xF033 || (instruction & 0xF0FF) == 0xF055;
+}
+
+/// Decode a basic block starting at the given address.
+///
+/// \param rom ROM to decode.
+/// \param start Address of the first instruction.
+/// \param successors Statically known successor addresses are added to this set.
+static BasicBlock decode_block(const Rom &rom, uint16_t start, std::set<uint16_t> &successors) {
+    BasicBlock block;
+    uint16_t addr = start;
+
+    while (rom.contains(addr) && !is_interpreted(rom, addr)) {
+        uint16_t instruction = rom.fetch(addr);
+        block.addresses.push_back(addr);
+
+        if (instruction == 0x00EE || (instruction & 0xF000) == 0xB000) {
+            // Return or computed jump, successor unknown
+            block.terminated = true;
+            break;
+        } else if ((instruction & 0xF000) == 0x1000) {
+            if ((instruction & 0x0FFF) == addr) {
+                // Jump to itself, left to the interpreter so the halt is detected
+                block.addresses.pop_back();
+                break;
+            }
+
+            successors.insert(instruction & 0x0FFF);
+            block.terminated = true;
+            break;
+        } else if ((instruction & 0xF000) == 0x2000) {
+            successors.insert(instruction & 0x0FFF);
+            successors.insert(addr + 2);
+            block.terminated = true;
+            break;
+        } else if (is_skip(instruction)) {
+            successors.insert(addr + 2);
+            successors.insert(addr + 4);
+            block.terminated = true;
+            break;
+        } else if ((instruction & 0xF0FF) == 0xF00A || writes_memory(instruction)) {
+            successors.insert(addr + 2);
+            block.terminated = true;
+            break;
+        }
+
+        addr += 2;
+    }
+
+    if (!block.terminated && !block.addresses.empty()) {
+        successors.insert(addr);
+    }
+
+    return block;
+}
+
+/// Emit C++ code for a single instruction.
+///
+/// \param out Output file.
+/// \param addr Address of the instruction.
+/// \param instruction The instruction to translate.
+static void emit_instruction(FILE *out, uint16_t addr, uint16_t instruction) {
+    unsigned x = (instruction & 0x0F00) >> 8;
+    unsigned y = (instruction & 0x00F0) >> 4;
+    unsigned n = instruction & 0x000F;
+    unsigned nn = instruction & 0x00FF;
+    unsigned nnn = instruction & 0x0FFF;
+    unsigned next = addr + 2;
+    unsigned skip = addr + 4;
+
+    std::fprintf(out, "    // 0x%03X: %04X\n", addr, instruction);
+
+    switch (instruction & 0xF000) {
+        case 0x0000:
+            if (instruction == 0x00E0) {
+                std::fprintf(out, "    clear(cpu);\n");
+            } else if (instruction == 0x00EE) {
+                std::fprintf(out, "    {\n");
+                std::fprintf(out, "        uint16_t addr = cpu.pop();\n");
+                std::fprintf(out, "        addr |= cpu.pop() << 8;\n");
+                std::fprintf(out, "        pc(cpu) = addr;\n");
+                std::fprintf(out, "    }\n");
+            }
+            break;
+        case 0x1000:
+            std::fprintf(out, "    pc(cpu) = 0x%03X;\n", nnn);
+            break;
+        case 0x2000:
+            std::fprintf(out, "    cpu.push(0x%02X);\n", next >> 8);
+            std::fprintf(out, "    cpu.push(0x%02X);\n", next & 0xFF);
+            std::fprintf(out, "    pc(cpu) = 0x%03X;\n", nnn);
+            break;
+        case 0x3000:
+            std::fprintf(out, "    pc(cpu) = v[0x%X] == 0x%02X ? 0x%03X : 0x%03X;\n", x, nn, skip, next);
+            break;
+        case 0x4000:
+            std::fprintf(out, "    pc(cpu) = v[0x%X] != 0x%02X ? 0x%03X : 0x%03X;\n", x, nn, skip, next);
+            break;
+        case 0x5000:
+            if (n == 0) {
+                std::fprintf(out, "    pc(cpu) = v[0x%X] == v[0x%X] ? 0x%03X : 0x%03X;\n", x, y, skip, next);
+            }
+            break;
+        case 0x6000:
+            std::fprintf(out, "    v[0x%X] = 0x%02X;\n", x, nn);
+            break;
+        case 0x7000:
+            std::fprintf(out, "    v[0x%X] += 0x%02X;\n", x, nn);
+            break;
+        case 0x8000:
+            switch (n) {
+                case 0x0:
+                    std::fprintf(out, "    v[0x%X] = v[0x%X];\n", x, y);
+                    break;
+                case 0x1:
+                    std::fprintf(out, "    v[0x%X] |= v[0x%X];\n", x, y);
+                    break;
+                case 0x2:
+                    std::fprintf(out, "    v[0x%X] &= v[0x%X];\n", x, y);
+                    break;
+                case 0x3:
+                    std::fprintf(out, "    v[0x%X] ^= v[0x%X];\n", x, y);
+                    break;
+                case 0x4:
+                    std::fprintf(out, "    {\n");
+                    std::fprintf(out, "        uint16_t result = v[0x%X] + v[0x%X];\n", x, y);
+                    std::fprintf(out, "        v[0x%X] = result & 0xFF;\n", x);
+                    std::fprintf(out, "        v[0xF] = result > 0xFF ? 1 : 0;\n");
+                    std::fprintf(out, "    }\n");
+                    break;
+                case 0x5:
+                    std::fprintf(out, "    {\n");
+                    std::fprintf(out, "        uint8_t flag = v[0x%X] >= v[0x%X];\n", x, y);
+                    std::fprintf(out, "        v[0x%X] = v[0x%X] - v[0x%X];\n", x, x, y);
+                    std::fprintf(out, "        v[0xF] = flag;\n");
+                    std::fprintf(out, "    }\n");
+                    break;
+                case 0x6:
+                    std::fprintf(out, "    {\n");
+                    std::fprintf(out, "        uint8_t flag = v[0x%X] & 0x01;\n", y);
+                    std::fprintf(out, "        v[0x%X] = v[0x%X] >> 1;\n", x, y);
+                    std::fprintf(out, "        v[0xF] = flag;\n");
+                    std::fprintf(out, "    }\n");
+                    break;
+                case 0x7:
+                    std::fprintf(out, "    v[0x%X] = v[0x%X] - v[0x%X];\n", x, y, x);
+                    std::fprintf(out, "    v[0xF] = v[0x%X] > v[0x%X] ? 1 : 0;\n", y, x);
+                    break;
+                case 0xE:
+                    std::fprintf(out, "    {\n");
+                    std::fprintf(out, "        uint8_t flag = (v[0x%X] & 0x80) >> 7;\n", y);
+                    std::fprintf(out, "        v[0x%X] = v[0x%X] << 1;\n", x, y);
+                    std::fprintf(out, "        v[0xF] = flag;\n");
+                    std::fprintf(out, "    }\n");
+                    break;
+            }
+            break;
+        case 0x9000:
+            if (n == 0) {
+                std::fprintf(out, "    pc(cpu) = v[0x%X] != v[0x%X] ? 0x%03X : 0x%03X;\n", x, y, skip, next);
+            }
+            break;
+        case 0xA000:
+            std::fprintf(out, "    i(cpu) = 0x%03X;\n", nnn);
+            break;
+        case 0xB000:
+            std::fprintf(out, "    pc(cpu) = 0x%03X + v[0x0];\n", nnn);
+            break;
+        case 0xC000:
+            std::fprintf(out, "    v[0x%X] = random_byte(cpu) & 0x%02X;\n", x, nn);
+            break;
+        case 0xD000:
+            std::fprintf(out, "    draw_sprite(cpu, v[0x%X], v[0x%X], %u);\n", x, y, n);
+            break;
+        case 0xE000:
+            if (nn == 0x9E) {
+                std::fprintf(out, "    pc(cpu) = read_key(cpu, v[0x%X] & 0x0F) ? 0x%03X : 0x%03X;\n", x, skip, next);
+            } else if (nn == 0xA1) {
+                std::fprintf(out, "    pc(cpu) = !read_key(cpu, v[0x%X] & 0x0F) ? 0x%03X : 0x%03X;\n", x, skip, next);
+            }
+            break;
+        case 0xF000:
+            switch (nn) {
+                case 0x07:
+                    std::fprintf(out, "    v[0x%X] = dt(cpu);\n", x);
+                    break;
+                case 0x0A:
+                    std::fprintf(out, "    key_wait_register(cpu) = 0x%X;\n", x);
+                    std::fprintf(out, "    pc(cpu) = 0x%03X;\n", next);
+                    break;
+                case 0x15:
+                    std::fprintf(out, "    dt(cpu) = v[0x%X];\n", x);
+                    break;
+                case 0x18:
+                    std::fprintf(out, "    st(cpu) = v[0x%X];\n", x);
+                    break;
+                case 0x1E:
+                    std::fprintf(out, "    i(cpu) += v[0x%X];\n", x);
+                    break;
+                case 0x29:
+                    std::fprintf(out, "    i(cpu) = CPU::FONT_OFFSET + 5 * (v[0x%X] & 0x0F);\n", x);
+                    break;
+                case 0x33:
+                    std::fprintf(out, "    memory(cpu)[i(cpu) & CPU::ADDRESS_MASK] = (v[0x%X] / 100) %% 10;\n", x);
+                    std::fprintf(out, "    memory(cpu)[(i(cpu) + 1) & CPU::ADDRESS_MASK] = (v[0x%X] / 10) %% 10;\n", x);
+                    std::fprintf(out, "    memory(cpu)[(i(cpu) + 2) & CPU::ADDRESS_MASK] = v[0x%X] %% 10;\n", x);
+                    std::fprintf(out, "    pc(cpu) = 0x%03X;\n", next);
+                    break;
+                case 0x55:
+                    for (unsigned reg = 0; reg <= x; ++reg) {
+                        std::fprintf(out, "    memory(cpu)[i(cpu)++ & CPU::ADDRESS_MASK] = v[0x%X];\n", reg);
+                    }
+                    std::fprintf(out, "    pc(cpu) = 0x%03X;\n", next);
+                    break;
+                case 0x65:
+                    for (unsigned reg = 0; reg <= x; ++reg) {
+                        std::fprintf(out, "    v[0x%X] = memory(cpu)[i(cpu)++ & CPU::ADDRESS_MASK];\n", reg);
+                    }
+                    break;
+            }
+            break;
+    }
+}
+
+/// Emit the generated translation unit.
+static void emit(FILE *out, const Rom &rom, const std::map<uint16_t, BasicBlock> &blocks, const char *rom_path, const char *name) {
+    std::fprintf(out, "// Generated by chip8_recompile from %s. Do not edit.\n\n", rom_path);
+    std::fprintf(out, "#include \"engine.h\"\n\n");
+    std::fprintf(out, "namespace {\n\n");
+
+    std::fprintf(out, "class RecompiledEngine : public Engine {\n");
+    std::fprintf(out, "    public:\n");
+    std::fprintf(out, "        static const uint8_t IMAGE[];\n");
+    std::fprintf(out, "        static const Block BLOCKS[];\n\n");
+    for (const auto &[start, block] : blocks) {
+        std::fprintf(out, "        static void block_%03X(CPU &cpu);\n", start);
+    }
+    std::fprintf(out, "\n    protected:\n");
+    std::fprintf(out, "        const Block* find_block(uint16_t pc) const override;\n\n");
+    std::fprintf(out, "        const uint8_t* get_image() const override {\n");
+    std::fprintf(out, "            return IMAGE;\n");
+    std::fprintf(out, "        }\n");
+    std::fprintf(out, "};\n\n");
+
+    std::fprintf(out, "const uint8_t RecompiledEngine::IMAGE[] = {");
+    for (size_t n = 0; n < rom.data.size(); ++n) {
+        std::fprintf(out, "%s0x%02X,", n % 16 == 0 ? "\n    " : " ", rom.data[n]);
+    }
+    std::fprintf(out, "\n};\n\n");
+
+    for (const auto &[start, block] : blocks) {
+        std::fprintf(out, "void RecompiledEngine::block_%03X(CPU &cpu) {\n", start);
+        std::fprintf(out, "    [[maybe_unused]] uint8_t *v = registers(cpu);\n\n");
+
+        for (uint16_t addr : block.addresses) {
+            emit_instruction(out, addr, rom.fetch(addr));
+        }
+
+        if (!block.terminated) {
+            std::fprintf(out, "    pc(cpu) = 0x%03X;\n", block.addresses.back() + 2);
+        }
+
+        std::fprintf(out, "}\n\n");
+    }
+
+    std::fprintf(out, "const Engine::Block RecompiledEngine::BLOCKS[] = {\n");
+    for (const auto &[start, block] : blocks) {
+        std::fprintf(out, "    {&RecompiledEngine::block_%03X, 0x%03X, %zu, %zu},\n",
+            start, start, block.addresses.size() * 2, block.addresses.size());
+    }
+    std::fprintf(out, "};\n\n");
+
+    std::fprintf(out, "const Engine::Block* RecompiledEngine::find_block(uint16_t pc) const {\n");
+    std::fprintf(out, "    switch (pc) {\n");
+    size_t idx = 0;
+    for (const auto &[start, block] : blocks) {
+        std::fprintf(out, "        case 0x%03X: return &BLOCKS[%zu];\n", start, idx++);
+    }
+    std::fprintf(out, "        default: return nullptr;\n");
+    std::fprintf(out, "    }\n");
+    std::fprintf(out, "}\n\n");
+
+    std::fprintf(out, "} // namespace\n\n");
+    std::fprintf(out, "const Engine& %s() {\n", name);
+    std::fprintf(out, "    static const RecompiledEngine engine;\n");
+    std::fprintf(out, "    return engine;\n");
+    std::fprintf(out, "}\n");
+}
+
+/// Statically translates a ROM into a C++ translation unit containing an Engine.
+///
+/// Usage: `chip8_recompile <rom> <output.cpp> [function name]`
+///
+/// The generated file defines `const Engine& <function name>()`, which
+/// returns the engine for the ROM.
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        std::fprintf(stderr, "Usage: %s <rom> <output.cpp> [function name]\n", argv[0]);
+        return 1;
+    }
+
+    const char *rom_path = argv[1];
+    const char *output_path = argv[2];
+    const char *name = argc > 3 ? argv[3] : "recompiled_engine";
+
+    std::ifstream stream(rom_path, std::ios::in | std::ios::binary);
+    if (!stream.is_open()) {
+        std::fprintf(stderr, "Failed to open %s\n", rom_path);
+        return 1;
+    }
+
+    Rom rom;
+    rom.data.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+
+    if (rom.data.empty() || rom.data.size() > CPU::MEMORY_SIZE - CPU::INITIAL_PC) {
+        std::fprintf(stderr, "Invalid ROM size: %zu bytes\n", rom.data.size());
+        return 1;
+    }
+
+    // Discover basic blocks by following all statically known control flow
+    std::map<uint16_t, BasicBlock> blocks;
+    std::set<uint16_t> pending = {CPU::INITIAL_PC};
+
+    while (!pending.empty()) {
+        uint16_t start = *pending.begin();
+        pending.erase(pending.begin());
+
+        if (blocks.count(start) != 0 || !rom.contains(start)) {
+            continue;
+        }
+
+        if (rom.fetch(start) == (0x1000 | start)) {
+            // Jump to itself, left to the interpreter so the halt is detected
+            continue;
+        }
+
+        if (is_interpreted(rom, start)) {
+            // Interpreted one instruction at a time, blocks may resume after it
+            uint16_t instruction = rom.fetch(start);
+
+            if (is_skip(instruction)) {
+                pending.insert({static_cast<uint16_t>(start + 2), static_cast<uint16_t>(start + 6)});
+            } else if (instruction != 0x00FD) {
+                pending.insert(static_cast<uint16_t>(start + (instruction == 0xF000 ? 4 : 2)));
+            }
+            continue;
+        }
+
+        std::set<uint16_t> successors;
+        BasicBlock block = decode_block(rom, start, successors);
+
+        blocks.emplace(start, block);
+        pending.insert(successors.begin(), successors.end());
+    }
+
+    FILE *out = std::fopen(output_path, "w");
+    if (out == nullptr) {
+        std::fprintf(stderr, "Failed to open %s for writing\n", output_path);
+        return 1;
+    }
+
+    emit(out, rom, blocks, rom_path, name);
+    std::fclose(out);
+
+    std::fprintf(stderr, "Recompiled %zu blocks\n", blocks.size());
+
+    return 0;
+}
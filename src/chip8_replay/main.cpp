@@ -0,0 +1,271 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cpu.h"
+#include "frame_writer.h"
+#include "input_log.h"
+#include "save_state.h"
+
+/// %Options passed on launch.
+struct Options {
+    /// Path of the ROM, or of a save state if #from_state is set.
+    const char *start_path = nullptr;
+
+    /// Whether #start_path is a save state rather than a ROM.
+    bool from_state = false;
+
+    const char *input_path = nullptr;
+
+    /// Path to write frames to, "-" for stdout.
+    const char *output_path = nullptr;
+
+    FrameWriter::Format format = FrameWriter::Format::Y4M;
+    FrameWriter::Resolution resolution = FrameWriter::Resolution::LOW;
+    int scale = 1;
+
+    /// Number of frames between keyframes.
+    size_t interval = 600;
+
+    /// Number of worker threads.
+    unsigned jobs = std::thread::hardware_concurrency();
+
+    /// Seed of the random number generator, when starting from a ROM.
+    uint32_t seed = CPU::DEFAULT_SEED;
+};
+
+/// A range of frames between two keyframes, rendered by one worker.
+struct Segment {
+    /// The encoded frames.
+    std::vector<uint8_t> data;
+
+    /// Whether #data is complete.
+    bool done = false;
+};
+
+/// State shared between the workers and the thread writing the output.
+struct Shared {
+    std::mutex lock;
+
+    /// Signalled when a segment is done or written.
+    std::condition_variable changed;
+
+    std::vector<Segment> segments;
+
+    /// Index of the next segment to be claimed by a worker. Protected by #lock.
+    size_t next = 0;
+
+    /// Number of segments written so far. Protected by #lock.
+    size_t written = 0;
+
+    /// Maximum number of segments rendered ahead of the output, bounding memory use.
+    size_t window = 0;
+};
+
+/// Main function of a worker thread, rendering segments until none are left.
+static void worker(Shared &shared, const std::vector<CPU> &keyframes, const std::vector<uint16_t> &inputs, const Options &options) {
+    std::vector<uint8_t> encoded;
+    Display::Frame last_frame;
+
+    while (true) {
+        size_t idx;
+
+        {
+            std::unique_lock<std::mutex> lock(shared.lock);
+            shared.changed.wait(lock, [&shared] {
+                return shared.next >= shared.segments.size() || shared.next < shared.written + shared.window;
+            });
+
+            if (shared.next >= shared.segments.size()) {
+                return;
+            }
+
+            idx = shared.next++;
+        }
+
+        CPU cpu = keyframes[idx];
+        std::vector<uint8_t> data;
+        size_t end = std::min(inputs.size(), (idx + 1) * options.interval);
+
+        for (size_t n = idx * options.interval; n < end; ++n) {
+            InputLog::run_frame(cpu, inputs[n]);
+
+            // Most frames are unchanged, only encode the ones that are not
+            Display::Frame frame = cpu.get_display().get_frame();
+            if (encoded.empty() || frame != last_frame) {
+                FrameWriter::encode(frame, options.format, options.scale, options.resolution, encoded);
+                last_frame = frame;
+            }
+
+            data.insert(data.end(), encoded.begin(), encoded.end());
+        }
+
+        std::lock_guard<std::mutex> lock(shared.lock);
+        shared.segments[idx].data = std::move(data);
+        shared.segments[idx].done = true;
+        shared.changed.notify_all();
+    }
+}
+
+/// Parse the given arguments into an Options struct.
+///
+/// \return Whether the arguments were valid.
+static bool parse_arguments(int argc, char **argv, Options &options) {
+    std::vector<const char *> positional;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--state") {
+            options.from_state = true;
+        } else if (arg == "--format" && has_value) {
+            std::string format(argv[++i]);
+
+            if (format == "raw") {
+                options.format = FrameWriter::Format::RAW;
+            } else if (format == "pbm") {
+                options.format = FrameWriter::Format::PBM;
+            } else if (format == "y4m") {
+                options.format = FrameWriter::Format::Y4M;
+            } else {
+                return false;
+            }
+        } else if (arg == "--native") {
+            options.resolution = FrameWriter::Resolution::NATIVE;
+        } else if (arg == "--scale" && has_value) {
+            options.scale = std::atoi(argv[++i]);
+        } else if (arg == "--interval" && has_value) {
+            options.interval = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--jobs" && has_value) {
+            options.jobs = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--seed" && has_value) {
+            options.seed = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg.starts_with("--")) {
+            return false;
+        } else {
+            positional.push_back(argv[i]);
+        }
+    }
+
+    if (positional.size() != 3 || options.interval == 0 || options.scale < 1 || options.scale > 64) {
+        return false;
+    }
+
+    options.start_path = positional[0];
+    options.input_path = positional[1];
+    options.output_path = positional[2];
+    options.jobs = std::max(1u, options.jobs);
+
+    return true;
+}
+
+/// Renders a recorded session to a video stream.
+///
+/// Usage: `chip8_replay [--state] [--format raw|pbm|y4m] [--native] [--scale n] [--interval n] [--jobs n] [--seed n] <rom> <inputs> <output>`
+///
+/// The session starts from a freshly loaded ROM, or from a save state with
+/// `--state`, and runs one frame per entry of the InputLog. A first pass
+/// records a keyframe every `--interval` frames. The segments between
+/// keyframes are then simulated and encoded in parallel, and written to the
+/// output in order. Frames are written at 64x32, or at 128x64 with every
+/// XO-CHIP plane with `--native`.
+int main(int argc, char **argv) {
+    Options options;
+
+    if (!parse_arguments(argc, argv, options)) {
+        std::fprintf(stderr, "Usage: %s [--state] [--format raw|pbm|y4m] [--native] [--scale n] [--interval n] [--jobs n] [--seed n] <rom> <inputs> <output>\n", argv[0]);
+        return 1;
+    }
+
+    CPU cpu;
+    cpu.seed(options.seed);
+
+    if (options.from_state ? !SaveState::load(cpu, options.start_path) : !cpu.load_code_from_file(options.start_path)) {
+        std::fprintf(stderr, "Failed to load %s\n", options.start_path);
+        return 1;
+    }
+
+    std::vector<uint16_t> inputs;
+    if (!InputLog::load(options.input_path, inputs)) {
+        std::fprintf(stderr, "Failed to load inputs from %s\n", options.input_path);
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    // First pass: simulate without rendering, recording keyframes
+    std::vector<CPU> keyframes;
+    keyframes.reserve(inputs.size() / options.interval + 1);
+
+    for (size_t n = 0; n < inputs.size(); ++n) {
+        if (n % options.interval == 0) {
+            keyframes.push_back(cpu);
+        }
+
+        InputLog::run_frame(cpu, inputs[n]);
+    }
+
+    auto simulated = std::chrono::steady_clock::now();
+
+    std::FILE *file = std::strcmp(options.output_path, "-") == 0 ? stdout : std::fopen(options.output_path, "wb");
+    if (file == nullptr) {
+        std::fprintf(stderr, "Failed to open %s\n", options.output_path);
+        return 1;
+    }
+
+    std::string header = FrameWriter::get_header(options.format, options.scale, options.resolution);
+    std::fwrite(header.data(), 1, header.size(), file);
+
+    // Second pass: render segments in parallel, writing them in order
+    Shared shared;
+    shared.segments.resize(keyframes.size());
+    shared.window = 2 * options.jobs;
+
+    std::vector<std::thread> workers;
+    for (unsigned job = 0; job < options.jobs; ++job) {
+        workers.emplace_back(worker, std::ref(shared), std::cref(keyframes), std::cref(inputs), std::cref(options));
+    }
+
+    for (size_t idx = 0; idx < shared.segments.size(); ++idx) {
+        std::vector<uint8_t> data;
+
+        {
+            std::unique_lock<std::mutex> lock(shared.lock);
+            shared.changed.wait(lock, [&shared, idx] { return shared.segments[idx].done; });
+            data = std::move(shared.segments[idx].data);
+        }
+
+        std::fwrite(data.data(), 1, data.size(), file);
+
+        std::lock_guard<std::mutex> lock(shared.lock);
+        shared.written += 1;
+        shared.changed.notify_all();
+    }
+
+    for (std::thread &thread : workers) {
+        thread.join();
+    }
+
+    if (file != stdout) {
+        std::fclose(file);
+    } else {
+        std::fflush(file);
+    }
+
+    auto rendered = std::chrono::steady_clock::now();
+    std::fprintf(stderr, "Rendered %zu frames in %zu segments: simulated in %.2f s, rendered in %.2f s\n",
+        inputs.size(), keyframes.size(),
+        std::chrono::duration<double>(simulated - start).count(),
+        std::chrono::duration<double>(rendered - simulated).count());
+
+    return 0;
+}
@@ -0,0 +1,184 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cpu.h"
+#include "input_log.h"
+#include "save_state.h"
+#include "search.h"
+
+/// %Options passed on launch.
+struct Options {
+    /// Path of the ROM, or of a save state if #from_state is set.
+    const char *start_path = nullptr;
+
+    /// Whether #start_path is a save state rather than a ROM.
+    bool from_state = false;
+
+    /// Path to write the input sequence to.
+    const char *output_path = nullptr;
+
+    /// Address the PC should reach, or -1.
+    int target_pc = -1;
+
+    /// Pixel which should be lit, or -1.
+    int pixel_x = -1;
+    int pixel_y = -1;
+
+    /// Address of a byte to maximise in a best-first search, or -1 for breadth-first.
+    int score_address = -1;
+
+    /// Number of frames each choice is held for.
+    unsigned hold = 1;
+
+    /// Maximum number of frames in a sequence.
+    size_t max_frames = 3600;
+
+    /// Maximum number of distinct states to visit.
+    size_t max_states = 100000;
+
+    /// Number of worker threads.
+    unsigned jobs = std::thread::hardware_concurrency();
+
+    /// Seed of the random number generator, when starting from a ROM.
+    uint32_t seed = CPU::DEFAULT_SEED;
+};
+
+/// Parse the given arguments into an Options struct.
+///
+/// \return Whether the arguments were valid.
+static bool parse_arguments(int argc, char **argv, Options &options) {
+    std::vector<const char *> positional;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--state") {
+            options.from_state = true;
+        } else if (arg == "--pc" && has_value) {
+            options.target_pc = std::strtoul(argv[++i], nullptr, 16) & CPU::ADDRESS_MASK;
+        } else if (arg == "--pixel" && has_value) {
+            if (std::sscanf(argv[++i], "%d,%d", &options.pixel_x, &options.pixel_y) != 2
+                || options.pixel_x < 0 || options.pixel_x >= Display::HIRES_WIDTH
+                || options.pixel_y < 0 || options.pixel_y >= Display::HIRES_HEIGHT) {
+                return false;
+            }
+        } else if (arg == "--score" && has_value) {
+            options.score_address = std::strtoul(argv[++i], nullptr, 16) & CPU::ADDRESS_MASK;
+        } else if (arg == "--hold" && has_value) {
+            options.hold = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--frames" && has_value) {
+            options.max_frames = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--states" && has_value) {
+            options.max_states = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--jobs" && has_value) {
+            options.jobs = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--seed" && has_value) {
+            options.seed = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg.starts_with("--")) {
+            return false;
+        } else {
+            positional.push_back(argv[i]);
+        }
+    }
+
+    if (positional.size() != 2 || (options.target_pc < 0 && options.pixel_x < 0) || options.hold == 0) {
+        return false;
+    }
+
+    options.start_path = positional[0];
+    options.output_path = positional[1];
+    options.jobs = std::max(1u, options.jobs);
+
+    return true;
+}
+
+/// Searches for key inputs which bring a ROM to a goal.
+///
+/// Usage: `chip8_search [--state] [--pc addr] [--pixel x,y] [--score addr] [--hold n] [--frames n] [--states n] [--jobs n] [--seed n] <rom> <output>`
+///
+/// The goal is the PC reaching a hexadecimal address (`--pc`), a pixel being
+/// lit (`--pixel`, in pixels of the current resolution), or either. The
+/// search is breadth-first, or best-first maximising the byte at a
+/// hexadecimal address (`--score`), e.g. a score or level counter. Every
+/// frame, one of no key or any single key is held for `--hold` frames.
+///
+/// The sequence found is written as an InputLog, to be replayed
+/// with `chip8_replay`.
+int main(int argc, char **argv) {
+    Options options;
+
+    if (!parse_arguments(argc, argv, options)) {
+        std::fprintf(stderr, "Usage: %s [--state] [--pc addr] [--pixel x,y] [--score addr] [--hold n] [--frames n] [--states n] [--jobs n] [--seed n] <rom> <output>\n", argv[0]);
+        return 1;
+    }
+
+    CPU cpu;
+    cpu.seed(options.seed);
+
+    if (options.from_state ? !SaveState::load(cpu, options.start_path) : !cpu.load_code_from_file(options.start_path)) {
+        std::fprintf(stderr, "Failed to load %s\n", options.start_path);
+        return 1;
+    }
+
+    Search search;
+    search.set_target_pc(options.target_pc);
+    search.set_hold_frames(options.hold);
+    search.set_max_frames(options.max_frames);
+    search.set_max_states(options.max_states);
+    search.set_jobs(options.jobs);
+
+    if (options.pixel_x >= 0) {
+        int x = options.pixel_x;
+        int y = options.pixel_y;
+
+        search.set_predicate([x, y](const CPU &cpu) {
+            Display::Frame frame = cpu.get_display().get_frame();
+            int width = frame.hires ? Display::HIRES_WIDTH : Display::WIDTH;
+            int height = frame.hires ? Display::HIRES_HEIGHT : Display::HEIGHT;
+
+            if (x >= width || y >= height) {
+                return false;
+            }
+
+            const auto &row = frame.rows[y];
+            int word = x / 64;
+            uint64_t bit = uint64_t{1} << (63 - x % 64);
+
+            return ((row[word] | row[2 + word]) & bit) != 0;
+        });
+    }
+
+    if (options.score_address >= 0) {
+        uint16_t addr = options.score_address;
+
+        search.set_score([addr](const CPU &cpu) {
+            return cpu.read_memory(addr);
+        });
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    Search::Result result = search.run(cpu);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::fprintf(stderr, "Visited %zu states in %.2f s\n", result.states, seconds);
+
+    if (!result.found) {
+        std::fprintf(stderr, "Goal not reached\n");
+        return 2;
+    }
+
+    if (!InputLog::save(options.output_path, result.inputs)) {
+        std::fprintf(stderr, "Failed to save inputs to %s\n", options.output_path);
+        return 1;
+    }
+
+    std::fprintf(stderr, "Reached the goal after %zu frames, at 0x%03X\n", result.inputs.size(), result.state.get_pc());
+
+    return 0;
+}
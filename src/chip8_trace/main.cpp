@@ -0,0 +1,65 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "trace.h"
+
+/// Decodes a binary execution trace into one line of text per instruction.
+///
+/// Usage: `chip8_trace [--stream n] <trace>`
+///
+/// Each line lists the stream, the address and opcode of the instruction, and
+/// the state it changed, e.g. `0 200 F033 [300]=01 [301]=02 [302]=03`.
+int main(int argc, char **argv) {
+    const char *path = nullptr;
+    long stream = -1;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+
+        if (arg == "--stream" && i + 1 < argc) {
+            stream = std::strtol(argv[++i], nullptr, 10);
+        } else {
+            path = argv[i];
+        }
+    }
+
+    if (path == nullptr) {
+        std::fprintf(stderr, "Usage: %s [--stream n] <trace>\n", argv[0]);
+        return 1;
+    }
+
+    TraceReader reader;
+    if (!reader.open(path)) {
+        std::fprintf(stderr, "Failed to open trace %s\n", path);
+        return 1;
+    }
+
+    TraceRecord record;
+    while (reader.next(record)) {
+        if (stream >= 0 && record.stream != stream) {
+            continue;
+        }
+
+        std::printf("%u %03X %04X", record.stream, record.pc, record.opcode);
+
+        for (int reg = 0; reg < 16; ++reg) {
+            if ((record.changed_registers >> reg) & 0x01) {
+                std::printf(" V%X=%02X", reg, record.registers[reg]);
+            }
+        }
+        if (record.i_changed) {
+            std::printf(" I=%03X", record.i);
+        }
+        if (record.sp_changed) {
+            std::printf(" SP=%02X", record.sp);
+        }
+        for (int n = 0; n < record.write_count; ++n) {
+            std::printf(" [%03X]=%02X", record.writes[n].addr, record.writes[n].value);
+        }
+
+        std::printf("\n");
+    }
+
+    return 0;
+}
@@ -0,0 +1,39 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "arena.h"
+
+TEST_CASE("Arena allocation", "[arena]") {
+    CPUArena arena(3);
+
+    CPU *a = arena.allocate();
+    CPU *b = arena.allocate();
+    CPU *c = arena.allocate();
+
+    REQUIRE(a != nullptr);
+    REQUIRE(b != nullptr);
+    REQUIRE(c != nullptr);
+
+    // Instances are contiguous and cache line aligned
+    CHECK(b == a + 1);
+    CHECK(c == a + 2);
+    CHECK(reinterpret_cast<uintptr_t>(a) % 64 == 0);
+
+    CHECK(arena.allocate() == nullptr);
+    CHECK(arena.get_size() == 3);
+
+    uint8_t code[] = {
+        0x60, 0x12, // LD V0, 0x12
+    };
+    b->load_code(code, sizeof(code));
+    b->step();
+
+    arena.release(b);
+    CHECK(arena.get_size() == 2);
+
+    // Released slots are reused, and start from a fresh state
+    CPU *d = arena.allocate();
+    CHECK(d == b);
+    CHECK(arena.index_of(d) == 1);
+    CHECK(d->get_pc() == CPU::INITIAL_PC);
+    REQUIRE(d->get_register(0) == 0);
+}
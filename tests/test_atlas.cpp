@@ -0,0 +1,109 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "atlas.h"
+#include "pool.h"
+
+#include <cstring>
+
+/// Get a pixel of the image.
+static uint32_t pixel(const Atlas &atlas, int x, int y) {
+    uint32_t ret;
+    std::memcpy(&ret, atlas.get_pixels() + 4 * (static_cast<size_t>(y) * atlas.get_width() + x), sizeof(ret));
+
+    return ret;
+}
+
+TEST_CASE("Atlas layout", "[atlas]") {
+    Atlas atlas;
+    atlas.set_layout(10);
+
+    CHECK(atlas.get_width() == 3 * Atlas::TILE_WIDTH);
+    CHECK(atlas.get_height() == 4 * Atlas::TILE_HEIGHT);
+    CHECK(atlas.get_dirty_begin() == 0);
+    CHECK(atlas.get_dirty_end() == atlas.get_height());
+
+    CHECK(atlas.get_tile(0, 0) == 0);
+    CHECK(atlas.get_tile(Atlas::TILE_WIDTH, Atlas::TILE_HEIGHT) == 4);
+    CHECK(atlas.get_tile(Atlas::TILE_WIDTH, 3 * Atlas::TILE_HEIGHT) == -1);
+    CHECK(atlas.get_tile(-1, 0) == -1);
+
+    atlas.set_layout(10, 5);
+    CHECK(atlas.get_width() == 5 * Atlas::TILE_WIDTH);
+    CHECK(atlas.get_height() == 2 * Atlas::TILE_HEIGHT);
+}
+
+TEST_CASE("Atlas tiles", "[atlas]") {
+    Atlas atlas;
+    atlas.set_colors(0x000000, 0xFFFFFF);
+    atlas.set_layout(4, 2);
+    atlas.reset_dirty();
+
+    uint32_t off = pixel(atlas, 0, 0);
+    uint8_t sprite[] = {0x80};
+
+    Display display;
+    CHECK_FALSE(atlas.update(3, display));
+
+    // Low resolution pixels cover 2x2 pixels of a tile
+    display.draw_sprite(1, 1, sprite, 1);
+    REQUIRE(atlas.update(3, display));
+    CHECK(atlas.get_dirty_begin() == Atlas::TILE_HEIGHT);
+    CHECK(atlas.get_dirty_end() == 2 * Atlas::TILE_HEIGHT);
+
+    int left = Atlas::TILE_WIDTH;
+    int top = Atlas::TILE_HEIGHT;
+    CHECK(pixel(atlas, left + 1, top + 1) == off);
+    CHECK(pixel(atlas, left + 2, top + 2) != off);
+    CHECK(pixel(atlas, left + 3, top + 3) != off);
+    CHECK(pixel(atlas, left + 4, top + 4) == off);
+
+    // Unmodified displays are not drawn again
+    atlas.reset_dirty();
+    CHECK_FALSE(atlas.update(3, display));
+    CHECK(atlas.get_dirty_end() == atlas.get_dirty_begin());
+
+    // Neither are modified displays showing the same contents
+    display.draw_sprite(1, 1, sprite, 1);
+    display.draw_sprite(1, 1, sprite, 1);
+    CHECK_FALSE(atlas.update(3, display));
+
+    // High resolution pixels cover a single pixel
+    display.set_hires(true);
+    display.draw_sprite(1, 1, sprite, 1);
+    REQUIRE(atlas.update(3, display));
+    CHECK(pixel(atlas, left + 1, top + 1) != off);
+    CHECK(pixel(atlas, left + 2, top + 2) == off);
+
+    // Other tiles are untouched
+    CHECK(pixel(atlas, 1, 1) == off);
+    CHECK_FALSE(atlas.update(4, display));
+}
+
+TEST_CASE("Atlas of a pool", "[atlas]") {
+    uint8_t code[] = {
+        0xF0, 0x29, // LD F, V0
+        0xD0, 0x05, // DRW V0, V0, 5
+        0x12, 0x04, // JP self
+    };
+
+    CPU cpu;
+    cpu.load_code(code, sizeof(code));
+
+    Pool pool;
+    for (int n = 0; n < 3; ++n) {
+        pool.add(cpu);
+    }
+
+    Atlas atlas;
+    atlas.set_layout(pool.size());
+
+    CHECK(atlas.update(pool) == 0);
+    CHECK(atlas.get_dirty_end() == atlas.get_dirty_begin());
+
+    pool.run_frame(CPU::STEPS_PER_FRAME);
+    CHECK(atlas.update(pool) == 3);
+    CHECK(atlas.get_dirty_end() > atlas.get_dirty_begin());
+
+    pool.run_frame(CPU::STEPS_PER_FRAME);
+    CHECK(atlas.update(pool) == 0);
+}
@@ -0,0 +1,109 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "boot_cache.h"
+#include "save_state.h"
+#include "state_hash.h"
+
+#include <filesystem>
+#include <iterator>
+
+// Clears the screen, waits half a second, draws a digit and waits for a key
+static const uint8_t ROM[] = {
+    0x00, 0xE0, // CLS
+    0xC3, 0xFF, // RND V3, 0xFF
+    0x60, 0x1E, // LD V0, 30
+    0xF0, 0x15, // LD DT, V0
+    0xF1, 0x07, // wait: LD V1, DT
+    0x31, 0x00, // SE V1, 0
+    0x12, 0x08, // JP wait
+    0xF0, 0x29, // LD F, V0
+    0xD0, 0x05, // DRW V0, V0, 5
+    0x62, 0x05, // LD V2, 5
+    0xF2, 0x0A, // LD V2, K
+    0x12, 0x16, // JP self
+};
+
+TEST_CASE("Booting", "[boot_cache]") {
+    CPU cpu;
+    cpu.load_code(ROM, sizeof(ROM));
+
+    CPU booted = cpu;
+    unsigned frames = BootCache::boot(booted, BootCache::DEFAULT_MAX_FRAMES);
+
+    CHECK(frames >= 30);
+    CHECK(frames < 40);
+
+    // Identical to running the same number of frames without keys
+    for (unsigned frame = 0; frame < frames; ++frame) {
+        cpu.run(CPU::STEPS_PER_FRAME);
+        cpu.tick_timers();
+    }
+
+    CHECK(StateHash::equal(cpu, booted));
+
+    // The next frame reads a key
+    CHECK(BootCache::boot(booted, BootCache::DEFAULT_MAX_FRAMES) == 0);
+
+    // ROMs which never read a key stop at the limit
+    uint8_t loop[] = {0x12, 0x00};
+    CPU looping;
+    looping.load_code(loop, sizeof(loop));
+    CHECK(BootCache::boot(looping, 10) == 10);
+}
+
+TEST_CASE("Boot cache", "[boot_cache]") {
+    std::filesystem::path directory = "test_boot_cache";
+    std::filesystem::remove_all(directory);
+
+    CPU expected;
+    expected.load_code(ROM, sizeof(ROM));
+    BootCache::boot(expected);
+
+    BootCache cache;
+    REQUIRE(cache.open(directory.c_str()));
+
+    CPU cpu;
+    REQUIRE(cache.load(cpu, ROM, sizeof(ROM)));
+    CHECK(StateHash::equal(cpu, expected));
+
+    size_t files = std::distance(std::filesystem::directory_iterator(directory), std::filesystem::directory_iterator());
+    REQUIRE(files == 1);
+
+    SECTION("From memory") {
+        CPU again;
+        REQUIRE(cache.load(again, ROM, sizeof(ROM)));
+        CHECK(StateHash::equal(again, expected));
+    }
+
+    SECTION("From disk") {
+        // A new cache finds the state saved by the first
+        for (const auto &entry : std::filesystem::directory_iterator(directory)) {
+            CPU saved;
+            CHECK(SaveState::load(saved, entry.path().c_str()));
+            CHECK(saved.get_pc() == expected.get_pc());
+        }
+
+        BootCache other;
+        REQUIRE(other.open(directory.c_str()));
+
+        CPU again;
+        REQUIRE(other.load(again, ROM, sizeof(ROM)));
+        CHECK(StateHash::equal(again, expected));
+    }
+
+    SECTION("Different seeds") {
+        CPU seeded;
+        REQUIRE(cache.load(seeded, ROM, sizeof(ROM), 1234));
+        CHECK(seeded.get_registers()[3] != expected.get_registers()[3]);
+
+        files = std::distance(std::filesystem::directory_iterator(directory), std::filesystem::directory_iterator());
+        CHECK(files == 2);
+    }
+
+    SECTION("Invalid ROMs") {
+        CHECK_FALSE(cache.load(cpu, ROM, 0));
+        CHECK_FALSE(cache.load_file(cpu, "does_not_exist.ch8"));
+    }
+
+    std::filesystem::remove_all(directory);
+}
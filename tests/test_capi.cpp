@@ -0,0 +1,136 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "chip8.h"
+
+#include <vector>
+
+TEST_CASE("Batched C API", "[capi]") {
+    uint8_t rom[] = {
+        0x60, 0x00, // LD V0, 0
+        0xF0, 0x29, // LD F, V0
+        0xD0, 0x05, // DRW V0, V0, 5
+        0xA3, 0x00, // LD I, 0x300
+        0xE0, 0xA1, // loop: SKNP V0
+        0x12, 0x0E, // JP score
+        0x12, 0x08, // JP loop
+        0x71, 0x01, // score: ADD V1, 1
+        0xF1, 0x55, // LD [I], V1 - stores V1 at 0x301
+        0xA3, 0x00, // LD I, 0x300
+        0x12, 0x08, // JP loop
+    };
+
+    // Too many instances to allocate, or even to count the bytes of
+    CHECK(chip8_batch_create(SIZE_MAX, rom, sizeof(rom)) == nullptr);
+    CHECK(chip8_batch_create(SIZE_MAX / 8192, rom, sizeof(rom)) == nullptr);
+
+    // A NULL batch is rejected rather than dereferenced
+    CHECK(chip8_batch_size(nullptr) == 0);
+    CHECK(chip8_batch_observation_size(nullptr) == 0);
+    CHECK(chip8_batch_set_cycle_skipping(nullptr, 1) == -1);
+    CHECK(chip8_batch_find_duplicates(nullptr, nullptr) == -1);
+    CHECK(chip8_batch_boot(nullptr, nullptr) == -1);
+    CHECK(chip8_batch_reset(nullptr, 0) == -1);
+
+    chip8_batch *batch = chip8_batch_create(3, rom, sizeof(rom));
+    REQUIRE(batch != nullptr);
+    CHECK(chip8_batch_size(batch) == 3);
+
+    chip8_batch_set_reward_address(batch, 0x301);
+    CHECK(chip8_batch_observation_size(batch) == 256);
+
+    std::vector<uint8_t> obs(3 * 256);
+    std::vector<float> rewards(3);
+    uint16_t actions[] = {0x0001, 0x0000, 0x0001};
+
+    REQUIRE(chip8_batch_step(batch, actions, 1, obs.data(), rewards.data()) == 0);
+
+    // Only instances holding key 0 score
+    CHECK(rewards[0] > 0);
+    CHECK(rewards[1] == 0);
+    CHECK(rewards[0] == rewards[2]);
+    CHECK(obs[0] == 0xF0);
+    CHECK(obs[256] == 0xF0);
+    CHECK(obs[256 + 8] == 0x90);
+
+    REQUIRE(chip8_batch_set_observation(batch, CHIP8_OBSERVATION_EXPANDED) == 0);
+    CHECK(chip8_batch_observation_size(batch) == 2048);
+    obs.resize(3 * 2048);
+
+    REQUIRE(chip8_batch_reset(batch, 0) == 0);
+    REQUIRE(chip8_batch_step(batch, nullptr, 1, obs.data(), nullptr) == 0);
+    CHECK(obs[0] == 1);
+    CHECK(obs[4] == 0);
+    CHECK(obs[2048 + 64] == 1);
+
+    // The ROM reads a key in its first frame, so there is nothing to skip
+    REQUIRE(chip8_batch_boot(batch, nullptr) == 0);
+    REQUIRE(chip8_batch_step(batch, nullptr, 1, obs.data(), nullptr) == 0);
+    CHECK(obs[2 * 2048] == 1);
+
+    // Low resolution is doubled at native resolution
+    REQUIRE(chip8_batch_set_observation(batch, CHIP8_OBSERVATION_NATIVE) == 0);
+    CHECK(chip8_batch_observation_size(batch) == 8192);
+    obs.resize(3 * 8192);
+
+    REQUIRE(chip8_batch_step(batch, nullptr, 1, obs.data(), nullptr) == 0);
+    CHECK(obs[0] == 1);
+    CHECK(obs[1] == 1);
+    CHECK(obs[128 + 1] == 1);
+    CHECK(obs[8] == 0);
+    CHECK(obs[2 * 128] == 1);
+    CHECK(obs[8192] == 1);
+
+    CHECK(chip8_batch_reset(batch, 3) == -1);
+    chip8_batch_destroy(batch);
+}
+
+TEST_CASE("Skipping cycles in the C API", "[capi]") {
+    uint8_t rom[] = {
+        0x60, 0x00, // LD V0, 0
+        0xA3, 0x00, // LD I, 0x300
+        0xE0, 0xA1, // loop: SKNP V0
+        0x71, 0x01, // ADD V1, 1
+        0xF1, 0x33, // LD B, V1
+        0xF0, 0x29, // LD F, V0
+        0xD0, 0x05, // DRW V0, V0, 5
+        0xA3, 0x00, // LD I, 0x300
+        0x12, 0x04, // JP loop
+    };
+
+    chip8_batch *skipping = chip8_batch_create(3, rom, sizeof(rom));
+    chip8_batch *reference = chip8_batch_create(3, rom, sizeof(rom));
+    REQUIRE(skipping != nullptr);
+    REQUIRE(reference != nullptr);
+
+    REQUIRE(chip8_batch_set_cycle_skipping(skipping, 1) == 0);
+    chip8_batch_set_reward_address(skipping, 0x302);
+    chip8_batch_set_reward_address(reference, 0x302);
+
+    std::vector<uint8_t> obs(3 * 256);
+    std::vector<uint8_t> expected_obs(3 * 256);
+    std::vector<float> rewards(3);
+    std::vector<float> expected_rewards(3);
+    uint16_t actions[] = {0x0001, 0x0000, 0x0001};
+
+    for (unsigned frames : {1u, 7u, 1000u, 33u, 5000u}) {
+        if (frames == 33) {
+            actions[1] = 0x0001;
+        }
+
+        REQUIRE(chip8_batch_step(skipping, actions, frames, obs.data(), rewards.data()) == 0);
+        REQUIRE(chip8_batch_step(reference, actions, frames, expected_obs.data(), expected_rewards.data()) == 0);
+
+        CHECK(obs == expected_obs);
+        CHECK(rewards == expected_rewards);
+    }
+
+    std::vector<size_t> duplicates(3);
+    REQUIRE(chip8_batch_find_duplicates(skipping, duplicates.data()) == 0);
+    CHECK(duplicates == std::vector<size_t> {0, 1, 0});
+
+    REQUIRE(chip8_batch_find_duplicates(reference, duplicates.data()) == 0);
+    REQUIRE(duplicates == std::vector<size_t> {0, 1, 0});
+
+    chip8_batch_destroy(skipping);
+    chip8_batch_destroy(reference);
+}
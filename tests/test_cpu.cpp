@@ -237,3 +237,374 @@ TEST_CASE("Sprite drawing", "[cpu][display]") {
         }
     }
 }
+
+TEST_CASE("Halt detection", "[cpu]") {
+    CPU cpu = CPU();
+
+    SECTION("Jump to self") {
+        uint8_t code[] = {
+            0x60, 0x01, // LD V0, 1
+            0x12, 0x02, // JP 0x202
+        };
+
+        cpu.load_code(code, sizeof(code));
+
+        CHECK(cpu.get_halt() == CPU::Halt::NONE);
+        cpu.step();
+        CHECK(cpu.get_halt() == CPU::Halt::JUMP_SELF);
+
+        REQUIRE(cpu.run(100) == 0);
+    }
+
+    SECTION("Wait for key") {
+        uint8_t code[] = {
+            0xF3, 0x0A, // LD V3, K
+            0x60, 0x01, // LD V0, 1
+        };
+
+        cpu.load_code(code, sizeof(code));
+
+        CHECK(cpu.run(100) == 1);
+        CHECK(cpu.get_halt() == CPU::Halt::KEY_WAIT);
+
+        cpu.set_key_down(0xA, true);
+        CHECK(cpu.get_halt() == CPU::Halt::KEY_WAIT);
+        cpu.set_key_down(0xA, false);
+        CHECK(cpu.get_halt() == CPU::Halt::NONE);
+        REQUIRE(cpu.get_register(3) == 0xA);
+    }
+}
+
+TEST_CASE("Delay timer loop fast-forward", "[cpu]") {
+    uint8_t code[] = {
+        0x60, 0x03, // LD V0, 3
+        0xF0, 0x15, // LD DT, V0
+        0xF1, 0x07, // loop: LD V1, DT
+        0x31, 0x00, // SE V1, 0
+        0x12, 0x04, // JP loop
+        0x62, 0x01, // LD V2, 1
+    };
+
+    for (unsigned steps = 0; steps < 12; ++steps) {
+        CPU stepped;
+        stepped.load_code(code, sizeof(code));
+        CPU skipped;
+        skipped.load_code(code, sizeof(code));
+
+        for (unsigned n = 0; n < 5 + steps; ++n) {
+            stepped.step();
+        }
+        CHECK(skipped.run(5 + steps) == 5 + steps);
+
+        INFO("steps: " << steps);
+        CHECK(skipped.get_halt() == CPU::Halt::TIMER_WAIT);
+        CHECK(skipped.get_pc() == stepped.get_pc());
+        CHECK(skipped.get_registers() == stepped.get_registers());
+    }
+
+    CPU cpu;
+    cpu.load_code(code, sizeof(code));
+    cpu.run(100);
+
+    for (int tick = 0; tick < 3; ++tick) {
+        cpu.tick_timers();
+        CHECK(cpu.get_halt() == CPU::Halt::NONE);
+        cpu.run(100);
+    }
+
+    REQUIRE(cpu.get_register(2) == 1);
+}
+
+TEST_CASE("Queued key events", "[cpu][input]") {
+    CPU cpu = CPU();
+
+    uint8_t code[] = {
+        0xF3, 0x0A, // LD V3, K
+        0x60, 0x01, // LD V0, 1
+    };
+
+    cpu.load_code(code, sizeof(code));
+    cpu.step();
+    CHECK(cpu.get_halt() == CPU::Halt::KEY_WAIT);
+
+    CHECK(cpu.queue_key_event(0x5, true, 0));
+    CHECK(cpu.queue_key_event(0x5, false, 0));
+
+    // Pending events may resume the CPU, but are not applied yet
+    CHECK(cpu.get_halt() == CPU::Halt::NONE);
+    CHECK_FALSE(cpu.is_key_down(0x5));
+
+    CHECK(cpu.run(2) == 2);
+    CHECK(cpu.get_register(3) == 0x5);
+    CHECK(cpu.get_register(0) == 0x1);
+    REQUIRE(cpu.get_input_latency().applied.count == 2);
+}
+
+TEST_CASE("Input-to-photon latency", "[cpu]") {
+    uint8_t code[] = {
+        0x60, 0x05, // LD V0, 5
+        0xE0, 0xA1, // SKNP V0
+        0x12, 0x0A, // JP 0x20A
+        0x12, 0x02, // JP 0x202
+        0x00, 0x00,
+        0xA0, 0x00, // LD I, 0x000
+        0xD0, 0x05, // DRW V0, V0, 5
+        0x12, 0x0C, // JP 0x20C
+    };
+
+    CPU cpu;
+    cpu.load_code(code, sizeof(code));
+
+    CHECK(cpu.run(10) == 10);
+    CHECK(cpu.take_drawn_input() == 0);
+
+    CHECK(cpu.queue_key_event(0x5, true, 1));
+    CHECK(cpu.run(1) == 1);
+
+    InputLatency latency = cpu.get_input_latency();
+    CHECK(latency.applied.count == 1);
+    CHECK(latency.observed.count == 0);
+
+    // Polled once more, then the loop is left for the draw
+    CHECK(cpu.run(3) == 3);
+    latency = cpu.get_input_latency();
+    CHECK(latency.observed.count == 1);
+    CHECK(latency.drawn.count == 0);
+
+    CHECK(cpu.run(2) == 2);
+    latency = cpu.get_input_latency();
+    CHECK(latency.observed.count == 1);
+    CHECK(latency.drawn.count == 1);
+    CHECK(latency.presented.count == 0);
+
+    // The draw is taken once, and further draws without input are ignored
+    CHECK(cpu.take_drawn_input() == 1);
+    CHECK(cpu.run(10) == 10);
+    CHECK(cpu.get_input_latency().drawn.count == 1);
+    REQUIRE(cpu.take_drawn_input() == 0);
+}
+
+TEST_CASE("Latency histograms", "[cpu]") {
+    LatencyHistogram histogram;
+    CHECK(histogram.percentile_ns(0.5) == 0);
+
+    histogram.add(500);
+    histogram.add(1500);
+    histogram.add(3000);
+    histogram.add(100'000'000'000);
+
+    CHECK(histogram.count == 4);
+    CHECK(histogram.max_ns == 100'000'000'000);
+    CHECK(histogram.buckets[0] == 1);
+    CHECK(histogram.buckets[1] == 1);
+    CHECK(histogram.buckets[2] == 1);
+    CHECK(histogram.buckets[LatencyHistogram::BUCKETS - 1] == 1);
+    CHECK(histogram.mean_ns() == 25'000'001'250);
+
+    CHECK(histogram.percentile_ns(0.25) == 1000);
+    CHECK(histogram.percentile_ns(0.5) == 2000);
+    REQUIRE(histogram.percentile_ns(1.0) == 100'000'000'000);
+}
+
+TEST_CASE("Seeded random numbers", "[cpu]") {
+    uint8_t code[] = {
+        0xC0, 0xFF, // RND V0, FF
+        0xC1, 0xFF, // RND V1, FF
+        0xC2, 0x0F, // RND V2, 0F
+    };
+
+    CPU a = CPU();
+    CPU b = CPU();
+    a.load_code(code, sizeof(code));
+    b.load_code(code, sizeof(code));
+    a.seed(1234);
+    b.seed(1234);
+
+    // A copied CPU continues the same random sequence
+    a.step();
+    CPU fork = a;
+
+    CHECK(a.run(2) == 2);
+    CHECK(b.run(3) == 3);
+    CHECK(fork.run(2) == 2);
+
+    for (uint8_t reg = 0; reg < 3; ++reg) {
+        CHECK(a.get_register(reg) == b.get_register(reg));
+        CHECK(fork.get_register(reg) == a.get_register(reg));
+    }
+    CHECK(a.get_register(0) != a.get_register(1));
+    REQUIRE(a.get_register(2) <= 0x0F);
+}
+
+TEST_CASE("SUPER-CHIP instructions", "[cpu]") {
+    CPU cpu = CPU();
+
+    SECTION("Resolution and big font") {
+        uint8_t code[] = {
+            0x00, 0xFF, // HIGH
+            0x60, 0x07, // LD V0, 7
+            0xF0, 0x30, // LD HF, V0
+            0xD1, 0x10, // DRW V1, V1, 0
+            0x00, 0xFE, // LOW
+        };
+
+        cpu.load_code(code, sizeof(code));
+        step_cpu(&cpu, 4);
+
+        CHECK(cpu.get_display().is_hires());
+        CHECK(cpu.get_i() == CPU::BIG_FONT_OFFSET + 70);
+        CHECK(cpu.read_memory(cpu.get_i()) == CPU::BIG_FONT[70]);
+        CHECK(cpu.get_display().get_frame().rows[0][0] == 0xFFFF000000000000);
+
+        cpu.step();
+        CHECK_FALSE(cpu.get_display().is_hires());
+        REQUIRE(cpu.get_display().get_frame() == Display::Frame{});
+    }
+
+    SECTION("Scrolling") {
+        uint8_t code[] = {
+            0xA0, 0x00, // LD I, 0
+            0xD0, 0x01, // DRW V0, V0, 1
+            0x00, 0xC2, // SCD 2
+            0x00, 0xFB, // SCR
+            0x00, 0xFC, // SCL
+            0x00, 0xFC, // SCL
+        };
+
+        cpu.load_code(code, sizeof(code));
+        step_cpu(&cpu, 4);
+
+        CHECK(cpu.get_display().get_rows()[0] == 0);
+        CHECK(cpu.get_display().get_rows()[2] == 0x0F00000000000000);
+
+        step_cpu(&cpu, 2);
+        REQUIRE(cpu.get_display().get_rows()[2] == 0x0000000000000000);
+    }
+
+    SECTION("Flag registers") {
+        uint8_t code[] = {
+            0x60, 0x11, // LD V0, 0x11
+            0x61, 0x22, // LD V1, 0x22
+            0xF1, 0x75, // LD R, V1
+            0x60, 0x00, // LD V0, 0
+            0x61, 0x00, // LD V1, 0
+            0xF0, 0x85, // LD V0, R
+        };
+
+        cpu.load_code(code, sizeof(code));
+        step_cpu(&cpu, 6);
+
+        CHECK(cpu.get_register(0) == 0x11);
+        REQUIRE(cpu.get_register(1) == 0x00);
+    }
+
+    SECTION("Exit") {
+        uint8_t code[] = {
+            0x60, 0x01, // LD V0, 1
+            0x00, 0xFD, // EXIT
+        };
+
+        cpu.load_code(code, sizeof(code));
+
+        CHECK(cpu.run(100) == 1);
+        CHECK(cpu.get_halt() == CPU::Halt::JUMP_SELF);
+        REQUIRE(cpu.get_pc() == 0x202);
+    }
+}
+
+TEST_CASE("XO-CHIP instructions", "[cpu]") {
+    CPU cpu = CPU();
+
+    SECTION("Long I and skips") {
+        uint8_t code[] = {
+            0x30, 0x00,             // SE V0, 0
+            0xF0, 0x00, 0x0F, 0xFE, // LD I, 0x0FFE
+            0x40, 0x00,             // SNE V0, 0
+            0xF0, 0x00, 0x0F, 0xFF, // LD I, 0x0FFF
+        };
+
+        cpu.load_code(code, sizeof(code));
+
+        cpu.step();
+        CHECK(cpu.get_pc() == 0x206);
+        cpu.step();
+        CHECK(cpu.get_pc() == 0x208);
+        cpu.step();
+        CHECK(cpu.get_pc() == 0x20C);
+        REQUIRE(cpu.get_i() == 0x0FFF);
+    }
+
+    SECTION("Register ranges") {
+        uint8_t code[] = {
+            0x62, 0x01, // LD V2, 1
+            0x63, 0x02, // LD V3, 2
+            0x64, 0x03, // LD V4, 3
+            0xA3, 0x00, // LD I, 0x300
+            0x52, 0x42, // LD [I], V2 - V4
+            0x54, 0x23, // LD V4 - V2, [I]
+        };
+
+        cpu.load_code(code, sizeof(code));
+        step_cpu(&cpu, 5);
+
+        CHECK(cpu.get_i() == 0x300);
+        CHECK(cpu.read_memory(0x300) == 1);
+        CHECK(cpu.read_memory(0x301) == 2);
+        CHECK(cpu.read_memory(0x302) == 3);
+
+        cpu.step();
+        CHECK(cpu.get_register(4) == 1);
+        CHECK(cpu.get_register(3) == 2);
+        REQUIRE(cpu.get_register(2) == 3);
+    }
+
+    SECTION("Drawing to both planes") {
+        uint8_t code[] = {
+            0xF3, 0x01, // PLANE 3
+            0xA2, 0x06, // LD I, 0x206
+            0xD0, 0x01, // DRW V0, V0, 1
+            0xF0, 0x0F, // Sprite data for each plane
+        };
+
+        cpu.load_code(code, sizeof(code));
+        step_cpu(&cpu, 3);
+
+        Display::Frame frame = cpu.get_display().get_frame();
+        CHECK(frame.rows[0][0] == 0xF000000000000000);
+        CHECK(frame.rows[0][2] == 0x0F00000000000000);
+        REQUIRE(cpu.get_register(0xF) == 0);
+    }
+
+    SECTION("Audio") {
+        uint8_t code[] = {
+            0xA0, 0x00, // LD I, 0
+            0xF0, 0x02, // AUDIO
+            0x60, 0x70, // LD V0, 0x70
+            0xF0, 0x3A, // PITCH V0
+        };
+
+        cpu.load_code(code, sizeof(code));
+        CHECK(cpu.get_pitch() == CPU::DEFAULT_PITCH);
+        step_cpu(&cpu, 4);
+
+        CHECK(cpu.get_audio_pattern()[0] == CPU::FONT[0]);
+        CHECK(cpu.get_audio_pattern()[15] == CPU::FONT[15]);
+        REQUIRE(cpu.get_pitch() == 0x70);
+    }
+
+    SECTION("Addresses wrap around the end of memory") {
+        uint8_t code[] = {
+            0x60, 0x2A, // LD V0, 42
+            0xAF, 0xFF, // LD I, 0xFFF
+            0xF0, 0x1E, // ADD I, V0
+            0xF0, 0x55, // LD [I], V0
+        };
+
+        cpu.load_code(code, sizeof(code));
+        step_cpu(&cpu, 4);
+
+        uint16_t addr = (0x0FFF + 42) & CPU::ADDRESS_MASK;
+        CHECK(cpu.read_memory(addr) == 42);
+        REQUIRE(cpu.read_memory(addr + CPU::MEMORY_SIZE) == 42);
+    }
+}
@@ -0,0 +1,94 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "debugger.h"
+
+TEST_CASE("Breakpoints and watchpoints", "[debugger][cpu]") {
+    uint8_t code[] = {
+        0x60, 0x7B, // LD V0, 123
+        0xA3, 0x00, // LD I, 300
+        0xF0, 0x33, // LD B, V0
+        0xF2, 0x65, // LD V2, [I]
+        0x22, 0x0E, // CALL 20E
+        0xD0, 0x05, // DRW V0, V0, 5
+        0x12, 0x0C, // JP 20C
+        0x00, 0xEE, // RET
+    };
+
+    CPU cpu = CPU();
+    cpu.load_code(code, sizeof(code));
+
+    Debugger debugger;
+
+    SECTION("No breakpoints") {
+        CHECK_FALSE(debugger.is_active());
+
+        Debugger::Stop stop = debugger.run(cpu, 100);
+        CHECK(stop.reason == Debugger::StopReason::HALT);
+        CHECK(stop.steps == 7);
+        REQUIRE(stop.pc == 0x20C);
+    }
+
+    SECTION("Breakpoint") {
+        debugger.set_breakpoint(0x204, true);
+        REQUIRE(debugger.is_active());
+
+        Debugger::Stop stop = debugger.run(cpu, 100);
+        CHECK(stop.reason == Debugger::StopReason::BREAKPOINT);
+        CHECK(stop.steps == 2);
+        CHECK(stop.pc == 0x204);
+        CHECK(debugger.check(cpu).reason == Debugger::StopReason::BREAKPOINT);
+
+        // Resumes past the breakpoint
+        stop = debugger.run(cpu, 1);
+        CHECK(stop.reason == Debugger::StopReason::NONE);
+        CHECK(stop.pc == 0x206);
+
+        debugger.set_breakpoint(0x204, false);
+        REQUIRE_FALSE(debugger.is_active());
+    }
+
+    SECTION("Write watchpoint") {
+        debugger.set_watchpoint(0x302, 1, Debugger::WRITE);
+
+        Debugger::Stop stop = debugger.run(cpu, 100);
+        CHECK(stop.reason == Debugger::StopReason::WATCH_WRITE);
+        CHECK(stop.pc == 0x204);
+        CHECK(stop.addr == 0x302);
+
+        // Reported before the write happens
+        REQUIRE(cpu.read_memory(0x302) == 0);
+    }
+
+    SECTION("Read watchpoint") {
+        debugger.set_watchpoint(0x300, 3, Debugger::READ);
+
+        Debugger::Stop stop = debugger.run(cpu, 100);
+        CHECK(stop.reason == Debugger::StopReason::WATCH_READ);
+        CHECK(stop.pc == 0x206);
+        REQUIRE(stop.addr == 0x300);
+    }
+
+    SECTION("Stack and sprite accesses") {
+        debugger.set_watchpoint(0x1FE, 2, Debugger::READ_WRITE);
+
+        Debugger::Stop stop = debugger.run(cpu, 100);
+        CHECK(stop.reason == Debugger::StopReason::WATCH_WRITE);
+        CHECK(stop.pc == 0x208);
+
+        stop = debugger.run(cpu, 100);
+        CHECK(stop.reason == Debugger::StopReason::WATCH_READ);
+        CHECK(stop.pc == 0x20E);
+        CHECK(stop.addr == 0x1FE);
+
+        // LD V2, [I] left I at 0x303, so the sprite is read from 0x303 - 0x307
+        debugger.set_watchpoint(0x1FE, 2, 0);
+        debugger.set_watchpoint(0x305, 1, Debugger::READ);
+        stop = debugger.run(cpu, 100);
+        CHECK(stop.reason == Debugger::StopReason::WATCH_READ);
+        CHECK(stop.pc == 0x20A);
+        CHECK(stop.addr == 0x305);
+
+        debugger.clear();
+        REQUIRE_FALSE(debugger.is_active());
+    }
+}
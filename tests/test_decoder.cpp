@@ -0,0 +1,288 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "decoder.h"
+
+#include <memory>
+#include <random>
+#include <vector>
+
+static void check_equal(const CPU &a, const CPU &b) {
+    REQUIRE(a.get_pc() == b.get_pc());
+    REQUIRE(a.get_i() == b.get_i());
+    REQUIRE(a.get_sp() == b.get_sp());
+    REQUIRE(a.get_registers() == b.get_registers());
+    REQUIRE(a.get_display().get_frame() == b.get_display().get_frame());
+
+    for (size_t addr = 0; addr < CPU::MEMORY_SIZE; ++addr) {
+        if (a.read_memory(addr) != b.read_memory(addr)) {
+            FAIL("Memory differs at " << addr);
+        }
+    }
+}
+
+/// Generate a random program made up mostly of sequences the decoder fuses.
+///
+/// The program is built from blocks that jumps and skips only ever land
+/// between, and only modifies its own code by changing one of `6xnn`, `7xnn`,
+/// `3xnn` and `4xnn` into another, so execution stays within the program and
+/// all accesses stay within memory. Any instruction a skip may land on
+/// starts a block.
+static std::vector<uint8_t> generate(std::mt19937 &rng) {
+    std::vector<uint16_t> code;
+    std::vector<uint16_t> blocks;
+
+    // Instructions whose targets are filled in once all blocks are known
+    std::vector<size_t> jumps;
+    std::vector<size_t> modifications;
+    std::vector<uint16_t> modifiable;
+
+    auto address = [&code]() -> uint16_t {
+        return 0x200 + 2 * code.size();
+    };
+
+    size_t length = 10 + rng() % 20;
+
+    for (size_t block = 0; block < length; ++block) {
+        uint8_t x = rng() % 16;
+        uint8_t y = rng() % 16;
+        uint8_t nn = rng() % 4 == 0 ? 0 : rng();
+
+        blocks.push_back(address());
+
+        switch (rng() % 10) {
+            case 0:
+                modifiable.push_back(address());
+                code.push_back(0x6000 | x << 8 | nn);
+                code.push_back(0x6000 | y << 8 | (rng() & 0xFF));
+                break;
+            case 1:
+                code.push_back(0xA000 | (rng() % 0xE00));
+                code.push_back(0xD000 | x << 8 | y << 4 | (rng() % 16));
+                break;
+            case 2:
+                // Loop counter
+                modifiable.push_back(address());
+                code.push_back(0x7000 | x << 8 | (rng() % 3));
+                modifiable.push_back(address());
+                code.push_back((rng() % 2 ? 0x3000 : 0x4000) | x << 8 | nn);
+                jumps.push_back(code.size());
+                code.push_back(0x1000);
+                break;
+            case 3:
+                code.push_back(0xA200 | (rng() & 0xFF));
+                code.push_back(0xF01E | x << 8);
+                code.push_back(0xF065 | y << 8);
+                break;
+            case 4:
+                // Delay timer polling loop
+                code.push_back(0xF015 | x << 8);
+                code.push_back(0xF007 | x << 8);
+                code.push_back(0x3000 | x << 8);
+                code.push_back(0x1000 | (address() - 4));
+                break;
+            case 5: {
+                // Modify code
+                static const uint8_t OPCODES[] = {0x60, 0x70, 0x30, 0x40};
+
+                code.push_back(0x6000 | OPCODES[rng() % 4] | (rng() % 16));
+                modifications.push_back(code.size());
+                code.push_back(0xA000);
+                code.push_back(0xF055);
+                break;
+            }
+            case 6:
+                modifiable.push_back(address());
+                code.push_back((rng() % 2 ? 0x3000 : 0x4000) | x << 8 | nn);
+                code.push_back(0x7000 | y << 8 | nn);
+                break;
+            case 7:
+                jumps.push_back(code.size());
+                code.push_back(0x1000);
+                break;
+            case 8:
+                code.push_back(0xC000 | x << 8 | nn);
+                code.push_back(0x8004 | x << 8 | y << 4);
+                break;
+            default:
+                code.push_back(0x7000 | x << 8 | nn);
+                break;
+        }
+    }
+
+    // Make sure execution stays within the program
+    uint16_t end = address();
+    blocks.push_back(end);
+    code.push_back(0x1000 | end);
+    code.push_back(0x1000 | end);
+
+    for (size_t idx : jumps) {
+        code[idx] |= blocks[rng() % blocks.size()];
+    }
+
+    for (size_t idx : modifications) {
+        code[idx] |= modifiable.empty() ? 0x300 : modifiable[rng() % modifiable.size()];
+    }
+
+    std::vector<uint8_t> ret;
+    for (uint16_t op : code) {
+        ret.push_back(op >> 8);
+        ret.push_back(op & 0xFF);
+    }
+
+    return ret;
+}
+
+TEST_CASE("Superinstructions match the interpreter", "[decoder][cpu]") {
+    std::mt19937 rng(1234);
+
+    for (int program = 0; program < 200; ++program) {
+        std::vector<uint8_t> code = generate(rng);
+
+        CPU expected = CPU();
+        CPU actual = CPU();
+        expected.load_code(code.data(), code.size());
+        actual.load_code(code.data(), code.size());
+
+        Decoder decoder;
+
+        for (int frame = 0; frame < 100; ++frame) {
+            unsigned steps = 1 + rng() % 20;
+
+            REQUIRE(decoder.run(actual, steps) == expected.run(steps));
+            check_equal(expected, actual);
+
+            expected.tick_timers();
+            actual.tick_timers();
+        }
+    }
+}
+
+TEST_CASE("Superinstruction decoding", "[decoder]") {
+    uint8_t code[] = {
+        0x60, 0x01, // LD V0, 1
+        0x61, 0x02, // LD V1, 2
+        0x62, 0x03, // LD V2, 3
+        0xA0, 0x00, // LD I, 0
+        0xD0, 0x15, // DRW V0, V1, 5
+        0x70, 0x01, // ADD V0, 1
+        0x30, 0x03, // SE V0, 3
+        0x12, 0x0A, // JP 20A
+        0x12, 0x10, // JP 210
+    };
+
+    CPU cpu = CPU();
+    cpu.load_code(code, sizeof(code));
+
+    Decoder decoder;
+    CHECK(decoder.run(cpu, 100) == 10);
+    CHECK(cpu.get_halt() == CPU::Halt::JUMP_SELF);
+    CHECK(cpu.get_register(0) == 3);
+
+    CHECK(decoder.get_kind(0x200) == Decoder::Kind::LD_RUN);
+    CHECK(decoder.get_kind(0x206) == Decoder::Kind::LD_I_DRAW);
+    CHECK(decoder.get_kind(0x20A) == Decoder::Kind::ADD_SE_JP);
+    REQUIRE(decoder.get_kind(0x210) == Decoder::Kind::JP);
+}
+
+TEST_CASE("Extended instructions are left to the interpreter", "[decoder][cpu]") {
+    uint8_t code[] = {
+        0x00, 0xFF,             // HIGH
+        0x30, 0x00,             // SE V0, 0
+        0xF0, 0x00, 0x02, 0x20, // LD I, 0x0220
+        0x70, 0x01,             // ADD V0, 1
+        0xA2, 0x20,             // LD I, 0x220
+        0xD0, 0x00,             // DRW V0, V0, 0
+        0x00, 0xC1,             // SCD 1
+        0x30, 0x03,             // SE V0, 3
+        0x12, 0x02,             // JP 202
+        0x00, 0xFD,             // EXIT
+    };
+
+    CPU expected = CPU();
+    expected.load_code(code, sizeof(code));
+    CPU actual = expected;
+
+    Decoder decoder;
+    for (int frame = 0; frame < 10; ++frame) {
+        REQUIRE(decoder.run(actual, 7) == expected.run(7));
+        check_equal(expected, actual);
+    }
+
+    CHECK(actual.get_halt() == CPU::Halt::JUMP_SELF);
+    CHECK(decoder.get_kind(0x202) == Decoder::Kind::STEP);
+    REQUIRE(decoder.get_kind(0x214) == Decoder::Kind::EXIT);
+}
+
+TEST_CASE("A shared decoder matches the interpreter", "[decoder][cpu]") {
+    std::mt19937 rng(5678);
+
+    for (int program = 0; program < 50; ++program) {
+        std::vector<uint8_t> code = generate(rng);
+
+        CPU start = CPU();
+        start.load_code(code.data(), code.size());
+
+        // Decoded once, then only read by all instances
+        std::shared_ptr<const Decoder> decoder = std::make_shared<const Decoder>(start);
+        CHECK(decoder->get_kind(CPU::INITIAL_PC) != Decoder::Kind::NONE);
+
+        std::vector<CPU> expected(4, start);
+        std::vector<CPU> actual(4, start);
+        std::vector<Decoder::Overlay> overlays(4);
+
+        for (size_t idx = 0; idx < expected.size(); ++idx) {
+            expected[idx].seed(idx);
+            actual[idx].seed(idx);
+        }
+
+        for (int frame = 0; frame < 50; ++frame) {
+            for (size_t idx = 0; idx < expected.size(); ++idx) {
+                unsigned steps = 1 + rng() % 20;
+
+                REQUIRE(decoder->run(actual[idx], steps, overlays[idx]) == expected[idx].run(steps));
+                check_equal(expected[idx], actual[idx]);
+
+                expected[idx].tick_timers();
+                actual[idx].tick_timers();
+            }
+        }
+    }
+}
+
+TEST_CASE("Only self-modified pages are decoded privately", "[decoder]") {
+    uint8_t code[] = {
+        0x60, 0x00, // LD V0, 0
+        0x70, 0x01, // ADD V0, 1
+        0x30, 0x10, // SE V0, 16
+        0x12, 0x02, // JP 202
+        0x60, 0x02, // LD V0, 2
+        0xA2, 0x03, // LD I, 203
+        0xF0, 0x55, // LD [I], V0
+        0x12, 0x00, // JP 200
+    };
+
+    CPU cpu = CPU();
+    cpu.load_code(code, sizeof(code));
+
+    const Decoder decoder(cpu);
+    CHECK(decoder.get_kind(0x202) == Decoder::Kind::ADD_SE_JP);
+
+    Decoder::Overlay unmodified;
+    CPU other = cpu;
+    decoder.run(other, 12, unmodified);
+    CHECK(unmodified.get_pages() == 0);
+
+    // Turns ADD V0, 1 into ADD V0, 2 on the first pass
+    Decoder::Overlay modified;
+    CPU expected = cpu;
+    for (int frame = 0; frame < 20; ++frame) {
+        REQUIRE(decoder.run(cpu, 12, modified) == expected.run(12));
+        check_equal(expected, cpu);
+    }
+
+    CHECK(cpu.read_memory(0x203) == 2);
+    CHECK(modified.get_pages() == 1);
+
+    // The shared entries are unaffected
+    REQUIRE(decoder.get_kind(0x202) == Decoder::Kind::ADD_SE_JP);
+}
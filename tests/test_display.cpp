@@ -85,3 +85,114 @@ TEST_CASE("Draw byte", "[display]") {
         CHECK(vram[4] == 1);
     }
 }
+
+TEST_CASE("High resolution", "[display]") {
+    Display display = Display();
+    display.set_hires(true);
+    REQUIRE(display.is_hires());
+
+    SECTION("Draw over edge") {
+        display.draw_byte(Display::HIRES_WIDTH - 4, Display::HIRES_HEIGHT - 1, 0xFF);
+
+        Display::Frame frame = display.get_frame();
+        CHECK(frame.rows[Display::HIRES_HEIGHT - 1][1] == 0x000000000000000F);
+        CHECK(frame.rows[Display::HIRES_HEIGHT - 1][0] == 0xF000000000000000);
+
+        // Each pixel of the low resolution view covers a 2x2 block
+        auto rows = display.get_rows();
+        CHECK(rows[Display::HEIGHT - 1] == 0xC000000000000003);
+        REQUIRE(display.get_vram()[(Display::HEIGHT - 1) * Display::WIDTH] == 1);
+    }
+
+    SECTION("16x16 sprites") {
+        uint8_t sprite[32];
+        for (int n = 0; n < 32; ++n) {
+            sprite[n] = n % 2 == 0 ? 0x80 : 0x01;
+        }
+
+        CHECK_FALSE(display.draw_sprite(60, 10, sprite, 0));
+
+        Display::Frame frame = display.get_frame();
+        for (int y = 10; y < 26; ++y) {
+            CHECK(frame.rows[y][0] == 0x0000000000000008);
+            CHECK(frame.rows[y][1] == 0x0010000000000000);
+        }
+        CHECK(frame.rows[26][0] == 0);
+
+        CHECK(display.draw_sprite(60, 10, sprite, 0));
+        REQUIRE(display.get_frame() == Display::Frame{.hires = true});
+    }
+
+    SECTION("Switching resolution clears the display") {
+        display.draw_byte(0, 0, 0xFF);
+        display.set_hires(false);
+
+        REQUIRE(display.get_frame() == Display::Frame{});
+    }
+}
+
+TEST_CASE("Scrolling", "[display]") {
+    Display display = Display();
+
+    SECTION("Low resolution") {
+        display.draw_byte(0, 0, 0xFF);
+
+        display.scroll_right();
+        CHECK(display.get_rows()[0] == 0x0FF0000000000000);
+
+        display.scroll_down(3);
+        CHECK(display.get_rows()[0] == 0);
+        CHECK(display.get_rows()[3] == 0x0FF0000000000000);
+
+        display.scroll_left();
+        display.scroll_left();
+        CHECK(display.get_rows()[3] == 0xF000000000000000);
+
+        display.scroll_up(4);
+        REQUIRE(display.get_frame() == Display::Frame{});
+    }
+
+    SECTION("High resolution moves pixels between words") {
+        display.set_hires(true);
+        display.draw_byte(60, Display::HIRES_HEIGHT - 1, 0xFF);
+
+        display.scroll_right();
+        Display::Frame frame = display.get_frame();
+        CHECK(frame.rows[Display::HIRES_HEIGHT - 1][0] == 0);
+        CHECK(frame.rows[Display::HIRES_HEIGHT - 1][1] == 0xFF00000000000000);
+
+        display.scroll_left();
+        display.scroll_up(Display::HIRES_HEIGHT - 1);
+        frame = display.get_frame();
+        CHECK(frame.rows[0][0] == 0x000000000000000F);
+        REQUIRE(frame.rows[0][1] == 0xF000000000000000);
+    }
+}
+
+TEST_CASE("Bitplanes", "[display]") {
+    Display display = Display();
+
+    display.select_planes(0x3);
+    uint8_t sprite[] = {0xF0, 0x0F};
+    display.draw_sprite(0, 0, sprite, 1);
+
+    Display::Frame frame = display.get_frame();
+    CHECK(frame.rows[0][0] == 0xF000000000000000);
+    CHECK(frame.rows[0][2] == 0x0F00000000000000);
+    CHECK(display.get_rows()[0] == 0xFF00000000000000);
+
+    // Only the selected planes are cleared and scrolled
+    display.select_planes(0x2);
+    display.scroll_down(1);
+    display.clear();
+    frame = display.get_frame();
+    CHECK(frame.rows[0][0] == 0xF000000000000000);
+    CHECK(frame.rows[0][2] == 0);
+    CHECK(frame.rows[1][2] == 0);
+
+    // Collisions are detected in any selected plane
+    display.select_planes(0x3);
+    CHECK(display.draw_byte(0, 0, 0x80));
+    display.select_planes(0x2);
+    REQUIRE_FALSE(display.draw_byte(0, 0, 0x08));
+}
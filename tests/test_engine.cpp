@@ -0,0 +1,107 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "engine.h"
+
+/// Hand-written equivalent of what chip8_recompile generates for a small ROM.
+class TestEngine : public Engine {
+    public:
+        static constexpr uint8_t IMAGE[] = {
+            0x60, 0x00, // LD V0, 0
+            0x70, 0x01, // loop: ADD V0, 1
+            0x12, 0x02, // JP loop
+        };
+
+        static void block_202(CPU &cpu) {
+            uint8_t *v = registers(cpu);
+
+            v[0x0] += 0x01;
+            pc(cpu) = 0x202;
+        }
+
+        static constexpr Block BLOCKS[] = {
+            {&TestEngine::block_202, 0x202, 4, 2},
+        };
+
+    protected:
+        const Block* find_block(uint16_t pc) const override {
+            return pc == 0x202 ? &BLOCKS[0] : nullptr;
+        }
+
+        const uint8_t* get_image() const override {
+            return IMAGE;
+        }
+};
+
+TEST_CASE("Recompiled engine", "[engine]") {
+    TestEngine engine;
+    CPU cpu;
+    cpu.load_code(TestEngine::IMAGE, sizeof(TestEngine::IMAGE));
+
+    SECTION("Matches the interpreter") {
+        CPU interpreted = cpu;
+
+        CHECK(engine.run(cpu, 101) == 101);
+        CHECK(interpreted.run(101) == 101);
+
+        CHECK(cpu.get_pc() == interpreted.get_pc());
+        REQUIRE(cpu.get_register(0) == interpreted.get_register(0));
+    }
+
+    SECTION("Falls back to the interpreter for modified code") {
+        uint8_t patched[] = {
+            0x60, 0x00, // LD V0, 0
+            0x70, 0x02, // loop: ADD V0, 2
+            0x12, 0x02, // JP loop
+        };
+        cpu.load_code(patched, sizeof(patched));
+
+        CHECK(engine.run(cpu, 11) == 11);
+        REQUIRE(cpu.get_register(0) == 10);
+    }
+}
+
+/// What chip8_recompile generates for a ROM ending in a jump to itself, which
+/// is left to the interpreter.
+class SelfJumpEngine : public Engine {
+    public:
+        static constexpr uint8_t IMAGE[] = {
+            0x60, 0x01, // LD V0, 1
+            0x12, 0x02, // JP 202
+        };
+
+        static void block_200(CPU &cpu) {
+            uint8_t *v = registers(cpu);
+
+            v[0x0] = 0x01;
+            pc(cpu) = 0x202;
+        }
+
+        static constexpr Block BLOCKS[] = {
+            {&SelfJumpEngine::block_200, 0x200, 2, 1},
+        };
+
+    protected:
+        const Block* find_block(uint16_t pc) const override {
+            return pc == 0x200 ? &BLOCKS[0] : nullptr;
+        }
+
+        const uint8_t* get_image() const override {
+            return IMAGE;
+        }
+};
+
+TEST_CASE("Recompiled engine stops at a jump to itself", "[engine]") {
+    SelfJumpEngine engine;
+    CPU cpu;
+    cpu.load_code(SelfJumpEngine::IMAGE, sizeof(SelfJumpEngine::IMAGE));
+    CPU interpreted = cpu;
+
+    CHECK(engine.run(cpu, 10) == 1);
+    CHECK(interpreted.run(10) == 1);
+    CHECK(cpu.get_pc() == interpreted.get_pc());
+    CHECK(cpu.get_halt() == CPU::Halt::JUMP_SELF);
+
+    // And stays halted
+    CHECK(engine.run(cpu, 10) == 0);
+    REQUIRE(interpreted.run(10) == 0);
+}
@@ -0,0 +1,111 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "frame_log.h"
+
+#include <filesystem>
+#include <vector>
+
+/// Record the frames of a sprite bouncing across both resolutions.
+static std::vector<Display::Frame> make_frames(size_t count) {
+    Display display;
+    std::vector<Display::Frame> ret;
+    uint8_t sprite[] = {0xF0, 0x90, 0xF0};
+
+    for (size_t n = 0; n < count; ++n) {
+        if (n == count / 2) {
+            display.set_hires(true);
+        }
+
+        if (n % 5 != 0) {
+            // Erase and redraw one pixel further, leaving some frames unchanged
+            display.draw_sprite(n - 1, n / 2, sprite, 3);
+            display.draw_sprite(n, n / 2, sprite, 3);
+        }
+
+        ret.push_back(display.get_frame());
+    }
+
+    return ret;
+}
+
+TEST_CASE("Frame encoding", "[frame_log]") {
+    std::vector<Display::Frame> frames = make_frames(2);
+    std::vector<uint8_t> encoded;
+
+    SECTION("Unchanged frames") {
+        FrameLogWriter::encode(frames[1], frames[1], encoded);
+        REQUIRE(encoded.size() == 3);
+
+        Display::Frame decoded = frames[1];
+        CHECK(FrameLogWriter::decode(encoded.data(), encoded.size(), decoded) == 3);
+        REQUIRE(decoded == frames[1]);
+    }
+
+    SECTION("Changed frames") {
+        FrameLogWriter::encode(frames[1], Display::Frame{}, encoded);
+        CHECK(encoded.size() < 32);
+
+        Display::Frame decoded;
+        CHECK(FrameLogWriter::decode(encoded.data(), encoded.size(), decoded) == encoded.size());
+        CHECK(decoded == frames[1]);
+
+        // Truncated data is rejected
+        REQUIRE(FrameLogWriter::decode(encoded.data(), encoded.size() - 1, decoded) == 0);
+    }
+}
+
+TEST_CASE("Frame logs", "[frame_log]") {
+    const char *path = "test_frames.c8f";
+    std::vector<Display::Frame> frames = make_frames(100);
+
+    FrameLogWriter writer;
+    REQUIRE(writer.open(path, 16));
+
+    for (const Display::Frame &frame : frames) {
+        writer.append(frame);
+    }
+
+    CHECK(writer.get_frames() == frames.size());
+
+    FrameLogReader reader;
+    Display::Frame frame;
+
+    SECTION("Sequential and random access") {
+        REQUIRE(writer.close());
+
+        // Far smaller than the frames themselves
+        CHECK(std::filesystem::file_size(path) < 2000);
+
+        REQUIRE(reader.open(path));
+        REQUIRE(reader.get_frames() == frames.size());
+
+        for (size_t n = 0; n < frames.size(); ++n) {
+            REQUIRE(reader.read(n, frame));
+            CHECK(frame == frames[n]);
+        }
+
+        for (size_t n : {99, 3, 50, 49, 16, 15, 0, 77}) {
+            REQUIRE(reader.read(n, frame));
+            CHECK(frame == frames[n]);
+        }
+
+        REQUIRE_FALSE(reader.read(frames.size(), frame));
+    }
+
+    SECTION("Unclosed files") {
+        REQUIRE(writer.close());
+
+        // Cut off the index and part of the last chunk
+        std::filesystem::resize_file(path, std::filesystem::file_size(path) - 8 * 7 - 24 - 4);
+
+        REQUIRE(reader.open(path));
+        REQUIRE(reader.get_frames() == 96);
+
+        REQUIRE(reader.read(95, frame));
+        CHECK(frame == frames[95]);
+        REQUIRE_FALSE(reader.read(96, frame));
+    }
+
+    reader.close();
+    std::filesystem::remove(path);
+}
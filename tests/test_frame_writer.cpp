@@ -0,0 +1,122 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "frame_writer.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+static std::vector<uint8_t> read_file(const char *path) {
+    std::ifstream stream(path, std::ios::in | std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+}
+
+TEST_CASE("Frame export", "[frame_writer][display]") {
+    const char *path = "test_frames.out";
+
+    Display display;
+    display.draw_byte(0, 0, 0x81);
+
+    FrameWriter writer;
+
+    SECTION("PBM with repeats") {
+        REQUIRE(writer.open(path, FrameWriter::Format::PBM, 2));
+
+        writer.submit(display);
+        writer.submit(display);
+        writer.close();
+
+        std::vector<uint8_t> data = read_file(path);
+        std::string header = "P4\n128 64\n";
+        size_t frame_size = header.size() + 16 * 64;
+
+        REQUIRE(data.size() == 2 * frame_size);
+        CHECK(std::string(data.begin(), data.begin() + header.size()) == header);
+
+        // Lit pixels are black in PBM, and each pixel is doubled
+        CHECK(data[header.size()] == 0x3F);
+        CHECK(data[header.size() + 1] == 0xFC);
+        CHECK(data[header.size() + 2] == 0xFF);
+        CHECK(data[header.size() + 16] == 0x3F);
+        CHECK(data[header.size() + 32] == 0xFF);
+        REQUIRE(std::equal(data.begin(), data.begin() + frame_size, data.begin() + frame_size));
+    }
+
+    SECTION("Raw") {
+        REQUIRE(writer.open(path, FrameWriter::Format::RAW, 1));
+
+        writer.submit(display);
+        display.clear();
+        writer.submit(display);
+        writer.close();
+
+        std::vector<uint8_t> data = read_file(path);
+
+        REQUIRE(data.size() == 2 * 8 * 32);
+        CHECK(data[0] == 0x81);
+        CHECK(data[1] == 0x00);
+        REQUIRE(data[8 * 32] == 0x00);
+    }
+
+    SECTION("Y4M at native resolution") {
+        REQUIRE(writer.open(path, FrameWriter::Format::Y4M, 1, FrameWriter::Resolution::NATIVE));
+        REQUIRE(writer.get_width() == 128);
+        REQUIRE(writer.get_height() == 64);
+
+        // Low resolution is doubled
+        writer.submit(display);
+
+        Display::Frame frame{};
+        frame.hires = true;
+        frame.rows[63][1] = 0x0000000000000001;
+        frame.rows[63][3] = 0x0000000000000003;
+        display.set_frame(frame);
+        writer.submit(display);
+        writer.close();
+
+        std::vector<uint8_t> data = read_file(path);
+        std::string header = "YUV4MPEG2 W128 H64 F60:1 Ip A1:1 Cmono\n";
+        size_t frame_size = 6 + 128 * 64;
+
+        REQUIRE(data.size() == header.size() + 2 * frame_size);
+        CHECK(std::string(data.begin(), data.begin() + header.size()) == header);
+
+        const uint8_t *first = data.data() + header.size() + 6;
+        CHECK(first[0] == 255);
+        CHECK(first[1] == 255);
+        CHECK(first[2] == 0);
+        CHECK(first[128 + 15] == 255);
+        CHECK(first[128 + 16] == 0);
+
+        // Each combination of planes has its own level
+        const uint8_t *second = first + frame_size;
+        CHECK(second[0] == 0);
+        CHECK(second[63 * 128 + 126] == 85);
+        CHECK(second[63 * 128 + 127] == 170);
+    }
+
+    CHECK(writer.get_dropped() == 0);
+    std::remove(path);
+}
+
+TEST_CASE("Dropped frames keep the cadence", "[frame_writer][display]") {
+    const char *path = "test_frames_dropped.out";
+
+    Display display;
+    FrameWriter writer;
+    REQUIRE(writer.open(path, FrameWriter::Format::RAW, 1));
+
+    // Faster than the output can keep up with, at least at times
+    for (int frame = 0; frame < 2000; ++frame) {
+        display.draw_byte(0, 1, frame);
+        writer.submit(display);
+    }
+    writer.close();
+
+    std::vector<uint8_t> data = read_file(path);
+    std::remove(path);
+
+    REQUIRE(data.size() == 2000 * 8 * 32);
+}
@@ -0,0 +1,105 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "cpu.h"
+#include "input.h"
+#include "input_log.h"
+
+#include <cstdio>
+#include <vector>
+
+TEST_CASE("Input queue overflow", "[input]") {
+    InputQueue queue;
+    InputEvent event {};
+
+    for (size_t n = 0; n < InputQueue::CAPACITY; ++n) {
+        event.key = n;
+        CHECK(queue.push(event));
+    }
+
+    CHECK_FALSE(queue.push(event));
+
+    REQUIRE(queue.pop(event));
+    CHECK(event.key == 0);
+    CHECK(queue.push(event));
+
+    for (size_t n = 1; n < InputQueue::CAPACITY; ++n) {
+        REQUIRE(queue.pop(event));
+        CHECK(event.key == n);
+    }
+
+    REQUIRE(queue.pop(event));
+    CHECK_FALSE(queue.pop(event));
+    REQUIRE(queue.empty());
+}
+
+TEST_CASE("Input logs", "[input][cpu]") {
+    const char *path = "test_inputs.log";
+    std::vector<uint16_t> frames = {0x0000, 0x8001, 0x0020, 0xFFFF};
+
+    REQUIRE(InputLog::save(path, frames));
+
+    std::vector<uint16_t> loaded;
+    REQUIRE(InputLog::load(path, loaded));
+    CHECK(loaded == frames);
+    std::remove(path);
+
+    // Setting all keys at once releases keys like set_key_down()
+    uint8_t code[] = {0xF3, 0x0A}; // LD V3, K
+    CPU cpu = CPU();
+    cpu.load_code(code, sizeof(code));
+    cpu.step();
+
+    cpu.set_keys(0x0021);
+    CHECK(cpu.is_key_down(0x0));
+    CHECK(cpu.is_key_down(0x5));
+    CHECK(cpu.get_halt() == CPU::Halt::KEY_WAIT);
+
+    cpu.set_keys(0x0001);
+    CHECK_FALSE(cpu.is_key_down(0x5));
+    REQUIRE(cpu.get_register(3) == 0x5);
+}
+
+TEST_CASE("Running frames of an input log", "[input][cpu]") {
+    uint8_t code[] = {
+        0x60, 0x05, // LD V0, 5
+        0xF0, 0x15, // LD DT, V0
+        0xF1, 0x07, // loop: LD V1, DT
+        0x31, 0x00, // SE V1, 0
+        0x12, 0x04, // JP loop
+        0xE2, 0x9E, // SKP V2
+        0x73, 0x01, // ADD V3, 1
+        0x12, 0x0A, // JP 0x20A
+    };
+    std::vector<uint16_t> frames = {0x0000, 0x0000, 0x0001, 0x0000, 0x0000, 0x0001, 0x0000, 0x0000};
+
+    CPU run;
+    run.load_code(code, sizeof(code));
+    CPU stepped = run;
+
+    unsigned steps = 0;
+    for (uint16_t keys : frames) {
+        InputLog::run_frame(run, keys);
+
+        // Stepping skips polling loops and halts just the same
+        bool done = InputLog::run_frame(stepped, keys, [&steps](CPU &cpu) {
+            cpu.step();
+            ++steps;
+            return true;
+        });
+
+        CHECK(done);
+        REQUIRE(StateHash::equal(run, stepped));
+    }
+
+    CHECK(run.get_register(3) > 0);
+    CHECK(steps < frames.size() * CPU::STEPS_PER_FRAME);
+
+    // Ending a frame early leaves the timers alone
+    CPU cpu;
+    cpu.load_code(code, sizeof(code));
+    InputLog::run_frame(cpu, 0);
+
+    CPU before = cpu;
+    REQUIRE_FALSE(InputLog::run_frame(cpu, 0, [](CPU &) { return false; }));
+    REQUIRE(StateHash::equal(cpu, before));
+}
@@ -0,0 +1,143 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "netplay.h"
+#include "state_hash.h"
+
+/// Run a sequence of inputs like InputLog.
+static CPU replay(const CPU &start, const std::vector<uint16_t> &inputs) {
+    CPU cpu = start;
+
+    for (uint16_t keys : inputs) {
+        cpu.set_keys(keys);
+        cpu.run(CPU::STEPS_PER_FRAME);
+        cpu.tick_timers();
+    }
+
+    return cpu;
+}
+
+/// A two-player ROM whose state depends on the order of both players' keys.
+static CPU make_game() {
+    uint8_t code[] = {
+        0x61, 0x01, // LD V1, 1
+        0x62, 0x0C, // LD V2, 0xC
+        0xE1, 0xA1, // loop: SKNP V1
+        0x73, 0x01, // ADD V3, 1
+        0xE2, 0xA1, // SKNP V2
+        0x83, 0x34, // ADD V3, V3
+        0x12, 0x04, // JP loop
+    };
+
+    CPU cpu;
+    cpu.load_code(code, sizeof(code));
+
+    return cpu;
+}
+
+/// Keys of the first player, key 1.
+static uint16_t first_player(uint32_t frame) {
+    return (frame / 7) % 2 ? 0x0002 : 0x0000;
+}
+
+/// Keys of the second player, key C.
+static uint16_t second_player(uint32_t frame) {
+    return (frame / 5) % 3 == 0 ? 0x1000 : 0x0000;
+}
+
+/// Play both sides in turn until both have run the given number of frames
+/// and confirmed all of them.
+static void play(Rollback &a, Rollback &b, uint32_t frames) {
+    for (int n = 0; n < 100000; ++n) {
+        if (a.get_frame() < frames) {
+            a.advance(first_player(a.get_frame()));
+        } else {
+            a.poll();
+        }
+
+        if (b.get_frame() < frames) {
+            b.advance(second_player(b.get_frame()));
+        } else {
+            b.poll();
+        }
+
+        if (a.get_confirmed_frames() == frames && b.get_confirmed_frames() == frames) {
+            return;
+        }
+    }
+}
+
+TEST_CASE("Rollback netplay", "[netplay]") {
+    const uint32_t frames = 300;
+    CPU start = make_game();
+
+    std::vector<uint16_t> expected;
+    for (uint32_t frame = 0; frame < frames; ++frame) {
+        expected.push_back(first_player(frame) | second_player(frame));
+    }
+
+    LoopbackTransport first;
+    LoopbackTransport second;
+    LoopbackTransport::connect(first, second);
+
+    SECTION("Without latency") {
+        Rollback a(start, first);
+        Rollback b(start, second);
+        play(a, b, frames);
+
+        REQUIRE(a.get_inputs() == expected);
+        REQUIRE(b.get_inputs() == expected);
+        CHECK(StateHash::equal(a.get_cpu(), replay(start, expected)));
+        CHECK(StateHash::equal(b.get_cpu(), a.get_cpu()));
+    }
+
+    SECTION("With latency and loss") {
+        first.set_delay(3);
+        first.set_loss(4);
+        second.set_delay(5);
+        second.set_loss(7);
+
+        Rollback a(start, first);
+        Rollback b(start, second);
+        play(a, b, frames);
+
+        REQUIRE(a.get_inputs() == expected);
+        REQUIRE(b.get_inputs() == expected);
+        CHECK(StateHash::equal(a.get_cpu(), replay(start, expected)));
+        CHECK(StateHash::equal(b.get_cpu(), a.get_cpu()));
+
+        CHECK(a.get_rollbacks() > 0);
+        CHECK(b.get_rollbacks() > 0);
+        CHECK(a.get_resimulated_frames() >= a.get_rollbacks());
+    }
+
+    SECTION("Stalling") {
+        Rollback a(start, first);
+
+        // Without a peer, only a limited number of frames are predicted
+        for (uint32_t frame = 0; frame < Rollback::MAX_PREDICTION; ++frame) {
+            REQUIRE(a.advance(0x0002));
+        }
+
+        REQUIRE_FALSE(a.advance(0x0002));
+        CHECK(a.get_frame() == Rollback::MAX_PREDICTION);
+        CHECK(a.get_confirmed_frames() == 0);
+    }
+}
+
+TEST_CASE("UDP transport", "[netplay]") {
+    UdpTransport first;
+    UdpTransport second;
+
+    REQUIRE(first.open(47801, "127.0.0.1", 47802));
+    REQUIRE(second.open(47802, "127.0.0.1", 47801));
+    REQUIRE_FALSE(first.open(47803, "127.0.0.1", 47804));
+
+    CPU start = make_game();
+    Rollback a(start, first);
+    Rollback b(start, second);
+    play(a, b, 60);
+
+    REQUIRE(a.get_inputs().size() == 60);
+    CHECK(a.get_inputs() == b.get_inputs());
+    CHECK(StateHash::equal(a.get_cpu(), b.get_cpu()));
+}
@@ -0,0 +1,102 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "pool.h"
+
+TEST_CASE("Parking halted instances", "[pool]") {
+    Pool pool;
+
+    uint8_t wait_code[] = {
+        0x60, 0x05, // LD V0, 5
+        0xF0, 0x15, // LD DT, V0
+        0xF1, 0x0A, // LD V1, K
+        0x70, 0x01, // ADD V0, 1
+        0x12, 0x08, // JP 0x208
+    };
+
+    uint8_t spin_code[] = {
+        0x70, 0x01, // ADD V0, 1
+        0x12, 0x00, // JP 0x200
+    };
+
+    CPU waiting;
+    waiting.load_code(wait_code, sizeof(wait_code));
+    CPU spinning;
+    spinning.load_code(spin_code, sizeof(spin_code));
+
+    size_t w = pool.add(waiting);
+    size_t s = pool.add(spinning);
+
+    pool.run_frame(10);
+
+    CHECK(pool.is_parked(w));
+    CHECK_FALSE(pool.is_parked(s));
+    CHECK(pool.runnable_count() == 1);
+
+    pool.run_frame(10);
+    pool.run_frame(10);
+
+    CHECK(pool.get(w).get_pc() == 0x206);
+
+    pool.set_key_down(w, 0x7, true);
+    CHECK(pool.is_parked(w));
+    pool.set_key_down(w, 0x7, false);
+    CHECK_FALSE(pool.is_parked(w));
+    CHECK(pool.get(w).get_register(1) == 0x7);
+    CHECK(pool.runnable_count() == 2);
+
+    pool.run_frame(10);
+
+    // Now stuck in a jump to itself
+    CHECK(pool.is_parked(w));
+    CHECK(pool.get(w).get_halt() == CPU::Halt::JUMP_SELF);
+    REQUIRE(pool.get(s).get_register(0) == 20);
+}
+
+TEST_CASE("Timers of parked instances", "[pool]") {
+    Pool pool;
+
+    uint8_t code[] = {
+        0x60, 0x05, // LD V0, 5
+        0xF0, 0x18, // LD ST, V0
+        0x12, 0x04, // JP 0x204
+    };
+
+    CPU cpu;
+    cpu.load_code(code, sizeof(code));
+    size_t idx = pool.add(cpu);
+
+    pool.run_frame(10);
+    CHECK(pool.is_parked(idx));
+
+    pool.run_frame(10);
+    pool.run_frame(10);
+    CHECK(pool.get(idx).is_sound_playing());
+
+    pool.run_frame(10);
+    pool.run_frame(10);
+    REQUIRE_FALSE(pool.get(idx).is_sound_playing());
+}
+
+TEST_CASE("Finding duplicate instances", "[pool]") {
+    Pool pool;
+
+    uint8_t code[] = {
+        0x70, 0x01, // ADD V0, 1
+        0x12, 0x00, // JP 0x200
+    };
+
+    CPU cpu;
+    cpu.load_code(code, sizeof(code));
+
+    pool.add(cpu);
+    pool.add(cpu);
+    cpu.seed(1);
+    pool.add(cpu);
+    cpu.seed(CPU::DEFAULT_SEED);
+    pool.add(cpu);
+
+    CHECK(pool.find_duplicates() == std::vector<size_t> {0, 0, 2, 0});
+
+    pool.get(1).set_key_down(0x1, true);
+    REQUIRE(pool.find_duplicates() == std::vector<size_t> {0, 1, 2, 0});
+}
@@ -0,0 +1,58 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "run_ahead.h"
+
+TEST_CASE("Run-ahead", "[run_ahead]") {
+    // Draws a digit once key 5 is pressed
+    uint8_t code[] = {
+        0x60, 0x05, // LD V0, 5
+        0xE0, 0xA1, // wait: SKNP V0
+        0x12, 0x08, // JP draw
+        0x12, 0x02, // JP wait
+        0xF0, 0x29, // draw: LD F, V0
+        0xD0, 0x05, // DRW V0, V0, 5
+        0x12, 0x0C, // JP self
+    };
+
+    CPU cpu;
+    cpu.load_code(code, sizeof(code));
+
+    RunAhead run_ahead;
+    CHECK(run_ahead.get_frames() == 1);
+    REQUIRE_FALSE(run_ahead.set_frames(RunAhead::MAX_FRAMES + 1));
+    REQUIRE(run_ahead.set_frames(2));
+
+    SECTION("The copy matches the CPU frames later") {
+        cpu.set_keys(0x0020);
+
+        Display::Frame frame = run_ahead.run(cpu).get_display().get_frame();
+        CHECK(run_ahead.run(cpu).get_pc() == 0x20C);
+
+        // The real CPU is untouched
+        REQUIRE(cpu.get_pc() == 0x200);
+        CHECK(cpu.get_display().get_frame() == Display::Frame{});
+
+        for (int n = 0; n < 2; ++n) {
+            cpu.run(CPU::STEPS_PER_FRAME);
+            cpu.tick_timers();
+        }
+
+        CHECK(cpu.get_pc() == 0x20C);
+        CHECK(cpu.get_display().get_frame() == frame);
+    }
+
+    SECTION("Draws are reported once") {
+        CHECK(run_ahead.run(cpu).get_pc() != 0x20C);
+        CHECK(run_ahead.take_drawn_input() == 0);
+
+        REQUIRE(cpu.queue_key_event(0x5, true, 1));
+
+        run_ahead.run(cpu);
+        CHECK(run_ahead.take_drawn_input() == 1);
+        CHECK(run_ahead.take_drawn_input() == 0);
+
+        // The next copy draws again in response to the same event
+        run_ahead.run(cpu);
+        CHECK(run_ahead.take_drawn_input() == 0);
+    }
+}
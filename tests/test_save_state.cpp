@@ -0,0 +1,168 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "save_state.h"
+#include "state_hash.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+/// Create a CPU with some state in every part of it.
+static CPU make_cpu() {
+    uint8_t code[] = {
+        0x60, 0x7B, // LD V0, 123
+        0xA3, 0x00, // LD I, 300
+        0xF0, 0x33, // LD B, V0
+        0xF0, 0x15, // LD DT, V0
+        0xC1, 0xFF, // RND V1, FF
+        0x22, 0x0E, // CALL 20E
+        0x12, 0x0C, // JP 20C
+        0xD0, 0x05, // DRW V0, V0, 5
+        0xF2, 0x0A, // LD V2, K
+    };
+
+    CPU cpu = CPU();
+    cpu.seed(42);
+    cpu.load_code(code, sizeof(code));
+    cpu.set_key_down(0x3, true);
+    cpu.run(8);
+
+    return cpu;
+}
+
+static void check_equal(const CPU &a, const CPU &b) {
+    CHECK(a.get_pc() == b.get_pc());
+    CHECK(a.get_i() == b.get_i());
+    CHECK(a.get_sp() == b.get_sp());
+    CHECK(a.get_registers() == b.get_registers());
+    CHECK(a.get_halt() == b.get_halt());
+    CHECK(a.is_key_down(0x3) == b.is_key_down(0x3));
+    CHECK(a.get_display().get_frame() == b.get_display().get_frame());
+    CHECK(a.get_display().get_selected_planes() == b.get_display().get_selected_planes());
+    CHECK(a.get_audio_pattern() == b.get_audio_pattern());
+    CHECK(a.get_pitch() == b.get_pitch());
+
+    for (size_t addr = 0; addr < CPU::MEMORY_SIZE; ++addr) {
+        if (a.read_memory(addr) != b.read_memory(addr)) {
+            FAIL("Memory differs at " << addr);
+        }
+    }
+}
+
+TEST_CASE("Save states", "[save_state][cpu]") {
+    CPU cpu = make_cpu();
+    REQUIRE(cpu.get_halt() == CPU::Halt::KEY_WAIT);
+
+    SECTION("Uncompressed round trip") {
+        std::vector<uint8_t> data = SaveState::serialize(cpu, SaveState::Compression::NONE);
+        CHECK(data.size() == SaveState::HEADER_SIZE + SaveState::PAYLOAD_SIZE);
+
+        CPU restored = CPU();
+        REQUIRE(SaveState::deserialize(data.data(), data.size(), restored));
+        check_equal(cpu, restored);
+
+        // Restored CPUs continue identically, including random numbers
+        uint8_t code[] = {0xC4, 0xFF}; // RND V4, FF
+        for (CPU *target : {&cpu, &restored}) {
+            target->set_key_down(0x3, false);
+            target->load_code(code, sizeof(code));
+            target->run(1);
+        }
+        check_equal(cpu, restored);
+    }
+
+    SECTION("Compressed round trip") {
+        std::vector<uint8_t> data = SaveState::serialize(cpu, SaveState::Compression::RLE);
+        CHECK(data.size() < SaveState::PAYLOAD_SIZE / 4);
+
+        CPU restored = CPU();
+        REQUIRE(SaveState::deserialize(data.data(), data.size(), restored));
+        check_equal(cpu, restored);
+    }
+
+    SECTION("Corruption is rejected") {
+        std::vector<uint8_t> data = SaveState::serialize(cpu, SaveState::Compression::NONE);
+        CPU restored = CPU();
+
+        data[SaveState::HEADER_SIZE + 100] ^= 0x01;
+        CHECK_FALSE(SaveState::deserialize(data.data(), data.size(), restored));
+        data[SaveState::HEADER_SIZE + 100] ^= 0x01;
+
+        // Different version
+        data[8] += 1;
+        CHECK_FALSE(SaveState::deserialize(data.data(), data.size(), restored));
+        data[8] -= 1;
+
+        CHECK_FALSE(SaveState::deserialize(data.data(), data.size() - 1, restored));
+        REQUIRE(restored.get_pc() == CPU::INITIAL_PC);
+    }
+
+    SECTION("SUPER-CHIP and XO-CHIP state") {
+        uint8_t code[] = {
+            0x00, 0xFF, // HIGH
+            0xF2, 0x01, // PLANE 2
+            0xD0, 0x00, // DRW V0, V0, 0
+            0xF0, 0x02, // AUDIO
+            0xF0, 0x3A, // PITCH V0
+            0xF2, 0x75, // LD R, V2
+            0x12, 0x0C, // JP 20C
+        };
+
+        CPU extended = CPU();
+        extended.load_code(code, sizeof(code));
+        extended.run(6);
+
+        std::vector<uint8_t> data = SaveState::serialize(extended, SaveState::Compression::RLE);
+
+        CPU restored = CPU();
+        REQUIRE(SaveState::deserialize(data.data(), data.size(), restored));
+        check_equal(extended, restored);
+        REQUIRE(StateHash::equal(extended, restored));
+    }
+
+    SECTION("Version 1") {
+        // Header and payload as written before high resolution support
+        std::vector<uint8_t> data(SaveState::HEADER_SIZE + SaveState::V1_PAYLOAD_SIZE);
+        uint8_t *payload = data.data() + SaveState::HEADER_SIZE;
+
+        payload[0] = 0x34; // PC
+        payload[1] = 0x02;
+        payload[5] = 0xFF; // No pending Fx0A
+        payload[8 + 0xA] = 0x5A; // VA
+        payload[28] = 42; // RNG
+        payload[32 + 0x300] = 0xAB;
+        payload[32 + 4096 + 7] = 0x80; // Top left pixel
+
+        uint64_t hash = 0xCBF29CE484222325;
+        for (size_t n = 0; n < SaveState::V1_PAYLOAD_SIZE; ++n) {
+            hash = (hash ^ payload[n]) * 0x100000001B3;
+        }
+
+        std::copy(SaveState::MAGIC.begin(), SaveState::MAGIC.end(), data.begin());
+        uint32_t fields[4] = {1, 0, SaveState::V1_PAYLOAD_SIZE, SaveState::V1_PAYLOAD_SIZE};
+        std::memcpy(data.data() + 8, fields, sizeof(fields));
+        std::memcpy(data.data() + 24, &hash, sizeof(hash));
+
+        REQUIRE(SaveState::deserialize(data.data(), data.size(), cpu));
+        CHECK(cpu.get_pc() == 0x234);
+        CHECK(cpu.get_register(0xA) == 0x5A);
+        CHECK(cpu.read_memory(0x300) == 0xAB);
+        CHECK(cpu.read_memory(0x000) == 0x00);
+        CHECK(cpu.get_pitch() == CPU::DEFAULT_PITCH);
+        CHECK_FALSE(cpu.get_display().is_hires());
+        REQUIRE(cpu.get_display().get_rows()[0] == 0x8000000000000000);
+    }
+
+    SECTION("Files") {
+        const char *path = "test_state.c8s";
+
+        REQUIRE(SaveState::save(cpu, path, SaveState::Compression::RLE));
+
+        CPU restored = CPU();
+        REQUIRE(SaveState::load(restored, path));
+        check_equal(cpu, restored);
+
+        std::remove(path);
+        REQUIRE_FALSE(SaveState::load(restored, path));
+    }
+}
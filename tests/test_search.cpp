@@ -0,0 +1,132 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "search.h"
+
+/// Run a sequence of inputs like InputLog.
+static CPU replay(const CPU &start, const std::vector<uint16_t> &inputs) {
+    CPU cpu = start;
+
+    for (uint16_t keys : inputs) {
+        cpu.set_keys(keys);
+        cpu.run(CPU::STEPS_PER_FRAME);
+        cpu.tick_timers();
+    }
+
+    return cpu;
+}
+
+TEST_CASE("Breadth-first search", "[search]") {
+    // Requires key 1, then key 2
+    uint8_t code[] = {
+        0x60, 0x01, // LD V0, 1
+        0xE0, 0xA1, // first: SKNP V0
+        0x12, 0x08, // JP second
+        0x12, 0x02, // JP first
+        0x60, 0x02, // second: LD V0, 2
+        0xE0, 0xA1, // SKNP V0
+        0x12, 0x10, // JP done
+        0x12, 0x0A, // JP second + 2
+        0x12, 0x10, // done: JP done
+    };
+
+    CPU cpu;
+    cpu.load_code(code, sizeof(code));
+
+    Search search;
+    search.set_jobs(1);
+    search.set_target_pc(0x210);
+
+    Search::Result result = search.run(cpu);
+
+    REQUIRE(result.found);
+    CHECK(result.inputs == std::vector<uint16_t>{0x0002, 0x0004});
+    CHECK(result.state.get_pc() == 0x210);
+    CHECK(replay(cpu, result.inputs).get_pc() == 0x210);
+
+    SECTION("Held choices") {
+        search.set_hold_frames(3);
+        result = search.run(cpu);
+
+        REQUIRE(result.found);
+        CHECK(result.inputs == std::vector<uint16_t>{0x0002, 0x0002, 0x0002, 0x0004});
+    }
+
+    SECTION("Unreachable goals") {
+        search.set_choices({0x0000, 0x0004});
+        result = search.run(cpu);
+
+        CHECK_FALSE(result.found);
+        CHECK(result.inputs.empty());
+        CHECK(result.states > 0);
+    }
+
+    SECTION("State limit") {
+        search.set_max_states(2);
+        result = search.run(cpu);
+
+        CHECK_FALSE(result.found);
+        CHECK(result.states == 2);
+    }
+}
+
+TEST_CASE("Screen predicates", "[search]") {
+    // Draws a digit while key 3 is held
+    uint8_t code[] = {
+        0x60, 0x03, // LD V0, 3
+        0xE0, 0x9E, // wait: SKP V0
+        0x12, 0x02, // JP wait
+        0xA0, 0x00, // LD I, 0x000
+        0xD1, 0x15, // DRW V1, V1, 5
+        0x12, 0x0A, // JP 0x20A
+    };
+
+    CPU cpu;
+    cpu.load_code(code, sizeof(code));
+
+    Search search;
+    search.set_predicate([](const CPU &cpu) {
+        return (cpu.get_display().get_rows()[0] >> 63) != 0;
+    });
+
+    Search::Result result = search.run(cpu);
+
+    REQUIRE(result.found);
+    CHECK(result.inputs == std::vector<uint16_t>{0x0008});
+    REQUIRE(replay(cpu, result.inputs).get_display().get_rows() == result.state.get_display().get_rows());
+}
+
+TEST_CASE("Best-first search", "[search]") {
+    // Counts presses of key A up to 5
+    uint8_t code[] = {
+        0xF2, 0x0A, // wait: LD V2, K
+        0x32, 0x0A, // SE V2, 0xA
+        0x12, 0x00, // JP wait
+        0x71, 0x01, // ADD V1, 1
+        0x31, 0x05, // SE V1, 5
+        0x12, 0x00, // JP wait
+        0x12, 0x0C, // done: JP done
+    };
+
+    CPU cpu;
+    cpu.load_code(code, sizeof(code));
+
+    Search search;
+    search.set_target_pc(0x20C);
+    search.set_score([](const CPU &cpu) {
+        return cpu.get_register(1);
+    });
+
+    SECTION("Single thread") {
+        search.set_jobs(1);
+    }
+
+    SECTION("Multiple threads") {
+        search.set_jobs(4);
+    }
+
+    Search::Result result = search.run(cpu);
+
+    REQUIRE(result.found);
+    CHECK(result.state.get_register(1) == 5);
+    REQUIRE(replay(cpu, result.inputs).get_pc() == 0x20C);
+}
@@ -0,0 +1,58 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "shared_session.h"
+
+#include <string>
+#include <unistd.h>
+
+TEST_CASE("Shared memory session", "[shared_session]") {
+    std::string name = "/chip8-test-" + std::to_string(getpid());
+
+    SharedSession emulator;
+    REQUIRE(emulator.create(name.c_str(), 10));
+
+    SharedSession agent;
+    REQUIRE(agent.attach(name.c_str()));
+
+    uint8_t code[] = {
+        0xF0, 0x0A, // LD V0, K
+        0xF0, 0x29, // LD F, V0
+        0x61, 0x00, // LD V1, 0
+        0xD1, 0x15, // DRW V1, V1, 5
+        0x12, 0x08, // JP 0x208
+    };
+
+    CPU cpu;
+    cpu.load_code(code, sizeof(code));
+    emulator.publish(cpu);
+
+    CHECK(agent.get_status().pc == 0x200);
+    CHECK_FALSE(emulator.process(cpu));
+
+    REQUIRE(agent.push_command({.type = SharedSession::CommandType::FRAME, .count = 1}));
+    REQUIRE(agent.push_command({.type = SharedSession::CommandType::KEY_DOWN, .key = 0x1}));
+    REQUIRE(agent.push_command({.type = SharedSession::CommandType::KEY_UP, .key = 0x1}));
+    REQUIRE(agent.push_command({.type = SharedSession::CommandType::STEP, .count = 4}));
+
+    CHECK(emulator.process(cpu));
+
+    SharedSession::Status status = agent.get_status();
+    CHECK(status.commands_done == agent.get_commands_sent());
+    CHECK(status.frames == 1);
+    CHECK(status.pc == 0x208);
+    CHECK(status.halt == CPU::Halt::JUMP_SELF);
+
+    // Font sprite for 1
+    CHECK(status.rows[0] >> 56 == 0x20);
+    REQUIRE(status.rows[4] >> 56 == 0x70);
+
+    // The full frame is published as well, in every plane
+    CHECK_FALSE(status.frame.hires);
+    CHECK(status.frame.rows[0][0] >> 56 == 0x20);
+    REQUIRE(status.frame == cpu.get_display().get_frame());
+}
+
+TEST_CASE("Attaching to a missing session", "[shared_session]") {
+    SharedSession agent;
+    REQUIRE_FALSE(agent.attach("/chip8-test-missing"));
+}
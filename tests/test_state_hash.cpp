@@ -0,0 +1,115 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "state_hash.h"
+
+/// A sprite moving right by 4 pixels every frame.
+static const uint8_t ATTRACT_CODE[] = {
+    0xA2, 0x18, // LD I, sprite
+    0x60, 0x00, // LD V0, 0
+    0x62, 0x00, // LD V2, 0
+    0xD0, 0x21, // draw: DRW V0, V2, 1
+    0x63, 0x01, // LD V3, 1
+    0xF3, 0x15, // LD DT, V3
+    0xF3, 0x07, // wait: LD V3, DT
+    0x33, 0x00, // SE V3, 0
+    0x12, 0x0C, // JP wait
+    0xD0, 0x21, // DRW V0, V2, 1
+    0x70, 0x04, // ADD V0, 4
+    0x12, 0x06, // JP draw
+    0x80, 0x00, // sprite
+};
+
+TEST_CASE("Incremental state hash", "[state_hash]") {
+    uint8_t code[] = {
+        0x00, 0xE0, // loop: CLS
+        0xC0, 0xFF, // RND V0, 0xFF
+        0xA3, 0x00, // LD I, 0x300
+        0xF0, 0x33, // LD B, V0
+        0xF2, 0x65, // LD V2, [I]
+        0xF0, 0x29, // LD F, V0
+        0xD1, 0x25, // DRW V1, V2, 5
+        0x22, 0x16, // CALL sub
+        0x12, 0x00, // JP loop
+        0x00, 0x00,
+        0x00, 0x00,
+        0xA3, 0x10, // sub: LD I, 0x310
+        0x71, 0x03, // ADD V1, 3
+        0xF3, 0x55, // LD [I], V3
+        0x00, 0xEE, // RET
+    };
+
+    CPU cpu = CPU();
+    cpu.load_code(code, sizeof(code));
+
+    StateHash hash;
+    hash.reset(cpu);
+    CHECK(hash.get(cpu) == StateHash::compute(cpu));
+
+    CPU reference = cpu;
+    uint64_t initial = hash.get(cpu);
+
+    for (unsigned steps = 1; steps < 60; ++steps) {
+        CHECK(hash.run(cpu, steps) == reference.run(steps));
+        REQUIRE(hash.get(cpu) == StateHash::compute(cpu));
+        REQUIRE(StateHash::equal(cpu, reference));
+    }
+
+    CHECK(hash.get(cpu) != initial);
+
+    SECTION("Every part of the state is covered") {
+        CPU other = cpu;
+        CHECK(StateHash::compute(other) == hash.get(cpu));
+
+        other.seed(1);
+        CHECK_FALSE(StateHash::equal(cpu, other));
+        CHECK(StateHash::compute(other) != hash.get(cpu));
+
+        other = cpu;
+        other.set_key_down(0x3, true);
+        CHECK_FALSE(StateHash::equal(cpu, other));
+        CHECK(StateHash::compute(other) != hash.get(cpu));
+
+        uint8_t patch[] = {0x12, 0x02};
+
+        other = cpu;
+        other.load_code(patch, sizeof(patch));
+        CHECK_FALSE(StateHash::equal(cpu, other));
+        REQUIRE(StateHash::compute(other) != hash.get(cpu));
+    }
+}
+
+TEST_CASE("Cycle detection", "[state_hash]") {
+    CPU cpu = CPU();
+    cpu.load_code(ATTRACT_CODE, sizeof(ATTRACT_CODE));
+
+    StateHash hash;
+    hash.reset(cpu);
+    CycleDetector detector;
+
+    unsigned frame = 0;
+    uint64_t period = 0;
+
+    while (period == 0 && frame < 1000) {
+        hash.run(cpu, CPU::STEPS_PER_FRAME);
+        cpu.tick_timers();
+        period = detector.update(cpu, hash.get(cpu));
+        ++frame;
+    }
+
+    // The sprite wraps around every 64 frames, while the position within the
+    // polling loop at the end of a frame repeats every 3
+    CHECK(period == 192);
+    CHECK(frame < 4 * period);
+
+    // Going once around the cycle returns to the same state
+    CPU start = cpu;
+    for (uint64_t n = 0; n < period; ++n) {
+        cpu.run(CPU::STEPS_PER_FRAME);
+        cpu.tick_timers();
+    }
+
+    CHECK(StateHash::equal(start, cpu));
+
+    detector.reset();
+    REQUIRE(detector.get_period() == 0);
+}
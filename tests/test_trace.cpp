@@ -0,0 +1,84 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "trace.h"
+
+#include <cstdio>
+#include <vector>
+
+TEST_CASE("Execution trace", "[trace][cpu]") {
+    const char *path = "test_trace.out";
+
+    uint8_t code[] = {
+        0x60, 0x7B, // LD V0, 123
+        0xA3, 0x00, // LD I, 300
+        0xF0, 0x33, // LD B, V0
+        0x22, 0x0A, // CALL 20A
+        0x12, 0x08, // JP 208
+        0x71, 0x01, // ADD V1, 1
+        0x00, 0xEE, // RET
+    };
+
+    CPU traced = CPU();
+    CPU plain = CPU();
+    traced.load_code(code, sizeof(code));
+    plain.load_code(code, sizeof(code));
+
+    TraceWriter writer;
+    REQUIRE(writer.open(path));
+
+    TraceBuffer *buffer = writer.create_buffer();
+    REQUIRE(buffer->get_stream() == 0);
+
+    // Stops at the jump to itself, like CPU::run()
+    CHECK(buffer->run(traced, 100) == 6);
+    CHECK(plain.run(100) == 6);
+    writer.close();
+
+    CHECK(traced.get_pc() == plain.get_pc());
+    CHECK(traced.get_registers() == plain.get_registers());
+
+    TraceReader reader;
+    REQUIRE(reader.open(path));
+
+    std::vector<TraceRecord> records;
+    TraceRecord record;
+    while (reader.next(record)) {
+        records.push_back(record);
+    }
+
+    REQUIRE(records.size() == 6);
+
+    CHECK(records[0].pc == 0x200);
+    CHECK(records[0].opcode == 0x607B);
+    CHECK(records[0].changed_registers == 0x0001);
+    CHECK(records[0].registers[0] == 123);
+    CHECK_FALSE(records[0].i_changed);
+
+    CHECK(records[1].i_changed);
+    CHECK(records[1].i == 0x300);
+
+    REQUIRE(records[2].write_count == 3);
+    CHECK(records[2].writes[0].addr == 0x300);
+    CHECK(records[2].writes[0].value == 1);
+    CHECK(records[2].writes[1].value == 2);
+    CHECK(records[2].writes[2].value == 3);
+    CHECK(records[2].changed_registers == 0);
+
+    // The return address is pushed below 0x200
+    CHECK(records[3].sp_changed);
+    CHECK(records[3].sp == 2);
+    REQUIRE(records[3].write_count == 2);
+    CHECK(records[3].writes[0].addr == 0x1FE);
+    CHECK(records[3].writes[0].value == 0x08);
+    CHECK(records[3].writes[1].addr == 0x1FF);
+    CHECK(records[3].writes[1].value == 0x02);
+
+    CHECK(records[4].pc == 0x20A);
+    CHECK(records[4].changed_registers == 0x0002);
+    CHECK(records[5].opcode == 0x00EE);
+    CHECK(records[5].sp == 0);
+
+    REQUIRE(buffer->get_stalls() == 0);
+
+    std::remove(path);
+}
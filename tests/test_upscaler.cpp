@@ -0,0 +1,105 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "upscaler.h"
+
+#include <cstring>
+
+/// Get the colour of an output pixel as `0xRRGGBB`.
+static uint32_t get_color(const Upscaler &upscaler, int x, int y) {
+    const uint8_t *pixel = upscaler.get_pixels() + 4 * (y * upscaler.get_width() + x);
+    return pixel[0] << 16 | pixel[1] << 8 | pixel[2];
+}
+
+TEST_CASE("Upscaling the display", "[upscaler]") {
+    Upscaler upscaler;
+    upscaler.set_size(200, 100);
+    upscaler.set_colors(0x102030, 0xFFEEDD);
+
+    Display::Frame frame;
+    frame.rows[0][0] = 0x8000000000000001;
+    frame.rows[31][0] = 0x0000000100000000;
+
+    upscaler.update(frame);
+    CHECK(upscaler.get_dirty_begin() == 0);
+    CHECK(upscaler.get_dirty_end() == 100);
+
+    // Display pixels are 3 or 4 output pixels wide and high
+    CHECK(get_color(upscaler, 0, 0) == 0xFFEEDD);
+    CHECK(get_color(upscaler, 2, 2) == 0xFFEEDD);
+    CHECK(get_color(upscaler, 3, 0) == 0x102030);
+    CHECK(get_color(upscaler, 3, 3) == 0x102030);
+    CHECK(get_color(upscaler, 195, 0) == 0x102030);
+    CHECK(get_color(upscaler, 196, 2) == 0xFFEEDD);
+    CHECK(get_color(upscaler, 199, 0) == 0xFFEEDD);
+    CHECK(get_color(upscaler, 31 * 200 / 64, 99) == 0xFFEEDD);
+    CHECK(get_color(upscaler, 31 * 200 / 64 - 1, 99) == 0x102030);
+    CHECK(upscaler.get_pixels()[3] == 0xFF);
+
+    // Only changed rows are expanded again
+    upscaler.update(frame);
+    CHECK(upscaler.get_dirty_begin() == upscaler.get_dirty_end());
+
+    frame.rows[10][0] = 0xFF;
+    upscaler.update(frame);
+    CHECK(upscaler.get_dirty_begin() == 10 * 100 / 32);
+    CHECK(upscaler.get_dirty_end() == 11 * 100 / 32);
+    REQUIRE(get_color(upscaler, 199, 32) == 0xFFEEDD);
+}
+
+TEST_CASE("Phosphor persistence", "[upscaler]") {
+    Upscaler upscaler;
+    upscaler.set_size(64, 32);
+    upscaler.set_persistence(4);
+
+    Display::Frame frame;
+    frame.rows[5][0] = 0x8000000000000000;
+    upscaler.update(frame);
+    CHECK(get_color(upscaler, 0, 5) == 0xFFFFFF);
+
+    // Fades out gradually once turned off
+    frame.rows[5][0] = 0;
+    uint32_t previous = 0xFF;
+    unsigned frames = 0;
+
+    while (previous != 0 && frames < 100) {
+        upscaler.update(frame);
+        uint32_t level = get_color(upscaler, 0, 5) & 0xFF;
+
+        CHECK(level < previous);
+        previous = level;
+        ++frames;
+    }
+
+    CHECK(frames >= 3);
+    CHECK(frames <= 5);
+
+    // Turning a pixel back on restores full brightness at once
+    frame.rows[5][0] = 0x8000000000000000;
+    upscaler.update(frame);
+    CHECK(get_color(upscaler, 0, 5) == 0xFFFFFF);
+
+    upscaler.set_persistence(0);
+    frame.rows[5][0] = 0;
+    upscaler.update(frame);
+    REQUIRE(get_color(upscaler, 0, 5) == 0x000000);
+}
+
+TEST_CASE("High resolution and bitplanes", "[upscaler]") {
+    Upscaler upscaler;
+    upscaler.set_size(256, 128);
+    upscaler.set_colors(0x000000, 0xFF0000, 0x00FF00, 0x0000FF);
+
+    Display::Frame frame;
+    frame.hires = true;
+    frame.rows[0] = {0x8000000000000000, 0x0000000000000001, 0xC000000000000000, 0};
+
+    upscaler.update(frame);
+
+    // Display pixels are 2x2 output pixels
+    CHECK(get_color(upscaler, 0, 0) == 0x0000FF);
+    CHECK(get_color(upscaler, 1, 1) == 0x0000FF);
+    CHECK(get_color(upscaler, 2, 0) == 0x00FF00);
+    CHECK(get_color(upscaler, 4, 0) == 0x000000);
+    CHECK(get_color(upscaler, 255, 1) == 0xFF0000);
+    REQUIRE(get_color(upscaler, 255, 2) == 0x000000);
+}